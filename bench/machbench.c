@@ -0,0 +1,126 @@
+// bench/machbench.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// Measures the throughput of mach_dump over the fixtures named on the command
+// line, as written by bench/machgen, in files, symbols and output bytes per
+// second. Every fixture is dumped into three sinks: an in-memory buffer with
+// color, the same without color, and the buffered writer on /dev/null, which
+// adds the cost of the writes themselves. The first two measure only the
+// dumper and libtermcolor.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dump.h"
+#include "macho.h"
+#include "mapfile.h"
+#include "out.h"
+#include "termcolor.h"
+
+// Each fixture is dumped into each sink for at least this long.
+#define BENCH_SECONDS 0.5
+
+enum sink {
+    SinkColor = 0,
+    SinkNoColor = 1,
+    SinkDevNull = 2,
+    SINK_COUNT
+};
+
+static const char* sink_names[SINK_COUNT] = {
+    [SinkColor] = "color",
+    [SinkNoColor] = "no-color",
+    [SinkDevNull] = "/dev/null"
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Dumps the file into a fresh sink once, returning how many bytes it
+// rendered, or 0 if it could not be dumped.
+static size_t dump_size(const struct mapped_file* file) {
+    struct out out;
+    out_init(&out, -1);
+    const enum dump_error error = mach_dump(&out, file->buffer, file->length);
+    const size_t length = out.length;
+    out_free(&out);
+    return error == DumpErrorNone ? length : 0;
+}
+
+// Dumps the file into the sink repeatedly and prints the rates. Output to
+// /dev/null is written without color, as it would be from the command line,
+// so its size is the no-color size.
+static void run(const char* name, const struct mapped_file* file,
+                uint64_t symbols, enum sink sink, int null_fd) {
+    tcol_override_color_checks(sink == SinkColor);
+    const size_t size = dump_size(file);
+    struct out out;
+    out_init(&out, sink == SinkDevNull ? null_fd : -1);
+    uint64_t files = 0;
+    const double start = now();
+    double elapsed;
+    do {
+        mach_dump(&out, file->buffer, file->length);
+        if (sink == SinkDevNull) {
+            out_flush(&out);
+        } else {
+            out.length = 0;
+        }
+        files++;
+    } while ((elapsed = now() - start) < BENCH_SECONDS);
+    out_free(&out);
+    printf("%-24s %-9s %10.1f files/s %12.0f symbols/s %8.1f MB/s\n", name,
+           sink_names[sink], files / elapsed, symbols * files / elapsed,
+           size * files / elapsed / 1e6);
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s FIXTURE...\n", argv[0]);
+        return 1;
+    }
+    const int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) {
+        perror("/dev/null");
+        return 1;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        struct mapped_file file;
+        if (map_file(argv[i], &file) != 0) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        struct macho macho;
+        uint64_t symbols = 0;
+        if (macho_parse(&macho, file.buffer, file.length) == DumpErrorNone) {
+            if (macho.symtab_command != MACHO_NONE) {
+                symbols = macho.symtab.nsyms;
+            }
+            macho_free(&macho);
+        }
+        if (dump_size(&file) == 0) {
+            fprintf(stderr, "%s: could not be dumped\n", argv[i]);
+            status = 1;
+        } else {
+            const char* name = strrchr(argv[i], '/');
+            for (int sink = 0; sink < SINK_COUNT; sink++) {
+                run(name ? name + 1 : argv[i], &file, symbols,
+                    (enum sink)sink, null_fd);
+            }
+        }
+        unmap_file(&file);
+    }
+    close(null_fd);
+    return status;
+}
@@ -0,0 +1,342 @@
+// bench/machgen.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// Writes a synthetic but valid 64-bit Mach-O executable with the given
+// numbers of extra load commands, segments, sections and symbols and the
+// given string table size, as a fixture for the benchmarks. The output is a
+// function of the options alone, so runs can be compared across machines.
+//
+// The file is laid out as a real one would be: __TEXT maps the header and
+// load commands, every segment starts on a page, and __LINKEDIT ends the
+// file with the symbol and string tables. Symbols are sorted into locals,
+// defined externals and undefined externals for LC_DYSYMTAB.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#define S(...) struct __VA_ARGS__
+
+#define PAGE_SIZE 0x4000
+#define VM_BASE 0x100000000ULL
+#define SECTION_SIZE 256
+#define DYLIB_NAME "/usr/lib/libfixture.%05u.dylib"
+#define RPATH_NAME "@loader_path/../lib/fixture.%05u"
+
+struct options {
+    unsigned commands;
+    unsigned segments;
+    unsigned sections;
+    unsigned symbols;
+    uint64_t strings;
+    const char* path;
+};
+
+struct image {
+    unsigned char* data;
+    size_t length;
+    size_t next;
+};
+
+static uint64_t align(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void* emit(struct image* image, size_t size) {
+    void* p = image->data + image->next;
+    image->next += size;
+    return p;
+}
+
+// Extra commands alternate between dylibs and run paths, whose names pad
+// them out to a multiple of eight bytes.
+static uint32_t extra_size(unsigned i) {
+    char name[64];
+    const int n = snprintf(name, sizeof(name), i % 2 ? RPATH_NAME : DYLIB_NAME,
+                           i);
+    const size_t header = i % 2 ? sizeof(S(rpath_command))
+                                : sizeof(S(dylib_command));
+    return (uint32_t)align(header + (size_t)n + 1, 8);
+}
+
+static void emit_extra(struct image* image, unsigned i) {
+    const uint32_t size = extra_size(i);
+    unsigned char* command = emit(image, size);
+    if (i % 2) {
+        S(rpath_command*) rpath = (void*)command;
+        rpath->cmd = LC_RPATH;
+        rpath->cmdsize = size;
+        rpath->path.offset = sizeof(*rpath);
+        sprintf((char*)command + sizeof(*rpath), RPATH_NAME, i);
+    } else {
+        S(dylib_command*) dylib = (void*)command;
+        dylib->cmd = LC_LOAD_DYLIB;
+        dylib->cmdsize = size;
+        dylib->dylib.name.offset = sizeof(*dylib);
+        dylib->dylib.timestamp = 2;
+        dylib->dylib.current_version = 0x10000 + i;
+        dylib->dylib.compatibility_version = 0x10000;
+        sprintf((char*)command + sizeof(*dylib), DYLIB_NAME, i);
+    }
+}
+
+// Segment 0 is __TEXT and the rest are __SEG1, __SEG2 and so on. Sections are
+// dealt out to the segments in turn.
+static unsigned segment_sections(const struct options* o, unsigned segment) {
+    return o->sections / o->segments
+           + (segment < o->sections % o->segments);
+}
+
+static void segment_name(char name[16], unsigned segment) {
+    memset(name, 0, 16);
+    if (segment == 0) {
+        memcpy(name, SEG_TEXT, sizeof(SEG_TEXT));
+    } else {
+        snprintf(name, 16, "__SEG%u", segment);
+    }
+}
+
+static int generate(const struct options* o) {
+    // Every symbol needs a name of at least "_sN" and its NUL, and the table
+    // starts with an empty string, as ld64's do.
+    const uint64_t min_name = 16;
+    uint64_t name_length = o->symbols && o->strings
+        ? (o->strings - 1) / o->symbols : 0;
+    if (name_length < min_name) {
+        name_length = min_name;
+    }
+    const uint64_t strsize = align(1 + name_length * o->symbols > o->strings
+                                   ? 1 + name_length * o->symbols : o->strings,
+                                   8);
+
+    uint64_t sizeofcmds = (uint64_t)o->segments * sizeof(S(segment_command_64))
+                          + (uint64_t)o->sections * sizeof(S(section_64))
+                          + sizeof(S(segment_command_64))
+                          + sizeof(S(uuid_command))
+                          + sizeof(S(symtab_command))
+                          + sizeof(S(dysymtab_command));
+    for (unsigned i = 0; i < o->commands; i++) {
+        sizeofcmds += extra_size(i);
+    }
+    if (sizeofcmds > UINT32_MAX) {
+        fprintf(stderr, "machgen: too many load commands\n");
+        return 1;
+    }
+
+    // __TEXT holds the load commands followed by its sections, and every
+    // other segment takes as many pages as its sections need.
+    uint64_t* fileoff = calloc(o->segments + 1, sizeof(uint64_t));
+    uint64_t* filesize = calloc(o->segments + 1, sizeof(uint64_t));
+    if (!fileoff || !filesize) {
+        fprintf(stderr, "machgen: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+    const uint64_t text_start = align(sizeof(S(mach_header_64)) + sizeofcmds,
+                                      SECTION_SIZE);
+    uint64_t offset = 0;
+    for (unsigned s = 0; s < o->segments; s++) {
+        fileoff[s] = offset;
+        filesize[s] = align((s == 0 ? text_start : 0)
+                            + (uint64_t)segment_sections(o, s) * SECTION_SIZE,
+                            PAGE_SIZE);
+        offset += filesize[s];
+    }
+    const uint64_t symoff = offset;
+    const uint64_t stroff = symoff + (uint64_t)o->symbols
+                                     * sizeof(S(nlist_64));
+    if (stroff + strsize > UINT32_MAX) {
+        fprintf(stderr, "machgen: the tables do not fit in 4 GiB\n");
+        return 1;
+    }
+    fileoff[o->segments] = offset;
+    filesize[o->segments] = stroff + strsize - symoff;
+
+    struct image image = { NULL, (size_t)(stroff + strsize), 0 };
+    image.data = calloc(1, image.length);
+    if (!image.data) {
+        fprintf(stderr, "machgen: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+
+    S(mach_header_64*) header = emit(&image, sizeof(*header));
+    header->magic = MH_MAGIC_64;
+    header->cputype = CPU_TYPE_ARM64;
+    header->cpusubtype = CPU_SUBTYPE_ARM64_ALL;
+    header->filetype = MH_EXECUTE;
+    header->ncmds = o->segments + 4 + o->commands;
+    header->sizeofcmds = (uint32_t)sizeofcmds;
+    header->flags = MH_DYLDLINK | MH_TWOLEVEL | MH_PIE;
+
+    uint64_t section_offset = text_start;
+    uint64_t first_address = 0;
+    for (unsigned s = 0; s < o->segments; s++) {
+        const unsigned nsects = segment_sections(o, s);
+        S(segment_command_64*) segment = emit(&image, sizeof(*segment));
+        segment->cmd = LC_SEGMENT_64;
+        segment->cmdsize = (uint32_t)(sizeof(*segment)
+                                      + nsects * sizeof(S(section_64)));
+        segment_name(segment->segname, s);
+        segment->vmaddr = VM_BASE + fileoff[s];
+        segment->vmsize = filesize[s];
+        segment->fileoff = fileoff[s];
+        segment->filesize = filesize[s];
+        segment->maxprot = s == 0 ? VM_PROT_READ | VM_PROT_EXECUTE
+                                  : VM_PROT_READ | VM_PROT_WRITE;
+        segment->initprot = segment->maxprot;
+        segment->nsects = nsects;
+        if (s > 0) {
+            section_offset = fileoff[s];
+        }
+        for (unsigned i = 0; i < nsects; i++) {
+            S(section_64*) section = emit(&image, sizeof(*section));
+            char name[32];
+            snprintf(name, sizeof(name), "__sect%u", i);
+            memcpy(section->sectname, name, sizeof(section->sectname));
+            memcpy(section->segname, segment->segname,
+                   sizeof(section->segname));
+            section->addr = VM_BASE + section_offset;
+            section->size = SECTION_SIZE;
+            section->offset = (uint32_t)section_offset;
+            section->align = 4;
+            section->flags = s == 0 ? S_REGULAR | S_ATTR_PURE_INSTRUCTIONS
+                                      | S_ATTR_SOME_INSTRUCTIONS
+                                    : S_REGULAR;
+            if (first_address == 0) {
+                first_address = section->addr;
+            }
+            // Contents are a byte pattern that differs from section to
+            // section, so they do not compress to nothing.
+            for (uint64_t b = 0; b < SECTION_SIZE; b++) {
+                image.data[section_offset + b] = (unsigned char)(b * 31 + i);
+            }
+            section_offset += SECTION_SIZE;
+        }
+    }
+
+    S(segment_command_64*) linkedit = emit(&image, sizeof(*linkedit));
+    linkedit->cmd = LC_SEGMENT_64;
+    linkedit->cmdsize = sizeof(*linkedit);
+    memcpy(linkedit->segname, SEG_LINKEDIT, sizeof(SEG_LINKEDIT));
+    linkedit->vmaddr = VM_BASE + fileoff[o->segments];
+    linkedit->vmsize = align(filesize[o->segments], PAGE_SIZE);
+    linkedit->fileoff = fileoff[o->segments];
+    linkedit->filesize = filesize[o->segments];
+    linkedit->maxprot = VM_PROT_READ;
+    linkedit->initprot = VM_PROT_READ;
+
+    S(uuid_command*) uuid = emit(&image, sizeof(*uuid));
+    uuid->cmd = LC_UUID;
+    uuid->cmdsize = sizeof(*uuid);
+    for (size_t i = 0; i < sizeof(uuid->uuid); i++) {
+        uuid->uuid[i] = (uint8_t)(o->symbols * 7 + o->sections * 3 + i);
+    }
+
+    // A quarter of the symbols are local, half are defined externals and the
+    // rest are undefined.
+    const unsigned nlocal = o->symbols / 4;
+    const unsigned nextdef = o->symbols / 2;
+    const unsigned nundef = o->symbols - nlocal - nextdef;
+    S(symtab_command*) symtab = emit(&image, sizeof(*symtab));
+    symtab->cmd = LC_SYMTAB;
+    symtab->cmdsize = sizeof(*symtab);
+    symtab->symoff = (uint32_t)symoff;
+    symtab->nsyms = o->symbols;
+    symtab->stroff = (uint32_t)stroff;
+    symtab->strsize = (uint32_t)strsize;
+
+    S(dysymtab_command*) dysymtab = emit(&image, sizeof(*dysymtab));
+    dysymtab->cmd = LC_DYSYMTAB;
+    dysymtab->cmdsize = sizeof(*dysymtab);
+    dysymtab->ilocalsym = 0;
+    dysymtab->nlocalsym = nlocal;
+    dysymtab->iextdefsym = nlocal;
+    dysymtab->nextdefsym = nextdef;
+    dysymtab->iundefsym = nlocal + nextdef;
+    dysymtab->nundefsym = nundef;
+
+    for (unsigned i = 0; i < o->commands; i++) {
+        emit_extra(&image, i);
+    }
+
+    char* strings = (char*)image.data + stroff;
+    S(nlist_64*) symbols = (void*)(image.data + symoff);
+    for (unsigned i = 0; i < o->symbols; i++) {
+        const uint64_t strx = 1 + (uint64_t)i * name_length;
+        char* name = strings + strx;
+        const int n = snprintf(name, (size_t)name_length, "_s%u_", i);
+        memset(name + n, 'x', (size_t)(name_length - 1 - (uint64_t)n));
+        symbols[i].n_un.n_strx = (uint32_t)strx;
+        if (i < nlocal + nextdef && o->sections > 0) {
+            symbols[i].n_type = N_SECT | (i >= nlocal ? N_EXT : 0);
+            symbols[i].n_sect = 1;
+            symbols[i].n_value = first_address + (i % SECTION_SIZE);
+        } else {
+            symbols[i].n_type = N_UNDF | N_EXT;
+            symbols[i].n_desc = 1 << 8;
+        }
+    }
+
+    FILE* file = fopen(o->path, "wb");
+    if (!file || fwrite(image.data, 1, image.length, file) != image.length
+        || fclose(file) != 0) {
+        fprintf(stderr, "machgen: %s: %s\n", o->path, strerror(errno));
+        return 1;
+    }
+    free(image.data);
+    free(fileoff);
+    free(filesize);
+    return 0;
+}
+
+static bool parse_count(const char* arg, const char* option, uint64_t max,
+                        uint64_t* value) {
+    const size_t n = strlen(option);
+    if (strncmp(arg, option, n) != 0) {
+        return false;
+    }
+    char* end;
+    const unsigned long long parsed = strtoull(arg + n, &end, 10);
+    if (end == arg + n || *end != '\0' || parsed > max) {
+        fprintf(stderr, "machgen: %s expects a number up to %llu\n", option,
+                (unsigned long long)max);
+        exit(1);
+    }
+    *value = parsed;
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    struct options o = { 0, 1, 1, 0, 0, NULL };
+    for (int i = 1; i < argc; i++) {
+        uint64_t value;
+        if (parse_count(argv[i], "--commands=", 100000, &value)) {
+            o.commands = (unsigned)value;
+        } else if (parse_count(argv[i], "--segments=", 1000, &value)) {
+            o.segments = (unsigned)value;
+        } else if (parse_count(argv[i], "--sections=", 100000, &value)) {
+            o.sections = (unsigned)value;
+        } else if (parse_count(argv[i], "--symbols=", 50000000, &value)) {
+            o.symbols = (unsigned)value;
+        } else if (parse_count(argv[i], "--strings=", UINT32_MAX / 2,
+                               &value)) {
+            o.strings = value;
+        } else if (argv[i][0] != '-' && !o.path) {
+            o.path = argv[i];
+        } else {
+            o.path = NULL;
+            break;
+        }
+    }
+    if (!o.path || o.segments == 0) {
+        fprintf(stderr, "Usage: %s [--commands=N] [--segments=N] "
+                "[--sections=N] [--symbols=N]\n"
+                "       [--strings=BYTES] FILE\n", argv[0]);
+        return 1;
+    }
+    return generate(&o);
+}
@@ -0,0 +1,41 @@
+// fuzz/fuzz.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fuzz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char fuzz_path[] = "/tmp/machfuzz.XXXXXX";
+static int fuzz_fd = -1;
+
+static void fuzz_remove(void) {
+    unlink(fuzz_path);
+}
+
+const char* fuzz_file(const uint8_t* data, size_t size) {
+    if (fuzz_fd < 0) {
+        fuzz_fd = mkstemp(fuzz_path);
+        if (fuzz_fd < 0) {
+            perror(fuzz_path);
+            return NULL;
+        }
+        atexit(fuzz_remove);
+    }
+    if (ftruncate(fuzz_fd, 0) != 0) {
+        return NULL;
+    }
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t n = pwrite(fuzz_fd, data + done, size - done,
+                                 (off_t)done);
+        if (n <= 0) {
+            return NULL;
+        }
+        done += (size_t)n;
+    }
+    return fuzz_path;
+}
@@ -0,0 +1,17 @@
+// fuzz/fuzz.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The entry points of a libFuzzer target, which each target in fuzz/ defines.
+// fuzz/replay.c calls them for the files named on the command line instead.
+int LLVMFuzzerInitialize(int* argc, char*** argv);
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// Replaces the contents of a temporary file, created on first use and removed
+// at exit, with the input, for the parts of machdump that only read files by
+// path. Returns its path, or NULL if it could not be written.
+const char* fuzz_file(const uint8_t* data, size_t size);
@@ -0,0 +1,119 @@
+// fuzz/machfuzz.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// A libFuzzer target for everything that reads an untrusted file in memory:
+// the index built by macho_parse, the text dumper with every section
+// hexdumped, the JSON and NDJSON renderers, --fingerprint,
+// --verify-signature-hashes, the symbol queries and --diff, over Mach-O files,
+// universal binaries and static archives alike. Each input is copied into a
+// buffer of exactly its size, so that AddressSanitizer catches any read past
+// the end of the file.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "diff.h"
+#include "dump.h"
+#include "fingerprint.h"
+#include "fuzz.h"
+#include "hex.h"
+#include "json.h"
+#include "macho.h"
+#include "out.h"
+#include "query.h"
+#include "safe.h"
+#include "termcolor.h"
+#include "verify.h"
+
+static const char* fuzz_names[] = { "_main", "", "radr://5614542" };
+static const char* fuzz_addresses[] = { "0", "0x100000000", "0x100003f50" };
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    (void)argc;
+    (void)argv;
+    tcol_override_color_checks(false);
+    dump_set_format(DumpFormatText);
+    dump_set_hexdump("");
+    return 0;
+}
+
+// Diffs the file against a copy of itself with one byte changed, so that
+// pairing and comparing always has a difference to find.
+static void fuzz_diff(struct out* out, char* buffer, size_t size) {
+    char* changed = xmalloc(size ? size : 1);
+    if (changed == NULL) {
+        return;
+    }
+    memcpy(changed, buffer, size);
+    if (size > 0) {
+        changed[size / 2] ^= 0x5a;
+    }
+    struct diff_file files[2] = {
+        { "old", buffer, size, DumpErrorNone },
+        { "new", changed, size, DumpErrorNone }
+    };
+    diff_dump(out, files, DumpFormatText, 1);
+    out->length = 0;
+    diff_dump(out, files, DumpFormatJSON, 1);
+    out->length = 0;
+    xfree(changed);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    char* buffer = xmalloc(size ? size : 1);
+    if (buffer == NULL) {
+        return 0;
+    }
+    memcpy(buffer, data, size);
+
+    struct macho macho;
+    if (macho_parse(&macho, buffer, size) == DumpErrorNone) {
+        macho_free(&macho);
+    }
+
+    // The renderers write into memory, which is thrown away.
+    struct out out;
+    out_init(&out, -1);
+    mach_dump(&out, buffer, size);
+    out.length = 0;
+    json_macho(&out, buffer, size, 1, false);
+    out.length = 0;
+    json_macho(&out, buffer, size, 1, true);
+    out.length = 0;
+    fingerprint_dump(&out, "fuzz", buffer, size, DumpFormatText, 1);
+    out.length = 0;
+    fingerprint_dump(&out, "fuzz", buffer, size, DumpFormatJSON, 1);
+    out.length = 0;
+    verify_dump(&out, buffer, size, DumpFormatText, 1);
+    out.length = 0;
+    verify_dump(&out, buffer, size, DumpFormatNDJSON, 1);
+    out.length = 0;
+
+    const struct query_list names = {
+        fuzz_names, sizeof(fuzz_names) / sizeof(*fuzz_names), NULL
+    };
+    const struct query_list addresses = {
+        fuzz_addresses, sizeof(fuzz_addresses) / sizeof(*fuzz_addresses), NULL
+    };
+    query_dump(&out, buffer, size, QueryFindSymbol, &names, DumpFormatText,
+               NULL);
+    out.length = 0;
+    query_dump(&out, buffer, size, QueryAddr2Sym, &addresses, DumpFormatJSON,
+               NULL);
+    out.length = 0;
+    fuzz_diff(&out, buffer, size);
+
+    // The rows are also laid out over the raw input, from an offset that
+    // makes the offset column grow partway through.
+    const size_t rows = size > 4096 ? 256 : (size + 15) / 16;
+    char* hex = xmalloc(rows * (strlen("  ") + HEX_ROW_SIZE) + 1);
+    if (hex) {
+        hex_dump_rows(hex, (const unsigned char*)buffer, rows * 16 < size
+                      ? rows * 16 : size, UINT32_MAX - 64, "  ");
+        xfree(hex);
+    }
+    out_free(&out);
+
+    xfree(buffer);
+    return 0;
+}
@@ -0,0 +1,60 @@
+// fuzz/partialfuzz.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// A libFuzzer target for --partial-reads. Each input is written to a file,
+// fetched piece by piece with mach_fetch and dumped, and the dump must match
+// the dump of the whole file byte for byte: anything the renderers read that
+// mach_fetch did not ask for reads as zeros and shows up as a difference.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dump.h"
+#include "fuzz.h"
+#include "out.h"
+#include "partial.h"
+#include "safe.h"
+#include "termcolor.h"
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    (void)argc;
+    (void)argv;
+    tcol_override_color_checks(false);
+    dump_set_format(DumpFormatText);
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    const char* path = fuzz_file(data, size);
+    struct partial_file file;
+    if (path == NULL || partial_open(path, &file) != 0) {
+        return 0;
+    }
+    char* buffer = xmalloc(size ? size : 1);
+    if (buffer == NULL || mach_fetch(&file) != 0) {
+        xfree(buffer);
+        partial_close(&file);
+        return 0;
+    }
+    memcpy(buffer, data, size);
+
+    struct out whole;
+    struct out parts;
+    out_init(&whole, -1);
+    out_init(&parts, -1);
+    const enum dump_error expected = mach_dump(&whole, buffer, size);
+    const enum dump_error error = mach_dump(&parts, file.buffer, file.length);
+    if (error != expected || whole.length != parts.length
+        || memcmp(whole.data, parts.data, whole.length) != 0) {
+        fprintf(stderr, "partialfuzz: the partial dump differs from the "
+                "whole one\n");
+        abort();
+    }
+    out_free(&whole);
+    out_free(&parts);
+    xfree(buffer);
+    partial_close(&file);
+    return 0;
+}
@@ -0,0 +1,32 @@
+// fuzz/replay.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// Runs the files named on the command line through a fuzz target, for
+// replaying crashes or running a corpus with compilers that lack libFuzzer.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "fuzz.h"
+#include "safe.h"
+
+int main(int argc, char* argv[]) {
+    LLVMFuzzerInitialize(&argc, &argv);
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE* file = fopen(argv[i], "rb");
+        size_t size;
+        char* data = file ? xfreadall(file, &size) : NULL;
+        if (file) {
+            xfclose(file);
+        }
+        if (data == NULL) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        LLVMFuzzerTestOneInput((const uint8_t*)data, size);
+        xfree(data);
+    }
+    return status;
+}
@@ -0,0 +1,46 @@
+// fuzz/symidxfuzz.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// A libFuzzer target for sidecar symbol index files, which symindex_open only
+// checks as far as their header before the lookups trust them. Each input is
+// written to a file and opened as the index of a binary with whatever UUID
+// and size its header claims, so that the staleness check never stops it,
+// and every symbol is then looked up by name and by address.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "fuzz.h"
+#include "symindex.h"
+
+// Only the first symbols are looked up, to keep each run short.
+#define FUZZ_SYMBOLS 4096
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    (void)argc;
+    (void)argv;
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    struct symindex_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(&header, data, size < sizeof(header) ? size : sizeof(header));
+    const char* path = fuzz_file(data, size);
+    struct symindex index;
+    if (path == NULL
+        || !symindex_open(&index, path, header.uuid, header.binary_size)) {
+        return 0;
+    }
+    const uint32_t count = index.count < FUZZ_SYMBOLS ? index.count
+                                                      : FUZZ_SYMBOLS;
+    for (uint32_t i = 0; i < count; i++) {
+        const char* name = symindex_name(&index, i);
+        uint32_t cursor = 0;
+        while (symindex_find(&index, name, &cursor) != SYMINDEX_NONE) {}
+        symindex_lookup(&index, index.value[i]);
+        symindex_lookup(&index, index.value[i] - 1);
+    }
+    symindex_free(&index);
+    return 0;
+}
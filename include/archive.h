@@ -0,0 +1,81 @@
+// include/archive.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Marks a symbol whose member is not in the archive.
+#define ARCHIVE_NONE SIZE_MAX
+
+// A member of a static archive, decoded from its ar_hdr. The name and
+// contents are views into the archive and are not copied; the name is not
+// terminated. BSD long names, stored as "#1/LENGTH" with the name at the
+// start of the contents, are resolved, so offset and size cover only the
+// member's own bytes. header is the offset of the ar_hdr, which the ranlib
+// table refers to members by.
+struct archive_member {
+    const char* name;
+    size_t name_length;
+    uint64_t header;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t date;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t mode;
+};
+
+// Whether the file in buffer is a static archive, i.e. starts with "!<arch>".
+bool archive_is(const void* buffer, size_t length);
+
+// Allocation-free iteration over the members of an archive, in file order:
+//
+//     struct archive_iter it = archive_members(buffer, length);
+//     for (struct archive_member m; archive_next(&it, &m);)
+//
+// Iteration stops at the end of the archive or at the first member whose
+// header is corrupt or that extends past the end, which sets malformed.
+struct archive_iter {
+    const char* data;
+    size_t length;
+    uint64_t next;
+    bool malformed;
+};
+
+struct archive_iter archive_members(const void* buffer, size_t length);
+bool archive_next(struct archive_iter* it, struct archive_member* member);
+
+// Whether the member is the ranlib table, "__.SYMDEF" or one of its sorted
+// and 64-bit variants, rather than an object.
+bool archive_is_symdef(const struct archive_member* member);
+
+// An entry of the ranlib table: a symbol and the header offset of the member
+// that defines it. The name is a view into the table and is "" if it does not
+// lie within the table's strings.
+struct archive_symbol {
+    const char* name;
+    size_t name_length;
+    uint64_t member;
+};
+
+// The decoded ranlib table. malformed is set if the table does not fit within
+// its member, in which case only the entries that do are decoded.
+struct archive_symbols {
+    struct archive_symbol* entries;
+    size_t count;
+    bool malformed;
+};
+
+// Decodes the ranlib table in the symdef member of the archive in buffer.
+void archive_symbols_decode(struct archive_symbols* symbols,
+                            const void* buffer,
+                            const struct archive_member* symdef);
+void archive_symbols_free(struct archive_symbols* symbols);
+
+// The index of the member whose header is at header among the count members,
+// which are in archive order, or ARCHIVE_NONE if there is none.
+size_t archive_find_member(const struct archive_member* members, size_t count,
+                           uint64_t header);
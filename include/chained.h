@@ -0,0 +1,83 @@
+// include/chained.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mach-o/fixup-chains.h>
+#include "macho.h"
+
+// Marks a fixup that rebases rather than binds.
+#define CHAINED_NONE UINT32_MAX
+
+// A symbol the fixups bind to. name is NULL if the symbols are compressed or
+// the name does not lie within them.
+struct chained_import {
+    const char* name;
+    int64_t addend;
+    int32_t ordinal;
+    bool weak;
+};
+
+// The chain starts of one segment. segment is the segment's index in the
+// parsed file's segments table. malformed is set if the starts do not lie
+// within the data, use a pointer format this decoder does not know or a chain
+// leaves its page.
+struct chained_starts {
+    uint32_t segment;
+    uint32_t size;
+    uint16_t page_size;
+    uint16_t pointer_format;
+    uint64_t segment_offset;
+    uint32_t max_valid_pointer;
+    uint16_t page_count;
+    bool malformed;
+};
+
+enum chained_flag {
+    ChainedFlagBind = 1 << 0,
+    ChainedFlagAuth = 1 << 1,
+    ChainedFlagAddressDiversity = 1 << 2
+};
+
+// One pointer on a chain. A rebase points at target, an address in the image
+// as linked; a bind points at its import plus target, which is the addend.
+// Authenticated pointers also carry their key and diversity.
+struct chained_fixup {
+    uint64_t address;
+    uint64_t target;
+    uint32_t import;
+    uint16_t diversity;
+    uint8_t flags;
+    uint8_t key;
+};
+
+// The decoded contents of an LC_DYLD_CHAINED_FIXUPS command: its header, its
+// imports and starts, and every fixup on every chain, ordered by segment and
+// page, and by address within a page. malformed is set if the header or
+// imports do not lie within the data or a fixup binds to an import that does
+// not exist; the starts carry their own flag.
+struct chained_fixups {
+    struct dyld_chained_fixups_header header;
+    struct chained_import* imports;
+    uint32_t nimports;
+    struct chained_starts* starts;
+    uint32_t nstarts;
+    struct chained_fixup* fixups;
+    size_t count;
+    bool malformed;
+};
+
+// Decodes the command, which must be a valid LC_DYLD_CHAINED_FIXUPS of the
+// parsed file. Chains are independent of one another, so the pages are
+// walked using up to threads threads.
+void chained_fixups_decode(struct chained_fixups* fixups,
+                           const struct macho* macho,
+                           const struct macho_command* command,
+                           unsigned threads);
+void chained_fixups_free(struct chained_fixups* fixups);
+
+// The name of a DYLD_CHAINED_PTR_* pointer format, or NULL if it is unknown.
+const char* chained_format_name(uint16_t pointer_format);
@@ -0,0 +1,71 @@
+// include/codesign.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "macho.h"
+
+// The CodeDirectory hash types. Only the SHA-256 based ones are verified.
+enum codesign_hash {
+    CodesignHashSHA1 = 1,
+    CodesignHashSHA256 = 2,
+    CodesignHashSHA256Truncated = 3,
+    CodesignHashSHA384 = 4,
+    CODESIGN_HASH_COUNT
+};
+
+// The name of a CodeDirectory hash type, or NULL if it is unknown.
+const char* codesign_hash_name(uint8_t hash_type);
+
+// The CodeDirectory of an LC_CODE_SIGNATURE, decoded to host order, and the
+// outcome of hashing the pages it covers. Page i is the bytes [i << page_shift,
+// min((i + 1) << page_shift, code_limit)) of the file, or all of them if
+// page_shift is 0. hashes points at the npages expected hashes of hash_size
+// bytes each, and mismatched[i] is set if page i does not hash to its own.
+struct codesign {
+    uint32_t version;
+    uint32_t flags;
+    uint8_t hash_type;
+    uint8_t hash_size;
+    uint8_t page_shift;
+    uint8_t platform;
+    uint64_t code_limit;
+    const char* identifier;
+    size_t identifier_length;
+    const uint8_t* hashes;
+    uint32_t npages;
+    bool* mismatched;
+    uint32_t nmismatched;
+};
+
+// Finds the CodeDirectory of the command, which must be a valid
+// LC_CODE_SIGNATURE of the parsed file, and hashes every page it covers using
+// up to threads threads. Of several CodeDirectories the SHA-256 one is used.
+// Returns DumpErrorUnsupportedSignature, leaving nothing to free, if none
+// uses a SHA-256 based hash, or DumpErrorMalformed if the blobs do not lie
+// within the signature or the pages do not lie within the file. Returns
+// DumpErrorNoMemory if memory runs out.
+enum dump_error codesign_verify(struct codesign* codesign,
+                                const struct macho* macho,
+                                const struct macho_command* command,
+                                unsigned threads);
+void codesign_free(struct codesign* codesign);
+
+// The bounds of page i within the file.
+static inline uint64_t codesign_page_offset(const struct codesign* codesign,
+                                            uint32_t i) {
+    return codesign->page_shift ? (uint64_t)i << codesign->page_shift : 0;
+}
+
+static inline uint64_t codesign_page_size(const struct codesign* codesign,
+                                          uint32_t i) {
+    const uint64_t offset = codesign_page_offset(codesign, i);
+    const uint64_t size = codesign->page_shift
+                          ? (uint64_t)1 << codesign->page_shift
+                          : codesign->code_limit;
+    return codesign->code_limit - offset < size ? codesign->code_limit - offset
+                                                : size;
+}
@@ -0,0 +1,33 @@
+// include/diff.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "dump.h"
+
+struct out;
+
+// One side of a comparison: a Mach-O file or universal binary, of which the
+// slice selected by mach_select is compared. error is set if it could not be
+// parsed or compared.
+struct diff_file {
+    const char* name;
+    void* buffer;
+    size_t length;
+    enum dump_error error;
+};
+
+// Compares two files structurally and writes their differences in the given
+// format. The header is compared field by field, segments are paired by name,
+// sections by segment and section name and the other load commands by type
+// and position among those of their type, and each pair is compared field by
+// field. The contents of paired sections, and of segments without sections,
+// are hashed in blocks on up to threads threads, and only blocks whose hashes
+// differ are compared byte by byte.
+// Returns whether the files differ, or false, writing nothing, if either
+// could not be parsed. If memory runs out partway, the differences found so
+// far are written and the old file's error is DumpErrorNoMemory.
+bool diff_dump(struct out* out, struct diff_file files[2],
+               enum dump_format format, unsigned threads);
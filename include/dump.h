@@ -3,6 +3,102 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 
-void mach_dump(void* buffer, const size_t length);
+struct out;
+
+// The reasons mach_dump can fail. Use dump_errorstr to display a diagnostic.
+enum dump_error {
+    DumpErrorNone = 0,
+    DumpErrorNotMachO64 = 1,
+    DumpErrorTruncated = 2,
+    DumpErrorNoUUID = 3,
+    DumpErrorIndexWrite = 4,
+    DumpErrorMalformed = 5,
+    DumpErrorNoSignature = 6,
+    DumpErrorUnsupportedSignature = 7,
+    DumpErrorHashMismatch = 8,
+    DumpErrorNoMemory = 9,
+    DUMP_ERROR_COUNT
+};
+
+const char* dump_errorstr(const enum dump_error err);
+
+// The ways mach_dump can render a file: the colored tree meant for people,
+// a JSON document, or newline-delimited JSON records. See json.h.
+enum dump_format {
+    DumpFormatText = 0,
+    DumpFormatJSON = 1,
+    DumpFormatNDJSON = 2
+};
+
+// Sets how mach_dump renders files. Defaults to DumpFormatText.
+void dump_set_format(enum dump_format format);
+
+// Sets how many threads mach_dump may use to render large tables. Output is
+// identical for any number of threads. Defaults to 1.
+void dump_set_threads(unsigned threads);
+
+// The parts of a Mach-O file that mach_dump can be restricted to, as named
+// for dump_set_only: "header", "segments", "symtab", "dysymtab", "build" and
+// "other" for every other load command.
+enum dump_part {
+    DumpPartHeader = 1 << 0,
+    DumpPartSegments = 1 << 1,
+    DumpPartSymtab = 1 << 2,
+    DumpPartDysymtab = 1 << 3,
+    DumpPartBuild = 1 << 4,
+    DumpPartOther = 1 << 5,
+    DUMP_PART_ALL = (1 << 6) - 1
+};
+
+// Restricts mach_dump to the parts named in the comma separated list, or
+// lifts the restriction if it is NULL, the default. Everything else is
+// validated but not rendered. Returns nonzero, changing nothing, if the list
+// names an unknown part.
+int dump_set_only(const char* parts);
+
+// Restricts the segments mach_dump renders to those named in the comma
+// separated list. NULL, the default, renders all of them. The list is not
+// copied.
+void dump_set_segments(const char* segments);
+
+struct load_command;
+
+// Whether the header or the load command pass the filters set above.
+bool dump_wants_header(void);
+bool dump_wants_command(const struct load_command* lc);
+
+// Makes mach_dump print the full contents of the sections named in the comma
+// separated list as hexdump rows, or of every section if it is empty. NULL,
+// the default, turns this off. The list is not copied.
+void dump_set_hexdump(const char* sections);
+
+// Restricts the slices of universal binaries that are dumped to the
+// architectures named in the comma separated list, such as "x86_64,arm64".
+// NULL, the default, dumps every slice. The list is not copied.
+void dump_set_arch(const char* arches);
+
+// Restricts the members of static archives that are dumped to those named in
+// the comma separated list, such as "a.o,b.o". NULL, the default, dumps every
+// member. The list is not copied.
+void dump_set_members(const char* members);
+
+// Narrows buffer to a single 64-bit Mach-O file: itself, or the first slice of
+// a universal binary allowed by dump_set_arch.
+enum dump_error mach_select(void** buffer, size_t* length);
+
+struct partial_file;
+
+// Reads into the partial file, opened with partial_open, the parts that
+// mach_dump will look at given the filters set above, in a few batches of
+// coalesced preads: the header, the load commands and then the data the
+// wanted commands refer to. Archives are read whole. Returns 0 on success, or
+// nonzero with errno set.
+int mach_fetch(struct partial_file* file);
+
+// Renders the Mach-O file, universal binary or static archive in buffer to
+// the given sink. On failure, whatever was rendered before the problem was
+// found stays in the sink.
+enum dump_error mach_dump(struct out* out, void* buffer, const size_t length);
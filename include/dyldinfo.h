@@ -0,0 +1,90 @@
+// include/dyldinfo.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "macho.h"
+
+// The opcode streams of LC_DYLD_INFO, in the order the command lists them.
+enum dyld_stream {
+    DyldStreamRebase = 0,
+    DyldStreamBind = 1,
+    DyldStreamWeakBind = 2,
+    DyldStreamLazyBind = 3,
+    DYLD_STREAM_COUNT
+};
+
+// One location dyld fixes up at load time. address is the segment's vmaddr
+// plus the offset the opcodes arrived at. Rebases have no symbol and only a
+// type; symbol points into the opcode stream, NUL terminated within it.
+struct dyld_fixup {
+    uint64_t address;
+    int64_t addend;
+    const char* symbol;
+    int32_t ordinal;
+    uint8_t segment;
+    uint8_t type;
+    uint8_t flags;
+};
+
+// The fixups one opcode stream describes, in stream order. malformed is set if
+// the stream ended early, used an unknown opcode or pointed outside its
+// segments; the fixups before that point are kept.
+struct dyld_fixups {
+    struct dyld_fixup* entries;
+    uint32_t count;
+    bool malformed;
+};
+
+// Runs the opcode stream of the given kind from the parsed file's
+// LC_DYLD_INFO or LC_DYLD_INFO_ONLY command, which must be valid.
+void dyld_fixups_decode(struct dyld_fixups* fixups, const struct macho* macho,
+                        const struct macho_command* command,
+                        enum dyld_stream stream);
+void dyld_fixups_free(struct dyld_fixups* fixups);
+
+// The name of the stream, as used for rendering.
+const char* dyld_stream_name(enum dyld_stream stream);
+
+// A symbol exported through the export trie. address is an offset from the
+// start of the image, except for absolute symbols. A re-export has the
+// library ordinal in other and, if it is renamed, the name it is imported by
+// in import_name; a stub with a resolver has the resolver's offset in other.
+struct dyld_export {
+    uint64_t address;
+    uint64_t flags;
+    uint64_t other;
+    const char* import_name;
+    uint32_t name;
+};
+
+// The symbols in an export trie in depth first order. Names are offsets into
+// the names arena, each NUL terminated. malformed is set if the trie runs out
+// of bounds, revisits a node, nests deeper than DYLD_TRIE_DEPTH or spells out
+// many times more name bytes than it holds; what was found before that point
+// is kept.
+struct dyld_exports {
+    struct dyld_export* entries;
+    uint32_t count;
+    char* names;
+    size_t names_size;
+    bool malformed;
+};
+
+// How deeply trie nodes may nest, which bounds the walk's explicit stack.
+#define DYLD_TRIE_DEPTH 1024
+
+// Walks the export trie of size bytes at offset in the parsed file, which
+// must lie within it.
+void dyld_exports_decode(struct dyld_exports* exports,
+                         const struct macho* macho, uint64_t offset,
+                         uint64_t size);
+void dyld_exports_free(struct dyld_exports* exports);
+
+static inline const char* dyld_export_name(const struct dyld_exports* exports,
+                                           const struct dyld_export* entry) {
+    return exports->names + entry->name;
+}
@@ -0,0 +1,35 @@
+// include/fat.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mach/machine.h>
+
+// A fat_arch or fat_arch_64 entry, decoded to host order.
+struct fat_slice {
+    cpu_type_t cputype;
+    cpu_subtype_t cpusubtype;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t align;
+};
+
+// Fat headers and their fat_arch entries are always big-endian.
+static inline uint32_t read_be32(const void* p) {
+    const unsigned char* bytes = p;
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16
+           | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static inline uint64_t read_be64(const void* p) {
+    return (uint64_t)read_be32(p) << 32 | read_be32((const char*)p + 4);
+}
+
+// Decodes the fat_arch, or fat_arch_64 if is64, at entry.
+void fat_slice_read(struct fat_slice* slice, const void* entry, bool is64);
+
+// The conventional name of an architecture, as used by lipo and --arch, or
+// NULL if it is not known.
+const char* arch_name(cpu_type_t cputype, cpu_subtype_t cpusubtype);
@@ -0,0 +1,21 @@
+// include/fingerprint.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include "dump.h"
+
+struct out;
+
+// Writes the reproducibility fingerprint of the Mach-O file in buffer, or of
+// the slice of a universal binary selected by mach_select: a hash of the
+// header and load commands, of every segment's and every section's contents
+// and of all of them together. The bytes that differ between otherwise
+// identical builds, the UUID in LC_UUID and the LC_CODE_SIGNATURE command and
+// signature, are left out. In text the fingerprint is one line, starting with
+// the overall hash and name; in NDJSON it is one record. Contents are hashed
+// on up to threads threads, and the hashes do not depend on how many.
+enum dump_error fingerprint_dump(struct out* out, const char* name,
+                                 void* buffer, size_t length,
+                                 enum dump_format format, unsigned threads);
@@ -0,0 +1,36 @@
+// include/funcstarts.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "macho.h"
+#include "symindex.h"
+
+// The functions listed by LC_FUNCTION_STARTS, as columns by ascending address.
+// A function extends to the next one's start or to the end of the __TEXT
+// section it starts in, whichever comes first; a function that is last and
+// outside every section has size 0. symbols is filled in by
+// function_starts_join.
+struct function_starts {
+    uint32_t count;
+    uint64_t* addresses;
+    uint64_t* sizes;
+    uint32_t* symbols;
+    // Set if the data ended in the middle of a ULEB128, so the list may be
+    // incomplete.
+    bool truncated;
+};
+
+// Decodes the parsed file's LC_FUNCTION_STARTS, which must be valid. A file
+// without one gets an empty list.
+void function_starts_decode(struct function_starts* starts,
+                            const struct macho* macho);
+void function_starts_free(struct function_starts* starts);
+
+// Names each function after a symbol defined at its exact start, or
+// SYMINDEX_NONE, in one merge with the index's address-sorted symbols.
+void function_starts_join(struct function_starts* starts,
+                          const struct symindex* index);
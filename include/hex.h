@@ -0,0 +1,22 @@
+// include/hex.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The most bytes one row of hex_dump_rows output can take, excluding the
+// prefix.
+#define HEX_ROW_SIZE 96
+
+// Writes the 2 * n lowercase hexadecimal digits of the bytes in src to dst.
+// Uses AVX2 or SSE2 when the processor has them.
+void hex_encode(char* dst, const unsigned char* src, size_t n);
+
+// Formats the n bytes in src as classic hexdump rows of 16 bytes each:
+// prefix, the offset of the row, the bytes in hex and the bytes as ASCII. The
+// first row is at offset. dst must have room for ceil(n / 16) rows of
+// strlen(prefix) + HEX_ROW_SIZE bytes. Returns the number of bytes written.
+size_t hex_dump_rows(char* dst, const unsigned char* src, size_t n,
+                     uint64_t offset, const char* prefix);
@@ -0,0 +1,63 @@
+// include/json.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dump.h"
+
+struct out;
+struct fat_slice;
+struct archive_member;
+struct archive_symbols;
+
+// Machine-readable dumps, written straight to the sink without going through
+// libtermcolor. In document mode each file is one JSON object on its own line;
+// in NDJSON mode every header, load command, section and symbol is its own
+// record, tagged by a "record" member. Both are streamed as the file is read,
+// so memory use does not grow with the size of the file. Numbers are written
+// as plain JSON integers and may exceed 2**53.
+
+// Writes the first n bytes of s, or up to its terminator, as a JSON string.
+void json_string(struct out* out, const char* s, size_t n);
+
+// Streams the 64-bit Mach-O file in buffer. In document mode this always
+// writes a complete value: null if buffer is not a Mach-O file, or the part
+// read so far with its arrays closed if the file is truncated.
+enum dump_error json_macho(struct out* out, void* buffer, size_t length,
+                           unsigned threads, bool ndjson);
+
+// Bracket the slices of a universal binary. Each slice is bracketed by
+// json_fat_arch_begin and json_fat_arch_end, with its contents written in
+// between, or nothing written for slices that are skipped. error is NULL for
+// slices that were dumped or skipped.
+void json_fat_begin(struct out* out, uint32_t magic, uint32_t nfat_arch,
+                    bool ndjson);
+void json_fat_arch_begin(struct out* out, size_t index,
+                         const struct fat_slice* slice, bool ndjson);
+void json_fat_arch_end(struct out* out, bool dumped, const char* error,
+                       bool ndjson);
+void json_fat_end(struct out* out, bool ndjson);
+
+// Bracket the members of a static archive in the same way.
+void json_archive_begin(struct out* out, size_t nmembers, bool ndjson);
+void json_archive_member_begin(struct out* out, size_t index,
+                               const struct archive_member* member,
+                               bool ndjson);
+void json_archive_member_end(struct out* out, bool dumped, const char* error,
+                             bool ndjson);
+void json_archive_end(struct out* out, bool ndjson);
+
+// Writes the contents of a ranlib table member, resolving each symbol to the
+// index of its member among the count members.
+void json_archive_symbols(struct out* out,
+                          const struct archive_symbols* symbols,
+                          const struct archive_member* members, size_t count,
+                          bool ndjson);
+
+// Bracket the dump of one file. error is NULL if the file was dumped.
+void json_file_begin(struct out* out, const char* path, bool ndjson);
+void json_file_end(struct out* out, bool dumped, const char* error,
+                   bool ndjson);
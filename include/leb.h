@@ -0,0 +1,87 @@
+// include/leb.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Reads the unsigned LEB128 at *p, which must lie before end, and advances *p
+// past it. Returns false, leaving *p alone, if it runs past end or does not
+// fit in 64 bits.
+//
+// The values in __LINKEDIT are nearly all one or two bytes long, and a loop
+// that branches on every byte mispredicts constantly on a mix of the two. So
+// values of up to two bytes are decoded without such a branch: the length
+// comes from the first byte's continuation bit alone, which also keeps the
+// dependency from one value to the next short. Up to eight bytes are decoded
+// as a word, the 7 bit groups packed together with three shift-and-mask steps.
+static inline bool uleb128_read(const uint8_t** p, const uint8_t* end,
+                                uint64_t* value) {
+    const uint8_t* s = *p;
+    if (end - s >= 2) {
+        const uint64_t more = s[0] >> 7;
+        if (!(more & s[1] >> 7)) {
+            *value = (s[0] & 0x7f) | ((uint64_t)(s[1] & 0x7f) << 7 & -more);
+            *p = s + 1 + more;
+            return true;
+        }
+    }
+    if (end - s >= 8) {
+        uint64_t word;
+        memcpy(&word, s, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        const uint64_t stops = ~word & 0x8080808080808080ull;
+        if (stops) {
+            // Keeps the bytes up to and including the last one.
+            uint64_t x = word & (stops ^ (stops - 1)) & 0x7f7f7f7f7f7f7f7full;
+            x = (x & 0x007f007f007f007full) | (x >> 1 & 0x3f803f803f803f80ull);
+            x = (x & 0x00003fff00003fffull) | (x >> 2 & 0x0fffc0000fffc000ull);
+            x = (x & 0x000000000fffffffull) | (x >> 4 & 0x00fffffff0000000ull);
+            *value = x;
+            *p = s + (__builtin_ctzll(stops) >> 3) + 1;
+            return true;
+        }
+    }
+
+    // Near the end of the data, or more than eight bytes long.
+    uint64_t result = 0;
+    for (unsigned shift = 0; s < end; shift += 7) {
+        const uint8_t byte = *s++;
+        if (shift > 63 || (shift == 63 && (byte & 0x7f) > 1)) {
+            return false;
+        }
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            *p = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads the signed LEB128 at *p like uleb128_read. Only addends are signed,
+// and they are rare enough that a plain loop does.
+static inline bool sleb128_read(const uint8_t** p, const uint8_t* end,
+                                int64_t* value) {
+    const uint8_t* s = *p;
+    uint64_t result = 0;
+    for (unsigned shift = 0; s < end && shift < 64; shift += 7) {
+        const uint8_t byte = *s++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            if (shift + 7 < 64 && (byte & 0x40)) {
+                result |= ~(uint64_t)0 << (shift + 7);
+            }
+            *value = (int64_t)result;
+            *p = s;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,222 @@
+// include/macho.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include "dump.h"
+
+// Marks a command that has no entry in one of the per-kind tables.
+#define MACHO_NONE UINT32_MAX
+
+// What validation made of a structure. A malformed structure contradicts
+// itself, e.g. its size is too small for its fields, and is not decoded any
+// further. An outside structure is well formed but refers to data that does
+// not lie within the file; only the parts that do are rendered.
+enum macho_verdict {
+    MachoVerdictValid = 0,
+    MachoVerdictMalformed = 1,
+    MachoVerdictOutside = 2,
+    MACHO_VERDICT_COUNT
+};
+
+const char* macho_verdictstr(const enum macho_verdict verdict);
+
+// What the parser knows about a kind of load command: its name, the struct
+// that lays it out and the smallest cmdsize that struct allows. If string is
+// nonzero, it is the offset of a union lc_str in the struct, which must point
+// past the struct and inside the command.
+struct macho_command_kind {
+    const char* name;
+    const char* type;
+    uint32_t size;
+    uint32_t string;
+};
+
+// The kind of cmd, or NULL if it is not a known load command. The registry is
+// a table indexed by whether LC_REQ_DYLD is set and by the low seven bits, so
+// looking a command up is a single load.
+const struct macho_command_kind* macho_command_kind(uint32_t cmd);
+
+// The registry index of cmd, if it has one.
+#define MACHO_KIND_DYLD(cmd) ((cmd) >> 31)
+#define MACHO_KIND_INDEX(cmd) ((cmd) & 0x7f)
+#define MACHO_KIND_VALID(cmd) \
+    (((cmd) & ~(uint32_t)(LC_REQ_DYLD | 0x7f)) == 0)
+
+// Where a load command is and what it is. segment is the index of its entry in
+// the segments table, or MACHO_NONE if it is not a well formed LC_SEGMENT_64.
+struct macho_command {
+    uint64_t offset;
+    uint32_t cmd;
+    uint32_t cmdsize;
+    uint32_t segment;
+    enum macho_verdict verdict;
+};
+
+// An LC_SEGMENT_64, decoded, with its sections at [first_section,
+// first_section + command.nsects) in the sections table.
+struct macho_segment {
+    struct segment_command_64 command;
+    uint32_t first_section;
+};
+
+// A structural index of a 64-bit Mach-O file, built in one validated pass over
+// its load commands. The tables are copies in host order, so walking them
+// never touches the load commands again. The file itself is only borrowed,
+// but its header and load commands are copied if data is not 8 byte aligned,
+// as archive members need not be, so that commands can be read in place.
+//
+// Every offset and size pair is checked against the file once, here, and the
+// outcome is kept as a verdict on the command or section it belongs to, so
+// renderers only look at verdicts and then read the file unchecked. A command
+// that is malformed or refers to data outside the file is recorded, the first
+// such problem is kept in error, and parsing carries on with the next command.
+// Only a command whose own cmdsize is unusable, or that runs past the
+// header's sizeofcmds, stops the walk, since nothing after it can be found.
+struct macho {
+    const char* data;
+    size_t length;
+    const char* load_commands;
+    struct mach_header_64 header;
+
+    struct macho_command* commands;
+    uint32_t ncommands;
+    struct macho_segment* segments;
+    uint32_t nsegments;
+    struct section_64* sections;
+    enum macho_verdict* section_verdicts;
+    uint32_t nsections;
+
+    // The LC_SYMTAB, LC_DYSYMTAB and LC_UUID commands, if there are any and
+    // they are valid, as indices into commands.
+    uint32_t symtab_command;
+    struct symtab_command symtab;
+    uint32_t dysymtab_command;
+    struct dysymtab_command dysymtab;
+    uint32_t uuid_command;
+    uint8_t uuid[16];
+    // The LC_FUNCTION_STARTS command, likewise; see funcstarts.h.
+    uint32_t function_starts_command;
+
+    enum dump_error error;
+};
+
+// Indexes the Mach-O file in buffer, which must outlive the index. Returns
+// an error, leaving nothing to free, only if the header cannot be read or
+// memory runs out; problems further in are recorded in the index.
+enum dump_error macho_parse(struct macho* macho, const void* buffer,
+                            size_t length);
+void macho_free(struct macho* macho);
+
+// The length bytes of the file at offset, or NULL if they do not all lie
+// within it. All access to the file's contents goes through here.
+const void* macho_data(const struct macho* macho, uint64_t offset,
+                       uint64_t length);
+
+// The raw load command, which is known to lie within the file.
+static inline const struct load_command* macho_command_data(
+    const struct macho* macho, const struct macho_command* command) {
+    return (const void*)(macho->load_commands + command->offset);
+}
+
+// Whether the section occupies bytes in the file, i.e. is not zero filled.
+static inline bool macho_section_has_contents(
+    const struct section_64* section) {
+    const uint32_t type = section->flags & SECTION_TYPE;
+    return type != S_ZEROFILL && type != S_GB_ZEROFILL
+           && type != S_THREAD_LOCAL_ZEROFILL;
+}
+
+// The section's contents, or NULL if they do not lie within the file.
+static inline const unsigned char* macho_section_data(
+    const struct macho* macho, const struct section_64* section) {
+    return macho->section_verdicts[section - macho->sections]
+           == MachoVerdictValid
+        ? (const unsigned char*)macho->data + section->offset : NULL;
+}
+
+// Allocation-free iteration over the tables. Each iterator yields its
+// entries in file order and then NULL:
+//
+//     struct macho_iter it = macho_commands(macho);
+//     for (const struct macho_command* c; (c = macho_next_command(&it));)
+struct macho_iter {
+    const struct macho* macho;
+    uint32_t next;
+    uint32_t end;
+};
+
+static inline struct macho_iter macho_commands(const struct macho* macho) {
+    struct macho_iter it = { macho, 0, macho->ncommands };
+    return it;
+}
+
+static inline const struct macho_command* macho_next_command(
+    struct macho_iter* it) {
+    return it->next < it->end ? &it->macho->commands[it->next++] : NULL;
+}
+
+static inline struct macho_iter macho_segments(const struct macho* macho) {
+    struct macho_iter it = { macho, 0, macho->nsegments };
+    return it;
+}
+
+static inline const struct macho_segment* macho_next_segment(
+    struct macho_iter* it) {
+    return it->next < it->end ? &it->macho->segments[it->next++] : NULL;
+}
+
+// Iterates over every section, or with macho_segment_sections over just
+// those of one segment.
+static inline struct macho_iter macho_sections(const struct macho* macho) {
+    struct macho_iter it = { macho, 0, macho->nsections };
+    return it;
+}
+
+static inline struct macho_iter macho_segment_sections(
+    const struct macho* macho, const struct macho_segment* segment) {
+    struct macho_iter it = {
+        macho, segment->first_section,
+        segment->first_section + segment->command.nsects
+    };
+    return it;
+}
+
+static inline const struct section_64* macho_next_section(
+    struct macho_iter* it) {
+    return it->next < it->end ? &it->macho->sections[it->next++] : NULL;
+}
+
+// The symbol at index, which must be below symtab.nsyms of a valid LC_SYMTAB.
+// It is copied out, since the table is only as aligned as the file is.
+static inline struct nlist_64 macho_symbol(const struct macho* macho,
+                                           uint32_t index) {
+    struct nlist_64 symbol;
+    memcpy(&symbol, macho->data + macho->symtab.symoff
+                    + (uint64_t)index * sizeof(symbol), sizeof(symbol));
+    return symbol;
+}
+
+// The string table, or NULL if the file has no valid LC_SYMTAB.
+static inline const char* macho_strings(const struct macho* macho) {
+    return macho->symtab_command == MACHO_NONE ? NULL
+        : macho->data + macho->symtab.stroff;
+}
+
+// Whether every symbol's name starts within the string table and the table
+// ends in a NUL, so that names can be read as C strings. This sweeps the whole
+// symbol table, so it is left to the renderers that need the names, to do
+// once before rendering them.
+bool macho_symbol_names(const struct macho* macho);
+
+// The name of the symbol and its length, which is bounded by the string
+// table, or "" if the name lies outside it. names is what macho_symbol_names
+// said of the file; if it is set the name is read without bounds checks.
+const char* macho_symbol_name(const struct macho* macho, bool names,
+                              const struct nlist_64* symbol, size_t* length);
@@ -0,0 +1,20 @@
+// include/mapfile.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A read-only view of a whole file. Regular files are mapped straight from the
+// page cache; pipes and other special files are read into a heap buffer.
+struct mapped_file {
+    void* buffer;
+    size_t length;
+    bool mapped;
+};
+
+// Returns 0 on success. Failures are reported through the safe.h failure
+// handler, in which case a nonzero value is returned.
+int map_file(const char* filename, struct mapped_file* file);
+void unmap_file(struct mapped_file* file);
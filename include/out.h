@@ -0,0 +1,94 @@
+// include/out.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+// Once this many bytes are pending, a buffered sink writes them to its file
+// descriptor in one go.
+#define OUT_FLUSH_SIZE (1 << 20)
+
+// Where rendered dump text goes. A buffered sink appends to a large private
+// buffer and writes it out in big chunks, or keeps everything in memory when
+// it has no file descriptor. A stdio sink passes everything through to a FILE*
+// and exists as a fallback.
+struct out {
+    FILE* stream;
+    int fd;
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+};
+
+// Initializes a buffered sink writing to fd, or accumulating in memory if fd
+// is negative.
+void out_init(struct out* out, int fd);
+void out_init_stdio(struct out* out, FILE* stream);
+void out_free(struct out* out);
+
+// Writes any pending buffered output. Returns 0 unless a write ever failed.
+int out_flush(struct out* out);
+
+// Appends everything rendered into other, which must be a buffered sink, to
+// out. Large buffers are written straight to out's descriptor without copying.
+void out_append(struct out* out, const struct out* other);
+
+// Renders entries [0, count) with render. When more than one thread is
+// allowed, chunks of chunk entries are rendered concurrently into private
+// buffers that are then appended to out in index order, a window of a couple
+// of chunks per thread at a time, so the output matches a serial render.
+void out_render_chunks(struct out* out, unsigned threads, size_t count,
+                       size_t chunk,
+                       void (*render)(struct out* out, void* context,
+                                      size_t begin, size_t end),
+                       void* context);
+
+// Printfs the colorized format string. fmt must be a string literal; see
+// tcol_fmt_cached.
+void out_printf(struct out* out, const char* fmt, ...);
+
+// Writes the colorized string literal s verbatim, without printf processing.
+void out_cputs(struct out* out, const char* s);
+
+// Writes the unsigned value as lowercase hexadecimal zero-padded to at least
+// digits characters, like "%0*llx", or in decimal, like "%llu".
+void out_hex(struct out* out, uint64_t value, int digits);
+void out_dec(struct out* out, uint64_t value);
+
+void out_reserve(struct out* out, size_t n);
+
+static inline void out_write(struct out* out, const char* s, size_t n) {
+    if (out->stream) {
+        fwrite(s, sizeof(char), n, out->stream);
+        stats_emitted(s, n);
+        return;
+    }
+    if (out->capacity - out->length < n) {
+        out_reserve(out, n);
+    }
+    memcpy(out->data + out->length, s, n);
+    out->length += n;
+}
+
+static inline void out_puts(struct out* out, const char* s) {
+    out_write(out, s, strlen(s));
+}
+
+static inline void out_putc(struct out* out, char c) {
+    if (out->stream) {
+        fputc(c, out->stream);
+        stats_emitted(&c, 1);
+        return;
+    }
+    if (out->length == out->capacity) {
+        out_reserve(out, 1);
+    }
+    out->data[out->length++] = c;
+}
@@ -0,0 +1,47 @@
+// include/partial.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Wanted ranges closer together than this are read as one, since a round trip
+// to a network filesystem costs about as much as transferring this much.
+#define PARTIAL_GAP ((uint64_t)64 << 10)
+
+struct partial_range {
+    uint64_t offset;
+    uint64_t length;
+};
+
+// A file read piece by piece with pread, for files on slow or network
+// filesystems that are only partly dumped. buffer spans the whole file, so it
+// can be indexed like a mapped one, but only the ranges that were fetched hold
+// the file's contents and the rest reads as zeros. It is a private anonymous
+// mapping, so the pages that are never fetched cost nothing. Files that are
+// not regular, and cannot be read at an offset, are read whole on opening.
+struct partial_file {
+    int fd;
+    char* buffer;
+    size_t length;
+    bool mapped;
+    uint64_t bytes_read;
+    struct partial_range* wanted;
+    size_t nwanted;
+    size_t capacity;
+};
+
+// Returns 0 on success, or nonzero with errno set.
+int partial_open(const char* filename, struct partial_file* file);
+void partial_close(struct partial_file* file);
+
+// Adds the bytes at offset to the next fetch, clamped to the file.
+void partial_want(struct partial_file* file, uint64_t offset,
+                  uint64_t length);
+
+// Reads every wanted range into buffer, sorted and with ranges that overlap or
+// lie within PARTIAL_GAP of each other merged. Returns 0 on success, or
+// nonzero with errno set.
+int partial_fetch(struct partial_file* file);
@@ -0,0 +1,20 @@
+// include/pool.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+
+// Calls task(context, i) for every i in [0, count) using up to threads threads,
+// including the calling one, and returns once all calls have finished. Indices
+// are handed out dynamically, so tasks of uneven size balance themselves.
+void pool_for(unsigned threads, size_t count,
+              void (*task)(void* context, size_t index), void* context);
+
+// Like pool_for, but with threads threads besides the calling one, which
+// calls emit(context, i) for every i in order as soon as task(context, i) has
+// finished, while later tasks carry on. At most window tasks run ahead of the
+// last one emitted, so each task can buffer its output in slot i % window.
+void pool_ordered(unsigned threads, size_t count, size_t window,
+                  void (*task)(void* context, size_t index),
+                  void (*emit)(void* context, size_t index), void* context);
@@ -0,0 +1,43 @@
+// include/query.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include "dump.h"
+
+struct out;
+
+// The symbol lookups machdump can answer instead of dumping a file.
+enum query_kind {
+    QueryNone = 0,
+    QueryFindSymbol = 1,
+    QueryAddr2Sym = 2
+};
+
+// A batch of queries, each a symbol name or an address.
+struct query_list {
+    const char** items;
+    size_t count;
+    char* storage;
+};
+
+// Loads the queries named by arg: arg itself, or one per line read from
+// standard input if arg is "-" or from FILE if arg is "@FILE". Returns 0 on
+// success, or nonzero with errno set if the queries could not be read.
+int query_load(struct query_list* queries, const char* arg);
+void query_free(struct query_list* queries);
+
+// Indexes the symbols of the Mach-O file in buffer, or of the slice of a
+// universal binary selected by mach_select, and answers every query in the
+// given format. A sidecar index at index_path is used instead of indexing the
+// file if it is up to date; index_path may be NULL.
+enum dump_error query_dump(struct out* out, void* buffer, size_t length,
+                           enum query_kind kind,
+                           const struct query_list* queries,
+                           enum dump_format format, const char* index_path);
+
+// Indexes the symbols of the file in buffer, as for query_dump, and writes
+// the index to a sidecar file at index_path.
+enum dump_error query_write_index(void* buffer, size_t length,
+                                  const char* index_path);
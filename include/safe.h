@@ -14,14 +14,20 @@ enum failure {
 };
 
 void set_failure_handler(void (*handler)(enum failure));
+const char* failure_str(enum failure failure);
 
 void* xmalloc(size_t n);
+void* xrealloc(void* ptr, size_t n);
 #define xfree free
 
 FILE* xfopen(const char* filename, const char* mode);
 unsigned long xfread(void* buffer, size_t size, size_t count, FILE* stream);
 int xfclose(FILE* file);
 
+// Reads the remainder of stream into a new heap buffer, for inputs that cannot
+// be sized up front. Returns NULL on failure.
+void* xfreadall(FILE* stream, size_t* length);
+
 #define xfseek fseek
 #define xftell ftell
 #define xrewind rewind
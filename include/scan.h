@@ -0,0 +1,60 @@
+// include/scan.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dump.h"
+#include "fat.h"
+
+struct out;
+
+// Java class files share the fat magic, but their version, which is where
+// nfat_arch would be, is at least 45, so fat headers with more slices than
+// this are not taken as universal binaries.
+#define SCAN_MAX_SLICES 44
+
+// The kinds of file machdump dumps, as told by their first few bytes.
+enum scan_kind {
+    ScanKindNone = 0,
+    ScanKindMachO = 1,
+    ScanKindFat = 2,
+    ScanKindArchive = 3,
+    SCAN_KIND_COUNT
+};
+
+// What the first few bytes of a file say about it. Mach-O files have one
+// slice, described by their header, and universal binaries have nslices.
+struct scan_sniff {
+    enum scan_kind kind;
+    uint64_t size;
+    uint64_t bytes_read;
+    uint32_t filetype;
+    uint32_t nslices;
+    struct fat_slice slices[SCAN_MAX_SLICES];
+};
+
+// The regular files under a directory, in the order scan_tree found them.
+struct scan_list {
+    char** paths;
+    size_t count;
+    size_t capacity;
+};
+
+// Adds the regular files under root to list, depth first and sorted by name
+// within each directory, without following symbolic links below root. If
+// root is not a directory it is added as it is. Directories that cannot be
+// read are passed to failed with the error and skipped.
+void scan_tree(struct scan_list* list, const char* root,
+               void (*failed)(const char* path, int errnum));
+void scan_free(struct scan_list* list);
+
+// Reads just enough of the file at path with pread to tell what it is, and
+// for universal binaries their fat_arch entries. Returns 0, or the errno of
+// the failure.
+int scan_sniff(const char* path, struct scan_sniff* sniff);
+
+// Writes the one line --summary prints for a file that was sniffed.
+void scan_summary(struct out* out, const char* path,
+                  const struct scan_sniff* sniff, enum dump_format format);
@@ -0,0 +1,18 @@
+// include/sha256.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// Hashes length bytes at data. The compression function is the fastest one
+// the CPU has: the SHA extensions on x86-64 or ARMv8 if available, or else
+// portable C. The choice is made once and is safe to make from any thread.
+void sha256(const void* data, size_t length,
+            uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// The name of the compression function sha256 uses, for diagnostics.
+const char* sha256_kernel(void);
@@ -0,0 +1,94 @@
+// include/stats.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The phases --stats times. Rendering includes translating markup, which is
+// timed inside libtermcolor, and formatting with printf, which are also timed
+// on their own. Files are mapped lazily, so reading them mostly shows up as
+// page faults in the phases after it. Times are in nanoseconds, summed over
+// threads, and leave out the cost of reading the clock.
+enum stats_phase {
+    StatsPhaseRead = 0,
+    StatsPhaseParse = 1,
+    StatsPhaseRender = 2,
+    StatsPhaseMarkup = 3,
+    StatsPhaseFormat = 4,
+    StatsPhaseWrite = 5,
+    STATS_PHASE_COUNT
+};
+
+enum stats_counter {
+    StatsBytesRead = 0,
+    StatsBytesEmitted = 1,
+    StatsLinesEmitted = 2,
+    StatsSymbols = 3,
+    StatsAllocations = 4,
+    StatsTermcolorAllocations = 5,
+    StatsTranslations = 6,
+    STATS_COUNTER_COUNT
+};
+
+// Whether counting is on. Every probe tests this first and does nothing else
+// while it is off, so the instrumentation costs a predictable branch.
+extern bool stats_enabled;
+
+// The totals. libtermcolor keeps its own, see tcol_get_stats, which are to be
+// copied into the markup phase and the last two counters before printing.
+extern uint64_t stats_phases[STATS_PHASE_COUNT];
+extern uint64_t stats_counters[STATS_COUNTER_COUNT];
+
+// Turns counting on. It cannot be turned off again, so that phases that are
+// underway are not left half counted.
+void stats_enable(void);
+
+// The monotonic clock, in nanoseconds.
+uint64_t stats_clock(void);
+
+static inline void stats_add(enum stats_counter counter, uint64_t n) {
+    if (stats_enabled) {
+        __atomic_fetch_add(&stats_counters[counter], n, __ATOMIC_RELAXED);
+    }
+}
+
+// Times a phase, or a load command with stats_command:
+//
+//     const uint64_t start = stats_begin();
+//     ...
+//     stats_end(StatsPhaseParse, start);
+static inline uint64_t stats_begin(void) {
+    return stats_enabled ? stats_clock() : 0;
+}
+
+void stats_phase(enum stats_phase phase, uint64_t start);
+void stats_load_command(uint32_t cmd, uint64_t start);
+
+static inline void stats_end(enum stats_phase phase, uint64_t start) {
+    if (stats_enabled) {
+        stats_phase(phase, start);
+    }
+}
+
+static inline void stats_command(uint32_t cmd, uint64_t start) {
+    if (stats_enabled) {
+        stats_load_command(cmd, start);
+    }
+}
+
+void stats_count_emitted(const char* data, size_t length);
+
+// Counts the bytes and lines in output that is being written out.
+static inline void stats_emitted(const char* data, size_t length) {
+    if (stats_enabled) {
+        stats_count_emitted(data, length);
+    }
+}
+
+// Prints everything counted so far, as a table or, if json is set, as a
+// single JSON object on one line.
+void stats_print(FILE* stream, bool json);
@@ -0,0 +1,104 @@
+// include/symindex.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "macho.h"
+#include "mapfile.h"
+
+// Returned by the lookups when no symbol matches.
+#define SYMINDEX_NONE UINT32_MAX
+
+// Sidecar index files are named after the binary with this suffix.
+#define SYMINDEX_SUFFIX ".symidx"
+
+// Bumped whenever the layout of sidecar index files or the name hash changes.
+#define SYMINDEX_VERSION 1
+
+// A lookup index over the symbol table of a 64-bit Mach-O file, built in one
+// pass over its nlist_64 entries. The symbols are kept as columns. Names are
+// found through an open addressing hash table of symbol numbers, and addresses
+// through the defined symbols sorted by value, so each lookup is O(1) or
+// O(log n) instead of a walk over the whole table.
+struct symindex {
+    uint32_t count;
+    const uint32_t* strx;
+    const uint64_t* value;
+    const uint8_t* type;
+    const uint8_t* sect;
+    const uint16_t* desc;
+
+    // The string table, which the index does not own.
+    const char* strtbl;
+    uint32_t strsize;
+
+    // Slots hold a symbol number plus one, or zero when empty. The number of
+    // slots is a power of two.
+    const uint32_t* names;
+    uint32_t nnames;
+
+    // Symbols defined in a section, by ascending value.
+    const uint32_t* addresses;
+    uint32_t naddresses;
+
+    void* storage;
+    struct mapped_file file;
+};
+
+// The header of a sidecar index file. The columns, names table, addresses
+// table and a copy of the string table follow at the given offsets, each
+// 8 byte aligned, in the byte order of the machine that wrote them.
+struct symindex_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint8_t uuid[16];
+    uint64_t binary_size;
+    uint32_t count;
+    uint32_t nnames;
+    uint32_t naddresses;
+    uint32_t strsize;
+    uint64_t value_offset;
+    uint64_t strx_offset;
+    uint64_t addresses_offset;
+    uint64_t names_offset;
+    uint64_t desc_offset;
+    uint64_t type_offset;
+    uint64_t sect_offset;
+    uint64_t strtbl_offset;
+    uint64_t file_size;
+};
+
+// Builds the index for the symbol table of the parsed file, which must outlive
+// it. A file without a symbol table gets an empty index.
+void symindex_build(struct symindex* index, const struct macho* macho);
+void symindex_free(struct symindex* index);
+
+// Writes index as a sidecar file at path, keyed by the UUID and size of the
+// binary it was built from. The file is replaced atomically. Returns 0 on
+// success, or nonzero with errno set.
+int symindex_write(const struct symindex* index, const uint8_t uuid[16],
+                   uint64_t binary_size, const char* path);
+
+// Maps the sidecar index file at path. Returns false, leaving index empty, if
+// it does not exist, is malformed, or is stale: written by another version or
+// for a binary with a different UUID or size.
+bool symindex_open(struct symindex* index, const char* path,
+                   const uint8_t uuid[16], uint64_t binary_size);
+
+// The hash of a symbol name used for the names table.
+uint32_t symindex_hash(const char* name, size_t length);
+
+// The name of the symbol, or "" if it has none.
+const char* symindex_name(const struct symindex* index, uint32_t symbol);
+
+// Finds the symbols named name, one per call. *cursor must be 0 before the
+// first call. Returns SYMINDEX_NONE once there are no more.
+uint32_t symindex_find(const struct symindex* index, const char* name,
+                       uint32_t* cursor);
+
+// Finds the symbol with the greatest address not above address.
+uint32_t symindex_lookup(const struct symindex* index, uint64_t address);
@@ -0,0 +1,17 @@
+// include/verify.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include "dump.h"
+
+struct out;
+
+// Recomputes the page hashes in the LC_CODE_SIGNATURE of the Mach-O file in
+// buffer, or of the slice of a universal binary selected by mach_select,
+// using up to threads threads, and reports the CodeDirectory and every page
+// that does not match in the given format. Returns DumpErrorHashMismatch if
+// any page does not. The signature itself is not validated.
+enum dump_error verify_dump(struct out* out, void* buffer, size_t length,
+                            enum dump_format format, unsigned threads);
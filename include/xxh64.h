@@ -0,0 +1,12 @@
+// include/xxh64.h
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hashes length bytes at data with XXH64, a fast non-cryptographic hash, for
+// telling apart blocks of contents. Its four independent lanes keep the
+// pipeline full, so it runs at close to memory bandwidth.
+uint64_t xxh64(const void* data, size_t length, uint64_t seed);
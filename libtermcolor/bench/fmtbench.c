@@ -0,0 +1,52 @@
+// libtermcolor: bench/fmtbench.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+// Measures the per-line cost of printing a typical colorized line through the
+// uncached (tcol_fprintf) and cached (tcol_cfprintf) paths, with and without
+// color, into /dev/null so that only libtermcolor and stdio are measured.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "termcolor.h"
+#include <stdint.h>
+#include <time.h>
+
+#define LINES 2000000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(FILE* sink, bool cached) {
+    const double start = now();
+    for (uint32_t i = 0; i < LINES; i++) {
+        if (cached) {
+            tcol_cfprintf(sink, "    │ Type: {Y}0x%02x{0}: {+}N_SECT{0}\n",
+                          i & 0xff);
+        } else {
+            tcol_fprintf(sink, "    │ Type: {Y}0x%02x{0}: {+}N_SECT{0}\n",
+                         i & 0xff);
+        }
+    }
+    return (now() - start) / LINES * 1e9;
+}
+
+int main(void) {
+    FILE* sink = fopen("/dev/null", "w");
+    if (!sink) {
+        perror("fopen");
+        return 1;
+    }
+    for (int color = 1; color >= 0; color--) {
+        tcol_override_color_checks(color);
+        const double uncached = run(sink, false);
+        const double cached = run(sink, true);
+        printf("%-8s  tcol_fprintf: %6.1f ns/line  tcol_cfprintf: %6.1f "
+               "ns/line  (%.2fx)\n", color ? "color" : "no-color", uncached,
+               cached, uncached / cached);
+    }
+    fclose(sink);
+    return 0;
+}
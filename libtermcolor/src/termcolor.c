@@ -3,17 +3,22 @@
 
 #include "termcolor.h"
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
 static bool use_color = true;
+static bool stats_enabled = false;
+static uint64_t (*stats_clock)(void);
+static struct tcol_stats stats;
 
 const char* tcol_errorstrs[TERM_COLOR_ERROR_COUNT] = {
     "Success",
     "Virtual memory exhausted",
     "Printing failed",
     "Invalid color provided",
-    "Color was not terminated with '}'"
+    "Color was not terminated with '}'",
+    "Format string cache is full"
 };
 
 inline const char* tcol_errorstr(const enum term_color_error_t err) {
@@ -24,6 +29,37 @@ void tcol_override_color_checks(bool enable_color) {
     use_color = enable_color;
 }
 
+void tcol_enable_stats(uint64_t (*clock)(void)) {
+    stats_clock = clock;
+    stats_enabled = true;
+}
+
+void tcol_get_stats(struct tcol_stats* result) {
+    result->allocations = __atomic_load_n(&stats.allocations,
+                                          __ATOMIC_RELAXED);
+    result->translations = __atomic_load_n(&stats.translations,
+                                           __ATOMIC_RELAXED);
+    result->translation_time = __atomic_load_n(&stats.translation_time,
+                                               __ATOMIC_RELAXED);
+}
+
+// Counts a translation and the allocation made for it, and times it.
+static inline uint64_t tcol_stats_begin(void) {
+    if (!stats_enabled) {
+        return 0;
+    }
+    __atomic_fetch_add(&stats.allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.translations, 1, __ATOMIC_RELAXED);
+    return stats_clock();
+}
+
+static inline void tcol_stats_end(uint64_t start) {
+    if (stats_enabled) {
+        __atomic_fetch_add(&stats.translation_time, stats_clock() - start,
+                           __ATOMIC_RELAXED);
+    }
+}
+
 int _termcolor_internal_lookup(const char color_name) {
     switch (color_name) {
         case 'N': return 30;
@@ -257,11 +293,13 @@ static int tcol_vfprintf(FILE* stream, const char* fmt, va_list ap) {
     const size_t n = l * 2 + 16;
 
     // Allocates and produces the new format string.
+    const uint64_t start = tcol_stats_begin();
     char* buffer = malloc(n);
     if (buffer == NULL) {
         return TermColorErrorAllocationFailed;
     }
     const int status = tcol_fmt_parse(buffer, n, fmt, l);
+    tcol_stats_end(start);
     if (status != TermColorErrorNone) {
         free(buffer);
         return status;
@@ -281,8 +319,97 @@ static int tcol_vfprintf(FILE* stream, const char* fmt, va_list ap) {
     return TermColorErrorNone;
 }
 
+// The format string cache is an open-addressed table of immutable entries keyed
+// by the address of the format string and whether color was enabled when it was
+// translated. Slots are only ever filled, never cleared, so readers need no lock:
+// an entry is published with a single compare-and-swap after it is fully built.
+#define TCOL_CACHE_SIZE 4096
+
+struct tcol_cache_entry {
+    const char* fmt;
+    bool color;
+    char translated[];
+};
+
+static struct tcol_cache_entry* tcol_cache[TCOL_CACHE_SIZE];
+
+static inline size_t tcol_cache_hash(const char* fmt, bool color) {
+    uint64_t key = (uint64_t)(uintptr_t)fmt ^ (uint64_t)color;
+    key *= 0x9e3779b97f4a7c15ull;
+    return (size_t)(key >> 52) & (TCOL_CACHE_SIZE - 1);
+}
+
+static int tcol_cache_entry_create(const char* fmt, bool color,
+                                   struct tcol_cache_entry** entry) {
+    const size_t l = strlen(fmt);
+    const size_t n = l * 2 + 16;
+
+    const uint64_t start = tcol_stats_begin();
+    struct tcol_cache_entry* fresh = malloc(sizeof(*fresh) + n);
+    if (fresh == NULL) {
+        return TermColorErrorAllocationFailed;
+    }
+    const int status = tcol_fmt_parse(fresh->translated, n, fmt, l);
+    tcol_stats_end(start);
+    if (status != TermColorErrorNone) {
+        free(fresh);
+        return status;
+    }
+    fresh->fmt = fmt;
+    fresh->color = color;
+    *entry = fresh;
+    return TermColorErrorNone;
+}
+
+int tcol_fmt_cached(const char* fmt, const char** translated) {
+    const bool color = use_color;
+    size_t slot = tcol_cache_hash(fmt, color);
+    for (size_t probe = 0; probe < TCOL_CACHE_SIZE; probe++) {
+        struct tcol_cache_entry* entry = __atomic_load_n(&tcol_cache[slot],
+                                                         __ATOMIC_ACQUIRE);
+        if (entry == NULL) {
+            // Miss: translate and try to claim the empty slot. If another
+            // thread got there first, its entry is examined like any other.
+            struct tcol_cache_entry* fresh;
+            const int status = tcol_cache_entry_create(fmt, color, &fresh);
+            if (status != TermColorErrorNone) {
+                return status;
+            }
+            if (__atomic_compare_exchange_n(&tcol_cache[slot], &entry, fresh,
+                                            false, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                *translated = fresh->translated;
+                return TermColorErrorNone;
+            }
+            free(fresh);
+        }
+        if (entry->fmt == fmt && entry->color == color) {
+            *translated = entry->translated;
+            return TermColorErrorNone;
+        }
+        slot = (slot + 1) & (TCOL_CACHE_SIZE - 1);
+    }
+    return TermColorErrorCacheFull;
+}
+
+static int tcol_cvfprintf(FILE* stream, const char* fmt, va_list ap) {
+    const char* translated;
+    const int status = tcol_fmt_cached(fmt, &translated);
+    if (status == TermColorErrorCacheFull) {
+        return tcol_vfprintf(stream, fmt, ap);
+    }
+    if (status != TermColorErrorNone) {
+        return status;
+    }
+    if (vfprintf(stream, translated, ap) < 0) {
+        return TermColorErrorPrintingFailed;
+    }
+    return TermColorErrorNone;
+}
+
 // These functions just create a variable argument list and call tcol_vfprintf
-// with the appropriate FILE* stream.
+// (or tcol_cvfprintf for the cached variants) with the appropriate FILE*
+// stream.
 int tcol_fprintf(FILE* stream, const char* fmt, ...) {
       va_list ap;
       va_start(ap, fmt);
@@ -297,3 +424,17 @@ int tcol_printf(const char* fmt, ...) {
       va_end(ap);
       return status;
 }
+int tcol_cfprintf(FILE* stream, const char* fmt, ...) {
+      va_list ap;
+      va_start(ap, fmt);
+      const int status = tcol_cvfprintf(stream, fmt, ap);
+      va_end(ap);
+      return status;
+}
+int tcol_cprintf(const char* fmt, ...) {
+      va_list ap;
+      va_start(ap, fmt);
+      const int status = tcol_cvfprintf(stdout, fmt, ap);
+      va_end(ap);
+      return status;
+}
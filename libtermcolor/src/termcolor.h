@@ -5,6 +5,7 @@
 #define _LIBTERMCOLOR_TERMCOLOR_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 // A type describing an libtermcolor error. These are the only value returned by
@@ -16,6 +17,7 @@ enum term_color_error_t {
     TermColorErrorPrintingFailed = 2,
     TermColorErrorInvalidColor = 3,
     TermColorErrorUnterminatedColor = 4,
+    TermColorErrorCacheFull = 5,
     TERM_COLOR_ERROR_COUNT
 };
 
@@ -30,12 +32,39 @@ const char* tcol_errorstr(const enum term_color_error_t err);
 // overridden using this function.
 void tcol_override_color_checks(bool enable_color);
 
+// Counts of the work libtermcolor has done since tcol_enable_stats, for
+// profiling: heap allocations, including the temporary format strings of
+// tcol_fprintf and tcol_printf, and markup translations and the time they
+// took, as measured by the clock given to tcol_enable_stats.
+struct tcol_stats {
+    size_t allocations;
+    size_t translations;
+    uint64_t translation_time;
+};
+
+// Turns the counters on. Until then each translation costs one extra branch.
+void tcol_enable_stats(uint64_t (*clock)(void));
+void tcol_get_stats(struct tcol_stats* stats);
+
 // Printfs the colorized format string to the specified stream.
 int tcol_fprintf(FILE* stream, const char* fmt, ...);
 
 // Printfs the colorized format string to the standard output.
 int tcol_printf(const char* fmt, ...);
 
+// Translates the colorized format string into a plain printf format string
+// once and caches the result by the address of fmt, so fmt must be a string
+// literal or otherwise outlive and never change under the cache. On success the
+// translation is stored in *translated and stays valid for the lifetime of the
+// program. Safe to call from multiple threads.
+int tcol_fmt_cached(const char* fmt, const char** translated);
+
+// Like tcol_fprintf and tcol_printf, but the format string is translated
+// through tcol_fmt_cached, so only the final vfprintf runs on repeated calls.
+// The same restrictions on fmt apply.
+int tcol_cfprintf(FILE* stream, const char* fmt, ...);
+int tcol_cprintf(const char* fmt, ...);
+
 
 // parses a termcolor color and puts result in dest
 int tcol_color_parse(char* dst, size_t dstn, char color[16],
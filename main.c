@@ -1,33 +1,386 @@
 // main.c
 // Copyright (C) 2021 Ethan Uppal. All rights reserved.
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include "include/diff.h"
 #include "include/dump.h"
+#include "include/fingerprint.h"
+#include "include/json.h"
+#include "include/mapfile.h"
+#include "include/out.h"
+#include "include/partial.h"
+#include "include/pool.h"
+#include "include/query.h"
+#include "include/scan.h"
+#include "include/stats.h"
+#include "include/symindex.h"
+#include "include/verify.h"
 #include "include/safe.h"
+#include "libtermcolor/src/termcolor.h"
 
-void driver(const char* filename) {
-    FILE* file = xfopen(filename, "r");
-    xfseek(file, 0, SEEK_END);
-    const size_t length = xftell(file);
-    xrewind(file);
+#define MAX_JOBS 256
 
-    void* buffer = xmalloc(length);
-    xfread(buffer, sizeof(char), length, file);
+// The outcome of dumping one file. Exactly one of open_errno and error is set
+// when the dump failed.
+struct job {
+    const char* filename;
+    struct out* out;
+    int open_errno;
+    enum dump_error error;
+};
 
-    xfclose(file);
+static enum dump_format format = DumpFormatText;
+static enum query_kind query_kind = QueryNone;
+static struct query_list queries;
+static bool show_filenames = false;
+static bool write_index = false;
+static bool verify_signature = false;
+static bool fingerprint = false;
+static bool compare_files = false;
+static bool show_stats = false;
+static bool stats_json = false;
+static bool recursive = false;
+static bool summary_only = false;
+static bool partial_reads = false;
+// How many files of each kind sniffing found, for the --summary totals.
+static size_t scan_counts[SCAN_KIND_COUNT];
+// The threads each file may use on its own, once the files are shared out.
+static unsigned file_threads = 1;
 
-    mach_dump(buffer, length);
+// Maps a file, as the read phase of --stats.
+static int read_file(const char* filename, struct mapped_file* file) {
+    const uint64_t start = stats_begin();
+    const int status = map_file(filename, file);
+    stats_end(StatsPhaseRead, start);
+    if (status == 0) {
+        stats_add(StatsBytesRead, file->length);
+    }
+    return status;
+}
+
+// Reads just the parts of a file that are dumped into partial, as the read
+// phase of --stats, and views them as a mapped file.
+static int read_parts(const char* filename, struct partial_file* partial,
+                      struct mapped_file* file) {
+    const uint64_t start = stats_begin();
+    int status = partial_open(filename, partial);
+    if (status == 0 && mach_fetch(partial) != 0) {
+        const int errnum = errno;
+        partial_close(partial);
+        errno = errnum;
+        status = 1;
+    }
+    stats_end(StatsPhaseRead, start);
+    if (status == 0) {
+        stats_add(StatsBytesRead, partial->bytes_read);
+        file->buffer = partial->buffer;
+        file->length = partial->length;
+        file->mapped = false;
+    }
+    return status;
+}
+
+// Reads the first few bytes of a file, as the read phase of --stats.
+static int sniff_file(const char* filename, struct scan_sniff* sniff) {
+    const uint64_t start = stats_begin();
+    const int errnum = scan_sniff(filename, sniff);
+    stats_end(StatsPhaseRead, start);
+    stats_add(StatsBytesRead, errnum == 0 ? sniff->bytes_read : 0);
+    return errnum;
+}
+
+// Files found by -r, and every file with --summary, are sniffed first, so
+// that the ones machdump does not dump are never read in full. Those found by
+// -r are then skipped without a word, as the walk would come across them.
+static bool sniff_job(struct job* job, bool json, bool ndjson) {
+    struct scan_sniff sniff;
+    const int errnum = sniff_file(job->filename, &sniff);
+    if (errnum == 0) {
+        __atomic_fetch_add(&scan_counts[sniff.kind], 1, __ATOMIC_RELAXED);
+    }
+    if (errnum == 0 && sniff.kind == ScanKindNone && recursive) {
+        return false;
+    }
+    if (errnum == 0 && sniff.kind != ScanKindNone && !summary_only) {
+        return true;
+    }
+    if (errnum != 0) {
+        job->open_errno = errnum;
+    } else if (sniff.kind == ScanKindNone) {
+        job->error = DumpErrorNotMachO64;
+    } else {
+        scan_summary(job->out, job->filename, &sniff, format);
+        return false;
+    }
+    if (json) {
+        json_file_begin(job->out, job->filename, ndjson);
+        json_file_end(job->out, false, errnum != 0 ? strerror(errnum)
+                      : dump_errorstr(job->error), ndjson);
+    }
+    return false;
+}
+
+static void print_filename(const struct job* job) {
+    if (show_filenames && format == DumpFormatText) {
+        out_puts(job->out, job->filename);
+        out_puts(job->out, ":\n");
+    }
+}
+
+// In the JSON formats every file gets a record, including the ones that could
+// not be dumped, so failures are reported in the output as well as on stderr.
+static void run_job(struct job* job) {
+    const bool json = format != DumpFormatText;
+    const bool ndjson = format == DumpFormatNDJSON;
+    if ((recursive || summary_only) && !sniff_job(job, json, ndjson)) {
+        return;
+    }
+    if (json) {
+        json_file_begin(job->out, job->filename, ndjson);
+    }
+    // Only plain dumps know which parts of the file they need.
+    const bool parts = partial_reads && !write_index && !verify_signature
+                       && !fingerprint && query_kind == QueryNone;
+    struct mapped_file file;
+    struct partial_file partial;
+    if ((parts ? read_parts(job->filename, &partial, &file)
+               : read_file(job->filename, &file)) != 0) {
+        job->open_errno = errno;
+        if (json) {
+            json_file_end(job->out, false, strerror(job->open_errno), ndjson);
+        }
+        return;
+    }
+    // The sidecar index of a binary lives next to it.
+    const size_t length = strlen(job->filename);
+    char* index_path = xmalloc(length + sizeof(SYMINDEX_SUFFIX));
+    if (index_path) {
+        memcpy(index_path, job->filename, length);
+        memcpy(index_path + length, SYMINDEX_SUFFIX, sizeof(SYMINDEX_SUFFIX));
+    }
+    if (write_index) {
+        job->error = index_path
+                     ? query_write_index(file.buffer, file.length, index_path)
+                     : DumpErrorIndexWrite;
+    } else if (verify_signature) {
+        print_filename(job);
+        job->error = verify_dump(job->out, file.buffer, file.length, format,
+                                 file_threads);
+    } else if (fingerprint) {
+        job->error = fingerprint_dump(job->out, job->filename, file.buffer,
+                                      file.length, format, file_threads);
+    } else if (query_kind != QueryNone) {
+        print_filename(job);
+        job->error = query_dump(job->out, file.buffer, file.length,
+                                query_kind, &queries, format, index_path);
+    } else {
+        // The files of a tree are told apart by name.
+        if (recursive) {
+            print_filename(job);
+        }
+        job->error = mach_dump(job->out, file.buffer, file.length);
+    }
+    xfree(index_path);
+    if (parts) {
+        partial_close(&partial);
+    } else {
+        unmap_file(&file);
+    }
+    if (json) {
+        json_file_end(job->out, !write_index, job->error != DumpErrorNone
+                      ? dump_errorstr(job->error) : NULL, ndjson);
+    }
+}
+
+static int report_job(const struct job* job) {
+    if (job->open_errno != 0) {
+        tcol_fprintf(stderr, "machdump: {R+}error:{0} %s: %s\n",
+                     job->filename, strerror(job->open_errno));
+        return 1;
+    }
+    if (job->error != DumpErrorNone) {
+        tcol_fprintf(stderr, "machdump: {R+}error:{0} %s: %s\n",
+                     job->filename, dump_errorstr(job->error));
+        return 1;
+    }
+    return 0;
+}
+
+int driver(struct out* out, const char* filename) {
+    struct job job = { filename, out, 0, DumpErrorNone };
+    run_job(&job);
+    out_flush(out);
+    return report_job(&job);
+}
+
+// Compares two files, exiting as diff(1) does: 0 if they are the same, 1 if
+// they differ and 2 if either could not be read.
+static int diff_driver(struct out* out, const char* filenames[],
+                       unsigned threads) {
+    struct mapped_file mapped[2];
+    struct diff_file files[2];
+    int status = 0;
+    for (int i = 0; i < 2; i++) {
+        struct job job = { filenames[i], out, 0, DumpErrorNone };
+        if (read_file(filenames[i], &mapped[i]) != 0) {
+            job.open_errno = errno;
+            report_job(&job);
+            if (i == 1) {
+                unmap_file(&mapped[0]);
+            }
+            return 2;
+        }
+        files[i].name = filenames[i];
+        files[i].buffer = mapped[i].buffer;
+        files[i].length = mapped[i].length;
+        files[i].error = DumpErrorNone;
+    }
+    if (diff_dump(out, files, format, threads)) {
+        status = 1;
+    }
+    for (int i = 0; i < 2; i++) {
+        struct job job = { filenames[i], out, 0, files[i].error };
+        if (report_job(&job) != 0) {
+            status = 2;
+        }
+        unmap_file(&mapped[i]);
+    }
+    return status;
+}
 
-    xfree(buffer);
+// The files being dumped in parallel, with a job and buffer for each of the
+// window files that can be in flight at once.
+struct parallel {
+    struct out* out;
+    const char** filenames;
+    struct job* jobs;
+    struct out* buffers;
+    size_t window;
+    int status;
+};
+
+static void parallel_task(void* context, size_t index) {
+    struct parallel* parallel = context;
+    struct job* job = &parallel->jobs[index % parallel->window];
+    job->filename = parallel->filenames[index];
+    job->out = &parallel->buffers[index % parallel->window];
+    out_init(job->out, -1);
+    job->open_errno = 0;
+    job->error = DumpErrorNone;
+    run_job(job);
+}
+
+static void parallel_emit(void* context, size_t index) {
+    struct parallel* parallel = context;
+    struct job* job = &parallel->jobs[index % parallel->window];
+    out_append(parallel->out, job->out);
+    out_flush(parallel->out);
+    parallel->status |= report_job(job);
+    out_free(job->out);
+}
+
+// Dumps the files on threads threads, each into its own buffer, and emits the
+// buffers in argument order so the output matches a serial run. Threads take
+// the next file as soon as they finish one, so a large file holds up only the
+// output after it, and at most a few files per thread are buffered at once.
+static int parallel_driver(struct out* out, unsigned threads,
+                           const char* filenames[], size_t count) {
+    const size_t window = (size_t)threads * 4;
+    struct parallel parallel = {
+        out, filenames, xmalloc(sizeof(struct job) * window),
+        xmalloc(sizeof(struct out) * window), window, 0
+    };
+    pool_ordered(threads, count, window, parallel_task, parallel_emit,
+                 &parallel);
+    xfree(parallel.buffers);
+    xfree(parallel.jobs);
+    return parallel.status;
+}
+
+static int scan_status = 0;
+
+static void scan_failed(const char* path, int errnum) {
+    tcol_fprintf(stderr, "machdump: {R+}error:{0} %s: %s\n", path,
+                 strerror(errnum));
+    scan_status = 1;
+}
+
+// File failures are reported per file by the driver, so the safe.h helpers
+// only need to stop the process when memory runs out.
+static void handle_failure(enum failure failure) {
+    if (failure == VirtualMemoryExhausted) {
+        fprintf(stderr, "machdump: %s\n", failure_str(failure));
+        exit(1);
+    }
 }
 
 static void print_help(const char* argv[]) {
     printf("Usage: %s [--help|--version]\n"
-           "   or: %s [FILE...]\n"
+           "   or: %s [OPTION...] [FILE...]\n"
            "\n"
-           "Verbatim dumps 64-bit Mach-O object files for low-level "
-           "debugging.\n",
+           "Verbatim dumps 64-bit Mach-O object files, universal binaries and "
+           "static\narchives for low-level debugging.\n"
+           "\n"
+           "Options:\n"
+           "  -j N       Use up to N threads, across files and within large "
+           "files\n"
+           "  --format=FORMAT\n"
+           "             Output text (the default), json (one object per "
+           "file) or\n             ndjson (one record per line)\n"
+           "  --find-symbol=NAME\n"
+           "             Print the symbols named NAME instead of dumping\n"
+           "  --addr2sym=ADDRESS\n"
+           "             Print the symbol containing ADDRESS instead of "
+           "dumping\n"
+           "             Either takes - or @FILE to read one query per line "
+           "from\n             standard input or FILE\n"
+           "  --write-index\n"
+           "             Write a symbol index next to each file, named "
+           "FILE"
+           SYMINDEX_SUFFIX ", which\n"
+           "             --find-symbol and --addr2sym use while it is up to "
+           "date\n"
+           "  --diff     Compare two files structurally instead of dumping "
+           "them, and exit\n             with 1 if they differ\n"
+           "  -r         Dump the Mach-O files, universal binaries and archives "
+           "under each\n             directory, told apart from the rest by "
+           "their first bytes\n"
+           "  --summary  Print one line per file of its kind, architectures and "
+           "size\n             instead of dumping\n"
+           "  --fingerprint\n"
+           "             Print one line per file of hashes of its segments and "
+           "sections,\n             leaving out the UUID and code signature, "
+           "instead of dumping\n"
+           "  --verify-signature-hashes\n"
+           "             Recompute the page hashes of each file's code "
+           "signature and\n             report the pages that do not match "
+           "instead of dumping\n"
+           "  --only=PART,...\n"
+           "             Only dump these parts: header, segments, symtab, "
+           "dysymtab,\n             build and other load commands\n"
+           "  --segment=SEG,...\n"
+           "             Only dump these segments\n"
+           "  --arch=ARCH,...\n"
+           "             Only dump these slices of universal binaries\n"
+           "  --member=NAME,...\n"
+           "             Only dump these members of static archives\n"
+           "  --hexdump[=SECT,...]\n"
+           "             Print the full contents of all or the named sections\n"
+           "  --partial-reads\n"
+           "             Read only the parts of each file that are dumped, with "
+           "pread,\n             instead of mapping it whole, for files on "
+           "network filesystems\n"
+           "  --stdio    Write through stdio instead of the buffered writer\n"
+           "  --stats[=json]\n"
+           "             Print the time spent in each phase and on each type of "
+           "load\n             command and counts of bytes, lines, symbols "
+           "and allocations to\n             standard error, as a table or "
+           "as JSON\n",
            argv[0], argv[0]);
 }
 
@@ -39,17 +392,172 @@ static void print_version(void) {
 int main(int argc, const char* argv[]) {
     if (argc == 1) {
         print_help(argv);
-    } else if (argc == 2) {
-        if (strncmp(argv[1], "--help", 7) == 0) {
+        return 0;
+    }
+
+    bool use_stdio = false;
+    const char* query_arg = NULL;
+    unsigned threads = 1;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(argv[i], "--help") == 0) {
             print_help(argv);
-        } else if (strncmp(argv[1], "--version", 10) == 0) {
+            return 0;
+        } else if (strcmp(argv[i], "--version") == 0) {
             print_version();
+            return 0;
+        } else if (strcmp(argv[i], "--partial-reads") == 0) {
+            partial_reads = true;
+        } else if (strcmp(argv[i], "--stdio") == 0) {
+            use_stdio = true;
+        } else if (strcmp(argv[i], "--stats") == 0
+                   || strcmp(argv[i], "--stats=json") == 0) {
+            show_stats = true;
+            stats_json = argv[i][7] == '=';
+        } else if (strncmp(argv[i], "--format=", 9) == 0) {
+            const char* name = argv[i] + 9;
+            if (strcmp(name, "text") == 0) {
+                format = DumpFormatText;
+            } else if (strcmp(name, "json") == 0) {
+                format = DumpFormatJSON;
+            } else if (strcmp(name, "ndjson") == 0) {
+                format = DumpFormatNDJSON;
+            } else {
+                tcol_fprintf(stderr, "machdump: {R+}error:{0} Unknown format "
+                             "'%s'\n", name);
+                return 1;
+            }
+            dump_set_format(format);
+        } else if (strncmp(argv[i], "--find-symbol=", 14) == 0) {
+            query_kind = QueryFindSymbol;
+            query_arg = argv[i] + 14;
+        } else if (strncmp(argv[i], "--addr2sym=", 11) == 0) {
+            query_kind = QueryAddr2Sym;
+            query_arg = argv[i] + 11;
+        } else if (strcmp(argv[i], "--write-index") == 0) {
+            write_index = true;
+        } else if (strcmp(argv[i], "--diff") == 0) {
+            compare_files = true;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            recursive = true;
+        } else if (strcmp(argv[i], "--summary") == 0) {
+            summary_only = true;
+        } else if (strcmp(argv[i], "--fingerprint") == 0) {
+            fingerprint = true;
+        } else if (strcmp(argv[i], "--verify-signature-hashes") == 0) {
+            verify_signature = true;
+        } else if (strncmp(argv[i], "--only=", 7) == 0) {
+            if (dump_set_only(argv[i] + 7) != 0) {
+                tcol_fprintf(stderr, "machdump: {R+}error:{0} --only expects "
+                             "a list of header, segments, symtab, dysymtab, "
+                             "build and other\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--segment=", 10) == 0) {
+            dump_set_segments(argv[i] + 10);
+        } else if (strncmp(argv[i], "--arch=", 7) == 0) {
+            dump_set_arch(argv[i] + 7);
+        } else if (strncmp(argv[i], "--member=", 9) == 0) {
+            dump_set_members(argv[i] + 9);
+        } else if (strcmp(argv[i], "--hexdump") == 0) {
+            dump_set_hexdump("");
+        } else if (strncmp(argv[i], "--hexdump=", 10) == 0) {
+            dump_set_hexdump(argv[i] + 10);
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            // The count must be all digits: strtol alone would take "4x",
+            // " 4" or "" too.
+            const char* count = argv[i][2] ? argv[i] + 2 : argv[++i];
+            char* end = NULL;
+            const long n = count && count[0] >= '0' && count[0] <= '9'
+                           ? strtol(count, &end, 10) : 0;
+            if (n < 1 || n > MAX_JOBS || *end != '\0') {
+                tcol_fprintf(stderr, "machdump: {R+}error:{0} -j expects a "
+                             "number of jobs from 1 to %d\n", MAX_JOBS);
+                return 1;
+            }
+            threads = (unsigned)n;
         } else {
-            driver(argv[1]);
+            tcol_fprintf(stderr, "machdump: {R+}error:{0} Unknown option "
+                         "'%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    set_failure_handler(handle_failure);
+    if (show_stats) {
+        stats_enable();
+        tcol_enable_stats(stats_clock);
+    }
+    if (query_kind != QueryNone && query_load(&queries, query_arg) != 0) {
+        tcol_fprintf(stderr, "machdump: {R+}error:{0} %s: %s\n",
+                     query_arg[0] == '@' ? query_arg + 1 : "stdin",
+                     strerror(errno));
+        return 1;
+    }
+
+    struct out out;
+    if (use_stdio) {
+        out_init_stdio(&out, stdout);
+    } else {
+        out_init(&out, STDOUT_FILENO);
+    }
+    // With -r the operands are the roots of trees, and the files are whatever
+    // the walk finds under them.
+    struct scan_list tree = { NULL, 0, 0 };
+    const char** filenames = argv + i;
+    size_t files = (size_t)(argc - i);
+    if (recursive && !compare_files) {
+        for (int root = i; root < argc; root++) {
+            scan_tree(&tree, argv[root], scan_failed);
         }
+        filenames = (const char**)tree.paths;
+        files = tree.count;
+    }
+
+    // Spare threads go to rendering the large tables inside each file.
+    show_filenames = files > 1 || recursive;
+    file_threads = files > 0 && threads > files ? threads / files : 1;
+    dump_set_threads(file_threads);
+
+    int status = 0;
+    if (compare_files) {
+        if (files != 2 || recursive) {
+            tcol_fprintf(stderr, "machdump: {R+}error:{0} --diff expects two "
+                         "files%s\n", recursive ? ", not -r" : "");
+            return 2;
+        }
+        status = diff_driver(&out, argv + i, threads);
+    } else if (threads > 1 && files > 1) {
+        status = parallel_driver(&out, threads, filenames, files);
     } else {
-        for (int i = 1; i < argc; i++) {
-            driver(argv[i]);
+        for (size_t file = 0; file < files; file++) {
+            status |= driver(&out, filenames[file]);
+        }
+    }
+    if (summary_only && format == DumpFormatText) {
+        size_t total = 0;
+        for (int kind = 0; kind < SCAN_KIND_COUNT; kind++) {
+            total += scan_counts[kind];
         }
+        out_printf(&out, "%zu file(s) scanned: %zu Mach-O, %zu universal, "
+                   "%zu archive(s)\n", total, scan_counts[ScanKindMachO],
+                   scan_counts[ScanKindFat], scan_counts[ScanKindArchive]);
+    }
+    status |= scan_status;
+    status |= out_flush(&out);
+    scan_free(&tree);
+    out_free(&out);
+    query_free(&queries);
+    if (show_stats) {
+        struct tcol_stats tcol;
+        tcol_get_stats(&tcol);
+        stats_phases[StatsPhaseMarkup] = tcol.translation_time;
+        stats_counters[StatsTermcolorAllocations] = tcol.allocations;
+        stats_counters[StatsTranslations] = tcol.translations;
+        stats_print(stderr, stats_json);
     }
+    return status;
 }
@@ -0,0 +1,224 @@
+// src/archive.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "archive.h"
+#include "safe.h"
+#include <ar.h>
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// The prefix of a BSD long name, which is followed by the name's length.
+#define ARCHIVE_LONG_NAME "#1/"
+#define ARCHIVE_SYMDEF "__.SYMDEF"
+#define ARCHIVE_SYMDEF_64 "__.SYMDEF_64"
+#define ARCHIVE_SORTED " SORTED"
+
+bool archive_is(const void* buffer, size_t length) {
+    return length >= SARMAG && memcmp(buffer, ARMAG, SARMAG) == 0;
+}
+
+struct archive_iter archive_members(const void* buffer, size_t length) {
+    struct archive_iter it = { buffer, length, SARMAG, false };
+    return it;
+}
+
+// Reads a header field of n ASCII digits in the given base, padded with
+// spaces on the right. Returns false if there are no digits or anything but
+// padding follows them.
+local bool archive_number(const char* field, size_t n, unsigned base,
+                          uint64_t* value) {
+    size_t i = 0;
+    *value = 0;
+    for (; i < n && field[i] >= '0' && field[i] < (char)('0' + base); i++) {
+        *value = *value * base + (uint64_t)(field[i] - '0');
+    }
+    if (i == 0) {
+        return false;
+    }
+    for (; i < n; i++) {
+        if (field[i] != ' ') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stops iteration, as at the end of the archive, marking it malformed.
+local bool archive_stop(struct archive_iter* it) {
+    it->next = it->length;
+    it->malformed = true;
+    return false;
+}
+
+bool archive_next(struct archive_iter* it, struct archive_member* member) {
+    if (it->next >= it->length) {
+        return false;
+    }
+    if (it->length - it->next < sizeof(S(ar_hdr))) {
+        return archive_stop(it);
+    }
+    const S(ar_hdr*) header = (const void*)(it->data + it->next);
+    uint64_t size, date, uid, gid, mode;
+    if (memcmp(header->ar_fmag, ARFMAG, sizeof(header->ar_fmag)) != 0
+        || !archive_number(header->ar_size, sizeof(header->ar_size), 10,
+                           &size)
+        || size > it->length - it->next - sizeof(*header)) {
+        return archive_stop(it);
+    }
+    // The rest are informational, so blank or garbled fields read as zero.
+    if (!archive_number(header->ar_date, sizeof(header->ar_date), 10, &date)) {
+        date = 0;
+    }
+    if (!archive_number(header->ar_uid, sizeof(header->ar_uid), 10, &uid)) {
+        uid = 0;
+    }
+    if (!archive_number(header->ar_gid, sizeof(header->ar_gid), 10, &gid)) {
+        gid = 0;
+    }
+    if (!archive_number(header->ar_mode, sizeof(header->ar_mode), 8, &mode)) {
+        mode = 0;
+    }
+    member->header = it->next;
+    member->offset = it->next + sizeof(*header);
+    member->size = size;
+    member->date = date;
+    member->uid = (uint32_t)uid;
+    member->gid = (uint32_t)gid;
+    member->mode = (uint32_t)mode;
+
+    const size_t prefix = sizeof(ARCHIVE_LONG_NAME) - 1;
+    uint64_t name_length;
+    if (memcmp(header->ar_name, ARCHIVE_LONG_NAME, prefix) == 0) {
+        if (!archive_number(header->ar_name + prefix,
+                            sizeof(header->ar_name) - prefix, 10,
+                            &name_length)
+            || name_length > size) {
+            return archive_stop(it);
+        }
+        // Long names are padded with NULs to keep the contents aligned.
+        member->name = it->data + member->offset;
+        member->offset += name_length;
+        member->size -= name_length;
+    } else {
+        member->name = header->ar_name;
+        name_length = sizeof(header->ar_name);
+        while (name_length > 0 && member->name[name_length - 1] == ' ') {
+            name_length--;
+        }
+    }
+    const char* end = memchr(member->name, '\0', (size_t)name_length);
+    member->name_length = end ? (size_t)(end - member->name)
+                              : (size_t)name_length;
+
+    // Members start on even offsets.
+    it->next = member->offset + member->size + (size & 1);
+    return true;
+}
+
+local bool archive_name_is(const struct archive_member* member,
+                           const char* name) {
+    const size_t length = strlen(name);
+    const size_t sorted = sizeof(ARCHIVE_SORTED) - 1;
+    return member->name_length >= length
+           && memcmp(member->name, name, length) == 0
+           && (member->name_length == length
+               || (member->name_length == length + sorted
+                   && memcmp(member->name + length, ARCHIVE_SORTED, sorted)
+                      == 0));
+}
+
+bool archive_is_symdef(const struct archive_member* member) {
+    return archive_name_is(member, ARCHIVE_SYMDEF)
+           || archive_name_is(member, ARCHIVE_SYMDEF_64);
+}
+
+// Fields of the ranlib table are little-endian words of 4 bytes, or 8 in
+// __.SYMDEF_64.
+local uint64_t archive_word(const unsigned char* p, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = width; i > 0; i--) {
+        value = value << 8 | p[i - 1];
+    }
+    return value;
+}
+
+// The table is the size in bytes of the ranlib entries, the entries as pairs
+// of string offset and member header offset, the size of the strings and the
+// strings.
+void archive_symbols_decode(struct archive_symbols* symbols,
+                            const void* buffer,
+                            const struct archive_member* symdef) {
+    memset(symbols, 0, sizeof(*symbols));
+    const unsigned char* data = (const unsigned char*)buffer + symdef->offset;
+    const uint64_t size = symdef->size;
+    const size_t width = archive_name_is(symdef, ARCHIVE_SYMDEF_64) ? 8 : 4;
+    if (size < width) {
+        symbols->malformed = true;
+        return;
+    }
+    uint64_t entries_size = archive_word(data, width);
+    if (entries_size > size - width || entries_size % (2 * width) != 0) {
+        symbols->malformed = true;
+        entries_size = (size - width) / (2 * width) * (2 * width);
+    }
+    const unsigned char* entries = data + width;
+    const char* strings = NULL;
+    uint64_t strings_size = 0;
+    if (size - width - entries_size >= width) {
+        strings = (const char*)entries + entries_size + width;
+        strings_size = archive_word(entries + entries_size, width);
+        if (strings_size > size - width - entries_size - width) {
+            symbols->malformed = true;
+            strings_size = size - width - entries_size - width;
+        }
+    } else {
+        symbols->malformed = true;
+    }
+
+    const size_t count = (size_t)(entries_size / (2 * width));
+    symbols->entries = xmalloc(sizeof(*symbols->entries)
+                               * (count ? count : 1));
+    if (!symbols->entries) {
+        symbols->malformed = true;
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        struct archive_symbol* symbol = &symbols->entries[i];
+        const uint64_t name = archive_word(entries + 2 * width * i, width);
+        symbol->member = archive_word(entries + 2 * width * i + width, width);
+        if (name < strings_size) {
+            const char* end = memchr(strings + name, '\0',
+                                     (size_t)(strings_size - name));
+            symbol->name = strings + name;
+            symbol->name_length = end ? (size_t)(end - symbol->name)
+                                      : (size_t)(strings_size - name);
+        } else {
+            symbol->name = "";
+            symbol->name_length = 0;
+        }
+    }
+    symbols->count = count;
+}
+
+void archive_symbols_free(struct archive_symbols* symbols) {
+    xfree(symbols->entries);
+    symbols->entries = NULL;
+    symbols->count = 0;
+}
+
+size_t archive_find_member(const struct archive_member* members, size_t count,
+                           uint64_t header) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (members[mid].header < header) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < count && members[low].header == header ? low : ARCHIVE_NONE;
+}
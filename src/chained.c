@@ -0,0 +1,522 @@
+// src/chained.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "chained.h"
+#include "pool.h"
+#include "safe.h"
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// Pages are handed to the pool this many at a time, since most chains are
+// short and a task per page would spend its time on the handoff.
+#define CHAINED_PAGES_PER_TASK 64
+
+// The fixed part of dyld_chained_starts_in_segment, before page_start.
+#define CHAINED_STARTS_SIZE \
+    offsetof(struct dyld_chained_starts_in_segment, page_start)
+
+static const char* chained_format_names[] = {
+    [DYLD_CHAINED_PTR_ARM64E] = "DYLD_CHAINED_PTR_ARM64E",
+    [DYLD_CHAINED_PTR_64] = "DYLD_CHAINED_PTR_64",
+    [DYLD_CHAINED_PTR_32] = "DYLD_CHAINED_PTR_32",
+    [DYLD_CHAINED_PTR_32_CACHE] = "DYLD_CHAINED_PTR_32_CACHE",
+    [DYLD_CHAINED_PTR_32_FIRMWARE] = "DYLD_CHAINED_PTR_32_FIRMWARE",
+    [DYLD_CHAINED_PTR_64_OFFSET] = "DYLD_CHAINED_PTR_64_OFFSET",
+    [DYLD_CHAINED_PTR_ARM64E_KERNEL] = "DYLD_CHAINED_PTR_ARM64E_KERNEL",
+    [DYLD_CHAINED_PTR_64_KERNEL_CACHE] = "DYLD_CHAINED_PTR_64_KERNEL_CACHE",
+    [DYLD_CHAINED_PTR_ARM64E_USERLAND] = "DYLD_CHAINED_PTR_ARM64E_USERLAND",
+    [DYLD_CHAINED_PTR_ARM64E_FIRMWARE] = "DYLD_CHAINED_PTR_ARM64E_FIRMWARE",
+    [DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE] =
+        "DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE",
+    [DYLD_CHAINED_PTR_ARM64E_USERLAND24] =
+        "DYLD_CHAINED_PTR_ARM64E_USERLAND24",
+};
+
+const char* chained_format_name(uint16_t pointer_format) {
+    return pointer_format < sizeof(chained_format_names)
+                            / sizeof(*chained_format_names)
+        ? chained_format_names[pointer_format] : NULL;
+}
+
+// How far apart the units of a format's next field are, or 0 for the 32-bit
+// formats, which cannot occur in a 64-bit image and are not decoded.
+local unsigned chained_stride(uint16_t pointer_format) {
+    switch (pointer_format) {
+        case DYLD_CHAINED_PTR_ARM64E:
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+            return 8;
+        case DYLD_CHAINED_PTR_64:
+        case DYLD_CHAINED_PTR_64_OFFSET:
+        case DYLD_CHAINED_PTR_ARM64E_KERNEL:
+        case DYLD_CHAINED_PTR_ARM64E_FIRMWARE:
+        case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+            return 4;
+        case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+local uint64_t chained_bits(uint64_t raw, unsigned shift, unsigned width) {
+    return (raw >> shift) & ((UINT64_C(1) << width) - 1);
+}
+
+local int64_t chained_signed_bits(uint64_t raw, unsigned shift,
+                                  unsigned width) {
+    const uint64_t value = chained_bits(raw, shift, width);
+    const uint64_t sign = UINT64_C(1) << (width - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+// Decodes one raw pointer of the given format, whose rebase targets are
+// relative to base where the format says so, and returns its next field.
+// The pointer layouts are those of the dyld_chained_ptr_* structs, read with
+// shifts rather than bitfields so as not to depend on the compiler's layout.
+local uint64_t chained_decode(uint64_t raw, uint16_t format, uint64_t base,
+                              struct chained_fixup* fixup) {
+    fixup->import = CHAINED_NONE;
+    fixup->target = 0;
+    fixup->diversity = 0;
+    fixup->flags = 0;
+    fixup->key = 0;
+    switch (format) {
+        case DYLD_CHAINED_PTR_64:
+        case DYLD_CHAINED_PTR_64_OFFSET:
+            if (raw >> 63) {
+                fixup->flags = ChainedFlagBind;
+                fixup->import = (uint32_t)chained_bits(raw, 0, 24);
+                fixup->target = chained_bits(raw, 24, 8);
+            } else {
+                fixup->target = chained_bits(raw, 0, 36)
+                                | chained_bits(raw, 36, 8) << 56;
+                if (format == DYLD_CHAINED_PTR_64_OFFSET) {
+                    fixup->target += base;
+                }
+            }
+            return chained_bits(raw, 51, 12);
+        case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+        case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+            fixup->target = base + chained_bits(raw, 0, 30);
+            fixup->diversity = (uint16_t)chained_bits(raw, 32, 16);
+            fixup->key = (uint8_t)chained_bits(raw, 49, 2);
+            if (raw >> 63) {
+                fixup->flags = ChainedFlagAuth;
+            }
+            if (chained_bits(raw, 48, 1)) {
+                fixup->flags |= ChainedFlagAddressDiversity;
+            }
+            return chained_bits(raw, 51, 12);
+        default: {
+            // The arm64e formats, which differ only in the width of a bind's
+            // ordinal and in whether plain rebase targets are addresses.
+            const bool auth = raw >> 63;
+            const bool bind = (raw >> 62) & 1;
+            const unsigned ordinal =
+                format == DYLD_CHAINED_PTR_ARM64E_USERLAND24 ? 24 : 16;
+            if (auth) {
+                fixup->flags = ChainedFlagAuth;
+                fixup->diversity = (uint16_t)chained_bits(raw, 32, 16);
+                fixup->key = (uint8_t)chained_bits(raw, 49, 2);
+                if (chained_bits(raw, 48, 1)) {
+                    fixup->flags |= ChainedFlagAddressDiversity;
+                }
+            }
+            if (bind) {
+                fixup->flags |= ChainedFlagBind;
+                fixup->import = (uint32_t)chained_bits(raw, 0, ordinal);
+                if (!auth) {
+                    fixup->target =
+                        (uint64_t)chained_signed_bits(raw, 32, 19);
+                }
+            } else if (auth) {
+                fixup->target = base + chained_bits(raw, 0, 32);
+            } else {
+                fixup->target = chained_bits(raw, 0, 43)
+                                | chained_bits(raw, 43, 8) << 56;
+                if (format != DYLD_CHAINED_PTR_ARM64E) {
+                    fixup->target += base;
+                }
+            }
+            return chained_bits(raw, 51, 11);
+        }
+    }
+}
+
+// One chain: the page it lies in and where in the page it starts.
+struct chained_page {
+    uint32_t starts;
+    uint16_t page;
+    uint16_t start;
+};
+
+// What a chain walk found wrong, kept per chain so that concurrent walks
+// never write the same memory.
+enum chained_problem {
+    ChainedProblemChain = 1 << 0,
+    ChainedProblemImport = 1 << 1
+};
+
+struct chained_walk {
+    const struct macho* macho;
+    const struct chained_fixups* fixups;
+    const struct chained_page* pages;
+    size_t npages;
+    uint64_t base;
+    // Per chain: in the first pass how many fixups it has, in the second
+    // where its first one goes.
+    size_t* counts;
+    uint8_t* problems;
+    bool fill;
+};
+
+// Follows the chain, counting its fixups or, once they have places, storing
+// them. A chain must stay within its page and the file.
+local size_t chained_walk_page(const struct chained_walk* walk, size_t index,
+                               struct chained_fixup* out) {
+    const struct chained_page* page = &walk->pages[index];
+    const struct chained_starts* starts = &walk->fixups->starts[page->starts];
+    const S(segment_command_64*) segment =
+        &walk->macho->segments[starts->segment].command;
+    const uint64_t page_offset = (uint64_t)page->page * starts->page_size;
+    uint64_t page_size = starts->page_size;
+    if (page_offset >= segment->filesize) {
+        walk->problems[index] |= ChainedProblemChain;
+        return 0;
+    }
+    if (segment->filesize - page_offset < page_size) {
+        page_size = segment->filesize - page_offset;
+    }
+    const unsigned char* data =
+        macho_data(walk->macho, segment->fileoff + page_offset, page_size);
+    if (!data) {
+        walk->problems[index] |= ChainedProblemChain;
+        return 0;
+    }
+
+    const unsigned stride = chained_stride(starts->pointer_format);
+    const uint32_t nimports = walk->fixups->nimports;
+    size_t count = 0;
+    uint64_t offset = page->start;
+    for (;;) {
+        if (page_size < sizeof(uint64_t)
+            || offset > page_size - sizeof(uint64_t)) {
+            walk->problems[index] |= ChainedProblemChain;
+            break;
+        }
+        uint64_t raw;
+        memcpy(&raw, data + offset, sizeof(raw));
+        struct chained_fixup fixup;
+        const uint64_t next = chained_decode(raw, starts->pointer_format,
+                                             walk->base, &fixup);
+        if (fixup.import != CHAINED_NONE && fixup.import >= nimports) {
+            walk->problems[index] |= ChainedProblemImport;
+        }
+        if (out) {
+            fixup.address = segment->vmaddr + page_offset + offset;
+            out[count] = fixup;
+        }
+        count++;
+        if (next == 0) {
+            break;
+        }
+        offset += next * stride;
+    }
+    return count;
+}
+
+static void chained_walk_task(void* context, size_t task) {
+    const struct chained_walk* walk = context;
+    const size_t begin = task * CHAINED_PAGES_PER_TASK;
+    const size_t end = walk->npages - begin < CHAINED_PAGES_PER_TASK
+                       ? walk->npages : begin + CHAINED_PAGES_PER_TASK;
+    for (size_t i = begin; i < end; i++) {
+        if (walk->fill) {
+            chained_walk_page(walk, i, walk->fixups->fixups + walk->counts[i]);
+        } else {
+            walk->counts[i] = chained_walk_page(walk, i, NULL);
+        }
+    }
+}
+
+// The address the image is linked at, which the offset formats' rebase
+// targets are relative to: that of the segment that maps the header.
+local uint64_t chained_base(const struct macho* macho) {
+    struct macho_iter it = macho_segments(macho);
+    for (const struct macho_segment* segment;
+         (segment = macho_next_segment(&it));) {
+        if (segment->command.fileoff == 0 && segment->command.filesize > 0) {
+            return segment->command.vmaddr;
+        }
+    }
+    return 0;
+}
+
+local bool chained_decode_imports(struct chained_fixups* fixups,
+                                  const unsigned char* data, uint32_t size) {
+    const S(dyld_chained_fixups_header*) header = &fixups->header;
+    size_t entry;
+    switch (header->imports_format) {
+        case DYLD_CHAINED_IMPORT:
+            entry = sizeof(uint32_t);
+            break;
+        case DYLD_CHAINED_IMPORT_ADDEND:
+            entry = 2 * sizeof(uint32_t);
+            break;
+        case DYLD_CHAINED_IMPORT_ADDEND64:
+            entry = 2 * sizeof(uint64_t);
+            break;
+        default:
+            return header->imports_count == 0;
+    }
+    if (header->imports_offset > size
+        || header->imports_count > (size - header->imports_offset) / entry) {
+        return false;
+    }
+    if (header->imports_count == 0) {
+        return true;
+    }
+    fixups->imports =
+        xmalloc(sizeof(struct chained_import) * header->imports_count);
+    if (!fixups->imports) {
+        return false;
+    }
+    fixups->nimports = header->imports_count;
+
+    // Only uncompressed names can be pointed at.
+    const char* symbols = NULL;
+    uint32_t symbols_size = 0;
+    if (header->symbols_format == 0 && header->symbols_offset < size) {
+        symbols = (const char*)data + header->symbols_offset;
+        symbols_size = size - header->symbols_offset;
+    }
+    bool valid = true;
+    const unsigned char* p = data + header->imports_offset;
+    for (uint32_t i = 0; i < header->imports_count; i++, p += entry) {
+        struct chained_import* import = &fixups->imports[i];
+        uint64_t raw = 0;
+        uint64_t name;
+        if (header->imports_format == DYLD_CHAINED_IMPORT_ADDEND64) {
+            memcpy(&raw, p, sizeof(uint64_t));
+            int64_t addend;
+            memcpy(&addend, p + sizeof(uint64_t), sizeof(addend));
+            import->ordinal = (int32_t)chained_signed_bits(raw, 0, 16);
+            import->weak = chained_bits(raw, 16, 1);
+            import->addend = addend;
+            name = chained_bits(raw, 32, 32);
+        } else {
+            uint32_t raw32;
+            memcpy(&raw32, p, sizeof(raw32));
+            raw = raw32;
+            import->ordinal = (int32_t)chained_signed_bits(raw, 0, 8);
+            import->weak = chained_bits(raw, 8, 1);
+            import->addend = 0;
+            if (header->imports_format == DYLD_CHAINED_IMPORT_ADDEND) {
+                int32_t addend;
+                memcpy(&addend, p + sizeof(uint32_t), sizeof(addend));
+                import->addend = addend;
+            }
+            name = chained_bits(raw, 9, 23);
+        }
+        // Ordinals are small and positive except for the few special
+        // lookups, which count down from -1.
+        if (import->ordinal < BIND_SPECIAL_DYLIB_WEAK_LOOKUP) {
+            import->ordinal &= header->imports_format
+                                   == DYLD_CHAINED_IMPORT_ADDEND64
+                               ? 0xffff : 0xff;
+        }
+        import->name = NULL;
+        if (symbols && name < symbols_size
+            && memchr(symbols + name, 0, symbols_size - name)) {
+            import->name = symbols + name;
+        } else if (symbols) {
+            valid = false;
+        }
+    }
+    return valid;
+}
+
+// Reads the starts of every segment and lists the chains they begin.
+local bool chained_decode_starts(struct chained_fixups* fixups,
+                                 const struct macho* macho,
+                                 const unsigned char* data, uint32_t size,
+                                 struct chained_page** pages, size_t* npages) {
+    const uint32_t offset = fixups->header.starts_offset;
+    uint32_t seg_count;
+    if (offset > size || size - offset < sizeof(seg_count)) {
+        return false;
+    }
+    memcpy(&seg_count, data + offset, sizeof(seg_count));
+    if (seg_count > (size - offset - sizeof(seg_count)) / sizeof(uint32_t)) {
+        return false;
+    }
+    fixups->starts = xmalloc(sizeof(struct chained_starts)
+                             * (seg_count ? seg_count : 1));
+    if (!fixups->starts) {
+        return false;
+    }
+
+    // The page starts are counted first so that the chains can be listed in
+    // one allocation.
+    size_t capacity = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        fixups->nstarts = 0;
+        *npages = 0;
+        for (uint32_t i = 0; i < seg_count; i++) {
+            uint32_t info;
+            memcpy(&info, data + offset + sizeof(seg_count)
+                              + i * sizeof(uint32_t), sizeof(info));
+            if (info == 0) {
+                continue;
+            }
+            struct chained_starts* starts = &fixups->starts[fixups->nstarts];
+            S(dyld_chained_starts_in_segment) raw;
+            if (info > size - offset
+                || size - offset - info < CHAINED_STARTS_SIZE) {
+                return false;
+            }
+            const unsigned char* p = data + offset + info;
+            memcpy(&raw, p, CHAINED_STARTS_SIZE);
+            starts->segment = i;
+            starts->size = raw.size;
+            starts->page_size = raw.page_size;
+            starts->pointer_format = raw.pointer_format;
+            starts->segment_offset = raw.segment_offset;
+            starts->max_valid_pointer = raw.max_valid_pointer;
+            starts->page_count = raw.page_count;
+            starts->malformed = i >= macho->nsegments || raw.page_size == 0
+                || chained_stride(raw.pointer_format) == 0
+                || raw.size < CHAINED_STARTS_SIZE
+                || raw.size > size - offset - info
+                || raw.page_count > (raw.size - CHAINED_STARTS_SIZE)
+                                    / sizeof(uint16_t);
+            fixups->nstarts++;
+            if (starts->malformed) {
+                continue;
+            }
+
+            // A page with several chains points at a list of their starts
+            // after the page_start array, the last of which is marked.
+            const uint32_t nstarts = (raw.size - CHAINED_STARTS_SIZE)
+                                     / sizeof(uint16_t);
+            for (uint16_t page = 0; page < raw.page_count; page++) {
+                uint16_t start;
+                memcpy(&start, p + CHAINED_STARTS_SIZE
+                               + page * sizeof(uint16_t), sizeof(start));
+                if (start == DYLD_CHAINED_PTR_START_NONE) {
+                    continue;
+                }
+                uint32_t next = start & ~DYLD_CHAINED_PTR_START_MULTI;
+                const bool multi = start & DYLD_CHAINED_PTR_START_MULTI;
+                do {
+                    if (multi) {
+                        if (next >= nstarts) {
+                            starts->malformed = true;
+                            break;
+                        }
+                        memcpy(&start, p + CHAINED_STARTS_SIZE
+                                       + next++ * sizeof(uint16_t),
+                               sizeof(start));
+                    }
+                    if (pass == 1) {
+                        struct chained_page* chain = &(*pages)[*npages];
+                        chain->starts = fixups->nstarts - 1;
+                        chain->page = page;
+                        chain->start = start & ~DYLD_CHAINED_PTR_START_LAST;
+                    }
+                    (*npages)++;
+                } while (multi && !(start & DYLD_CHAINED_PTR_START_LAST));
+            }
+        }
+        if (pass == 0) {
+            capacity = *npages;
+            *pages = xmalloc(sizeof(struct chained_page)
+                             * (capacity ? capacity : 1));
+            if (!*pages) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void chained_fixups_decode(struct chained_fixups* fixups,
+                           const struct macho* macho,
+                           const struct macho_command* command,
+                           unsigned threads) {
+    memset(fixups, 0, sizeof(*fixups));
+    const S(linkedit_data_command*) lc =
+        (const void*)macho_command_data(macho, command);
+    const unsigned char* data = macho_data(macho, lc->dataoff, lc->datasize);
+    if (!data || lc->datasize < sizeof(fixups->header)) {
+        fixups->malformed = true;
+        return;
+    }
+    memcpy(&fixups->header, data, sizeof(fixups->header));
+    if (!chained_decode_imports(fixups, data, lc->datasize)) {
+        fixups->malformed = true;
+    }
+    struct chained_page* pages = NULL;
+    size_t npages = 0;
+    if (!chained_decode_starts(fixups, macho, data, lc->datasize, &pages,
+                               &npages)) {
+        fixups->malformed = true;
+        xfree(pages);
+        return;
+    }
+
+    // The chains are walked twice, first to count their fixups and then, once
+    // each has its place in the table, to store them. Both passes touch only
+    // their own chains' entries.
+    struct chained_walk walk = {
+        macho, fixups, pages, npages, chained_base(macho),
+        xmalloc(sizeof(size_t) * (npages ? npages : 1)),
+        xmalloc(npages ? npages : 1), false
+    };
+    if (!walk.counts || !walk.problems) {
+        fixups->malformed = true;
+        goto done;
+    }
+    memset(walk.problems, 0, npages);
+    const size_t tasks = (npages + CHAINED_PAGES_PER_TASK - 1)
+                         / CHAINED_PAGES_PER_TASK;
+    pool_for(threads, tasks, chained_walk_task, &walk);
+    size_t total = 0;
+    for (size_t i = 0; i < npages; i++) {
+        const size_t count = walk.counts[i];
+        walk.counts[i] = total;
+        total += count;
+    }
+    fixups->fixups = xmalloc(sizeof(struct chained_fixup)
+                             * (total ? total : 1));
+    if (!fixups->fixups) {
+        fixups->malformed = true;
+        goto done;
+    }
+    walk.fill = true;
+    pool_for(threads, tasks, chained_walk_task, &walk);
+    fixups->count = total;
+    for (size_t i = 0; i < npages; i++) {
+        if (walk.problems[i] & ChainedProblemChain) {
+            fixups->starts[pages[i].starts].malformed = true;
+        }
+        if (walk.problems[i] & ChainedProblemImport) {
+            fixups->malformed = true;
+        }
+    }
+
+done:
+    xfree(walk.problems);
+    xfree(walk.counts);
+    xfree(pages);
+}
+
+void chained_fixups_free(struct chained_fixups* fixups) {
+    xfree(fixups->imports);
+    xfree(fixups->starts);
+    xfree(fixups->fixups);
+    memset(fixups, 0, sizeof(*fixups));
+}
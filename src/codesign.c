@@ -0,0 +1,244 @@
+// src/codesign.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "codesign.h"
+#include "fat.h"
+#include "pool.h"
+#include "safe.h"
+#include "sha256.h"
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// The blobs of a signature, which are always big-endian. The SuperBlob is a
+// header of magic, length and count followed by count pairs of slot type and
+// offset, and a CodeDirectory sits in slot 0 or one of the alternate slots.
+#define CODESIGN_SUPERBLOB 0xfade0cc0
+#define CODESIGN_DIRECTORY 0xfade0c02
+#define CODESIGN_SUPERBLOB_SIZE 12
+#define CODESIGN_INDEX_SIZE 8
+#define CODESIGN_SLOT_DIRECTORY 0
+#define CODESIGN_SLOT_ALTERNATE 0x1000
+#define CODESIGN_SLOT_ALTERNATE_COUNT 5
+
+// The CodeDirectory fields read here, by offset, and the versions that added
+// the later ones. The fields up to scatterOffset are always present.
+#define CODESIGN_VERSION 8
+#define CODESIGN_FLAGS 12
+#define CODESIGN_HASH_OFFSET 16
+#define CODESIGN_IDENT_OFFSET 20
+#define CODESIGN_CODE_SLOTS 28
+#define CODESIGN_CODE_LIMIT 32
+#define CODESIGN_HASH_SIZE 36
+#define CODESIGN_HASH_TYPE 37
+#define CODESIGN_PLATFORM 38
+#define CODESIGN_PAGE_SIZE 39
+#define CODESIGN_SCATTER_OFFSET 44
+#define CODESIGN_CODE_LIMIT_64 56
+#define CODESIGN_DIRECTORY_SIZE 44
+#define CODESIGN_SUPPORTS_SCATTER 0x20100
+#define CODESIGN_SUPPORTS_CODE_LIMIT_64 0x20300
+
+// Pages are handed to the pool this many at a time, about a megabyte of
+// hashing per task.
+#define CODESIGN_PAGES_PER_TASK 256
+
+static const char* codesign_hash_names[CODESIGN_HASH_COUNT] = {
+    [CodesignHashSHA1] = "SHA-1",
+    [CodesignHashSHA256] = "SHA-256",
+    [CodesignHashSHA256Truncated] = "SHA-256 (truncated)",
+    [CodesignHashSHA384] = "SHA-384"
+};
+
+const char* codesign_hash_name(uint8_t hash_type) {
+    return hash_type < CODESIGN_HASH_COUNT ? codesign_hash_names[hash_type]
+                                           : NULL;
+}
+
+// The CodeDirectory in the blob at offset of the signature, or NULL if it is
+// not one or does not lie within the signature. Its length is stored in size.
+local const unsigned char* codesign_directory(const unsigned char* signature,
+                                              uint32_t signature_size,
+                                              uint32_t offset,
+                                              uint32_t* size) {
+    if (offset > signature_size
+        || signature_size - offset < CODESIGN_DIRECTORY_SIZE) {
+        return NULL;
+    }
+    const unsigned char* blob = signature + offset;
+    *size = read_be32(blob + 4);
+    if (read_be32(blob) != CODESIGN_DIRECTORY
+        || *size < CODESIGN_DIRECTORY_SIZE
+        || *size > signature_size - offset) {
+        return NULL;
+    }
+    return blob;
+}
+
+// Picks the CodeDirectory to verify: the first SHA-256 one, or else the
+// first truncated SHA-256 one.
+local enum dump_error codesign_find(const unsigned char* signature,
+                                    uint32_t signature_size,
+                                    const unsigned char** directory,
+                                    uint32_t* directory_size) {
+    if (signature_size < CODESIGN_SUPERBLOB_SIZE
+        || read_be32(signature) != CODESIGN_SUPERBLOB
+        || read_be32(signature + 4) > signature_size
+        || read_be32(signature + 4) < CODESIGN_SUPERBLOB_SIZE) {
+        return DumpErrorMalformed;
+    }
+    signature_size = read_be32(signature + 4);
+    const uint32_t count = read_be32(signature + 8);
+    if (count > (signature_size - CODESIGN_SUPERBLOB_SIZE)
+                / CODESIGN_INDEX_SIZE) {
+        return DumpErrorMalformed;
+    }
+    *directory = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char* entry = signature + CODESIGN_SUPERBLOB_SIZE
+                                     + (size_t)i * CODESIGN_INDEX_SIZE;
+        const uint32_t type = read_be32(entry);
+        if (type != CODESIGN_SLOT_DIRECTORY
+            && (type < CODESIGN_SLOT_ALTERNATE
+                || type >= CODESIGN_SLOT_ALTERNATE
+                           + CODESIGN_SLOT_ALTERNATE_COUNT)) {
+            continue;
+        }
+        uint32_t size;
+        const unsigned char* blob = codesign_directory(
+            signature, signature_size, read_be32(entry + 4), &size);
+        if (!blob) {
+            return DumpErrorMalformed;
+        }
+        const uint8_t hash_type = blob[CODESIGN_HASH_TYPE];
+        if (hash_type == CodesignHashSHA256
+            || (hash_type == CodesignHashSHA256Truncated && !*directory)) {
+            *directory = blob;
+            *directory_size = size;
+        }
+        if (hash_type == CodesignHashSHA256) {
+            break;
+        }
+    }
+    return *directory ? DumpErrorNone : DumpErrorUnsupportedSignature;
+}
+
+// Decodes the CodeDirectory's fields and checks that its identifier, its
+// page hashes and the pages themselves lie where they should.
+local enum dump_error codesign_decode(struct codesign* codesign,
+                                      const struct macho* macho,
+                                      const unsigned char* directory,
+                                      uint32_t size) {
+    codesign->version = read_be32(directory + CODESIGN_VERSION);
+    codesign->flags = read_be32(directory + CODESIGN_FLAGS);
+    codesign->hash_size = directory[CODESIGN_HASH_SIZE];
+    codesign->hash_type = directory[CODESIGN_HASH_TYPE];
+    codesign->platform = directory[CODESIGN_PLATFORM];
+    codesign->page_shift = directory[CODESIGN_PAGE_SIZE];
+    codesign->code_limit = read_be32(directory + CODESIGN_CODE_LIMIT);
+    codesign->npages = read_be32(directory + CODESIGN_CODE_SLOTS);
+    if (codesign->version >= CODESIGN_SUPPORTS_SCATTER
+        && size >= CODESIGN_SCATTER_OFFSET + 4
+        && read_be32(directory + CODESIGN_SCATTER_OFFSET) != 0) {
+        return DumpErrorUnsupportedSignature;
+    }
+    if (codesign->version >= CODESIGN_SUPPORTS_CODE_LIMIT_64
+        && size >= CODESIGN_CODE_LIMIT_64 + 8
+        && read_be64(directory + CODESIGN_CODE_LIMIT_64) != 0) {
+        codesign->code_limit = read_be64(directory + CODESIGN_CODE_LIMIT_64);
+    }
+
+    const uint32_t ident_offset = read_be32(directory + CODESIGN_IDENT_OFFSET);
+    const char* end = ident_offset < size
+        ? memchr(directory + ident_offset, '\0', size - ident_offset) : NULL;
+    if (!end) {
+        return DumpErrorMalformed;
+    }
+    codesign->identifier = (const char*)directory + ident_offset;
+    codesign->identifier_length = (size_t)(end - codesign->identifier);
+
+    // Each page has exactly one slot, and all of them lie within the file.
+    const uint32_t hash_offset = read_be32(directory + CODESIGN_HASH_OFFSET);
+    if (codesign->hash_size == 0 || codesign->hash_size > SHA256_DIGEST_SIZE
+        || codesign->page_shift >= 32 || hash_offset > size
+        || codesign->npages > (size - hash_offset) / codesign->hash_size
+        || !macho_data(macho, 0, codesign->code_limit)) {
+        return DumpErrorMalformed;
+    }
+    const uint64_t npages = codesign->page_shift
+        ? (codesign->code_limit + ((uint64_t)1 << codesign->page_shift) - 1)
+          >> codesign->page_shift
+        : codesign->code_limit > 0;
+    if (npages != codesign->npages) {
+        return DumpErrorMalformed;
+    }
+    codesign->hashes = directory + hash_offset;
+    return DumpErrorNone;
+}
+
+struct codesign_walk {
+    const struct macho* macho;
+    struct codesign* codesign;
+};
+
+static void codesign_hash_task(void* context, size_t task) {
+    const struct codesign_walk* walk = context;
+    struct codesign* codesign = walk->codesign;
+    const size_t begin = task * CODESIGN_PAGES_PER_TASK;
+    const size_t end = codesign->npages - begin < CODESIGN_PAGES_PER_TASK
+                       ? codesign->npages : begin + CODESIGN_PAGES_PER_TASK;
+    for (size_t i = begin; i < end; i++) {
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        sha256(walk->macho->data + codesign_page_offset(codesign, (uint32_t)i),
+               (size_t)codesign_page_size(codesign, (uint32_t)i), digest);
+        codesign->mismatched[i] =
+            memcmp(digest, codesign->hashes + i * codesign->hash_size,
+                   codesign->hash_size) != 0;
+    }
+}
+
+enum dump_error codesign_verify(struct codesign* codesign,
+                                const struct macho* macho,
+                                const struct macho_command* command,
+                                unsigned threads) {
+    memset(codesign, 0, sizeof(*codesign));
+    const S(linkedit_data_command*) lc =
+        (const void*)macho_command_data(macho, command);
+    const unsigned char* signature =
+        macho_data(macho, lc->dataoff, lc->datasize);
+    if (!signature) {
+        return DumpErrorMalformed;
+    }
+    const unsigned char* directory;
+    uint32_t size;
+    enum dump_error error = codesign_find(signature, lc->datasize, &directory,
+                                          &size);
+    if (error == DumpErrorNone) {
+        error = codesign_decode(codesign, macho, directory, size);
+    }
+    if (error != DumpErrorNone) {
+        return error;
+    }
+
+    // Every page is hashed on its own, so they are split across the threads
+    // and each records only its own verdicts.
+    codesign->mismatched = xmalloc(sizeof(bool)
+                                   * (codesign->npages ? codesign->npages : 1));
+    if (!codesign->mismatched) {
+        return DumpErrorNoMemory;
+    }
+    struct codesign_walk walk = { macho, codesign };
+    pool_for(threads, (codesign->npages + CODESIGN_PAGES_PER_TASK - 1)
+                      / CODESIGN_PAGES_PER_TASK,
+             codesign_hash_task, &walk);
+    for (uint32_t i = 0; i < codesign->npages; i++) {
+        codesign->nmismatched += codesign->mismatched[i];
+    }
+    return DumpErrorNone;
+}
+
+void codesign_free(struct codesign* codesign) {
+    xfree(codesign->mismatched);
+    codesign->mismatched = NULL;
+}
@@ -0,0 +1,1006 @@
+// src/diff.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "diff.h"
+#include "hex.h"
+#include "json.h"
+#include "macho.h"
+#include "out.h"
+#include "pool.h"
+#include "safe.h"
+#include "xxh64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// Contents are hashed in blocks of this size, one per task, so a small change
+// costs at most a block of byte comparisons.
+#define DIFF_BLOCK_SIZE ((uint64_t)1 << 20)
+
+// Differing contents are shown as hexdump rows, at most this many per region.
+#define DIFF_ROWS 4
+#define DIFF_ROW_SIZE 16
+
+// A field of a structure that is compared as a number.
+struct diff_field {
+    const char* name;
+    size_t offset;
+    size_t size;
+};
+
+#define DIFF_FIELD(type, field) \
+    { #field, offsetof(S(type), field), sizeof(((S(type)*)0)->field) }
+
+static const struct diff_field diff_header_fields[] = {
+    DIFF_FIELD(mach_header_64, magic),
+    DIFF_FIELD(mach_header_64, cputype),
+    DIFF_FIELD(mach_header_64, cpusubtype),
+    DIFF_FIELD(mach_header_64, filetype),
+    DIFF_FIELD(mach_header_64, ncmds),
+    DIFF_FIELD(mach_header_64, sizeofcmds),
+    DIFF_FIELD(mach_header_64, flags),
+    DIFF_FIELD(mach_header_64, reserved)
+};
+
+static const struct diff_field diff_segment_fields[] = {
+    DIFF_FIELD(segment_command_64, cmdsize),
+    DIFF_FIELD(segment_command_64, vmaddr),
+    DIFF_FIELD(segment_command_64, vmsize),
+    DIFF_FIELD(segment_command_64, fileoff),
+    DIFF_FIELD(segment_command_64, filesize),
+    DIFF_FIELD(segment_command_64, maxprot),
+    DIFF_FIELD(segment_command_64, initprot),
+    DIFF_FIELD(segment_command_64, nsects),
+    DIFF_FIELD(segment_command_64, flags)
+};
+
+static const struct diff_field diff_section_fields[] = {
+    DIFF_FIELD(section_64, addr),
+    DIFF_FIELD(section_64, size),
+    DIFF_FIELD(section_64, offset),
+    DIFF_FIELD(section_64, align),
+    DIFF_FIELD(section_64, reloff),
+    DIFF_FIELD(section_64, nreloc),
+    DIFF_FIELD(section_64, flags),
+    DIFF_FIELD(section_64, reserved1),
+    DIFF_FIELD(section_64, reserved2),
+    DIFF_FIELD(section_64, reserved3)
+};
+
+static const struct diff_field diff_symtab_fields[] = {
+    DIFF_FIELD(symtab_command, symoff),
+    DIFF_FIELD(symtab_command, nsyms),
+    DIFF_FIELD(symtab_command, stroff),
+    DIFF_FIELD(symtab_command, strsize)
+};
+
+static const struct diff_field diff_dysymtab_fields[] = {
+    DIFF_FIELD(dysymtab_command, ilocalsym),
+    DIFF_FIELD(dysymtab_command, nlocalsym),
+    DIFF_FIELD(dysymtab_command, iextdefsym),
+    DIFF_FIELD(dysymtab_command, nextdefsym),
+    DIFF_FIELD(dysymtab_command, iundefsym),
+    DIFF_FIELD(dysymtab_command, nundefsym),
+    DIFF_FIELD(dysymtab_command, tocoff),
+    DIFF_FIELD(dysymtab_command, ntoc),
+    DIFF_FIELD(dysymtab_command, modtaboff),
+    DIFF_FIELD(dysymtab_command, nmodtab),
+    DIFF_FIELD(dysymtab_command, extrefsymoff),
+    DIFF_FIELD(dysymtab_command, nextrefsyms),
+    DIFF_FIELD(dysymtab_command, indirectsymoff),
+    DIFF_FIELD(dysymtab_command, nindirectsyms),
+    DIFF_FIELD(dysymtab_command, extreloff),
+    DIFF_FIELD(dysymtab_command, nextrel),
+    DIFF_FIELD(dysymtab_command, locreloff),
+    DIFF_FIELD(dysymtab_command, nlocrel)
+};
+
+static const struct diff_field diff_dyld_info_fields[] = {
+    DIFF_FIELD(dyld_info_command, rebase_off),
+    DIFF_FIELD(dyld_info_command, rebase_size),
+    DIFF_FIELD(dyld_info_command, bind_off),
+    DIFF_FIELD(dyld_info_command, bind_size),
+    DIFF_FIELD(dyld_info_command, weak_bind_off),
+    DIFF_FIELD(dyld_info_command, weak_bind_size),
+    DIFF_FIELD(dyld_info_command, lazy_bind_off),
+    DIFF_FIELD(dyld_info_command, lazy_bind_size),
+    DIFF_FIELD(dyld_info_command, export_off),
+    DIFF_FIELD(dyld_info_command, export_size)
+};
+
+static const struct diff_field diff_linkedit_data_fields[] = {
+    DIFF_FIELD(linkedit_data_command, dataoff),
+    DIFF_FIELD(linkedit_data_command, datasize)
+};
+
+static const struct diff_field diff_uuid_fields[] = {
+    DIFF_FIELD(uuid_command, uuid)
+};
+
+// The tools that follow the command are compared word by word.
+static const struct diff_field diff_build_version_fields[] = {
+    DIFF_FIELD(build_version_command, platform),
+    DIFF_FIELD(build_version_command, minos),
+    DIFF_FIELD(build_version_command, sdk),
+    DIFF_FIELD(build_version_command, ntools)
+};
+
+static const struct diff_field diff_dylib_fields[] = {
+    DIFF_FIELD(dylib_command, dylib.timestamp),
+    DIFF_FIELD(dylib_command, dylib.current_version),
+    DIFF_FIELD(dylib_command, dylib.compatibility_version)
+};
+
+static const struct diff_field diff_version_min_fields[] = {
+    DIFF_FIELD(version_min_command, version),
+    DIFF_FIELD(version_min_command, sdk)
+};
+
+static const struct diff_field diff_entry_point_fields[] = {
+    DIFF_FIELD(entry_point_command, entryoff),
+    DIFF_FIELD(entry_point_command, stacksize)
+};
+
+static const struct diff_field diff_source_version_fields[] = {
+    DIFF_FIELD(source_version_command, version)
+};
+
+static const struct diff_field diff_encryption_info_fields[] = {
+    DIFF_FIELD(encryption_info_command_64, cryptoff),
+    DIFF_FIELD(encryption_info_command_64, cryptsize),
+    DIFF_FIELD(encryption_info_command_64, cryptid)
+};
+
+#define DIFF_COUNT(fields) (sizeof(fields) / sizeof(*(fields)))
+
+// The fields of the load commands other than segments, in order of offset.
+struct diff_command_fields {
+    uint32_t cmd;
+    const struct diff_field* fields;
+    size_t count;
+};
+
+#define DIFF_COMMAND(cmd, fields) { cmd, fields, DIFF_COUNT(fields) }
+
+static const struct diff_command_fields diff_commands[] = {
+    DIFF_COMMAND(LC_SYMTAB, diff_symtab_fields),
+    DIFF_COMMAND(LC_DYSYMTAB, diff_dysymtab_fields),
+    DIFF_COMMAND(LC_DYLD_INFO, diff_dyld_info_fields),
+    DIFF_COMMAND(LC_DYLD_INFO_ONLY, diff_dyld_info_fields),
+    DIFF_COMMAND(LC_CODE_SIGNATURE, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_SEGMENT_SPLIT_INFO, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_FUNCTION_STARTS, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_DATA_IN_CODE, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_DYLIB_CODE_SIGN_DRS, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_LINKER_OPTIMIZATION_HINT, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_DYLD_EXPORTS_TRIE, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_DYLD_CHAINED_FIXUPS, diff_linkedit_data_fields),
+    DIFF_COMMAND(LC_UUID, diff_uuid_fields),
+    DIFF_COMMAND(LC_BUILD_VERSION, diff_build_version_fields),
+    DIFF_COMMAND(LC_ID_DYLIB, diff_dylib_fields),
+    DIFF_COMMAND(LC_LOAD_DYLIB, diff_dylib_fields),
+    DIFF_COMMAND(LC_LOAD_WEAK_DYLIB, diff_dylib_fields),
+    DIFF_COMMAND(LC_REEXPORT_DYLIB, diff_dylib_fields),
+    DIFF_COMMAND(LC_LAZY_LOAD_DYLIB, diff_dylib_fields),
+    DIFF_COMMAND(LC_LOAD_UPWARD_DYLIB, diff_dylib_fields),
+    DIFF_COMMAND(LC_VERSION_MIN_MACOSX, diff_version_min_fields),
+    DIFF_COMMAND(LC_VERSION_MIN_IPHONEOS, diff_version_min_fields),
+    DIFF_COMMAND(LC_VERSION_MIN_TVOS, diff_version_min_fields),
+    DIFF_COMMAND(LC_VERSION_MIN_WATCHOS, diff_version_min_fields),
+    DIFF_COMMAND(LC_MAIN, diff_entry_point_fields),
+    DIFF_COMMAND(LC_SOURCE_VERSION, diff_source_version_fields),
+    DIFF_COMMAND(LC_ENCRYPTION_INFO, diff_encryption_info_fields),
+    DIFF_COMMAND(LC_ENCRYPTION_INFO_64, diff_encryption_info_fields)
+};
+
+// The fields of commands of type cmd, or NULL if they are compared word by
+// word.
+local const struct diff_command_fields* diff_command_lookup(uint32_t cmd) {
+    for (size_t i = 0; i < DIFF_COUNT(diff_commands); i++) {
+        if (diff_commands[i].cmd == cmd) {
+            return &diff_commands[i];
+        }
+    }
+    return NULL;
+}
+
+// A block of contents of the same size on both sides, and whether it hashed
+// the same on both.
+struct diff_block {
+    const unsigned char* data[2];
+    size_t size;
+    bool equal;
+};
+
+// Contents present on both sides. Its blocks are [first_block, first_block +
+// nblocks) of the block table; contents whose sizes differ are not hashed.
+struct diff_region {
+    size_t first_block;
+    size_t nblocks;
+};
+
+// The files are walked twice in the same order: first to collect the regions
+// of contents and their blocks, which are then hashed all at once, and then
+// to write the differences, taking the regions' outcomes in turn.
+struct diff {
+    struct out* out;
+    const struct macho* macho[2];
+    enum dump_format format;
+    bool emit;
+    struct diff_region* regions;
+    size_t nregions;
+    size_t regions_capacity;
+    size_t next_region;
+    struct diff_block* blocks;
+    size_t nblocks;
+    size_t blocks_capacity;
+    bool exhausted;
+    size_t changes;
+};
+
+// What a structure is known by on either side: its name, e.g. a segment
+// name, and command. Entries of the two sides with the same name and command
+// are paired in order.
+struct diff_key {
+    char name[16];
+    uint32_t cmd;
+    uint32_t index;
+};
+
+static int diff_key_compare(const void* x, const void* y) {
+    const struct diff_key* a = x;
+    const struct diff_key* b = y;
+    const int name = memcmp(a->name, b->name, sizeof(a->name));
+    if (name != 0) {
+        return name;
+    }
+    if (a->cmd != b->cmd) {
+        return a->cmd < b->cmd ? -1 : 1;
+    }
+    return a->index < b->index ? -1 : a->index > b->index;
+}
+
+// Pairs the keys of both sides, which are sorted in place. pair[side][i] is
+// the index of entry i's partner on the other side, or MACHO_NONE, and
+// rank[side][i] its position among the entries of its side with its name and
+// command. Sorting keeps this linearithmic however many entries there are.
+local void diff_pair(struct diff_key* keys[2], const uint32_t count[2],
+                     uint32_t* pair[2], uint32_t* rank[2]) {
+    for (int side = 0; side < 2; side++) {
+        qsort(keys[side], count[side], sizeof(struct diff_key),
+              diff_key_compare);
+        for (uint32_t i = 0; i < count[side]; i++) {
+            const struct diff_key* key = &keys[side][i];
+            pair[side][key->index] = MACHO_NONE;
+            rank[side][key->index] =
+                i > 0 && memcmp(key->name, key[-1].name, sizeof(key->name))
+                         == 0 && key->cmd == key[-1].cmd
+                ? rank[side][key[-1].index] + 1 : 0;
+        }
+    }
+    uint32_t i = 0;
+    uint32_t j = 0;
+    while (i < count[0] && j < count[1]) {
+        const struct diff_key* a = &keys[0][i];
+        const struct diff_key* b = &keys[1][j];
+        int order = memcmp(a->name, b->name, sizeof(a->name));
+        if (order == 0 && a->cmd != b->cmd) {
+            order = a->cmd < b->cmd ? -1 : 1;
+        }
+        if (order < 0) {
+            i++;
+        } else if (order > 0) {
+            j++;
+        } else {
+            pair[0][a->index] = b->index;
+            pair[1][b->index] = a->index;
+            i++;
+            j++;
+        }
+    }
+}
+
+local void diff_tables_free(struct diff_key* keys[2], uint32_t* pair[2],
+                            uint32_t* rank[2]) {
+    for (int side = 0; side < 2; side++) {
+        xfree(keys[side]);
+        xfree(pair[side]);
+        xfree(rank[side]);
+    }
+}
+
+// Allocates the key, pair and rank tables for count[side] entries a side.
+// Returns false, allocating nothing, if memory runs out.
+local bool diff_tables(const uint32_t count[2], struct diff_key* keys[2],
+                       uint32_t* pair[2], uint32_t* rank[2]) {
+    bool ok = true;
+    for (int side = 0; side < 2; side++) {
+        const size_t n = (size_t)count[side] + 1;
+        keys[side] = xmalloc(sizeof(*keys[side]) * n);
+        pair[side] = xmalloc(sizeof(*pair[side]) * n);
+        rank[side] = xmalloc(sizeof(*rank[side]) * n);
+        ok = ok && keys[side] && pair[side] && rank[side];
+    }
+    if (!ok) {
+        diff_tables_free(keys, pair, rank);
+    }
+    return ok;
+}
+
+// Gives up on the structures left when memory runs out. Regions are no
+// longer recorded, or no longer taken, so the two walks still agree on the
+// regions before.
+local void diff_exhausted(struct diff* d) {
+    d->exhausted = true;
+    if (d->emit) {
+        d->next_region = d->nregions;
+    }
+}
+
+// Starts a change of the given kind, counting it.
+local void diff_begin(struct diff* d, const char* kind, const char* path) {
+    struct out* out = d->out;
+    d->changes++;
+    if (d->format == DumpFormatText) {
+        return;
+    }
+    if (d->format == DumpFormatNDJSON) {
+        out_puts(out, "{\"record\":\"change\",\"kind\":\"");
+    } else {
+        out_puts(out, d->changes > 1 ? ",{\"kind\":\"" : "{\"kind\":\"");
+    }
+    out_puts(out, kind);
+    out_puts(out, "\",\"path\":");
+    json_string(out, path, (size_t)-1);
+}
+
+local void diff_end(struct diff* d) {
+    if (d->format != DumpFormatText) {
+        out_puts(d->out, d->format == DumpFormatNDJSON ? "}\n" : "}");
+    }
+}
+
+// Reports a structure that is only in the old file, or only in the new one.
+local void diff_presence(struct diff* d, int side, const char* path) {
+    if (!d->emit) {
+        return;
+    }
+    diff_begin(d, side == 0 ? "removed" : "added", path);
+    if (d->format == DumpFormatText) {
+        out_cputs(d->out, side == 0 ? "{R}-{0} " : "{G}+{0} ");
+        out_puts(d->out, path);
+        out_putc(d->out, '\n');
+    }
+    diff_end(d);
+}
+
+local void diff_value(struct diff* d, const char* path, const char* field,
+                      uint64_t old, uint64_t new) {
+    struct out* out = d->out;
+    diff_begin(d, "field", path);
+    if (d->format == DumpFormatText) {
+        out_cputs(out, "{Y}~{0} ");
+        out_puts(out, path);
+        out_putc(out, ' ');
+        out_puts(out, field);
+        out_cputs(out, ": {R}0x");
+        out_hex(out, old, 1);
+        out_cputs(out, "{0} -> {G}0x");
+        out_hex(out, new, 1);
+        out_cputs(out, "{0}\n");
+    } else {
+        out_puts(out, ",\"field\":");
+        json_string(out, field, (size_t)-1);
+        out_puts(out, ",\"old\":");
+        out_dec(out, old);
+        out_puts(out, ",\"new\":");
+        out_dec(out, new);
+    }
+    diff_end(d);
+}
+
+// Reports a field that is compared as bytes, like a UUID, in hexadecimal.
+local void diff_bytes_value(struct diff* d, const char* path,
+                            const struct diff_field* field,
+                            const unsigned char* old,
+                            const unsigned char* new) {
+    struct out* out = d->out;
+    char hex[2 * 16];
+    diff_begin(d, "field", path);
+    if (d->format == DumpFormatText) {
+        out_cputs(out, "{Y}~{0} ");
+        out_puts(out, path);
+        out_putc(out, ' ');
+        out_puts(out, field->name);
+        out_puts(out, ": ");
+    } else {
+        out_puts(out, ",\"field\":");
+        json_string(out, field->name, (size_t)-1);
+    }
+    for (int side = 0; side < 2; side++) {
+        hex_encode(hex, side == 0 ? old : new, field->size);
+        if (d->format == DumpFormatText) {
+            out_cputs(out, side == 0 ? "{R}" : " -> {G}");
+            out_write(out, hex, 2 * field->size);
+            out_cputs(out, side == 0 ? "{0}" : "{0}\n");
+        } else {
+            out_puts(out, side == 0 ? ",\"old\":\"" : "\",\"new\":\"");
+            out_write(out, hex, 2 * field->size);
+        }
+    }
+    if (d->format != DumpFormatText) {
+        out_putc(out, '"');
+    }
+    diff_end(d);
+}
+
+local uint64_t diff_read(const void* base, const struct diff_field* field) {
+    const unsigned char* p = (const unsigned char*)base + field->offset;
+    if (field->size == sizeof(uint64_t)) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Compares the fields of two copies of a structure. Fields longer than a word
+// are compared as bytes.
+local void diff_fields(struct diff* d, const char* path,
+                       const struct diff_field* fields, size_t count,
+                       const void* old, const void* new) {
+    if (!d->emit) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (fields[i].size > sizeof(uint64_t)) {
+            const unsigned char* a = (const unsigned char*)old
+                                     + fields[i].offset;
+            const unsigned char* b = (const unsigned char*)new
+                                     + fields[i].offset;
+            if (memcmp(a, b, fields[i].size) != 0) {
+                diff_bytes_value(d, path, &fields[i], a, b);
+            }
+            continue;
+        }
+        const uint64_t a = diff_read(old, &fields[i]);
+        const uint64_t b = diff_read(new, &fields[i]);
+        if (a != b) {
+            diff_value(d, path, fields[i].name, a, b);
+        }
+    }
+}
+
+// The number of bytes that differ between two words.
+local unsigned diff_count_bytes(uint64_t a, uint64_t b) {
+    uint64_t x = a ^ b;
+    x |= x >> 4;
+    x |= x >> 2;
+    x |= x >> 1;
+    return (unsigned)(((x & 0x0101010101010101ULL) * 0x0101010101010101ULL)
+                      >> 56);
+}
+
+// The differing bytes of a region: how many, the first and up to DIFF_ROWS
+// rows that contain them, as offsets into the region.
+struct diff_bytes {
+    uint64_t count;
+    uint64_t first;
+    uint64_t rows[DIFF_ROWS];
+    unsigned nrows;
+};
+
+local void diff_compare(const unsigned char* old, const unsigned char* new,
+                        uint64_t offset, uint64_t size,
+                        struct diff_bytes* bytes) {
+    for (uint64_t row = 0; row < size; row += DIFF_ROW_SIZE) {
+        const size_t n = size - row < DIFF_ROW_SIZE ? (size_t)(size - row)
+                                                    : DIFF_ROW_SIZE;
+        const unsigned char* a = old + offset + row;
+        const unsigned char* b = new + offset + row;
+        if (memcmp(a, b, n) == 0) {
+            continue;
+        }
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+            uint64_t x, y;
+            memcpy(&x, a + i, sizeof(x));
+            memcpy(&y, b + i, sizeof(y));
+            bytes->count += diff_count_bytes(x, y);
+        }
+        for (; i < n; i++) {
+            bytes->count += a[i] != b[i];
+        }
+        if (bytes->nrows == 0) {
+            size_t first = 0;
+            while (a[first] == b[first]) {
+                first++;
+            }
+            bytes->first = offset + row + first;
+        }
+        if (bytes->nrows < DIFF_ROWS) {
+            bytes->rows[bytes->nrows++] = offset + row;
+        }
+    }
+}
+
+local void diff_rows(struct diff* d, const unsigned char* data[2],
+                     uint64_t size, uint64_t address,
+                     const struct diff_bytes* bytes) {
+    struct out* out = d->out;
+    for (unsigned i = 0; i < bytes->nrows; i++) {
+        const uint64_t row = bytes->rows[i];
+        const size_t n = size - row < DIFF_ROW_SIZE ? (size_t)(size - row)
+                                                    : DIFF_ROW_SIZE;
+        if (d->format == DumpFormatText) {
+            char text[HEX_ROW_SIZE + 8];
+            for (int side = 0; side < 2; side++) {
+                out_cputs(out, side == 0 ? "  {R}-{0}" : "  {G}+{0}");
+                out_write(out, text, hex_dump_rows(text, data[side] + row, n,
+                                                   address + row, " "));
+            }
+            continue;
+        }
+        char hex[2 * DIFF_ROW_SIZE];
+        out_puts(out, i > 0 ? ",{\"address\":" : "{\"address\":");
+        out_dec(out, address + row);
+        out_puts(out, ",\"old\":\"");
+        hex_encode(hex, data[0] + row, n);
+        out_write(out, hex, 2 * n);
+        out_puts(out, "\",\"new\":\"");
+        hex_encode(hex, data[1] + row, n);
+        out_write(out, hex, 2 * n);
+        out_puts(out, "\"}");
+    }
+}
+
+// Grows a table to hold count entries of the given size, doubling its
+// capacity. Returns NULL, leaving it as it was, if memory runs out.
+local void* diff_grow(void* table, size_t* capacity, size_t count,
+                      size_t size) {
+    if (count <= *capacity) {
+        return table;
+    }
+    size_t n = *capacity ? *capacity : 16;
+    while (n < count) {
+        n *= 2;
+    }
+    void* grown = xrealloc(table, n * size);
+    if (grown) {
+        *capacity = n;
+    }
+    return grown;
+}
+
+// Compares contents present on both sides, which are at address in the old
+// file. Blocks that hashed the same are skipped; if the sizes differ, which
+// is reported with the structure's fields, their common part is compared.
+local void diff_region(struct diff* d, const char* path,
+                       const unsigned char* data[2], const uint64_t size[2],
+                       uint64_t address) {
+    if (!d->emit) {
+        // Once a region could not be recorded, none after it are, so that
+        // the second walk still takes them in the right order.
+        struct diff_region* region = d->exhausted ? NULL
+            : diff_grow(d->regions, &d->regions_capacity, d->nregions + 1,
+                        sizeof(*region));
+        if (!region) {
+            diff_exhausted(d);
+            return;
+        }
+        d->regions = region;
+        region = &d->regions[d->nregions++];
+        region->first_block = d->nblocks;
+        region->nblocks = size[0] == size[1]
+            ? (size_t)((size[0] + DIFF_BLOCK_SIZE - 1) / DIFF_BLOCK_SIZE) : 0;
+        struct diff_block* blocks = diff_grow(d->blocks, &d->blocks_capacity,
+                                              d->nblocks + region->nblocks,
+                                              sizeof(*blocks));
+        if (!blocks) {
+            // Unhashed contents are compared in full instead.
+            region->nblocks = 0;
+            return;
+        }
+        d->blocks = blocks;
+        for (size_t i = 0; i < region->nblocks; i++) {
+            const uint64_t offset = i * DIFF_BLOCK_SIZE;
+            struct diff_block* block = &d->blocks[d->nblocks++];
+            block->data[0] = data[0] + offset;
+            block->data[1] = data[1] + offset;
+            block->size = (size_t)(size[0] - offset < DIFF_BLOCK_SIZE
+                                   ? size[0] - offset : DIFF_BLOCK_SIZE);
+            block->equal = false;
+        }
+        return;
+    }
+    if (d->next_region >= d->nregions) {
+        return;
+    }
+
+    const struct diff_region* region = &d->regions[d->next_region++];
+    struct diff_bytes bytes = { 0, 0, { 0 }, 0 };
+    if (size[0] != size[1] || region->nblocks == 0) {
+        diff_compare(data[0], data[1], 0,
+                     size[0] < size[1] ? size[0] : size[1], &bytes);
+    } else {
+        for (size_t i = 0; i < region->nblocks; i++) {
+            const struct diff_block* block = &d->blocks[region->first_block
+                                                        + i];
+            if (!block->equal) {
+                diff_compare(data[0], data[1], i * DIFF_BLOCK_SIZE,
+                             block->size, &bytes);
+            }
+        }
+    }
+    if (bytes.count == 0) {
+        return;
+    }
+
+    struct out* out = d->out;
+    diff_begin(d, "contents", path);
+    if (d->format == DumpFormatText) {
+        out_cputs(out, "{Y}~{0} ");
+        out_puts(out, path);
+        out_puts(out, " contents: ");
+        out_dec(out, bytes.count);
+        out_puts(out, " byte(s) differ, first at 0x");
+        out_hex(out, address + bytes.first, 16);
+        out_putc(out, '\n');
+    } else {
+        out_puts(out, ",\"address\":");
+        out_dec(out, address);
+        out_puts(out, ",\"bytes\":");
+        out_dec(out, bytes.count);
+        out_puts(out, ",\"first\":");
+        out_dec(out, address + bytes.first);
+        out_puts(out, ",\"rows\":[");
+    }
+    diff_rows(d, data, size[0] < size[1] ? size[0] : size[1], address,
+              &bytes);
+    if (d->format != DumpFormatText) {
+        out_putc(out, ']');
+    }
+    diff_end(d);
+}
+
+// The string of a command with one, and its length within the command, or
+// NULL if it does not lie within it.
+local const char* diff_string(const S(load_command*) lc,
+                              const struct macho_command_kind* kind,
+                              size_t* length) {
+    uint32_t offset;
+    memcpy(&offset, (const char*)lc + kind->string, sizeof(offset));
+    if (offset < kind->size || offset >= lc->cmdsize) {
+        return NULL;
+    }
+    const char* string = (const char*)lc + offset;
+    const char* end = memchr(string, '\0', lc->cmdsize - offset);
+    *length = end ? (size_t)(end - string) : lc->cmdsize - offset;
+    return string;
+}
+
+// Compares two commands of the same type field by field, with the string of
+// commands that have one compared as a string. Commands without a field table,
+// and whatever follows the fields, like the tools of LC_BUILD_VERSION, are
+// compared word by word.
+local void diff_command(struct diff* d, const char* path,
+                        const struct macho_command* old,
+                        const struct macho_command* new) {
+    if (!d->emit) {
+        return;
+    }
+    const S(load_command*) lc[2] = {
+        macho_command_data(d->macho[0], old),
+        macho_command_data(d->macho[1], new)
+    };
+    if (old->cmdsize != new->cmdsize) {
+        diff_value(d, path, "cmdsize", old->cmdsize, new->cmdsize);
+    }
+    const struct macho_command_kind* kind = macho_command_kind(old->cmd);
+    const bool string = kind && kind->string && old->cmdsize >= kind->size
+                        && new->cmdsize >= kind->size;
+    uint32_t end = old->cmdsize < new->cmdsize ? old->cmdsize : new->cmdsize;
+    if (string) {
+        end = kind->size;
+    }
+    uint32_t start = sizeof(S(load_command));
+    const struct diff_command_fields* table = diff_command_lookup(old->cmd);
+    if (table) {
+        const struct diff_field* last = &table->fields[table->count - 1];
+        const uint32_t size = (uint32_t)(last->offset + last->size);
+        if (old->cmdsize >= size && new->cmdsize >= size) {
+            diff_fields(d, path, table->fields, table->count, lc[0], lc[1]);
+            start = size;
+        }
+    }
+    for (uint32_t offset = start; offset + 4 <= end; offset += 4) {
+        uint32_t a, b;
+        memcpy(&a, (const char*)lc[0] + offset, sizeof(a));
+        memcpy(&b, (const char*)lc[1] + offset, sizeof(b));
+        if (a != b && !(string && offset == kind->string)) {
+            char field[16];
+            snprintf(field, sizeof(field), "+0x%x", offset);
+            diff_value(d, path, field, a, b);
+        }
+    }
+    if (!string) {
+        return;
+    }
+    size_t length[2] = { 0, 0 };
+    const char* s[2] = {
+        diff_string(lc[0], kind, &length[0]),
+        diff_string(lc[1], kind, &length[1])
+    };
+    if ((s[0] == NULL) == (s[1] == NULL)
+        && (!s[0] || (length[0] == length[1]
+                      && memcmp(s[0], s[1], length[0]) == 0))) {
+        return;
+    }
+    struct out* out = d->out;
+    diff_begin(d, "string", path);
+    if (d->format == DumpFormatText) {
+        out_cputs(out, "{Y}~{0} ");
+        out_puts(out, path);
+        out_puts(out, " string: ");
+    } else {
+        out_puts(out, ",\"old\":");
+    }
+    for (int side = 0; side < 2; side++) {
+        if (d->format == DumpFormatText) {
+            out_cputs(out, side == 0 ? "{R}" : " -> {G}");
+            if (s[side]) {
+                out_putc(out, '"');
+                out_write(out, s[side], length[side]);
+                out_putc(out, '"');
+            } else {
+                out_puts(out, "(none)");
+            }
+            out_cputs(out, side == 0 ? "{0}" : "{0}\n");
+        } else {
+            if (side == 1) {
+                out_puts(out, ",\"new\":");
+            }
+            if (s[side]) {
+                json_string(out, s[side], length[side]);
+            } else {
+                out_puts(out, "null");
+            }
+        }
+    }
+    diff_end(d);
+}
+
+local void diff_section_path(char path[64], const S(section_64*) section) {
+    snprintf(path, 64, "section \"%.16s,%.16s\"", section->segname,
+             section->sectname);
+}
+
+// Compares two segments with the same name: their fields, their sections,
+// paired by name, and the contents of the sections, or of the segments
+// themselves if they have none, like __LINKEDIT.
+local void diff_segment(struct diff* d, const char* path,
+                        const struct macho_segment* old,
+                        const struct macho_segment* new) {
+    const struct macho_segment* segment[2] = { old, new };
+    diff_fields(d, path, diff_segment_fields, DIFF_COUNT(diff_segment_fields),
+                &old->command, &new->command);
+    if (old->command.nsects == 0 && new->command.nsects == 0) {
+        const unsigned char* data[2];
+        uint64_t size[2];
+        for (int side = 0; side < 2; side++) {
+            size[side] = segment[side]->command.filesize;
+            data[side] = macho_data(d->macho[side],
+                                    segment[side]->command.fileoff,
+                                    size[side]);
+        }
+        if (data[0] && data[1]) {
+            diff_region(d, path, data, size, old->command.vmaddr);
+        }
+        return;
+    }
+
+    uint32_t count[2];
+    struct diff_key* keys[2];
+    uint32_t* pair[2];
+    uint32_t* rank[2];
+    for (int side = 0; side < 2; side++) {
+        count[side] = segment[side]->command.nsects;
+    }
+    if (!diff_tables(count, keys, pair, rank)) {
+        diff_exhausted(d);
+        return;
+    }
+    for (int side = 0; side < 2; side++) {
+        for (uint32_t i = 0; i < count[side]; i++) {
+            const S(section_64*) section =
+                &d->macho[side]->sections[segment[side]->first_section + i];
+            memcpy(keys[side][i].name, section->sectname,
+                   sizeof(keys[side][i].name));
+            keys[side][i].cmd = 0;
+            keys[side][i].index = i;
+        }
+    }
+    diff_pair(keys, count, pair, rank);
+
+    char section_path[64];
+    for (uint32_t i = 0; i < count[0]; i++) {
+        const uint32_t index[2] = {
+            old->first_section + i,
+            pair[0][i] == MACHO_NONE ? MACHO_NONE
+                                     : new->first_section + pair[0][i]
+        };
+        const S(section_64*) section[2] = {
+            &d->macho[0]->sections[index[0]],
+            index[1] == MACHO_NONE ? NULL : &d->macho[1]->sections[index[1]]
+        };
+        diff_section_path(section_path, section[0]);
+        if (!section[1]) {
+            diff_presence(d, 0, section_path);
+            continue;
+        }
+        diff_fields(d, section_path, diff_section_fields,
+                    DIFF_COUNT(diff_section_fields), section[0], section[1]);
+        const unsigned char* data[2];
+        uint64_t size[2];
+        for (int side = 0; side < 2; side++) {
+            data[side] = macho_section_has_contents(section[side])
+                ? macho_section_data(d->macho[side], section[side]) : NULL;
+            size[side] = section[side]->size;
+        }
+        if (data[0] && data[1]) {
+            diff_region(d, section_path, data, size, section[0]->addr);
+        }
+    }
+    for (uint32_t i = 0; i < count[1]; i++) {
+        if (pair[1][i] == MACHO_NONE) {
+            diff_section_path(section_path,
+                &d->macho[1]->sections[new->first_section + i]);
+            diff_presence(d, 1, section_path);
+        }
+    }
+    diff_tables_free(keys, pair, rank);
+}
+
+// Names a command: a segment by its name, anything else by its type and
+// position among the commands of that type.
+local void diff_command_path(char path[64], const struct macho* macho,
+                             const struct macho_command* command,
+                             uint32_t rank) {
+    if (command->segment != MACHO_NONE) {
+        snprintf(path, 64, "segment \"%.16s\"",
+                 macho->segments[command->segment].command.segname);
+        return;
+    }
+    const struct macho_command_kind* kind = macho_command_kind(command->cmd);
+    if (kind) {
+        snprintf(path, 64, "%s[%u]", kind->name, rank);
+    } else {
+        snprintf(path, 64, "0x%08x[%u]", command->cmd, rank);
+    }
+}
+
+local void diff_walk(struct diff* d) {
+    diff_fields(d, "header", diff_header_fields,
+                DIFF_COUNT(diff_header_fields), &d->macho[0]->header,
+                &d->macho[1]->header);
+
+    uint32_t count[2];
+    struct diff_key* keys[2];
+    uint32_t* pair[2];
+    uint32_t* rank[2];
+    for (int side = 0; side < 2; side++) {
+        count[side] = d->macho[side]->ncommands;
+    }
+    if (!diff_tables(count, keys, pair, rank)) {
+        diff_exhausted(d);
+        return;
+    }
+    for (int side = 0; side < 2; side++) {
+        const struct macho* macho = d->macho[side];
+        for (uint32_t i = 0; i < count[side]; i++) {
+            const struct macho_command* command = &macho->commands[i];
+            struct diff_key* key = &keys[side][i];
+            memset(key->name, 0, sizeof(key->name));
+            if (command->segment != MACHO_NONE) {
+                memcpy(key->name,
+                       macho->segments[command->segment].command.segname,
+                       sizeof(key->name));
+            }
+            key->cmd = command->cmd;
+            key->index = i;
+        }
+    }
+    diff_pair(keys, count, pair, rank);
+
+    char path[64];
+    for (uint32_t i = 0; i < count[0]; i++) {
+        const struct macho_command* old = &d->macho[0]->commands[i];
+        diff_command_path(path, d->macho[0], old, rank[0][i]);
+        if (pair[0][i] == MACHO_NONE) {
+            diff_presence(d, 0, path);
+            continue;
+        }
+        const struct macho_command* new = &d->macho[1]->commands[pair[0][i]];
+        if (old->segment != MACHO_NONE && new->segment != MACHO_NONE) {
+            diff_segment(d, path, &d->macho[0]->segments[old->segment],
+                         &d->macho[1]->segments[new->segment]);
+        } else {
+            diff_command(d, path, old, new);
+        }
+    }
+    for (uint32_t i = 0; i < count[1]; i++) {
+        if (pair[1][i] == MACHO_NONE) {
+            diff_command_path(path, d->macho[1], &d->macho[1]->commands[i],
+                              rank[1][i]);
+            diff_presence(d, 1, path);
+        }
+    }
+    diff_tables_free(keys, pair, rank);
+}
+
+static void diff_hash_task(void* context, size_t index) {
+    struct diff_block* block = (struct diff_block*)context + index;
+    block->equal = xxh64(block->data[0], block->size, 0)
+                   == xxh64(block->data[1], block->size, 0);
+}
+
+bool diff_dump(struct out* out, struct diff_file files[2],
+               enum dump_format format, unsigned threads) {
+    struct macho macho[2];
+    for (int side = 0; side < 2; side++) {
+        void* buffer = files[side].buffer;
+        size_t length = files[side].length;
+        files[side].error = mach_select(&buffer, &length);
+        if (files[side].error == DumpErrorNone) {
+            files[side].error = macho_parse(&macho[side], buffer, length);
+        }
+        if (files[side].error != DumpErrorNone) {
+            if (side == 1) {
+                macho_free(&macho[0]);
+            }
+            return false;
+        }
+    }
+
+    struct diff d = {
+        out, { &macho[0], &macho[1] }, format, false,
+        NULL, 0, 0, 0, NULL, 0, 0, false, 0
+    };
+    diff_walk(&d);
+    pool_for(threads, d.nblocks, diff_hash_task, d.blocks);
+
+    if (format == DumpFormatText) {
+        out_cputs(out, "{R}---{0} ");
+        out_puts(out, files[0].name);
+        out_cputs(out, "\n{G}+++{0} ");
+        out_puts(out, files[1].name);
+        out_putc(out, '\n');
+    } else {
+        out_puts(out, format == DumpFormatNDJSON
+                      ? "{\"record\":\"diff\",\"old\":" : "{\"old\":");
+        json_string(out, files[0].name, (size_t)-1);
+        out_puts(out, ",\"new\":");
+        json_string(out, files[1].name, (size_t)-1);
+        out_puts(out, format == DumpFormatNDJSON ? "}\n" : ",\"changes\":[");
+    }
+    d.emit = true;
+    diff_walk(&d);
+    if (format == DumpFormatJSON) {
+        out_puts(out, "]}\n");
+    }
+
+    if (d.exhausted) {
+        files[0].error = DumpErrorNoMemory;
+    }
+
+    xfree(d.regions);
+    xfree(d.blocks);
+    macho_free(&macho[0]);
+    macho_free(&macho[1]);
+    return d.changes > 0;
+}
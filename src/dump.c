@@ -1,33 +1,195 @@
 // src/dump.c
 // Copyright (C) 2021 Ethan Uppal. All rights reserved.
 
+#include "archive.h"
+#include "chained.h"
 #include "dump.h"
+#include "dyldinfo.h"
+#include "fat.h"
+#include "funcstarts.h"
+#include "hex.h"
+#include "json.h"
+#include "macho.h"
+#include "out.h"
+#include "partial.h"
 #include "safe.h"
+#include "stats.h"
+#include "symindex.h"
 #include "termcolor.h"
-#define printf tcol_printf
-#define fprintf tcol_fprintf
+#define printf(...) out_printf(out, __VA_ARGS__)
+#include <mach-o/fat.h>
+#include <mach-o/fixup-chains.h>
 #include <mach-o/loader.h>
 #include <mach-o/nlist.h>
+#include <string.h>
 
 #define S(...) struct __VA_ARGS__
-#define START_READ() size_t __CUR = 0
-#define READ(n) buffer + __CUR; do { \
-    __CUR += (n); \
-    if (__CUR >= length) return; \
-} while (0)
-#define CONSUME(n) __CUR += (n)
 
+// The flag and option names and their extras contain no conversions, so they
+// are written verbatim rather than going through printf.
 #define PRINT_FLAG(flags, flag) \
-    if ((flags) & (flag)) printf(" {+}" #flag "{0}")
+    if ((flags) & (flag)) out_cputs(out, " {+}" #flag "{0}")
 #define PRINT_FLAG_EXT(flags, flag, extra) \
-    if ((flags) & (flag)) printf(" {+}" #flag "{0}" extra)
+    if ((flags) & (flag)) out_cputs(out, " {+}" #flag "{0}" extra)
+#define PRINT_OPTION_FLAG(value, instance) \
+    if ((value) == (instance)) out_cputs(out, " {+}" #instance "{0}")
 #define PRINT_OPTION(value, instance) \
-    if ((value) == (instance)) printf("{+}" #instance "{0}\n")
+    if ((value) == (instance)) out_cputs(out, "{+}" #instance "{0}\n")
 #define PRINT_OPTION_EXT(value, instance, extra) \
-    if ((value) == (instance)) printf("{+}" #instance "{0}" extra "\n")
+    if ((value) == (instance)) out_cputs(out, "{+}" #instance "{0}" extra "\n")
+
+// Hand-rolled formatting for the fields printed once per symbol or section,
+// which would otherwise spend most of their time inside vfprintf.
+#define PRINT_HEX(prefix, value, digits, suffix) do { \
+    out_cputs(out, prefix); \
+    out_hex(out, (value), (digits)); \
+    out_cputs(out, suffix); \
+} while (0)
+#define PRINT_DEC(prefix, value, suffix) do { \
+    out_cputs(out, prefix); \
+    out_dec(out, (value)); \
+    out_cputs(out, suffix); \
+} while (0)
 
 #define local static inline
 
+// Large tables are rendered this many entries at a time, one chunk per task.
+#define DUMP_CHUNK_SIZE 16384
+
+static unsigned dump_threads = 1;
+
+void dump_set_threads(unsigned threads) {
+    dump_threads = threads > 0 ? threads : 1;
+}
+
+// Renders entries [0, count) with render, in parallel chunks when threads are
+// available; see out_render_chunks.
+local void dump_in_chunks(struct out* out, size_t count, size_t chunk,
+                          void (*render)(struct out* out, void* context,
+                                         size_t begin, size_t end),
+                          void* context) {
+    out_render_chunks(out, dump_threads, count, chunk, render, context);
+}
+
+static enum dump_format dump_format = DumpFormatText;
+static const char* dump_hexdump_sections = NULL;
+static const char* dump_arches = NULL;
+static const char* dump_members = NULL;
+static unsigned dump_parts = DUMP_PART_ALL;
+static const char* dump_segments = NULL;
+
+static const struct {
+    const char* name;
+    enum dump_part part;
+} dump_part_names[] = {
+    { "header", DumpPartHeader },
+    { "segments", DumpPartSegments },
+    { "symtab", DumpPartSymtab },
+    { "dysymtab", DumpPartDysymtab },
+    { "build", DumpPartBuild },
+    { "other", DumpPartOther }
+};
+
+void dump_set_format(enum dump_format format) {
+    dump_format = format;
+}
+
+void dump_set_hexdump(const char* sections) {
+    dump_hexdump_sections = sections;
+}
+
+void dump_set_arch(const char* arches) {
+    dump_arches = arches;
+}
+
+void dump_set_members(const char* members) {
+    dump_members = members;
+}
+
+int dump_set_only(const char* parts) {
+    if (!parts) {
+        dump_parts = DUMP_PART_ALL;
+        return 0;
+    }
+    const size_t count = sizeof(dump_part_names) / sizeof(*dump_part_names);
+    unsigned selected = 0;
+    while (*parts) {
+        const size_t length = strcspn(parts, ",");
+        size_t i = 0;
+        while (i < count && !(strlen(dump_part_names[i].name) == length
+                              && strncmp(parts, dump_part_names[i].name,
+                                         length) == 0)) {
+            i++;
+        }
+        if (i == count) {
+            return 1;
+        }
+        selected |= dump_part_names[i].part;
+        parts += length;
+        if (*parts == ',') {
+            parts++;
+        }
+    }
+    dump_parts = selected;
+    return 0;
+}
+
+void dump_set_segments(const char* segments) {
+    dump_segments = segments;
+}
+
+// Whether the name of the given length appears in the comma separated list.
+local bool list_contains(const char* list, const char* name, size_t n) {
+    while (*list) {
+        size_t length = 0;
+        while (list[length] && list[length] != ',') {
+            length++;
+        }
+        if (length == n && strncmp(list, name, length) == 0) {
+            return true;
+        }
+        list += length;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return false;
+}
+
+// Whether the 16 character name appears in the comma separated list.
+local bool name_in_list(const char* list, const char name[16]) {
+    size_t length = 0;
+    while (length < 16 && name[length]) {
+        length++;
+    }
+    return list_contains(list, name, length);
+}
+
+bool dump_wants_header(void) {
+    return dump_parts & DumpPartHeader;
+}
+
+bool dump_wants_command(const S(load_command*) lc) {
+    switch (lc->cmd) {
+        case LC_SEGMENT_64: {
+            if (!(dump_parts & DumpPartSegments)) {
+                return false;
+            }
+            const S(segment_command_64*) seg64 = (const void*)lc;
+            return !dump_segments || lc->cmdsize < sizeof(*seg64)
+                   || name_in_list(dump_segments, seg64->segname);
+        }
+        case LC_SYMTAB:
+            return dump_parts & DumpPartSymtab;
+        case LC_DYSYMTAB:
+            return dump_parts & DumpPartDysymtab;
+        case LC_BUILD_VERSION:
+            return dump_parts & DumpPartBuild;
+        default:
+            return dump_parts & DumpPartOther;
+    }
+}
+
 local const char* argz_get_string(const char* start, size_t index) {
     const char* next = start;
     while (index > 0) {
@@ -38,20 +200,35 @@ local const char* argz_get_string(const char* start, size_t index) {
     return start;
 }
 
-local void dump_header(void* buffer, S(mach_header_64)* header) {
-    printf("│ {C}Header{0}: {M+}struct {0}mach_header_64\n");
-    printf("└─┐ Magic: {Y}0x%08x{0}\n", header->magic);
+local void dump_header(struct out* out, const struct macho* macho) {
+    const S(mach_header_64*) header = &macho->header;
+    out_cputs(out, "│ {C}Header{0}: {M+}struct {0}mach_header_64\n");
+    PRINT_HEX("└─┐ Magic: {Y}0x", header->magic, 8, "{0}\n");
 
-    printf("  │ CPU Type: {Y}0x%08x{0}: ", header->cputype);
-    PRINT_OPTION(header->cputype, CPU_TYPE_X86_64);
-    PRINT_OPTION(header->cputype, CPU_TYPE_POWERPC64);
-    PRINT_OPTION(header->cputype, CPU_TYPE_ANY);
+    PRINT_HEX("  │ CPU Type: {Y}0x", (uint32_t)header->cputype, 8, "{0}: ");
+    PRINT_OPTION(header->cputype, CPU_TYPE_X86_64); else
+    PRINT_OPTION(header->cputype, CPU_TYPE_ARM64); else
+    PRINT_OPTION(header->cputype, CPU_TYPE_POWERPC64); else
+    PRINT_OPTION(header->cputype, CPU_TYPE_ANY); else {
+        out_putc(out, '\n');
+    }
 
-    printf("  │ CPU Subtype: {Y}0x%08x{0}:", header->cpusubtype);
-    PRINT_OPTION(header->cpusubtype, CPU_SUBTYPE_POWERPC_ALL);
-    PRINT_OPTION(header->cpusubtype, CPU_SUBTYPE_X86_64_ALL);
+    PRINT_HEX("  │ CPU Subtype: {Y}0x", (uint32_t)header->cpusubtype, 8,
+              "{0}:");
+    if (header->cputype == CPU_TYPE_ARM64) {
+        const cpu_subtype_t subtype = header->cpusubtype & ~CPU_SUBTYPE_MASK;
+        PRINT_OPTION(subtype, CPU_SUBTYPE_ARM64_ALL); else
+        PRINT_OPTION(subtype, CPU_SUBTYPE_ARM64E); else {
+            out_putc(out, '\n');
+        }
+    } else {
+        PRINT_OPTION(header->cpusubtype, CPU_SUBTYPE_POWERPC_ALL); else
+        PRINT_OPTION(header->cpusubtype, CPU_SUBTYPE_X86_64_ALL); else {
+            out_putc(out, '\n');
+        }
+    }
 
-    printf("  │ File Type: {Y}0x%08x{0}: ", header->filetype);
+    PRINT_HEX("  │ File Type: {Y}0x", header->filetype, 8, "{0}: ");
     PRINT_OPTION_EXT(header->filetype, MH_OBJECT,
                      ": Intermediate Object File"); else
     PRINT_OPTION_EXT(header->filetype, MH_EXECUTE,
@@ -73,10 +250,10 @@ local void dump_header(void* buffer, S(mach_header_64)* header) {
         printf("Unknown file type\n");
     }
 
-    printf("  │ Number of load commands: %u\n", header->ncmds);
-    printf("  │ Size of load commands: %u byte(s)\n", header->sizeofcmds);
+    PRINT_DEC("  │ Number of load commands: ", header->ncmds, "\n");
+    PRINT_DEC("  │ Size of load commands: ", header->sizeofcmds, " byte(s)\n");
 
-    printf("┌─┘ Flags: {Y}0x%08x{0}:", header->flags);
+    PRINT_HEX("┌─┘ Flags: {Y}0x", header->flags, 8, "{0}:");
     PRINT_FLAG(header->flags, MH_NOUNDEFS);
     PRINT_FLAG(header->flags, MH_INCRLINK);
     PRINT_FLAG(header->flags, MH_DYLDLINK);
@@ -94,10 +271,34 @@ local void dump_header(void* buffer, S(mach_header_64)* header) {
     if (header->flags == 0) {
         printf(" None");
     }
-    fputc('\n', stdout);
+    out_putc(out, '\n');
+}
+
+struct dump_hexdump {
+    const unsigned char* bytes;
+    uint64_t size;
+    uint64_t offset;
+};
+
+static void dump_hexdump_range(struct out* out, void* context, size_t begin,
+                               size_t end) {
+    static const char prefix[] = "  │   ";
+    struct dump_hexdump* hexdump = context;
+    char rows[64 * (sizeof(prefix) + HEX_ROW_SIZE)];
+    for (size_t row = begin; row < end; row += 64) {
+        const uint64_t start = (uint64_t)row * 16;
+        uint64_t size = (end - row < 64 ? end - row : 64) * 16;
+        if (size > hexdump->size - start) {
+            size = hexdump->size - start;
+        }
+        out_write(out, rows, hex_dump_rows(rows, hexdump->bytes + start,
+                                           (size_t)size,
+                                           hexdump->offset + start, prefix));
+    }
 }
 
-local void dump_section_64(void* buffer, S(section_64*) sec64) {
+local void dump_section_64(struct out* out, const struct macho* macho,
+                           const S(section_64*) sec64) {
     printf("  │ {C}Section 64{0}: {M+}struct {0}section_64\n");
     printf("  └─┐ Section Name: {/}\"%.16s\"{0}\n", sec64->sectname);
     printf("    │ Segment Name: {/}\"%.16s\"{0}\n", sec64->segname);
@@ -133,109 +334,153 @@ local void dump_section_64(void* buffer, S(section_64*) sec64) {
     if (sec64->flags == 0) {
         printf("None");
     }
-    fputc('\n', stdout);
-    printf("  ┌─┘ Assembly:");
-    for (uint64_t i = 0; i < sec64->size; i++) {
-        const unsigned char byte = ((char*)buffer + sec64->offset)[i];
+    out_putc(out, '\n');
+    out_cputs(out, "  ┌─┘ Assembly:");
+    const unsigned char* bytes = macho_section_data(macho, sec64);
+    if (!bytes) {
+        out_puts(out, " (outside the file)");
+    }
+    for (uint64_t i = 0; bytes && i < sec64->size; i++) {
+        const unsigned char byte = bytes[i];
         if (sec64->size > 16 && i > 4 && i < sec64->size - 4) {
             i = sec64->size - 4;
-            printf(" ...");
+            out_puts(out, " ...");
         } else {
-            printf(" 0x%02x", (uint32_t)byte);
+            PRINT_HEX(" 0x", byte, 2, "");
         }
     }
-    fputc('\n', stdout);
+    out_putc(out, '\n');
+
+    if (bytes && dump_hexdump_sections && macho_section_has_contents(sec64)
+        && (!*dump_hexdump_sections
+            || name_in_list(dump_hexdump_sections, sec64->sectname))) {
+        struct dump_hexdump hexdump = { bytes, sec64->size, sec64->offset };
+        dump_in_chunks(out, (size_t)((sec64->size + 15) / 16),
+                       DUMP_CHUNK_SIZE, dump_hexdump_range, &hexdump);
+    }
 }
 
-local void dump_segment_64(void* buffer, S(segment_command_64*) seg64) {
-    printf("  │ Command Size: %u byte(s)\n", seg64->cmdsize);
+local void dump_segment_64(struct out* out, const struct macho* macho,
+                           const struct macho_segment* segment) {
+    const S(segment_command_64*) seg64 = &segment->command;
+    PRINT_DEC("  │ Command Size: ", seg64->cmdsize, " byte(s)\n");
     printf("  │ Segment Name: {/}\"%.16s\"{0}\n", seg64->segname);
-    printf("  │ Virtual Memory Address: {Y}0x%016llx{0}\n", seg64->vmaddr);
-    printf("  │ Virtual Memory Size: {Y}0x%016llx{0}\n", seg64->vmsize);
-    printf("  │ File Offset: {Y}0x%016llx{0}\n", seg64->fileoff);
-    printf("  │ File Size: {Y}0x%016llx{0}\n", seg64->filesize);
-    printf("  │ Maximum Virtual Memory Protection: {Y}0x%08x{0}\n",
-           seg64->maxprot);
-    printf("  │ Initial Virtual Memory Protection: {Y}0x%08x{0}\n",
-           seg64->initprot);
-    printf("  │ Number of sections: %u\n", seg64->nsects);
+    PRINT_HEX("  │ Virtual Memory Address: {Y}0x", seg64->vmaddr, 16, "{0}\n");
+    PRINT_HEX("  │ Virtual Memory Size: {Y}0x", seg64->vmsize, 16, "{0}\n");
+    PRINT_HEX("  │ File Offset: {Y}0x", seg64->fileoff, 16, "{0}\n");
+    PRINT_HEX("  │ File Size: {Y}0x", seg64->filesize, 16, "{0}\n");
+    PRINT_HEX("  │ Maximum Virtual Memory Protection: {Y}0x",
+              (uint32_t)seg64->maxprot, 8, "{0}\n");
+    PRINT_HEX("  │ Initial Virtual Memory Protection: {Y}0x",
+              (uint32_t)seg64->initprot, 8, "{0}\n");
+    PRINT_DEC("  │ Number of sections: ", seg64->nsects, "\n");
 
     if (seg64->nsects > 0) {
-        printf("  │ ");
+        out_cputs(out, "  │ ");
     } else {
-        printf("┌─┘ ");
+        out_cputs(out, "┌─┘ ");
     }
-    printf("Flags: {Y}0x%08x{0}:", seg64->flags);
+    PRINT_HEX("Flags: {Y}0x", seg64->flags, 8, "{0}:");
     PRINT_FLAG(seg64->flags, SG_HIGHVM);
     PRINT_FLAG(seg64->flags, SG_NORELOC);
     if (seg64->flags == 0) {
         printf(" None");
     }
-    fputc('\n', stdout);
+    out_putc(out, '\n');
 
-    char* sections = (void*)(seg64 + 1);
-    for (uint32_t i = 0; i < seg64->nsects; i++) {
-        S(section_64*) section = (void*)sections;
-        sections += sizeof(S(section_64));//section->size;
-        dump_section_64(buffer, section);
+    struct macho_iter it = macho_segment_sections(macho, segment);
+    for (const S(section_64*) section; (section = macho_next_section(&it));) {
+        dump_section_64(out, macho, section);
     }
     printf("┌─┘\n");
 }
 
-local void dumo_nlist64_elem(void* buffer, S(nlist_64*) elem,
-                             const char* symtable) {
-    printf("  │ {C}Symbol{0}: {M+}struct {0}nlist_64\n");
-    printf("  └─┐ Offset in String Table: %u\n", elem->n_un.n_strx);
-    printf("    │ Type: {Y}0x%02x{0}:", elem->n_type);
+local void dumo_nlist64_elem(struct out* out, const struct macho* macho,
+                             bool names,
+                             const S(nlist_64*) elem) {
+    out_cputs(out, "  │ {C}Symbol{0}: {M+}struct {0}nlist_64\n");
+    PRINT_DEC("  └─┐ Offset in String Table: ", elem->n_un.n_strx, "\n");
+    PRINT_HEX("    │ Type: {Y}0x", elem->n_type, 2, "{0}:");
     PRINT_FLAG_EXT(elem->n_type, N_STAB, "(Symbolic Debugging Entry)");
     PRINT_FLAG_EXT(elem->n_type, N_PEXT, "(Private External Symbol)");
     PRINT_FLAG_EXT(elem->n_type, N_EXT, "(External Symbol)");
 
     const uint32_t actual_type = (elem->n_type & N_TYPE);
-    fputc(' ', stdout);
+    out_putc(out, ' ');
     PRINT_OPTION_EXT(actual_type, N_SECT, "(Defined in Section)"); else
     PRINT_OPTION_EXT(actual_type, N_INDR, "(Indirect)"); else
     PRINT_OPTION_EXT(actual_type, N_PBUD, "(Prebound)"); else
     PRINT_OPTION_EXT(actual_type, N_ABS, "(Absolute)"); else
     PRINT_OPTION_EXT(actual_type, N_UNDF, "(Undefined)"); else {
-        fputc('\n', stdout);
+        out_putc(out, '\n');
     }
 
-    printf("    │ Section Location: ");
+    out_cputs(out, "    │ Section Location: ");
     if (elem->n_sect > 0) {
-        printf("%u (from 1)\n", elem->n_sect);
+        PRINT_DEC("", elem->n_sect, " (from 1)\n");
     } else {
-        printf("NO_SECT\n");
+        out_cputs(out, "NO_SECT\n");
     }
-    printf("    │ Description: {Y}0x%04x{0}\n", elem->n_desc);
-    printf("    │ Address of Symbol in Assembly: {Y}0x%08x{0}\n",
-           elem->n_value);
-    const char* symbol = symtable + elem->n_un.n_strx;
-    printf("  ┌─┘ String: offset {Y}0x%016lx{0}: {/}\"%s\"{0}\n", (void*)symbol - buffer,
-           symbol);
+    PRINT_HEX("    │ Description: {Y}0x", elem->n_desc, 4, "{0}\n");
+    PRINT_HEX("    │ Address of Symbol in Assembly: {Y}0x", elem->n_value, 8,
+              "{0}\n");
+    size_t length;
+    const char* symbol = macho_symbol_name(macho, names, elem, &length);
+    PRINT_HEX("  ┌─┘ String: offset {Y}0x",
+              (uint64_t)macho->symtab.stroff + elem->n_un.n_strx, 16,
+              "{0}: {/}\"");
+    out_write(out, symbol, length);
+    out_cputs(out, "\"{0}\n");
+
+}
+
+struct dump_symbols {
+    const struct macho* macho;
+    bool names;
+};
 
+static void dump_symbol_range(struct out* out, void* context, size_t begin,
+                              size_t end) {
+    struct dump_symbols* symbols = context;
+    for (size_t i = begin; i < end; i++) {
+        const S(nlist_64) elem = macho_symbol(symbols->macho, (uint32_t)i);
+        dumo_nlist64_elem(out, symbols->macho, symbols->names, &elem);
+    }
 }
 
-local void dump_symbol_table(void* buffer, S(symtab_command*) symt) {
+// The symbols are only rendered if the command is valid; otherwise just its
+// fields are.
+static void dump_symbol_table(struct out* out, const struct macho* macho,
+                              const struct macho_command* command) {
+    S(symtab_command) copy;
+    memcpy(&copy, macho_command_data(macho, command), sizeof(copy));
+    const S(symtab_command*) symt = &copy;
+    const uint32_t nsyms = command->verdict == MachoVerdictValid
+                           ? symt->nsyms : 0;
     printf("  │ Command Size: %u byte(s)\n", symt->cmdsize);
     printf("  │ Symbol Table Offset: %u byte(s)\n", symt->symoff);
     printf("  │ Number of Symbols: %u\n", symt->nsyms);
     printf("  │ String Table Offset: %u byte(s)\n", symt->stroff);
-    if (symt->nsyms > 0) {
+    if (nsyms > 0) {
         printf("  │ ");
     } else {
         printf("┌─┘ ");
     }
     printf("String Table Size: %u byte(s)\n", symt->strsize);
-    S(nlist_64*) syms = (void*)((char*)buffer + symt->symoff);
-    char* strtbl = (char*)buffer + symt->stroff;
-    for (uint32_t i = 0; i < symt->nsyms; i++) {
-        dumo_nlist64_elem(buffer, syms + i, strtbl);
-    }
+    struct dump_symbols symbols = {
+        macho, nsyms > 0 && macho_symbol_names(macho)
+    };
+    dump_in_chunks(out, nsyms, DUMP_CHUNK_SIZE, dump_symbol_range,
+                   &symbols);
+    stats_add(StatsSymbols, nsyms);
     printf("┌─┘\n");
 }
 
-local void dump_dysym_table(void* buffer, S(dysymtab_command*) dsymt) {
+static void dump_dysym_table(struct out* out, const struct macho* macho,
+                             const struct macho_command* command) {
+    S(dysymtab_command) copy;
+    memcpy(&copy, macho_command_data(macho, command), sizeof(copy));
+    const S(dysymtab_command*) dsymt = &copy;
     printf("  │ Command Size: %u byte(s)\n", dsymt->cmdsize);
     printf("  │ Index of first local symbol: %u\n", dsymt->ilocalsym);
     printf("  │ Number of local symbols: %u\n", dsymt->nlocalsym);
@@ -271,102 +516,1306 @@ local void dump_dysym_table(void* buffer, S(dysymtab_command*) dsymt) {
 //    printf("┌─┘\n");
 }
 
-local void dump_build_version(void* buffer, S(build_version_command*) bver) {
+// Prints the packed xxxx.yy.zz version, as used by dylibs and the minimum OS
+// and SDK versions.
+#define PRINT_VERSION(prefix, version) \
+    printf(prefix "{Y}0x%08x{0}: %u.%u.%u\n", (version), (version) >> 16, \
+           (version) >> 8 & 0xff, (version) & 0xff)
+
+// Writes the string the command embeds at offset, which validation has put
+// inside it, up to its NUL or the end of the command.
+local void dump_lc_str(struct out* out, const S(load_command*) lc,
+                       uint32_t offset) {
+    const char* string = (const char*)lc + offset;
+    const char* nul = memchr(string, '\0', lc->cmdsize - offset);
+    out_cputs(out, "{/}\"");
+    out_write(out, string, nul ? (size_t)(nul - string)
+                                : lc->cmdsize - offset);
+    out_cputs(out, "\"{0}\n");
+}
+
+static void dump_segment_command(struct out* out, const struct macho* macho,
+                                 const struct macho_command* command) {
+    dump_segment_64(out, macho, &macho->segments[command->segment]);
+}
+
+static void dump_build_version(struct out* out, const struct macho* macho,
+                               const struct macho_command* command) {
+    const S(build_version_command*) bver =
+        (const void*)macho_command_data(macho, command);
     printf("  │ Command Size: %u byte(s)\n", bver->cmdsize);
-    printf("  │ Platform: {Y]0x%08x{0}\n", bver->platform);
-    printf("  │ Minimum OS: {Y}0x%08x{0}: %u.%u.%u\n", bver->minos, bver->minos >> 16,
-           bver->minos >> 8 & 0xFF, bver->minos & 0xFF);
-    printf("  │ Minimum SDK: {Y}0x%08x{0}: %u.%u.%u\n", bver->sdk, bver->sdk >> 16,
-           bver->sdk >> 8 & 0xFF, bver->sdk & 0xFF);
-    printf("┌─┘ Number of build tools: %u\n", bver->ntools);
-}
-
-local void dump_load_command(void* buffer, S(load_command*) load_command) {
-    printf("│ {C}Load Command{0} (at offset {Y}0x%016lx{0})\n",
-           (void*)load_command - buffer);
-    printf("└─┐ Command Type: {Y}0x%08x{0}: ", load_command->cmd);
-
-    if (load_command->cmd == LC_UUID) {
-        printf("LC_UUID: struct uuid_command\n");
-    } else if (load_command->cmd == LC_SEGMENT) {
-        printf("LC_SEGMENT: struct segment_command\n");
-    } else if (load_command->cmd == LC_SEGMENT_64) {
-        printf("{+}LC_SEGMENT_64{0}: {M+}struct {0}segment_command_64\n");
-        dump_segment_64(buffer, (S(segment_command_64*))load_command);
-    } else if (load_command->cmd == LC_SYMTAB) {
-        printf("{+}LC_SYMTAB{0}: {M+}struct {0}symtab_command\n");
-        dump_symbol_table(buffer, (S(symtab_command*))load_command);
-    } else if (load_command->cmd == LC_DYSYMTAB) {
-        printf("{+}LC_DYSYMTAB{0}: {M+}struct {0}dysymtab_command\n");
-        dump_dysym_table(buffer, (S(dysymtab_command*))load_command);
-    } else if (load_command->cmd == LC_THREAD) {
-        printf("LC_THREAD: struct thread_command\n");
-    } else if (load_command->cmd == LC_UNIXTHREAD) {
-        printf("LC_UNIXTHREAD: struct thread_command\n");
-    } else if (load_command->cmd == LC_LOAD_DYLIB) {
-        printf("LC_LOAD_DYLIB: struct dylib_command\n");
-    } else if (load_command->cmd == LC_ID_DYLIB) {
-        printf("LC_ID_DYLIB: struct dylib_command\n");
-    } else if (load_command->cmd == LC_PREBOUND_DYLIB) {
-        printf("LC_PREBOUND_DYLIB: struct prebound_dylib_command\n");
-    } else if (load_command->cmd == LC_LOAD_DYLINKER) {
-        printf("LC_LOAD_DYLINKER: struct dylinker_command\n");
-    } else if (load_command->cmd == LC_ID_DYLINKER) {
-        printf("LC_ID_DYLINKER: struct dylinker_command\n");
-    } else if (load_command->cmd == LC_ROUTINES) {
-        printf("LC_ROUTINES: struct routines_command\n");
-    } else if (load_command->cmd == LC_ROUTINES_64) {
-        printf("LC_ROUTINES_64: struct routines_command_64\n");
-    } else if (load_command->cmd == LC_TWOLEVEL_HINTS) {
-        printf("LC_TWOLEVEL_HINTS: struct twolevel_hints_command\n");
-    } else if (load_command->cmd == LC_SUB_FRAMEWORK) {
-        printf("LC_SUB_FRAMEWORK: struct sub_framework_command\n");
-    } else if (load_command->cmd == LC_SUB_UMBRELLA) {
-        printf("LC_SUB_UMBRELLA: struct sub_umbrella_command\n");
-    } else if (load_command->cmd == LC_SUB_LIBRARY) {
-        printf("LC_SUB_LIBRARY: struct sub_library_command\n");
-    } else if (load_command->cmd == LC_SUB_CLIENT) {
-        printf("LC_SUB_CLIENT: struct sub_client_command\n");
-    } else if (load_command->cmd == LC_DYLD_INFO_ONLY) {
-        printf("LC_DYLD_INFO_ONLY\n");
-    } else if (load_command->cmd == LC_VERSION_MIN_MACOSX) {
-        printf("LC_VERSION_MIN_MACOSX: struct version_min_command\n");
-    } else if (load_command->cmd == LC_SOURCE_VERSION) {
-        printf("LC_SOURCE_VERSION: struct source_version_command\n");
-    } else if (load_command->cmd == LC_MAIN) {
-        printf("LC_MAIN\n");
-    } else if (load_command->cmd == LC_FUNCTION_STARTS) {
-        printf("FUNCTION_STARTS\n");
-    } else if (load_command->cmd == LC_LAZY_LOAD_DYLIB) {
-        printf("LC_LAZY_LOAD_DYLIB\n");
-    } else if (load_command->cmd == LC_BUILD_VERSION) {
-        printf("{+}LC_BUILD_VERSION{0}: {M+}struct {0}build_version_command\n");
-        dump_build_version(buffer, (S(build_version_command*))load_command);
-    }
-
-    #ifdef LC_SYMSEG
-    else if (load_command->cmd == LC_SYMSEG) {
-        printf("LC_SYMSEG: struct symseg_command\n");
-    }
-    #endif
-    else {
-        printf("Unknown\r├──\n");
-    }
-}
-
-void mach_dump(void* buffer, const size_t length) {
-    START_READ();
-
-    S(mach_header_64*) header = READ(sizeof(*header));
-    if (header->magic != MH_MAGIC_64) {
-        fprintf(stderr, "machdump: {R+}error:{0} Expected 64 bit mach-o file\n");
+    printf("  │ Platform: {Y}0x%08x{0}\n", bver->platform);
+    PRINT_VERSION("  │ Minimum OS: ", bver->minos);
+    PRINT_VERSION("  │ Minimum SDK: ", bver->sdk);
+    printf("%s Number of build tools: %u\n", bver->ntools > 0 ? "  │" : "┌─┘",
+           bver->ntools);
+    const S(build_tool_version*) tools = (const void*)(bver + 1);
+    for (uint32_t i = 0; i < bver->ntools; i++) {
+        printf("  │ Tool: {Y}0x%08x{0}\n", tools[i].tool);
+        if (i + 1 < bver->ntools) {
+            PRINT_VERSION("  │ Tool Version: ", tools[i].version);
+        } else {
+            PRINT_VERSION("┌─┘ Tool Version: ", tools[i].version);
+        }
+    }
+}
+
+static void dump_dylib(struct out* out, const struct macho* macho,
+                       const struct macho_command* command) {
+    const S(dylib_command*) dylib =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", dylib->cmdsize);
+    out_cputs(out, "  │ Name: ");
+    dump_lc_str(out, macho_command_data(macho, command),
+                dylib->dylib.name.offset);
+    printf("  │ Time Stamp: %u\n", dylib->dylib.timestamp);
+    PRINT_VERSION("  │ Current Version: ", dylib->dylib.current_version);
+    PRINT_VERSION("┌─┘ Compatibility Version: ",
+                  dylib->dylib.compatibility_version);
+}
+
+// For the commands whose only field is the string the registry points at,
+// such as LC_LOAD_DYLINKER and LC_RPATH.
+static void dump_string_command(struct out* out, const struct macho* macho,
+                                const struct macho_command* command) {
+    const S(load_command*) lc = macho_command_data(macho, command);
+    uint32_t offset;
+    memcpy(&offset, (const char*)lc + macho_command_kind(lc->cmd)->string,
+           sizeof(offset));
+    printf("  │ Command Size: %u byte(s)\n", lc->cmdsize);
+    out_cputs(out, "┌─┘ Name: ");
+    dump_lc_str(out, lc, offset);
+}
+
+static void dump_uuid(struct out* out, const struct macho* macho,
+                      const struct macho_command* command) {
+    const S(uuid_command*) uuid =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", uuid->cmdsize);
+    out_cputs(out, "┌─┘ UUID: {Y}");
+    for (size_t i = 0; i < sizeof(uuid->uuid); i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            out_putc(out, '-');
+        }
+        printf("%02X", uuid->uuid[i]);
+    }
+    out_cputs(out, "{0}\n");
+}
+
+static void dump_entry_point(struct out* out, const struct macho* macho,
+                             const struct macho_command* command) {
+    const S(entry_point_command*) entry =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", entry->cmdsize);
+    PRINT_HEX("  │ Entry Offset: {Y}0x", entry->entryoff, 16, "{0}\n");
+    PRINT_DEC("┌─┘ Stack Size: ", entry->stacksize, " byte(s)\n");
+}
+
+static void dump_source_version(struct out* out, const struct macho* macho,
+                                const struct macho_command* command) {
+    const S(source_version_command*) source =
+        (const void*)macho_command_data(macho, command);
+    const uint64_t version = source->version;
+    printf("  │ Command Size: %u byte(s)\n", source->cmdsize);
+    printf("┌─┘ Version: {Y}0x%016llx{0}: %llu.%llu.%llu.%llu.%llu\n",
+           (unsigned long long)version,
+           (unsigned long long)(version >> 40),
+           (unsigned long long)(version >> 30 & 0x3ff),
+           (unsigned long long)(version >> 20 & 0x3ff),
+           (unsigned long long)(version >> 10 & 0x3ff),
+           (unsigned long long)(version & 0x3ff));
+}
+
+static void dump_version_min(struct out* out, const struct macho* macho,
+                             const struct macho_command* command) {
+    const S(version_min_command*) version =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", version->cmdsize);
+    PRINT_VERSION("  │ Minimum OS: ", version->version);
+    PRINT_VERSION("┌─┘ SDK: ", version->sdk);
+}
+
+static void dump_linkedit_data(struct out* out, const struct macho* macho,
+                               const struct macho_command* command) {
+    const S(linkedit_data_command*) data =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", data->cmdsize);
+    printf("  │ Data Offset: {Y}0x%08x{0}\n", data->dataoff);
+    printf("┌─┘ Data Size: %u byte(s)\n", data->datasize);
+}
+
+struct dump_functions {
+    const struct function_starts* starts;
+    const struct symindex* index;
+};
+
+static void dump_function_range(struct out* out, void* context, size_t begin,
+                                size_t end) {
+    const struct dump_functions* functions = context;
+    const struct function_starts* starts = functions->starts;
+    for (size_t i = begin; i < end; i++) {
+        PRINT_HEX("  │ Function: {Y}0x", starts->addresses[i], 16,
+                  "{0}, size ");
+        PRINT_HEX("{Y}0x", starts->sizes[i], 1, "{0}");
+        if (starts->symbols[i] != SYMINDEX_NONE) {
+            out_cputs(out, ": {/}\"");
+            out_puts(out, symindex_name(functions->index, starts->symbols[i]));
+            out_cputs(out, "\"{0}");
+        }
+        out_putc(out, '\n');
+    }
+}
+
+// Lists the functions with their sizes and the symbols defined at their
+// starts. Only the fields are shown of a command that is not the file's
+// valid LC_FUNCTION_STARTS.
+static void dump_function_starts(struct out* out, const struct macho* macho,
+                                 const struct macho_command* command) {
+    if (macho->function_starts_command == MACHO_NONE
+        || command != &macho->commands[macho->function_starts_command]) {
+        dump_linkedit_data(out, macho, command);
+        return;
+    }
+    const S(linkedit_data_command*) data =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", data->cmdsize);
+    printf("  │ Data Offset: {Y}0x%08x{0}\n", data->dataoff);
+    printf("  │ Data Size: %u byte(s)\n", data->datasize);
+
+    struct function_starts starts;
+    struct symindex index;
+    function_starts_decode(&starts, macho);
+    symindex_build(&index, macho);
+    function_starts_join(&starts, &index);
+    printf("%s Number of functions: %u\n",
+           starts.count > 0 || starts.truncated ? "  │" : "┌─┘", starts.count);
+    if (starts.symbols) {
+        struct dump_functions functions = { &starts, &index };
+        dump_in_chunks(out, starts.count, DUMP_CHUNK_SIZE, dump_function_range,
+                       &functions);
+    }
+    if (starts.truncated) {
+        out_cputs(out, "  │ {R+}Error:{0} The function starts end in the "
+                  "middle of a delta\n");
+    }
+    if (starts.count > 0 || starts.truncated) {
+        printf("┌─┘\n");
+    }
+    symindex_free(&index);
+    function_starts_free(&starts);
+}
+
+struct dump_fixups {
+    const struct dyld_fixups* fixups;
+    const char* label;
+};
+
+// Writes the signed value in decimal.
+local void dump_signed(struct out* out, int64_t value) {
+    if (value < 0) {
+        out_putc(out, '-');
+        out_dec(out, 0 - (uint64_t)value);
+    } else {
+        out_dec(out, (uint64_t)value);
+    }
+}
+
+// The library a bind looks its symbol up in: a dylib by its one-based
+// ordinal among the LC_LOAD_DYLIB-like commands, or a special lookup.
+local void dump_bind_ordinal(struct out* out, int32_t ordinal) {
+    switch (ordinal) {
+        case BIND_SPECIAL_DYLIB_SELF:
+            out_puts(out, "self");
+            break;
+        case BIND_SPECIAL_DYLIB_MAIN_EXECUTABLE:
+            out_puts(out, "main executable");
+            break;
+        case BIND_SPECIAL_DYLIB_FLAT_LOOKUP:
+            out_puts(out, "flat lookup");
+            break;
+        case BIND_SPECIAL_DYLIB_WEAK_LOOKUP:
+            out_puts(out, "weak lookup");
+            break;
+        default:
+            out_puts(out, "dylib ");
+            dump_signed(out, ordinal);
+            break;
+    }
+}
+
+// Rebase and bind types share their values.
+local void dump_fixup_type(struct out* out, uint8_t type) {
+    switch (type) {
+        case REBASE_TYPE_POINTER:
+            out_puts(out, "pointer");
+            break;
+        case REBASE_TYPE_TEXT_ABSOLUTE32:
+            out_puts(out, "absolute32");
+            break;
+        case REBASE_TYPE_TEXT_PCREL32:
+            out_puts(out, "pcrel32");
+            break;
+        default:
+            out_puts(out, "type ");
+            out_dec(out, type);
+            break;
+    }
+}
+
+static void dump_fixup_range(struct out* out, void* context, size_t begin,
+                             size_t end) {
+    const struct dump_fixups* fixups = context;
+    for (size_t i = begin; i < end; i++) {
+        const struct dyld_fixup* fixup = &fixups->fixups->entries[i];
+        out_cputs(out, "  │ ");
+        out_puts(out, fixups->label);
+        PRINT_HEX(": {Y}0x", fixup->address, 16, "{0}, ");
+        dump_fixup_type(out, fixup->type);
+        if (fixup->symbol) {
+            out_puts(out, ", ");
+            dump_bind_ordinal(out, fixup->ordinal);
+            out_cputs(out, ": {/}\"");
+            out_puts(out, fixup->symbol);
+            out_cputs(out, "\"{0}");
+            if (fixup->addend) {
+                out_puts(out, ", addend ");
+                dump_signed(out, fixup->addend);
+            }
+            PRINT_FLAG(fixup->flags, BIND_SYMBOL_FLAGS_WEAK_IMPORT);
+            PRINT_FLAG(fixup->flags, BIND_SYMBOL_FLAGS_NON_WEAK_DEFINITION);
+        }
+        out_putc(out, '\n');
+    }
+}
+
+static void dump_export_range(struct out* out, void* context, size_t begin,
+                              size_t end) {
+    const struct dyld_exports* exports = context;
+    for (size_t i = begin; i < end; i++) {
+        const struct dyld_export* entry = &exports->entries[i];
+        if (entry->flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+            out_cputs(out, "  │ Export: re-export from ");
+            dump_bind_ordinal(out, (int32_t)entry->other);
+        } else {
+            PRINT_HEX("  │ Export: {Y}0x", entry->address, 16, "{0}");
+        }
+        out_cputs(out, ": {/}\"");
+        out_puts(out, dyld_export_name(exports, entry));
+        out_cputs(out, "\"{0}");
+        if (entry->import_name) {
+            out_cputs(out, " as {/}\"");
+            out_puts(out, entry->import_name);
+            out_cputs(out, "\"{0}");
+        }
+        const uint64_t kind = entry->flags & EXPORT_SYMBOL_FLAGS_KIND_MASK;
+        PRINT_OPTION_FLAG(kind, EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL);
+        PRINT_OPTION_FLAG(kind, EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE);
+        PRINT_FLAG(entry->flags, EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION);
+        if (entry->flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER) {
+            PRINT_HEX(" {+}EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER{0} {Y}0x",
+                      entry->other, 16, "{0}");
+        }
+        out_putc(out, '\n');
+    }
+}
+
+// Lists the symbols exported through the trie of size bytes at offset, and
+// closes the command.
+local void dump_exports(struct out* out, const struct macho* macho,
+                        uint64_t offset, uint64_t size) {
+    struct dyld_exports exports;
+    dyld_exports_decode(&exports, macho, offset, size);
+    printf("  │ Number of exports: %u\n", exports.count);
+    dump_in_chunks(out, exports.count, DUMP_CHUNK_SIZE, dump_export_range,
+                   &exports);
+    if (exports.malformed) {
+        out_cputs(out, "  │ {R+}Error:{0} The export trie is malformed\n");
+    }
+    dyld_exports_free(&exports);
+    printf("┌─┘\n");
+}
+
+// Lists the fixups of each opcode stream and then the exported symbols. Only
+// the fields are shown of a command that refers outside the file.
+static void dump_dyld_info(struct out* out, const struct macho* macho,
+                           const struct macho_command* command) {
+    const S(dyld_info_command*) info =
+        (const void*)macho_command_data(macho, command);
+    const bool valid = command->verdict == MachoVerdictValid;
+    printf("  │ Command Size: %u byte(s)\n", info->cmdsize);
+    printf("  │ Rebase Offset: {Y}0x%08x{0}\n", info->rebase_off);
+    printf("  │ Rebase Size: %u byte(s)\n", info->rebase_size);
+    printf("  │ Bind Offset: {Y}0x%08x{0}\n", info->bind_off);
+    printf("  │ Bind Size: %u byte(s)\n", info->bind_size);
+    printf("  │ Weak Bind Offset: {Y}0x%08x{0}\n", info->weak_bind_off);
+    printf("  │ Weak Bind Size: %u byte(s)\n", info->weak_bind_size);
+    printf("  │ Lazy Bind Offset: {Y}0x%08x{0}\n", info->lazy_bind_off);
+    printf("  │ Lazy Bind Size: %u byte(s)\n", info->lazy_bind_size);
+    printf("  │ Export Offset: {Y}0x%08x{0}\n", info->export_off);
+    printf("%s Export Size: %u byte(s)\n", valid ? "  │" : "┌─┘",
+           info->export_size);
+    if (!valid) {
+        return;
+    }
+
+    static const char* plurals[DYLD_STREAM_COUNT] = {
+        "rebases", "binds", "weak binds", "lazy binds"
+    };
+    for (int stream = 0; stream < DYLD_STREAM_COUNT; stream++) {
+        struct dyld_fixups fixups;
+        dyld_fixups_decode(&fixups, macho, command, stream);
+        const char* label = dyld_stream_name(stream);
+        printf("  │ Number of %s: %u\n", plurals[stream], fixups.count);
+        struct dump_fixups context = { &fixups, label };
+        dump_in_chunks(out, fixups.count, DUMP_CHUNK_SIZE, dump_fixup_range,
+                       &context);
+        if (fixups.malformed) {
+            printf("  │ {R+}Error:{0} The %s opcodes are malformed\n",
+                   plurals[stream]);
+        }
+        dyld_fixups_free(&fixups);
+    }
+
+    dump_exports(out, macho, info->export_off, info->export_size);
+}
+
+// Lists the exported symbols of an LC_DYLD_EXPORTS_TRIE. Only the fields are
+// shown of a command that refers outside the file.
+static void dump_exports_trie(struct out* out, const struct macho* macho,
+                              const struct macho_command* command) {
+    if (command->verdict != MachoVerdictValid) {
+        dump_linkedit_data(out, macho, command);
+        return;
+    }
+    const S(linkedit_data_command*) data =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", data->cmdsize);
+    printf("  │ Data Offset: {Y}0x%08x{0}\n", data->dataoff);
+    printf("  │ Data Size: %u byte(s)\n", data->datasize);
+    dump_exports(out, macho, data->dataoff, data->datasize);
+}
+
+local void dump_key(struct out* out, uint8_t key) {
+    static const char* keys[] = { "IA", "IB", "DA", "DB" };
+    out_puts(out, keys[key & 3]);
+}
+
+static void dump_chained_range(struct out* out, void* context, size_t begin,
+                               size_t end) {
+    const struct chained_fixups* fixups = context;
+    for (size_t i = begin; i < end; i++) {
+        const struct chained_fixup* fixup = &fixups->fixups[i];
+        if (fixup->flags & ChainedFlagBind) {
+            PRINT_HEX("  │ Bind: {Y}0x", fixup->address, 16, "{0}, import ");
+            out_dec(out, fixup->import);
+            if (fixup->import < fixups->nimports
+                && fixups->imports[fixup->import].name) {
+                out_cputs(out, ": {/}\"");
+                out_puts(out, fixups->imports[fixup->import].name);
+                out_cputs(out, "\"{0}");
+            }
+            if (fixup->target) {
+                out_puts(out, ", addend ");
+                dump_signed(out, (int64_t)fixup->target);
+            }
+        } else {
+            PRINT_HEX("  │ Rebase: {Y}0x", fixup->address, 16, "{0} -> ");
+            PRINT_HEX("{Y}0x", fixup->target, 16, "{0}");
+        }
+        if (fixup->flags & ChainedFlagAuth) {
+            out_puts(out, ", auth ");
+            dump_key(out, fixup->key);
+            PRINT_HEX(" diversity {Y}0x", fixup->diversity, 4, "{0}");
+            if (fixup->flags & ChainedFlagAddressDiversity) {
+                out_puts(out, " with address");
+            }
+        }
+        out_putc(out, '\n');
+    }
+}
+
+// Lists the imports, the chain starts of each segment and every fixup on the
+// chains. Only the fields are shown of a command that refers outside the
+// file.
+static void dump_chained_fixups(struct out* out, const struct macho* macho,
+                                const struct macho_command* command) {
+    if (command->verdict != MachoVerdictValid) {
+        dump_linkedit_data(out, macho, command);
+        return;
+    }
+    const S(linkedit_data_command*) data =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", data->cmdsize);
+    printf("  │ Data Offset: {Y}0x%08x{0}\n", data->dataoff);
+    printf("  │ Data Size: %u byte(s)\n", data->datasize);
+
+    struct chained_fixups fixups;
+    chained_fixups_decode(&fixups, macho, command, dump_threads);
+    const S(dyld_chained_fixups_header*) header = &fixups.header;
+    printf("  │ Fixups Version: %u\n", header->fixups_version);
+    printf("  │ Imports Format: %u\n", header->imports_format);
+    printf("  │ Symbols Format: %u%s\n", header->symbols_format,
+           header->symbols_format ? " (compressed)" : "");
+    printf("  │ Number of imports: %u\n", fixups.nimports);
+    for (uint32_t i = 0; i < fixups.nimports; i++) {
+        const struct chained_import* import = &fixups.imports[i];
+        PRINT_DEC("  │ Import ", i, ": ");
+        dump_bind_ordinal(out, import->ordinal);
+        if (import->name) {
+            out_cputs(out, ": {/}\"");
+            out_puts(out, import->name);
+            out_cputs(out, "\"{0}");
+        }
+        if (import->addend) {
+            out_puts(out, ", addend ");
+            dump_signed(out, import->addend);
+        }
+        if (import->weak) {
+            out_puts(out, ", weak");
+        }
+        out_putc(out, '\n');
+    }
+    printf("  │ Number of segments with fixups: %u\n", fixups.nstarts);
+    for (uint32_t i = 0; i < fixups.nstarts; i++) {
+        const struct chained_starts* starts = &fixups.starts[i];
+        const char* format = chained_format_name(starts->pointer_format);
+        PRINT_DEC("  │ Segment ", starts->segment, "");
+        if (starts->segment < macho->nsegments) {
+            const S(segment_command_64*) segment =
+                &macho->segments[starts->segment].command;
+            printf(": {/}\"%.16s\"{0}", segment->segname);
+        }
+        PRINT_DEC(", ", starts->page_count, " page(s) of ");
+        PRINT_HEX("{Y}0x", starts->page_size, 1, "{0} byte(s), ");
+        if (format) {
+            out_cputs(out, "{+}");
+            out_puts(out, format);
+            out_cputs(out, "{0}");
+        } else {
+            PRINT_DEC("pointer format ", starts->pointer_format, "");
+        }
+        out_putc(out, '\n');
+        if (starts->malformed) {
+            out_cputs(out, "  │ {R+}Error:{0} The segment's chains are "
+                      "malformed\n");
+        }
+    }
+    printf("  │ Number of fixups: %zu\n", fixups.count);
+    dump_in_chunks(out, fixups.count, DUMP_CHUNK_SIZE, dump_chained_range,
+                   &fixups);
+    if (fixups.malformed) {
+        out_cputs(out, "  │ {R+}Error:{0} The chained fixups are "
+                  "malformed\n");
+    }
+    chained_fixups_free(&fixups);
+    printf("┌─┘\n");
+}
+
+static void dump_encryption_info(struct out* out, const struct macho* macho,
+                                 const struct macho_command* command) {
+    const S(encryption_info_command*) crypt =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", crypt->cmdsize);
+    printf("  │ Encrypted Range Offset: {Y}0x%08x{0}\n", crypt->cryptoff);
+    printf("  │ Encrypted Range Size: %u byte(s)\n", crypt->cryptsize);
+    printf("┌─┘ Encryption System: %u\n", crypt->cryptid);
+}
+
+static void dump_linker_option(struct out* out, const struct macho* macho,
+                               const struct macho_command* command) {
+    const S(linker_option_command*) option =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", option->cmdsize);
+    printf("%s Number of options: %u\n", option->count > 0 ? "  │" : "┌─┘",
+           option->count);
+    // The options follow the struct as consecutive NUL terminated strings.
+    uint32_t offset = sizeof(*option);
+    for (uint32_t i = 0; i < option->count && offset < option->cmdsize; i++) {
+        out_cputs(out, i + 1 < option->count ? "  │ Option: "
+                                              : "┌─┘ Option: ");
+        dump_lc_str(out, (const void*)option, offset);
+        const char* string = (const char*)option + offset;
+        const char* nul = memchr(string, '\0', option->cmdsize - offset);
+        offset = nul ? (uint32_t)(nul - (const char*)option) + 1
+                     : option->cmdsize;
+    }
+}
+
+static void dump_note(struct out* out, const struct macho* macho,
+                      const struct macho_command* command) {
+    const S(note_command*) note =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", note->cmdsize);
+    printf("  │ Data Owner: {/}\"%.16s\"{0}\n", note->data_owner);
+    PRINT_HEX("  │ Offset: {Y}0x", note->offset, 16, "{0}\n");
+    PRINT_DEC("┌─┘ Size: ", note->size, " byte(s)\n");
+}
+
+static void dump_fileset_entry(struct out* out, const struct macho* macho,
+                               const struct macho_command* command) {
+    const S(fileset_entry_command*) entry =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", entry->cmdsize);
+    PRINT_HEX("  │ Virtual Memory Address: {Y}0x", entry->vmaddr, 16, "{0}\n");
+    PRINT_HEX("  │ File Offset: {Y}0x", entry->fileoff, 16, "{0}\n");
+    out_cputs(out, "┌─┘ Entry ID: ");
+    dump_lc_str(out, (const void*)entry, entry->entry_id.offset);
+}
+
+static void dump_routines_64(struct out* out, const struct macho* macho,
+                             const struct macho_command* command) {
+    const S(routines_command_64*) routines =
+        (const void*)macho_command_data(macho, command);
+    printf("  │ Command Size: %u byte(s)\n", routines->cmdsize);
+    PRINT_HEX("  │ Initialization Routine Address: {Y}0x",
+              routines->init_address, 16, "{0}\n");
+    PRINT_DEC("┌─┘ Initialization Routine Module: ", routines->init_module,
+              "\n");
+}
+
+// Renders the command as raw bytes, for those that are unknown, malformed or
+// have nothing more useful to show.
+static void dump_command_bytes(struct out* out, const struct macho* macho,
+                               const struct macho_command* command) {
+    printf("  │ Command Size: %u byte(s)\n", command->cmdsize);
+    struct dump_hexdump hexdump = {
+        (const void*)macho_command_data(macho, command), command->cmdsize,
+        command->offset
+    };
+    dump_in_chunks(out, (command->cmdsize + 15) / 16, DUMP_CHUNK_SIZE,
+                   dump_hexdump_range, &hexdump);
+    printf("┌─┘\n");
+}
+
+#define RENDERER(lc, render) \
+    [MACHO_KIND_DYLD(lc)][MACHO_KIND_INDEX(lc)] = render
+
+// How each kind of load command is rendered, indexed like the registry in
+// macho.c. Kinds without an entry are rendered as raw bytes.
+static void (*const dump_renderers[2][0x80])(
+    struct out* out, const struct macho* macho,
+    const struct macho_command* command) = {
+    RENDERER(LC_SEGMENT_64, dump_segment_command),
+    RENDERER(LC_SYMTAB, dump_symbol_table),
+    RENDERER(LC_DYSYMTAB, dump_dysym_table),
+    RENDERER(LC_BUILD_VERSION, dump_build_version),
+    RENDERER(LC_LOAD_DYLIB, dump_dylib),
+    RENDERER(LC_ID_DYLIB, dump_dylib),
+    RENDERER(LC_LOAD_WEAK_DYLIB, dump_dylib),
+    RENDERER(LC_REEXPORT_DYLIB, dump_dylib),
+    RENDERER(LC_LAZY_LOAD_DYLIB, dump_dylib),
+    RENDERER(LC_LOAD_UPWARD_DYLIB, dump_dylib),
+    RENDERER(LC_LOAD_DYLINKER, dump_string_command),
+    RENDERER(LC_ID_DYLINKER, dump_string_command),
+    RENDERER(LC_DYLD_ENVIRONMENT, dump_string_command),
+    RENDERER(LC_RPATH, dump_string_command),
+    RENDERER(LC_SUB_FRAMEWORK, dump_string_command),
+    RENDERER(LC_SUB_UMBRELLA, dump_string_command),
+    RENDERER(LC_SUB_CLIENT, dump_string_command),
+    RENDERER(LC_SUB_LIBRARY, dump_string_command),
+    RENDERER(LC_UUID, dump_uuid),
+    RENDERER(LC_MAIN, dump_entry_point),
+    RENDERER(LC_SOURCE_VERSION, dump_source_version),
+    RENDERER(LC_VERSION_MIN_MACOSX, dump_version_min),
+    RENDERER(LC_VERSION_MIN_IPHONEOS, dump_version_min),
+    RENDERER(LC_VERSION_MIN_TVOS, dump_version_min),
+    RENDERER(LC_VERSION_MIN_WATCHOS, dump_version_min),
+    RENDERER(LC_CODE_SIGNATURE, dump_linkedit_data),
+    RENDERER(LC_SEGMENT_SPLIT_INFO, dump_linkedit_data),
+    RENDERER(LC_FUNCTION_STARTS, dump_function_starts),
+    RENDERER(LC_DATA_IN_CODE, dump_linkedit_data),
+    RENDERER(LC_DYLIB_CODE_SIGN_DRS, dump_linkedit_data),
+    RENDERER(LC_LINKER_OPTIMIZATION_HINT, dump_linkedit_data),
+    RENDERER(LC_DYLD_EXPORTS_TRIE, dump_exports_trie),
+    RENDERER(LC_DYLD_CHAINED_FIXUPS, dump_chained_fixups),
+    RENDERER(LC_DYLD_INFO, dump_dyld_info),
+    RENDERER(LC_DYLD_INFO_ONLY, dump_dyld_info),
+    RENDERER(LC_ENCRYPTION_INFO, dump_encryption_info),
+    RENDERER(LC_ENCRYPTION_INFO_64, dump_encryption_info),
+    RENDERER(LC_LINKER_OPTION, dump_linker_option),
+    RENDERER(LC_NOTE, dump_note),
+    RENDERER(LC_FILESET_ENTRY, dump_fileset_entry),
+    RENDERER(LC_ROUTINES_64, dump_routines_64)
+};
+
+local void dump_load_command(struct out* out, const struct macho* macho,
+                             const struct macho_command* command) {
+    const struct macho_command_kind* kind = macho_command_kind(command->cmd);
+    PRINT_HEX("│ {C}Load Command{0} (at offset {Y}0x", command->offset, 16,
+              "{0})\n");
+    printf("└─┐ Command Type: {Y}0x%08x{0}: ", command->cmd);
+    if (kind) {
+        out_cputs(out, "{+}");
+        out_puts(out, kind->name);
+        out_cputs(out, "{0}: {M+}struct {0}");
+        out_puts(out, kind->type);
+        out_putc(out, '\n');
+    } else {
+        out_puts(out, "Unknown\n");
+    }
+
+    // A malformed command gets no further than its bytes, while one that
+    // reaches outside the file is rendered up to the parts that do.
+    void (*render)(struct out* out, const struct macho* macho,
+                   const struct macho_command* command) = NULL;
+    if (kind && command->verdict != MachoVerdictMalformed) {
+        render = dump_renderers[MACHO_KIND_DYLD(command->cmd)]
+                               [MACHO_KIND_INDEX(command->cmd)];
+    }
+    (render ? render : dump_command_bytes)(out, macho, command);
+    if (command->verdict != MachoVerdictValid) {
+        out_cputs(out, "│ {R+}Error:{0} ");
+        out_puts(out, macho_verdictstr(command->verdict));
+        out_putc(out, '\n');
+    }
+}
+
+static const char* dump_errorstrs[DUMP_ERROR_COUNT] = {
+    "Success",
+    "Expected 64 bit mach-o file",
+    "Unexpected end of file",
+    "No LC_UUID to key the symbol index by",
+    "Could not write the symbol index",
+    "Malformed load command",
+    "No LC_CODE_SIGNATURE to verify",
+    "Code signature has no supported SHA-256 CodeDirectory",
+    "Code signature page hashes do not match",
+    "Virtual memory exhausted"
+};
+
+const char* dump_errorstr(const enum dump_error err) {
+    return dump_errorstrs[err];
+}
+
+struct dump_fat {
+    char* buffer;
+    size_t length;
+    const struct fat_slice* slices;
+    enum dump_error error;
+};
+
+static void dump_fat_range(struct out* out, void* context, size_t begin,
+                           size_t end) {
+    struct dump_fat* fat = context;
+    const bool ndjson = dump_format == DumpFormatNDJSON;
+    for (size_t i = begin; i < end; i++) {
+        const struct fat_slice* slice = &fat->slices[i];
+        const char* name = arch_name(slice->cputype, slice->cpusubtype);
+        if (dump_format != DumpFormatText) {
+            json_fat_arch_begin(out, i, slice, ndjson);
+        } else {
+            out_cputs(out, "│ {C}Architecture{0}: {M+}struct {0}fat_arch\n");
+            PRINT_HEX("└─┐ CPU Type: {Y}0x", (uint32_t)slice->cputype, 8,
+                      "{0}: ");
+            out_puts(out, name ? name : "Unknown");
+            PRINT_HEX("\n  │ CPU Subtype: {Y}0x", (uint32_t)slice->cpusubtype,
+                      8, "{0}\n");
+            PRINT_HEX("  │ Offset: {Y}0x", slice->offset, 16, "{0}\n");
+            PRINT_DEC("  │ Size: ", slice->size, " byte(s)\n");
+            PRINT_DEC("┌─┘ Alignment: 2**", slice->align, "\n");
+        }
+
+        if (dump_arches && !(name && name_in_list(dump_arches, name))) {
+            if (dump_format != DumpFormatText) {
+                json_fat_arch_end(out, false, NULL, ndjson);
+            }
+            continue;
+        }
+        if (slice->offset > fat->length
+            || slice->size > fat->length - slice->offset) {
+            __atomic_store_n(&fat->error, DumpErrorTruncated,
+                             __ATOMIC_RELAXED);
+            if (dump_format != DumpFormatText) {
+                json_fat_arch_end(out, false, "Slice extends past the end "
+                                  "of the file", ndjson);
+            } else {
+                out_cputs(out, "│ {R+}Error:{0} Slice extends past the end "
+                          "of the file\n");
+            }
+            continue;
+        }
+
+        // Each slice is dumped in place, as a view into the same buffer. Only
+        // 64-bit Mach-O slices are, so that a slice which is itself a fat
+        // header, possibly the same one, is not recursed into.
+        uint32_t magic = 0;
+        if (slice->size >= sizeof(magic)) {
+            memcpy(&magic, fat->buffer + slice->offset, sizeof(magic));
+        }
+        const bool object = magic == MH_MAGIC_64;
+        const enum dump_error error = object
+            ? mach_dump(out, fat->buffer + slice->offset, (size_t)slice->size)
+            : DumpErrorNotMachO64;
+        if (error != DumpErrorNone && error != DumpErrorNotMachO64) {
+            __atomic_store_n(&fat->error, error, __ATOMIC_RELAXED);
+        }
+        if (dump_format != DumpFormatText) {
+            json_fat_arch_end(out, object, error != DumpErrorNone
+                              ? dump_errorstr(error) : NULL, ndjson);
+        } else if (error != DumpErrorNone) {
+            out_cputs(out, "│ {R+}Error:{0} ");
+            out_puts(out, dump_errorstr(error));
+            out_putc(out, '\n');
+        }
+    }
+}
+
+local enum dump_error dump_fat(struct out* out, void* buffer,
+                               const size_t length) {
+    S(fat_header*) header = buffer;
+    const uint32_t magic = read_be32(&header->magic);
+    const uint32_t nfat_arch = length >= sizeof(*header)
+                               ? read_be32(&header->nfat_arch) : 0;
+    const bool is64 = magic == FAT_MAGIC_64;
+    const size_t entry_size = is64 ? sizeof(S(fat_arch_64))
+                                   : sizeof(S(fat_arch));
+    if (length < sizeof(*header)
+        || nfat_arch > (length - sizeof(*header)) / entry_size) {
+        // A JSON document still gets a value for this file.
+        if (dump_format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+        return DumpErrorTruncated;
+    }
+
+    if (dump_format != DumpFormatText) {
+        json_fat_begin(out, magic, nfat_arch,
+                       dump_format == DumpFormatNDJSON);
+    } else {
+        out_cputs(out, "│ {C}Fat Header{0}: {M+}struct {0}fat_header\n");
+        PRINT_HEX("└─┐ Magic: {Y}0x", magic, 8, "{0}\n");
+        PRINT_DEC("┌─┘ Number of architectures: ", nfat_arch, "\n");
+    }
+
+    struct fat_slice* slices = xmalloc(sizeof(*slices) * (nfat_arch + 1));
+    for (uint32_t i = 0; i < nfat_arch; i++) {
+        fat_slice_read(&slices[i], (char*)(header + 1) + i * entry_size,
+                       is64);
+    }
+
+    struct dump_fat fat = { buffer, length, slices, DumpErrorNone };
+    dump_in_chunks(out, nfat_arch, 1, dump_fat_range, &fat);
+    xfree(slices);
+    if (dump_format != DumpFormatText) {
+        json_fat_end(out, dump_format == DumpFormatNDJSON);
+    }
+    return fat.error;
+}
+
+struct dump_archive {
+    char* buffer;
+    const struct archive_member* members;
+    size_t count;
+    enum dump_error error;
+};
+
+struct dump_ranlib {
+    const struct dump_archive* archive;
+    const struct archive_symbols* symbols;
+};
+
+static void dump_ranlib_range(struct out* out, void* context, size_t begin,
+                              size_t end) {
+    const struct dump_ranlib* ranlib = context;
+    const struct dump_archive* archive = ranlib->archive;
+    for (size_t i = begin; i < end; i++) {
+        const struct archive_symbol* symbol = &ranlib->symbols->entries[i];
+        const size_t member = archive_find_member(archive->members,
+                                                  archive->count,
+                                                  symbol->member);
+        PRINT_DEC("  │ Symbol ", i, ": {/}\"");
+        out_write(out, symbol->name, symbol->name_length);
+        if (member == ARCHIVE_NONE) {
+            PRINT_HEX("\"{0} in {R+}no member at 0x", symbol->member, 8,
+                      "{0}\n");
+        } else {
+            out_cputs(out, "\"{0} in {/}\"");
+            out_write(out, archive->members[member].name,
+                      archive->members[member].name_length);
+            out_cputs(out, "\"{0}\n");
+        }
+    }
+}
+
+// Renders the ranlib table, resolving each symbol to the member defining it.
+local bool dump_ranlib(struct out* out, struct dump_archive* archive,
+                       const struct archive_member* symdef) {
+    struct archive_symbols symbols;
+    archive_symbols_decode(&symbols, archive->buffer, symdef);
+    if (dump_format != DumpFormatText) {
+        json_archive_symbols(out, &symbols, archive->members, archive->count,
+                             dump_format == DumpFormatNDJSON);
+    } else {
+        out_cputs(out, "│ {C}Symbol Table{0}: {M+}struct {0}ranlib\n");
+        PRINT_DEC("└─┐ Number of symbols: ", symbols.count, "\n");
+        struct dump_ranlib ranlib = { archive, &symbols };
+        dump_in_chunks(out, symbols.count, DUMP_CHUNK_SIZE, dump_ranlib_range,
+                       &ranlib);
+        if (symbols.malformed) {
+            out_cputs(out, "  │ {R+}Error:{0} The table does not fit within "
+                      "its member\n");
+        }
+        out_puts(out, "┌─┘\n");
+    }
+    const bool malformed = symbols.malformed;
+    archive_symbols_free(&symbols);
+    return !malformed;
+}
+
+static void dump_archive_range(struct out* out, void* context, size_t begin,
+                               size_t end) {
+    struct dump_archive* archive = context;
+    const bool ndjson = dump_format == DumpFormatNDJSON;
+    for (size_t i = begin; i < end; i++) {
+        const struct archive_member* member = &archive->members[i];
+        if (dump_format != DumpFormatText) {
+            json_archive_member_begin(out, i, member, ndjson);
+        } else {
+            out_cputs(out, "│ {C}Member{0}: {M+}struct {0}ar_hdr\n"
+                      "└─┐ Name: {/}\"");
+            out_write(out, member->name, member->name_length);
+            PRINT_HEX("\"{0}\n  │ Header Offset: {Y}0x", member->header, 16,
+                      "{0}\n");
+            PRINT_HEX("  │ Offset: {Y}0x", member->offset, 16, "{0}\n");
+            PRINT_DEC("  │ Size: ", member->size, " byte(s)\n");
+            PRINT_DEC("  │ Date: ", member->date, "\n");
+            PRINT_DEC("  │ User ID: ", member->uid, "\n");
+            PRINT_DEC("  │ Group ID: ", member->gid, "\n");
+            printf("┌─┘ Mode: {Y}0%o{0}\n", (unsigned)member->mode);
+        }
+
+        if (dump_members && !list_contains(dump_members, member->name,
+                                           member->name_length)) {
+            if (dump_format != DumpFormatText) {
+                json_archive_member_end(out, false, NULL, ndjson);
+            }
+            continue;
+        }
+        if (archive_is_symdef(member)) {
+            const bool valid = dump_ranlib(out, archive, member);
+            if (!valid) {
+                __atomic_store_n(&archive->error, DumpErrorMalformed,
+                                 __ATOMIC_RELAXED);
+            }
+            if (dump_format != DumpFormatText) {
+                json_archive_member_end(out, true, valid ? NULL
+                                        : "Malformed ranlib table", ndjson);
+            }
+            continue;
+        }
+
+        // Like the slices of a universal binary, each member is dumped in
+        // place, as a view into the mapped archive. Members that are not
+        // objects are only listed.
+        uint32_t magic = 0;
+        if (member->size >= sizeof(magic)) {
+            memcpy(&magic, archive->buffer + member->offset, sizeof(magic));
+        }
+        const bool object = magic == MH_MAGIC_64;
+        const enum dump_error error = object
+            ? mach_dump(out, archive->buffer + member->offset,
+                        (size_t)member->size)
+            : DumpErrorNotMachO64;
+        if (error != DumpErrorNone && error != DumpErrorNotMachO64) {
+            __atomic_store_n(&archive->error, error, __ATOMIC_RELAXED);
+        }
+        if (dump_format != DumpFormatText) {
+            json_archive_member_end(out, object, error != DumpErrorNone
+                                    ? dump_errorstr(error) : NULL, ndjson);
+        } else if (error != DumpErrorNone) {
+            out_cputs(out, "│ {R+}Error:{0} ");
+            out_puts(out, dump_errorstr(error));
+            out_putc(out, '\n');
+        }
+    }
+}
+
+local enum dump_error dump_archive(struct out* out, void* buffer,
+                                   const size_t length) {
+    // Only the headers are read up front, so that the members themselves can
+    // be dumped in parallel. The counting pass is the one that runs into a
+    // corrupt header, if there is one.
+    size_t count = 0;
+    struct archive_iter it = archive_members(buffer, length);
+    for (struct archive_member member; archive_next(&it, &member);) {
+        count++;
+    }
+    struct archive_member* members = xmalloc(sizeof(*members) * (count + 1));
+    if (members == NULL) {
+        // A JSON document still gets a value for this file.
+        if (dump_format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+        return DumpErrorNoMemory;
+    }
+    struct archive_iter fill = archive_members(buffer, length);
+    for (size_t i = 0; i < count && archive_next(&fill, &members[i]); i++) {}
+
+    if (dump_format != DumpFormatText) {
+        json_archive_begin(out, count, dump_format == DumpFormatNDJSON);
+    } else {
+        PRINT_DEC("│ {C}Archive{0}: ", count, " member(s)\n");
+    }
+    struct dump_archive archive = {
+        buffer, members, count,
+        it.malformed ? DumpErrorTruncated : DumpErrorNone
+    };
+    dump_in_chunks(out, count, 1, dump_archive_range, &archive);
+    if (it.malformed && dump_format == DumpFormatText) {
+        out_cputs(out, "│ {R+}Error:{0} A member header is corrupt or "
+                  "extends past the end of the file\n");
+    }
+    xfree(members);
+    if (dump_format != DumpFormatText) {
+        json_archive_end(out, dump_format == DumpFormatNDJSON);
+    }
+    return archive.error;
+}
+
+// A Mach-O file within a file being read by mach_fetch: the file itself or a
+// slice of a universal binary. sizeofcmds is 0 until its header is known to
+// be a Mach-O header, and is then clamped to the slice.
+struct dump_fetch {
+    uint64_t base;
+    uint64_t size;
+    uint32_t sizeofcmds;
+};
+
+// Wants the bytes at offset in the slice, clamped to it.
+local void dump_want(struct partial_file* file, const struct dump_fetch* slice,
+                     uint64_t offset, uint64_t length) {
+    if (offset < slice->size) {
+        partial_want(file, slice->base + offset,
+                     length < slice->size - offset ? length
+                                                   : slice->size - offset);
+    }
+}
+
+// The load command at *offset in the slice's commands, which have been
+// fetched, with its cmd and cmdsize copied to lc, advancing *offset past it.
+// Returns NULL after the last command or at one whose cmdsize is unusable,
+// where macho_parse stops too.
+local const char* dump_next_command(const struct partial_file* file,
+                                    const struct dump_fetch* slice,
+                                    uint32_t* offset, S(load_command*) lc) {
+    if (slice->sizeofcmds - *offset < sizeof(*lc)) {
+        return NULL;
+    }
+    const char* p = file->buffer + slice->base + sizeof(S(mach_header_64))
+                    + *offset;
+    memcpy(lc, p, sizeof(*lc));
+    if (lc->cmdsize < sizeof(*lc)
+        || lc->cmdsize > slice->sizeofcmds - *offset) {
+        return NULL;
+    }
+    *offset += lc->cmdsize;
+    return p;
+}
+
+// Wants the symbol and string tables of the slice, if it has them.
+local void dump_fetch_symbols(struct partial_file* file,
+                              const struct dump_fetch* slice) {
+    uint32_t offset = 0;
+    S(load_command) lc;
+    for (const char* p; (p = dump_next_command(file, slice, &offset, &lc));) {
+        S(symtab_command) symtab;
+        if (lc.cmd == LC_SYMTAB && lc.cmdsize >= sizeof(symtab)) {
+            memcpy(&symtab, p, sizeof(symtab));
+            dump_want(file, slice, symtab.symoff,
+                      (uint64_t)symtab.nsyms * sizeof(S(nlist_64)));
+            dump_want(file, slice, symtab.stroff, symtab.strsize);
+        }
+    }
+}
+
+// Wants the contents of the index-th LC_SEGMENT_64 of the slice.
+local void dump_fetch_segment(struct partial_file* file,
+                              const struct dump_fetch* slice, uint32_t index) {
+    uint32_t offset = 0;
+    uint32_t segments = 0;
+    S(load_command) lc;
+    for (const char* p; (p = dump_next_command(file, slice, &offset, &lc));) {
+        S(segment_command_64) seg64;
+        if (lc.cmd == LC_SEGMENT_64 && lc.cmdsize >= sizeof(seg64)
+            && segments++ == index) {
+            memcpy(&seg64, p, sizeof(seg64));
+            dump_want(file, slice, seg64.fileoff, seg64.filesize);
+            return;
+        }
+    }
+}
+
+// Wants what dump_section_64 reads of each section of the segment: the bytes
+// at either end that it shows, or all of them if they are hexdumped.
+local void dump_fetch_sections(struct partial_file* file,
+                               const struct dump_fetch* slice, const char* p,
+                               uint32_t cmdsize) {
+    if (cmdsize < sizeof(S(segment_command_64))) {
         return;
     }
-    dump_header(buffer, header);
+    S(segment_command_64) seg64;
+    memcpy(&seg64, p, sizeof(seg64));
+    const uint32_t fit = (cmdsize - sizeof(seg64)) / sizeof(S(section_64));
+    const uint32_t nsects = seg64.nsects < fit ? seg64.nsects : fit;
+    for (uint32_t i = 0; i < nsects; i++) {
+        S(section_64) sec64;
+        memcpy(&sec64, p + sizeof(seg64) + i * sizeof(sec64), sizeof(sec64));
+        const bool hexdump = dump_hexdump_sections
+            && macho_section_has_contents(&sec64)
+            && (!*dump_hexdump_sections
+                || name_in_list(dump_hexdump_sections, sec64.sectname));
+        if (hexdump || sec64.size <= 32) {
+            dump_want(file, slice, sec64.offset, sec64.size);
+        } else {
+            dump_want(file, slice, sec64.offset, 16);
+            dump_want(file, slice, sec64.offset + sec64.size - 16, 16);
+        }
+    }
+}
+
+// Wants the data that the wanted load commands of the slice refer to and that
+// rendering them reads.
+local void dump_fetch_data(struct partial_file* file,
+                           const struct dump_fetch* slice) {
+    uint32_t offset = 0;
+    S(load_command) lc;
+    for (const char* p; (p = dump_next_command(file, slice, &offset, &lc));) {
+        if (!dump_wants_command((const void*)p)) {
+            continue;
+        }
+        S(linkedit_data_command) data;
+        S(dyld_info_command) info;
+        switch (lc.cmd) {
+            case LC_SEGMENT_64:
+                dump_fetch_sections(file, slice, p, lc.cmdsize);
+                break;
+            case LC_SYMTAB:
+                dump_fetch_symbols(file, slice);
+                break;
+            case LC_FUNCTION_STARTS:
+                // Functions are named after the symbols at their starts.
+                dump_fetch_symbols(file, slice);
+                // fallthrough
+            case LC_DYLD_EXPORTS_TRIE:
+            case LC_DYLD_CHAINED_FIXUPS:
+                if (lc.cmdsize >= sizeof(data)) {
+                    memcpy(&data, p, sizeof(data));
+                    dump_want(file, slice, data.dataoff, data.datasize);
+                }
+                break;
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY:
+                if (lc.cmdsize >= sizeof(info)) {
+                    memcpy(&info, p, sizeof(info));
+                    dump_want(file, slice, info.rebase_off, info.rebase_size);
+                    dump_want(file, slice, info.bind_off, info.bind_size);
+                    dump_want(file, slice, info.weak_bind_off,
+                              info.weak_bind_size);
+                    dump_want(file, slice, info.lazy_bind_off,
+                              info.lazy_bind_size);
+                    dump_want(file, slice, info.export_off, info.export_size);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
 
-    for (uint32_t i = 0; i < header->ncmds; i++) {
-        S(load_command*) load_command = READ(sizeof(*load_command));
-        CONSUME(load_command->cmdsize - sizeof(*load_command));
-        dump_load_command(buffer, load_command);
+// Wants the segments whose chains the wanted chained fixups of the slice,
+// which have been fetched, start in.
+local void dump_fetch_chains(struct partial_file* file,
+                             const struct dump_fetch* slice) {
+    uint32_t offset = 0;
+    S(load_command) lc;
+    for (const char* p; (p = dump_next_command(file, slice, &offset, &lc));) {
+        S(linkedit_data_command) data;
+        if (lc.cmd != LC_DYLD_CHAINED_FIXUPS || lc.cmdsize < sizeof(data)
+            || !dump_wants_command((const void*)p)) {
+            continue;
+        }
+        memcpy(&data, p, sizeof(data));
+        S(dyld_chained_fixups_header) header;
+        if (data.dataoff > slice->size
+            || data.datasize > slice->size - data.dataoff
+            || data.datasize < sizeof(header)) {
+            continue;
+        }
+        const char* blob = file->buffer + slice->base + data.dataoff;
+        memcpy(&header, blob, sizeof(header));
+        uint32_t seg_count;
+        if (header.starts_offset > data.datasize
+            || data.datasize - header.starts_offset < sizeof(seg_count)) {
+            continue;
+        }
+        memcpy(&seg_count, blob + header.starts_offset, sizeof(seg_count));
+        const uint32_t fit = (data.datasize - header.starts_offset
+                              - sizeof(seg_count)) / sizeof(uint32_t);
+        for (uint32_t i = 0; i < seg_count && i < fit; i++) {
+            uint32_t info;
+            memcpy(&info, blob + header.starts_offset + sizeof(seg_count)
+                          + i * sizeof(info), sizeof(info));
+            if (info != 0) {
+                dump_fetch_segment(file, slice, i);
+            }
+        }
+    }
+}
+
+int mach_fetch(struct partial_file* file) {
+    partial_want(file, 0, sizeof(S(mach_header_64)));
+    if (partial_fetch(file) != 0) {
+        return 1;
+    }
+    // The member headers of an archive are spread throughout it.
+    if (archive_is(file->buffer, file->length)) {
+        partial_want(file, 0, file->length);
+        return partial_fetch(file);
+    }
+
+    struct dump_fetch whole = { 0, file->length, 0 };
+    struct dump_fetch* slices = &whole;
+    uint32_t count = 1;
+    int status = 0;
+    const uint32_t magic = file->length >= sizeof(S(fat_header))
+                           ? read_be32(file->buffer) : 0;
+    if (magic == FAT_MAGIC || magic == FAT_MAGIC_64) {
+        // The slices are chosen as dump_fat does, which reports any that do
+        // not fit in the file.
+        const uint32_t nfat_arch = read_be32(file->buffer + 4);
+        const bool is64 = magic == FAT_MAGIC_64;
+        const size_t entry_size = is64 ? sizeof(S(fat_arch_64))
+                                       : sizeof(S(fat_arch));
+        if (nfat_arch > (file->length - sizeof(S(fat_header))) / entry_size) {
+            return 0;
+        }
+        partial_want(file, sizeof(S(fat_header)), nfat_arch * entry_size);
+        slices = xmalloc(sizeof(*slices) * (nfat_arch + 1));
+        if (slices == NULL || partial_fetch(file) != 0) {
+            xfree(slices);
+            return 1;
+        }
+        count = 0;
+        for (uint32_t i = 0; i < nfat_arch; i++) {
+            struct fat_slice slice;
+            fat_slice_read(&slice, file->buffer + sizeof(S(fat_header))
+                                   + i * entry_size, is64);
+            const char* name = arch_name(slice.cputype, slice.cpusubtype);
+            if ((dump_arches && !(name && name_in_list(dump_arches, name)))
+                || slice.offset > file->length
+                || slice.size > file->length - slice.offset) {
+                continue;
+            }
+            struct dump_fetch* fetch = &slices[count++];
+            fetch->base = slice.offset;
+            fetch->size = slice.size;
+            fetch->sizeofcmds = 0;
+            dump_want(file, fetch, 0, sizeof(S(mach_header_64)));
+        }
+        status = partial_fetch(file);
+    }
+
+    // Then the load commands of every slice are read, the data they refer to
+    // and the segments chained fixups start in, each stage in one batch.
+    for (uint32_t i = 0; status == 0 && i < count; i++) {
+        S(mach_header_64) header;
+        if (slices[i].size < sizeof(header)) {
+            continue;
+        }
+        memcpy(&header, file->buffer + slices[i].base, sizeof(header));
+        const uint64_t room = slices[i].size - sizeof(header);
+        if (header.magic == MH_MAGIC_64) {
+            slices[i].sizeofcmds = header.sizeofcmds < room
+                                   ? header.sizeofcmds : (uint32_t)room;
+            dump_want(file, &slices[i], sizeof(header), slices[i].sizeofcmds);
+        }
+    }
+    status = status == 0 ? partial_fetch(file) : status;
+    for (uint32_t i = 0; status == 0 && i < count; i++) {
+        dump_fetch_data(file, &slices[i]);
+    }
+    status = status == 0 ? partial_fetch(file) : status;
+    for (uint32_t i = 0; status == 0 && i < count; i++) {
+        dump_fetch_chains(file, &slices[i]);
+    }
+    status = status == 0 ? partial_fetch(file) : status;
+    if (slices != &whole) {
+        xfree(slices);
+    }
+    return status;
+}
+
+enum dump_error mach_select(void** buffer, size_t* length) {
+    if (*length < sizeof(S(fat_header))) {
+        return DumpErrorNone;
+    }
+    S(fat_header*) header = *buffer;
+    const uint32_t magic = read_be32(&header->magic);
+    if (magic != FAT_MAGIC && magic != FAT_MAGIC_64) {
+        return DumpErrorNone;
+    }
+    const uint32_t nfat_arch = read_be32(&header->nfat_arch);
+    const bool is64 = magic == FAT_MAGIC_64;
+    const size_t entry_size = is64 ? sizeof(S(fat_arch_64))
+                                   : sizeof(S(fat_arch));
+    if (nfat_arch > (*length - sizeof(*header)) / entry_size) {
+        return DumpErrorTruncated;
+    }
+    for (uint32_t i = 0; i < nfat_arch; i++) {
+        struct fat_slice slice;
+        fat_slice_read(&slice, (char*)(header + 1) + i * entry_size, is64);
+        const char* name = arch_name(slice.cputype, slice.cpusubtype);
+        if (!(slice.cputype & CPU_ARCH_ABI64)
+            || (dump_arches && !(name && name_in_list(dump_arches, name)))) {
+            continue;
+        }
+        if (slice.offset > *length || slice.size > *length - slice.offset) {
+            return DumpErrorTruncated;
+        }
+        *buffer = (char*)*buffer + slice.offset;
+        *length = (size_t)slice.size;
+        return DumpErrorNone;
+    }
+    return DumpErrorNotMachO64;
+}
+
+enum dump_error mach_dump(struct out* out, void* buffer, const size_t length) {
+    if (archive_is(buffer, length)) {
+        return dump_archive(out, buffer, length);
+    }
+    if (length >= sizeof(uint32_t)) {
+        const uint32_t magic = read_be32(buffer);
+        if (magic == FAT_MAGIC || magic == FAT_MAGIC_64) {
+            return dump_fat(out, buffer, length);
+        }
+    }
+    if (dump_format != DumpFormatText) {
+        return json_macho(out, buffer, length, dump_threads,
+                          dump_format == DumpFormatNDJSON);
+    }
+
+    struct macho macho;
+    enum dump_error error = macho_parse(&macho, buffer, length);
+    if (error != DumpErrorNone) {
+        return error;
+    }
+    const uint64_t start = stats_begin();
+    if (dump_wants_header()) {
+        dump_header(out, &macho);
+    }
+
+    // Corrupt commands are reported in place and the rest are still rendered.
+    struct macho_iter it = macho_commands(&macho);
+    for (const struct macho_command* command;
+         (command = macho_next_command(&it));) {
+        if (dump_wants_command(macho_command_data(&macho, command))) {
+            const uint64_t command_start = stats_begin();
+            dump_load_command(out, &macho, command);
+            stats_command(command->cmd, command_start);
+        }
     }
+    stats_end(StatsPhaseRender, start);
+    error = macho.error;
+    macho_free(&macho);
+    return error;
 }
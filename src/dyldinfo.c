@@ -0,0 +1,494 @@
+// src/dyldinfo.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "dyldinfo.h"
+#include "leb.h"
+#include "safe.h"
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+#define DYLD_POINTER_SIZE 8
+
+static const char* dyld_stream_names[DYLD_STREAM_COUNT] = {
+    "Rebase", "Bind", "Weak bind", "Lazy bind"
+};
+
+const char* dyld_stream_name(enum dyld_stream stream) {
+    return dyld_stream_names[stream];
+}
+
+// The interpreter's registers, which the SET_* opcodes write and each fixup
+// is a snapshot of.
+struct dyld_state {
+    struct dyld_fixup fixup;
+    uint64_t offset;
+    uint32_t capacity;
+    uint32_t limit;
+};
+
+// Emits count fixups stride bytes apart starting at the current offset and
+// leaves the offset past the last one, as every DO_* opcode does. The whole
+// run is checked against its segment and reserved once, so the fill loop does
+// nothing but store.
+local bool dyld_emit(struct dyld_fixups* fixups, struct dyld_state* state,
+                     const struct macho* macho, uint64_t count,
+                     uint64_t stride) {
+    if (count == 0) {
+        return true;
+    }
+    if (state->fixup.segment >= macho->nsegments
+        || count > state->limit - fixups->count) {
+        return false;
+    }
+    const uint64_t vmsize =
+        macho->segments[state->fixup.segment].command.vmsize;
+    if (vmsize < DYLD_POINTER_SIZE
+        || state->offset > vmsize - DYLD_POINTER_SIZE
+        || (count - 1) > (vmsize - DYLD_POINTER_SIZE - state->offset)
+                         / stride) {
+        return false;
+    }
+    if (fixups->count + count > state->capacity) {
+        uint64_t grown = state->capacity ? (uint64_t)state->capacity * 2
+                                         : 1024;
+        if (grown < fixups->count + count) {
+            grown = fixups->count + count;
+        }
+        if (grown > state->limit) {
+            grown = state->limit;
+        }
+        S(dyld_fixup*) entries =
+            xrealloc(fixups->entries, sizeof(*entries) * grown);
+        if (!entries) {
+            return false;
+        }
+        fixups->entries = entries;
+        state->capacity = (uint32_t)grown;
+    }
+    const uint64_t vmaddr =
+        macho->segments[state->fixup.segment].command.vmaddr;
+    S(dyld_fixup*) entry = fixups->entries + fixups->count;
+    S(dyld_fixup) fixup = state->fixup;
+    uint64_t offset = state->offset;
+    for (uint64_t i = 0; i < count; i++) {
+        fixup.address = vmaddr + offset;
+        entry[i] = fixup;
+        offset += stride;
+    }
+    fixups->count += (uint32_t)count;
+    state->offset = offset;
+    return true;
+}
+
+// Both streams scale their immediates by the pointer size and step past the
+// pointer they just fixed up.
+local bool dyld_stride(uint64_t skip, uint64_t* stride) {
+    if (skip > UINT64_MAX - DYLD_POINTER_SIZE) {
+        return false;
+    }
+    *stride = skip + DYLD_POINTER_SIZE;
+    return true;
+}
+
+local bool dyld_rebase_opcode(struct dyld_fixups* fixups,
+                              struct dyld_state* state,
+                              const struct macho* macho, const uint8_t** p,
+                              const uint8_t* end, bool* done) {
+    const uint8_t opcode = **p & REBASE_OPCODE_MASK;
+    const uint8_t immediate = **p & REBASE_IMMEDIATE_MASK;
+    (*p)++;
+    uint64_t count, skip, stride;
+    switch (opcode) {
+        case REBASE_OPCODE_DONE:
+            *done = true;
+            return true;
+        case REBASE_OPCODE_SET_TYPE_IMM:
+            state->fixup.type = immediate;
+            return true;
+        case REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+            state->fixup.segment = immediate;
+            return uleb128_read(p, end, &state->offset);
+        case REBASE_OPCODE_ADD_ADDR_ULEB:
+            if (!uleb128_read(p, end, &skip)) {
+                return false;
+            }
+            state->offset += skip;
+            return true;
+        case REBASE_OPCODE_ADD_ADDR_IMM_SCALED:
+            state->offset += (uint64_t)immediate * DYLD_POINTER_SIZE;
+            return true;
+        case REBASE_OPCODE_DO_REBASE_IMM_TIMES:
+            return dyld_emit(fixups, state, macho, immediate,
+                             DYLD_POINTER_SIZE);
+        case REBASE_OPCODE_DO_REBASE_ULEB_TIMES:
+            return uleb128_read(p, end, &count)
+                   && dyld_emit(fixups, state, macho, count,
+                                DYLD_POINTER_SIZE);
+        case REBASE_OPCODE_DO_REBASE_ADD_ADDR_ULEB:
+            return uleb128_read(p, end, &skip) && dyld_stride(skip, &stride)
+                   && dyld_emit(fixups, state, macho, 1, stride);
+        case REBASE_OPCODE_DO_REBASE_ULEB_TIMES_SKIPPING_ULEB:
+            return uleb128_read(p, end, &count) && uleb128_read(p, end, &skip)
+                   && dyld_stride(skip, &stride)
+                   && dyld_emit(fixups, state, macho, count, stride);
+        default:
+            return false;
+    }
+}
+
+// Threaded binds only ever appeared in early arm64e binaries, which have
+// since moved to chained fixups, and are rejected like an unknown opcode.
+local bool dyld_bind_opcode(struct dyld_fixups* fixups,
+                            struct dyld_state* state,
+                            const struct macho* macho, const uint8_t** p,
+                            const uint8_t* end, bool lazy, bool* done) {
+    const uint8_t opcode = **p & BIND_OPCODE_MASK;
+    const uint8_t immediate = **p & BIND_IMMEDIATE_MASK;
+    (*p)++;
+    uint64_t value, count, stride;
+    switch (opcode) {
+        case BIND_OPCODE_DONE:
+            // Lazy binds are separated by DONE so that dyld can start at any
+            // one of them, and only the end of the data ends the stream.
+            *done = !lazy;
+            return true;
+        case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+            state->fixup.ordinal = immediate;
+            return true;
+        case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:
+            if (!uleb128_read(p, end, &value) || value > INT32_MAX) {
+                return false;
+            }
+            state->fixup.ordinal = (int32_t)value;
+            return true;
+        case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+            state->fixup.ordinal = immediate
+                ? (int8_t)(BIND_OPCODE_MASK | immediate) : 0;
+            return true;
+        case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM: {
+            const uint8_t* nul = memchr(*p, 0, end - *p);
+            if (!nul) {
+                return false;
+            }
+            state->fixup.symbol = (const char*)*p;
+            state->fixup.flags = immediate;
+            *p = nul + 1;
+            return true;
+        }
+        case BIND_OPCODE_SET_TYPE_IMM:
+            state->fixup.type = immediate;
+            return true;
+        case BIND_OPCODE_SET_ADDEND_SLEB:
+            return sleb128_read(p, end, &state->fixup.addend);
+        case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+            state->fixup.segment = immediate;
+            return uleb128_read(p, end, &state->offset);
+        case BIND_OPCODE_ADD_ADDR_ULEB:
+            if (!uleb128_read(p, end, &value)) {
+                return false;
+            }
+            state->offset += value;
+            return true;
+        case BIND_OPCODE_DO_BIND:
+            return dyld_emit(fixups, state, macho, 1, DYLD_POINTER_SIZE);
+        case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+            return uleb128_read(p, end, &value) && dyld_stride(value, &stride)
+                   && dyld_emit(fixups, state, macho, 1, stride);
+        case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+            return dyld_emit(fixups, state, macho, 1,
+                             (uint64_t)(immediate + 1) * DYLD_POINTER_SIZE);
+        case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
+            return uleb128_read(p, end, &count) && uleb128_read(p, end, &value)
+                   && dyld_stride(value, &stride)
+                   && dyld_emit(fixups, state, macho, count, stride);
+        default:
+            return false;
+    }
+}
+
+void dyld_fixups_decode(struct dyld_fixups* fixups, const struct macho* macho,
+                        const struct macho_command* command,
+                        enum dyld_stream stream) {
+    fixups->entries = NULL;
+    fixups->count = 0;
+    fixups->malformed = false;
+
+    const S(dyld_info_command*) info =
+        (const void*)macho_command_data(macho, command);
+    const uint32_t offsets[DYLD_STREAM_COUNT] = {
+        info->rebase_off, info->bind_off, info->weak_bind_off,
+        info->lazy_bind_off
+    };
+    const uint32_t sizes[DYLD_STREAM_COUNT] = {
+        info->rebase_size, info->bind_size, info->weak_bind_size,
+        info->lazy_bind_size
+    };
+    const uint8_t* p = macho_data(macho, offsets[stream], sizes[stream]);
+    if (!p || sizes[stream] == 0) {
+        return;
+    }
+    const uint8_t* end = p + sizes[stream];
+
+    struct dyld_state state;
+    memset(&state, 0, sizeof(state));
+    // Every fixup patches a pointer in the file's data, so a stream that
+    // claims more of them than the file has pointers is lying, however well
+    // its DO_*_TIMES opcodes compress.
+    const uint64_t limit = macho->length / DYLD_POINTER_SIZE;
+    state.limit = limit > UINT32_MAX ? UINT32_MAX : (uint32_t)limit;
+    if (stream == DyldStreamRebase) {
+        state.fixup.type = REBASE_TYPE_POINTER;
+    } else {
+        state.fixup.type = BIND_TYPE_POINTER;
+    }
+
+    // Trailing zero padding reads as a run of DONE opcodes, so stopping at the
+    // first one loses nothing.
+    bool done = false;
+    while (!done && p < end) {
+        const bool ok = stream == DyldStreamRebase
+            ? dyld_rebase_opcode(fixups, &state, macho, &p, end, &done)
+            : dyld_bind_opcode(fixups, &state, macho, &p, end,
+                               stream == DyldStreamLazyBind, &done);
+        if (!ok) {
+            fixups->malformed = true;
+            return;
+        }
+    }
+}
+
+void dyld_fixups_free(struct dyld_fixups* fixups) {
+    xfree(fixups->entries);
+    fixups->entries = NULL;
+    fixups->count = 0;
+}
+
+// A node on the walk's path: where its list of children continues, how many
+// are left and how long the name was when it was entered.
+struct dyld_frame {
+    const uint8_t* next;
+    uint32_t children;
+    uint32_t prefix;
+};
+
+struct dyld_walk {
+    const uint8_t* start;
+    const uint8_t* end;
+    struct dyld_exports* exports;
+    uint32_t capacity;
+    size_t names_capacity;
+    char* prefix;
+    uint32_t prefix_length;
+    uint64_t budget;
+};
+
+// Nodes may overlap, so a hostile trie can spell out far more name bytes than
+// it has, by sending many edges through one long string. Real tries share
+// prefixes well short of this many name bytes read or written per trie byte.
+#define DYLD_TRIE_EXPANSION 64
+
+local bool dyld_walk_spend(struct dyld_walk* walk, uint64_t bytes) {
+    if (bytes > walk->budget) {
+        return false;
+    }
+    walk->budget -= bytes;
+    return true;
+}
+
+local bool dyld_walk_name(struct dyld_walk* walk, uint32_t* offset) {
+    struct dyld_exports* exports = walk->exports;
+    const size_t needed = exports->names_size + walk->prefix_length + 1;
+    if (needed > UINT32_MAX
+        || !dyld_walk_spend(walk, walk->prefix_length + 1)) {
+        return false;
+    }
+    if (needed > walk->names_capacity) {
+        size_t capacity = walk->names_capacity ? walk->names_capacity * 2
+                                               : 1 << 16;
+        if (capacity < needed) {
+            capacity = needed;
+        }
+        char* names = xrealloc(exports->names, capacity);
+        if (!names) {
+            return false;
+        }
+        exports->names = names;
+        walk->names_capacity = capacity;
+    }
+    *offset = (uint32_t)exports->names_size;
+    memcpy(exports->names + exports->names_size, walk->prefix,
+           walk->prefix_length);
+    exports->names[needed - 1] = '\0';
+    exports->names_size = needed;
+    return true;
+}
+
+// Decodes the terminal information of the node whose terminal size has
+// been read, up to terminal_end, into an export named by the current prefix.
+local bool dyld_walk_terminal(struct dyld_walk* walk, const uint8_t* p,
+                              const uint8_t* terminal_end) {
+    S(dyld_export) entry;
+    memset(&entry, 0, sizeof(entry));
+    if (!uleb128_read(&p, terminal_end, &entry.flags)) {
+        return false;
+    }
+    if (entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+        if (!uleb128_read(&p, terminal_end, &entry.other)) {
+            return false;
+        }
+        const uint8_t* nul = memchr(p, 0, terminal_end - p);
+        if (!nul) {
+            return false;
+        }
+        if (nul != p) {
+            entry.import_name = (const char*)p;
+        }
+    } else {
+        if (!uleb128_read(&p, terminal_end, &entry.address)) {
+            return false;
+        }
+        if ((entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER)
+            && !uleb128_read(&p, terminal_end, &entry.other)) {
+            return false;
+        }
+    }
+
+    struct dyld_exports* exports = walk->exports;
+    if (exports->count == walk->capacity) {
+        if (walk->capacity > UINT32_MAX / 2) {
+            return false;
+        }
+        const uint32_t grown = walk->capacity ? walk->capacity * 2 : 1024;
+        S(dyld_export*) entries =
+            xrealloc(exports->entries, sizeof(*entries) * grown);
+        if (!entries) {
+            return false;
+        }
+        exports->entries = entries;
+        walk->capacity = grown;
+    }
+    if (!dyld_walk_name(walk, &entry.name)) {
+        return false;
+    }
+    exports->entries[exports->count++] = entry;
+    return true;
+}
+
+// Enters the node at p: emits its export, if it has one, and leaves frame
+// ready to walk its children.
+local bool dyld_walk_node(struct dyld_walk* walk, const uint8_t* p,
+                          struct dyld_frame* frame) {
+    uint64_t terminal_size;
+    if (!uleb128_read(&p, walk->end, &terminal_size)
+        || terminal_size >= (uint64_t)(walk->end - p)) {
+        return false;
+    }
+    if (terminal_size
+        && !dyld_walk_terminal(walk, p, p + terminal_size)) {
+        return false;
+    }
+    p += terminal_size;
+    frame->children = *p;
+    frame->next = p + 1;
+    frame->prefix = walk->prefix_length;
+    return true;
+}
+
+void dyld_exports_decode(struct dyld_exports* exports,
+                         const struct macho* macho, uint64_t offset,
+                         uint64_t size) {
+    exports->entries = NULL;
+    exports->count = 0;
+    exports->names = NULL;
+    exports->names_size = 0;
+    exports->malformed = false;
+
+    const uint8_t* start = macho_data(macho, offset, size);
+    if (!start || size == 0 || size > UINT32_MAX) {
+        exports->malformed = start && size > UINT32_MAX;
+        return;
+    }
+
+    // Each node is entered at most once, which the visited bitmap enforces,
+    // so a cyclic or self-sharing trie costs no more than a tree of the same
+    // size. A name can be no longer than the trie it is spelled out in.
+    struct dyld_walk walk = {
+        start, start + size, exports, 0, 0, xmalloc(size), 0,
+        (size + 4096) * DYLD_TRIE_EXPANSION
+    };
+    uint8_t* visited = xmalloc((size + 7) / 8);
+    struct dyld_frame* stack =
+        xmalloc(sizeof(struct dyld_frame) * DYLD_TRIE_DEPTH);
+    if (!walk.prefix || !visited || !stack) {
+        exports->malformed = true;
+        goto done;
+    }
+    memset(visited, 0, (size + 7) / 8);
+
+    visited[0] = 1;
+    uint32_t depth = 0;
+    if (!dyld_walk_node(&walk, start, &stack[depth++])) {
+        exports->malformed = true;
+        goto done;
+    }
+    while (depth > 0) {
+        struct dyld_frame* frame = &stack[depth - 1];
+        if (frame->children == 0) {
+            walk.prefix_length = frame->prefix;
+            depth--;
+            continue;
+        }
+        frame->children--;
+
+        const uint8_t* edge = frame->next;
+        const uint8_t* nul = memchr(edge, 0, walk.end - edge);
+        uint64_t child;
+        const uint8_t* p = nul ? nul + 1 : walk.end;
+        if (!dyld_walk_spend(&walk, p - edge)) {
+            exports->malformed = true;
+            break;
+        }
+        if (!nul || !uleb128_read(&p, walk.end, &child)) {
+            // The rest of this node's children cannot be found, but its
+            // siblings and theirs are still good.
+            exports->malformed = true;
+            frame->children = 0;
+            continue;
+        }
+        frame->next = p;
+        if (child >= size || (visited[child / 8] & (1 << child % 8))
+            || depth == DYLD_TRIE_DEPTH
+            || (size_t)(nul - edge) > size - frame->prefix) {
+            exports->malformed = true;
+            continue;
+        }
+        visited[child / 8] |= 1 << child % 8;
+
+        const size_t length = nul - edge;
+        walk.prefix_length = frame->prefix;
+        memcpy(walk.prefix + walk.prefix_length, edge, length);
+        walk.prefix_length += (uint32_t)length;
+        if (!dyld_walk_node(&walk, start + child, &stack[depth])) {
+            exports->malformed = true;
+            walk.prefix_length = frame->prefix;
+            continue;
+        }
+        depth++;
+    }
+
+done:
+    xfree(stack);
+    xfree(visited);
+    xfree(walk.prefix);
+}
+
+void dyld_exports_free(struct dyld_exports* exports) {
+    xfree(exports->entries);
+    xfree(exports->names);
+    exports->entries = NULL;
+    exports->names = NULL;
+    exports->count = 0;
+    exports->names_size = 0;
+}
@@ -0,0 +1,50 @@
+// src/fat.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "fat.h"
+#include <stddef.h>
+
+static const struct {
+    cpu_type_t cputype;
+    cpu_subtype_t cpusubtype;
+    const char* name;
+} arch_names[] = {
+    { CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_ALL, "x86_64" },
+    { CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_H, "x86_64h" },
+    { CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64_ALL, "arm64" },
+    { CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64_V8, "arm64v8" },
+    { CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64E, "arm64e" },
+    { CPU_TYPE_ARM64_32, CPU_SUBTYPE_ARM64_32_V8, "arm64_32" },
+    { CPU_TYPE_I386, CPU_SUBTYPE_I386_ALL, "i386" },
+    { CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7, "armv7" },
+    { CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7S, "armv7s" },
+    { CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7K, "armv7k" },
+    { CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_ALL, "ppc" },
+    { CPU_TYPE_POWERPC64, CPU_SUBTYPE_POWERPC_ALL, "ppc64" }
+};
+
+void fat_slice_read(struct fat_slice* slice, const void* entry, bool is64) {
+    const char* bytes = entry;
+    slice->cputype = (cpu_type_t)read_be32(bytes);
+    slice->cpusubtype = (cpu_subtype_t)read_be32(bytes + 4);
+    if (is64) {
+        slice->offset = read_be64(bytes + 8);
+        slice->size = read_be64(bytes + 16);
+        slice->align = read_be32(bytes + 24);
+    } else {
+        slice->offset = read_be32(bytes + 8);
+        slice->size = read_be32(bytes + 12);
+        slice->align = read_be32(bytes + 16);
+    }
+}
+
+const char* arch_name(cpu_type_t cputype, cpu_subtype_t cpusubtype) {
+    cpusubtype &= ~CPU_SUBTYPE_MASK;
+    for (size_t i = 0; i < sizeof(arch_names) / sizeof(*arch_names); i++) {
+        if (arch_names[i].cputype == cputype
+            && arch_names[i].cpusubtype == cpusubtype) {
+            return arch_names[i].name;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,372 @@
+// src/fingerprint.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "fingerprint.h"
+#include "json.h"
+#include "macho.h"
+#include "out.h"
+#include "pool.h"
+#include "safe.h"
+#include "xxh64.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// Contents are hashed in blocks of at most this size, one per task.
+#define FINGERPRINT_BLOCK_SIZE ((uint64_t)1 << 20)
+
+// Bytes of the file, clamped to it. A range's hash is seeded with the number
+// of bytes hashed plus seed, which for a zero filled section is its size.
+struct fingerprint_range {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t seed;
+};
+
+struct fingerprint_block {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t hashed;
+};
+
+// Every range is hashed in blocks counted from its own start, so that its
+// hash depends only on its bytes, and then from the run of its block hashes.
+// Excluded bytes within a block are skipped. Range i's blocks are
+// [first_block[i], first_block[i + 1]).
+//
+// ranges holds the header and load commands, then the segments and then the
+// sections, in the order of the tables in struct macho. excluded is sorted
+// and its ranges do not overlap.
+struct fingerprint {
+    const struct macho* macho;
+    struct fingerprint_range* ranges;
+    size_t nranges;
+    struct fingerprint_range* excluded;
+    size_t nexcluded;
+    size_t* first_block;
+    struct fingerprint_block* blocks;
+    uint64_t* block_hashes;
+    size_t nblocks;
+    uint64_t* hashes;
+};
+
+local struct fingerprint_range fingerprint_clamp(const struct macho* macho,
+                                                 uint64_t offset,
+                                                 uint64_t size) {
+    const uint64_t length = macho->length;
+    struct fingerprint_range range;
+    range.begin = offset < length ? offset : length;
+    range.end = size < length - range.begin ? range.begin + size : length;
+    range.seed = 0;
+    return range;
+}
+
+// Collects the ranges, and the parts of the file that change between
+// otherwise identical builds: the UUID and the code signature, along with
+// the command that locates it.
+local void fingerprint_collect(struct fingerprint* f) {
+    const struct macho* macho = f->macho;
+    f->ranges[f->nranges++] = fingerprint_clamp(
+        macho, 0, sizeof(macho->header) + (uint64_t)macho->header.sizeofcmds);
+    struct macho_iter it = macho_segments(macho);
+    for (const struct macho_segment* segment;
+         (segment = macho_next_segment(&it));) {
+        f->ranges[f->nranges++] = fingerprint_clamp(
+            macho, segment->command.fileoff, segment->command.filesize);
+    }
+    it = macho_sections(macho);
+    for (const struct section_64* section;
+         (section = macho_next_section(&it));) {
+        struct fingerprint_range* range = &f->ranges[f->nranges++];
+        if (macho_section_has_contents(section)) {
+            *range = fingerprint_clamp(macho, section->offset, section->size);
+        } else {
+            *range = fingerprint_clamp(macho, 0, 0);
+            range->seed = section->size;
+        }
+    }
+
+    // Only the fields of commands that are not malformed can be read.
+    it = macho_commands(macho);
+    for (const struct macho_command* command;
+         (command = macho_next_command(&it));) {
+        const bool readable = command->verdict != MachoVerdictMalformed;
+        if (command->cmd == LC_UUID && readable) {
+            f->excluded[f->nexcluded++] = fingerprint_clamp(
+                macho, command->offset + offsetof(S(uuid_command), uuid),
+                sizeof(macho->uuid));
+        } else if (command->cmd == LC_CODE_SIGNATURE) {
+            f->excluded[f->nexcluded++] = fingerprint_clamp(
+                macho, command->offset, command->cmdsize);
+            if (readable) {
+                const S(linkedit_data_command*) signature =
+                    (const void*)macho_command_data(macho, command);
+                f->excluded[f->nexcluded++] = fingerprint_clamp(
+                    macho, signature->dataoff, signature->datasize);
+            }
+        }
+    }
+}
+
+static int fingerprint_compare(const void* a, const void* b) {
+    const struct fingerprint_range* x = a;
+    const struct fingerprint_range* y = b;
+    return (x->begin > y->begin) - (x->begin < y->begin);
+}
+
+// Sorts the excluded ranges and merges those that overlap or touch.
+local void fingerprint_merge(struct fingerprint* f) {
+    qsort(f->excluded, f->nexcluded, sizeof(*f->excluded),
+          fingerprint_compare);
+    size_t n = 0;
+    for (size_t i = 0; i < f->nexcluded; i++) {
+        const struct fingerprint_range* range = &f->excluded[i];
+        if (range->begin == range->end) {
+            continue;
+        }
+        if (n > 0 && range->begin <= f->excluded[n - 1].end) {
+            if (range->end > f->excluded[n - 1].end) {
+                f->excluded[n - 1].end = range->end;
+            }
+        } else {
+            f->excluded[n++] = *range;
+        }
+    }
+    f->nexcluded = n;
+}
+
+// Lays out the blocks of every range. Returns false if memory runs out.
+local bool fingerprint_blocks(struct fingerprint* f) {
+    f->nblocks = 0;
+    for (size_t i = 0; i < f->nranges; i++) {
+        f->first_block[i] = f->nblocks;
+        f->nblocks += (size_t)((f->ranges[i].end - f->ranges[i].begin
+                                + FINGERPRINT_BLOCK_SIZE - 1)
+                               / FINGERPRINT_BLOCK_SIZE);
+    }
+    f->first_block[f->nranges] = f->nblocks;
+
+    f->blocks = xmalloc(sizeof(*f->blocks) * (f->nblocks ? f->nblocks : 1));
+    f->block_hashes = xmalloc(sizeof(uint64_t)
+                              * (f->nblocks ? f->nblocks : 1));
+    if (!f->blocks || !f->block_hashes) {
+        return false;
+    }
+    for (size_t i = 0; i < f->nranges; i++) {
+        const struct fingerprint_range* range = &f->ranges[i];
+        uint64_t offset = range->begin;
+        for (size_t block = f->first_block[i]; block < f->first_block[i + 1];
+             offset += FINGERPRINT_BLOCK_SIZE, block++) {
+            f->blocks[block].offset = offset;
+            f->blocks[block].size = range->end - offset
+                                    < FINGERPRINT_BLOCK_SIZE
+                                    ? range->end - offset
+                                    : FINGERPRINT_BLOCK_SIZE;
+        }
+    }
+    return true;
+}
+
+// The index of the first excluded range that ends after offset.
+local size_t fingerprint_excluded(const struct fingerprint* f,
+                                  uint64_t offset) {
+    size_t low = 0;
+    size_t high = f->nexcluded;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (f->excluded[mid].end <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Hashes a block, chaining the hashes of the stretches between the excluded
+// ranges within it, so that a block with none hashes as a whole.
+static void fingerprint_hash_task(void* context, size_t index) {
+    const struct fingerprint* f = context;
+    struct fingerprint_block* block = &f->blocks[index];
+    const uint64_t end = block->offset + block->size;
+    uint64_t offset = block->offset;
+    uint64_t hash = 0;
+    block->hashed = 0;
+    for (size_t i = fingerprint_excluded(f, offset); offset < end; i++) {
+        const uint64_t stop = i < f->nexcluded && f->excluded[i].begin < end
+                              ? f->excluded[i].begin : end;
+        if (offset < stop) {
+            hash = xxh64(f->macho->data + offset, (size_t)(stop - offset),
+                         hash);
+            block->hashed += stop - offset;
+        }
+        if (stop == end) {
+            break;
+        }
+        offset = f->excluded[i].end;
+    }
+    f->block_hashes[index] = hash;
+}
+
+local uint64_t fingerprint_range_hash(const struct fingerprint* f,
+                                      size_t index) {
+    const size_t first = f->first_block[index];
+    const size_t last = f->first_block[index + 1];
+    uint64_t bytes = f->ranges[index].seed;
+    for (size_t i = first; i < last; i++) {
+        bytes += f->blocks[i].hashed;
+    }
+    return xxh64(f->block_hashes + first,
+                 (last - first) * sizeof(*f->block_hashes), bytes);
+}
+
+local void fingerprint_free(struct fingerprint* f) {
+    xfree(f->ranges);
+    xfree(f->excluded);
+    xfree(f->first_block);
+    xfree(f->blocks);
+    xfree(f->block_hashes);
+    xfree(f->hashes);
+}
+
+// Hashes every range, and then the file as the hash of those hashes.
+local bool fingerprint_hash(struct fingerprint* f, unsigned threads,
+                            uint64_t* total) {
+    const struct macho* macho = f->macho;
+    const size_t nranges = 1 + (size_t)macho->nsegments + macho->nsections;
+    const size_t nexcluded = 2 * (size_t)macho->ncommands;
+    f->ranges = xmalloc(sizeof(*f->ranges) * nranges);
+    f->excluded = xmalloc(sizeof(*f->excluded)
+                          * (nexcluded ? nexcluded : 1));
+    f->first_block = xmalloc(sizeof(*f->first_block) * (nranges + 1));
+    f->hashes = xmalloc(sizeof(*f->hashes) * nranges);
+    if (!f->ranges || !f->excluded || !f->first_block || !f->hashes) {
+        return false;
+    }
+    fingerprint_collect(f);
+    fingerprint_merge(f);
+    if (!fingerprint_blocks(f)) {
+        return false;
+    }
+    pool_for(threads, f->nblocks, fingerprint_hash_task, f);
+    for (size_t i = 0; i < f->nranges; i++) {
+        f->hashes[i] = fingerprint_range_hash(f, i);
+    }
+    *total = xxh64(f->hashes, f->nranges * sizeof(*f->hashes), 0);
+    return true;
+}
+
+// Names are fixed fields, terminated only if they are shorter.
+local void fingerprint_name(struct out* out, const char* name) {
+    const char* end = memchr(name, '\0', 16);
+    out_write(out, name, end ? (size_t)(end - name) : 16);
+}
+
+local void fingerprint_text(struct out* out, const struct fingerprint* f,
+                            const char* name, uint64_t total) {
+    const struct macho* macho = f->macho;
+    out_hex(out, total, 16);
+    out_putc(out, ' ');
+    out_puts(out, name);
+    out_puts(out, " header=");
+    out_hex(out, f->hashes[0], 16);
+    for (uint32_t i = 0; i < macho->nsegments; i++) {
+        const struct macho_segment* segment = &macho->segments[i];
+        out_putc(out, ' ');
+        fingerprint_name(out, segment->command.segname);
+        out_putc(out, '=');
+        out_hex(out, f->hashes[1 + i], 16);
+        struct macho_iter it = macho_segment_sections(macho, segment);
+        for (const struct section_64* section;
+             (section = macho_next_section(&it));) {
+            out_putc(out, ' ');
+            fingerprint_name(out, section->segname);
+            out_putc(out, ',');
+            fingerprint_name(out, section->sectname);
+            out_putc(out, '=');
+            out_hex(out, f->hashes[1 + macho->nsegments
+                                   + (size_t)(section - macho->sections)], 16);
+        }
+    }
+    out_putc(out, '\n');
+}
+
+local void fingerprint_json_hash(struct out* out, uint64_t hash) {
+    out_putc(out, '"');
+    out_hex(out, hash, 16);
+    out_putc(out, '"');
+}
+
+local void fingerprint_json(struct out* out, const struct fingerprint* f,
+                            uint64_t total, bool ndjson) {
+    const struct macho* macho = f->macho;
+    out_puts(out, ndjson ? "{\"record\":\"fingerprint\",\"fingerprint\":"
+                         : "{\"fingerprint\":");
+    fingerprint_json_hash(out, total);
+    out_puts(out, ",\"header\":");
+    fingerprint_json_hash(out, f->hashes[0]);
+    out_puts(out, ",\"segments\":[");
+    for (uint32_t i = 0; i < macho->nsegments; i++) {
+        const struct macho_segment* segment = &macho->segments[i];
+        out_puts(out, i ? ",{\"segname\":" : "{\"segname\":");
+        json_string(out, segment->command.segname,
+                    sizeof(segment->command.segname));
+        out_puts(out, ",\"hash\":");
+        fingerprint_json_hash(out, f->hashes[1 + i]);
+        out_puts(out, ",\"sections\":[");
+        struct macho_iter it = macho_segment_sections(macho, segment);
+        for (const struct section_64* section;
+             (section = macho_next_section(&it));) {
+            out_puts(out, section == &macho->sections[segment->first_section]
+                          ? "{\"sectname\":" : ",{\"sectname\":");
+            json_string(out, section->sectname, sizeof(section->sectname));
+            out_puts(out, ",\"hash\":");
+            fingerprint_json_hash(out, f->hashes[1 + macho->nsegments
+                + (size_t)(section - macho->sections)]);
+            out_putc(out, '}');
+        }
+        out_puts(out, "]}");
+    }
+    out_puts(out, ndjson ? "]}\n" : "]}");
+}
+
+enum dump_error fingerprint_dump(struct out* out, const char* name,
+                                 void* buffer, size_t length,
+                                 enum dump_format format, unsigned threads) {
+    struct macho macho;
+    enum dump_error error = mach_select(&buffer, &length);
+    if (error == DumpErrorNone) {
+        error = macho_parse(&macho, buffer, length);
+    }
+    if (error != DumpErrorNone) {
+        if (format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+        return error;
+    }
+
+    // Problems within the file do not stop it from being fingerprinted, as
+    // its bytes are hashed as they are, but they are still reported.
+    struct fingerprint f;
+    memset(&f, 0, sizeof(f));
+    f.macho = &macho;
+    uint64_t total;
+    if (!fingerprint_hash(&f, threads, &total)) {
+        error = DumpErrorNoMemory;
+        if (format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+    } else {
+        error = macho.error;
+        if (format == DumpFormatText) {
+            fingerprint_text(out, &f, name, total);
+        } else {
+            fingerprint_json(out, &f, total, format == DumpFormatNDJSON);
+        }
+    }
+    fingerprint_free(&f);
+    macho_free(&macho);
+    return error;
+}
@@ -0,0 +1,159 @@
+// src/funcstarts.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "funcstarts.h"
+#include "leb.h"
+#include "safe.h"
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// The address the first delta is relative to: the start of __TEXT.
+local const struct macho_segment* function_starts_text(
+    const struct macho* macho) {
+    struct macho_iter it = macho_segments(macho);
+    for (const struct macho_segment* segment;
+         (segment = macho_next_segment(&it));) {
+        if (strncmp(segment->command.segname, SEG_TEXT,
+                    sizeof(segment->command.segname)) == 0) {
+            return segment;
+        }
+    }
+    return NULL;
+}
+
+// Clips each size to the end of the __TEXT section its function starts in.
+// Both the functions and, after sorting, the sections are by address, so one
+// merge finds every function's section.
+local void function_starts_clip(struct function_starts* starts,
+                                const struct macho* macho,
+                                const struct macho_segment* text) {
+    const uint32_t nsects = text->command.nsects;
+    const S(section_64*) sections = &macho->sections[text->first_section];
+    uint32_t* order = xmalloc(sizeof(*order) * (nsects ? nsects : 1));
+    if (!order) {
+        return;
+    }
+    // There are only ever a handful of sections.
+    for (uint32_t i = 0; i < nsects; i++) {
+        uint32_t j = i;
+        for (; j > 0 && sections[order[j - 1]].addr > sections[i].addr; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < starts->count; i++) {
+        const uint64_t address = starts->addresses[i];
+        while (next < nsects
+               && sections[order[next]].addr + sections[order[next]].size
+                  <= address) {
+            next++;
+        }
+        if (next < nsects && sections[order[next]].addr <= address) {
+            const uint64_t end = sections[order[next]].addr
+                                 + sections[order[next]].size;
+            if (end - address < starts->sizes[i]) {
+                starts->sizes[i] = end - address;
+            }
+        }
+    }
+    xfree(order);
+}
+
+local bool function_starts_grow(struct function_starts* starts,
+                                uint32_t* capacity) {
+    if (*capacity > UINT32_MAX / 2) {
+        return false;
+    }
+    const uint32_t grown = *capacity ? *capacity * 2 : 1024;
+    uint64_t* addresses = xrealloc(starts->addresses,
+                                   sizeof(uint64_t) * grown);
+    if (!addresses) {
+        return false;
+    }
+    starts->addresses = addresses;
+    uint64_t* sizes = xrealloc(starts->sizes, sizeof(uint64_t) * grown);
+    if (!sizes) {
+        return false;
+    }
+    starts->sizes = sizes;
+    *capacity = grown;
+    return true;
+}
+
+void function_starts_decode(struct function_starts* starts,
+                            const struct macho* macho) {
+    memset(starts, 0, sizeof(*starts));
+    if (macho->function_starts_command == MACHO_NONE) {
+        return;
+    }
+    const S(linkedit_data_command*) command = (const void*)macho_command_data(
+        macho, &macho->commands[macho->function_starts_command]);
+    const uint8_t* p = (const uint8_t*)macho->data + command->dataoff;
+    const uint8_t* end = p + command->datasize;
+    const struct macho_segment* text = function_starts_text(macho);
+    uint64_t address = text ? text->command.vmaddr : 0;
+
+    // The columns grow as deltas are read rather than being sized from
+    // datasize, which counts the zero padding after the terminator too.
+    uint32_t capacity = 0;
+    uint64_t delta;
+    while (p < end) {
+        if (!uleb128_read(&p, end, &delta)) {
+            starts->truncated = true;
+            break;
+        }
+        if (delta == 0) {
+            break;
+        }
+        if (starts->count == capacity
+            && !function_starts_grow(starts, &capacity)) {
+            starts->truncated = true;
+            break;
+        }
+        address += delta;
+        starts->addresses[starts->count++] = address;
+    }
+
+    for (uint32_t i = 0; i < starts->count; i++) {
+        starts->sizes[i] = i + 1 < starts->count
+                           ? starts->addresses[i + 1] - starts->addresses[i]
+                           : UINT64_MAX;
+    }
+    if (text) {
+        function_starts_clip(starts, macho, text);
+    }
+    if (starts->count > 0 && starts->sizes[starts->count - 1] == UINT64_MAX) {
+        starts->sizes[starts->count - 1] = 0;
+    }
+}
+
+void function_starts_free(struct function_starts* starts) {
+    xfree(starts->addresses);
+    xfree(starts->sizes);
+    xfree(starts->symbols);
+    memset(starts, 0, sizeof(*starts));
+}
+
+void function_starts_join(struct function_starts* starts,
+                          const struct symindex* index) {
+    xfree(starts->symbols);
+    starts->symbols = xmalloc(sizeof(uint32_t)
+                              * (starts->count ? starts->count : 1));
+    if (!starts->symbols) {
+        return;
+    }
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < starts->count; i++) {
+        const uint64_t address = starts->addresses[i];
+        while (next < index->naddresses
+               && index->value[index->addresses[next]] < address) {
+            next++;
+        }
+        starts->symbols[i] = next < index->naddresses
+                             && index->value[index->addresses[next]] == address
+                             ? index->addresses[next] : SYMINDEX_NONE;
+    }
+}
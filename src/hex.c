@@ -0,0 +1,242 @@
+// src/hex.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "hex.h"
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#define HEX_X86 1
+#include <immintrin.h>
+#endif
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void hex_encode_scalar(char* dst, const unsigned char* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[2 * i] = hex_digits[src[i] >> 4];
+        dst[2 * i + 1] = hex_digits[src[i] & 0xf];
+    }
+}
+
+#ifdef HEX_X86
+// Each nibble n becomes n + '0', plus 'a' - '0' - 10 more when it is above 9.
+// The high and low nibble vectors are then interleaved into digit pairs.
+static inline __m128i hex_nibbles_sse2(__m128i nibbles) {
+    const __m128i above_nine = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+                        _mm_and_si128(above_nine,
+                                      _mm_set1_epi8('a' - '0' - 10)));
+}
+
+static size_t hex_encode_sse2(char* dst, const unsigned char* src, size_t n) {
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i hi = hex_nibbles_sse2(
+            _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        const __m128i lo = hex_nibbles_sse2(_mm_and_si128(bytes, mask));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i + 16),
+                         _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HEX_AVX2 1
+__attribute__((target("avx2")))
+static size_t hex_encode_avx2(char* dst, const unsigned char* src, size_t n) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i letters = _mm256_set1_epi8('a' - '0' - 10);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i bytes = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask);
+        __m256i lo = _mm256_and_si256(bytes, mask);
+        hi = _mm256_add_epi8(_mm256_add_epi8(hi, zero),
+                             _mm256_and_si256(_mm256_cmpgt_epi8(hi, nine),
+                                              letters));
+        lo = _mm256_add_epi8(_mm256_add_epi8(lo, zero),
+                             _mm256_and_si256(_mm256_cmpgt_epi8(lo, nine),
+                                              letters));
+        // The unpacks work within each 128-bit lane, so the halves are put
+        // back in order before storing.
+        const __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i),
+                            _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i + 32),
+                            _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    return i;
+}
+#endif
+
+// Lays out one full row's hex and ASCII columns, starting with the space after
+// the offset, by shuffling the digit pairs into their " xx" slots. The stores
+// go left to right and each one overwrites the spill of the one before.
+#if defined(__GNUC__) || defined(__clang__)
+#define HEX_SSSE3 1
+__attribute__((target("ssse3")))
+static char* hex_row_ssse3(char* row, const unsigned char* bytes) {
+    #define P 0x80
+    static const unsigned char first[16] = {
+        P, 0, 1, P, 2, 3, P, 4, 5, P, 6, 7, P, 8, 9, P
+    };
+    static const unsigned char second[16] = {
+        10, 11, P, 12, 13, P, 14, 15, P, P, P, P, P, P, P, P
+    };
+    static const unsigned char third[16] = {
+        P, P, 0, 1, P, 2, 3, P, 4, 5, P, 6, 7, P, 8, 9
+    };
+    static const unsigned char fourth[16] = {
+        P, 10, 11, P, 12, 13, P, 14, 15, P, P, P, P, P, P, P
+    };
+    #undef P
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+
+    const __m128i bytes16 = _mm_loadu_si128((const __m128i*)bytes);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes16, 4), mask);
+    __m128i lo = _mm_and_si128(bytes16, mask);
+    hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+                      _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letters));
+    lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+                      _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letters));
+    const __m128i left = _mm_unpacklo_epi8(hi, lo);
+    const __m128i right = _mm_unpackhi_epi8(hi, lo);
+
+    // Shuffled-in zeros are the gaps between pairs; max turns them into
+    // spaces since every digit is above ' '.
+    #define HEX_STORE(at, digits, order) \
+        _mm_storeu_si128((__m128i*)(row + (at)), _mm_max_epu8(space, \
+            _mm_shuffle_epi8((digits), \
+                             _mm_loadu_si128((const __m128i*)(order)))))
+    HEX_STORE(0, left, first);
+    HEX_STORE(16, left, second);
+    HEX_STORE(24, right, third);
+    HEX_STORE(40, right, fourth);
+    #undef HEX_STORE
+    memcpy(row + 49, "  |", 3);
+
+    // Printable bytes are those from ' ' to '~', which as signed bytes are
+    // exactly the ones above 31 and below 127.
+    const __m128i printable = _mm_and_si128(
+        _mm_cmpgt_epi8(bytes16, _mm_set1_epi8(31)),
+        _mm_cmplt_epi8(bytes16, _mm_set1_epi8(127)));
+    _mm_storeu_si128((__m128i*)(row + 52), _mm_or_si128(
+        _mm_and_si128(printable, bytes16),
+        _mm_andnot_si128(printable, _mm_set1_epi8('.'))));
+    memcpy(row + 68, "|\n", 2);
+    return row + 70;
+}
+#endif
+#endif
+
+void hex_encode(char* dst, const unsigned char* src, size_t n) {
+    size_t done = 0;
+#ifdef HEX_AVX2
+    if (n >= 32 && __builtin_cpu_supports("avx2")) {
+        done = hex_encode_avx2(dst, src, n);
+    }
+#endif
+#ifdef HEX_X86
+    done += hex_encode_sse2(dst + 2 * done, src + done, n - done);
+#endif
+    hex_encode_scalar(dst + 2 * done, src + done, n - done);
+}
+
+// Rows are laid out from hex encoded blocks of this many bytes.
+#define HEX_BLOCK 4096
+
+size_t hex_dump_rows(char* dst, const unsigned char* src, size_t n,
+                     uint64_t offset, const char* prefix) {
+    const size_t prefix_length = strlen(prefix);
+    char digits[2 * HEX_BLOCK];
+    char* row = dst;
+#ifdef HEX_SSSE3
+    const bool shuffle = __builtin_cpu_supports("ssse3");
+#else
+    const bool shuffle = false;
+#endif
+    for (size_t block = 0; block < n; block += HEX_BLOCK) {
+        const size_t block_size = n - block < HEX_BLOCK ? n - block
+                                                        : HEX_BLOCK;
+        if (!shuffle || block_size % 16 != 0) {
+            hex_encode(digits, src + block, block_size);
+        }
+        for (size_t i = 0; i < block_size; i += 16) {
+            const size_t count = block_size - i < 16 ? block_size - i : 16;
+            const unsigned char* bytes = src + block + i;
+
+            memcpy(row, prefix, prefix_length);
+            row += prefix_length;
+
+            uint64_t address = offset + block + i;
+            int width = 8;
+            while (width < 16 && address >> (4 * width)) {
+                width++;
+            }
+            for (int d = width - 1; d >= 0; d--) {
+                *row++ = hex_digits[(address >> (4 * d)) & 0xf];
+            }
+            *row++ = ' ';
+#ifdef HEX_SSSE3
+            if (count == 16 && shuffle) {
+                row = hex_row_ssse3(row, bytes);
+                continue;
+            }
+#endif
+
+            // "  xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  |"
+            if (count == 16) {
+                // Full rows, which is all of them but the last, have a fixed
+                // layout and need no per-byte checks.
+                for (size_t b = 0; b < 16; b++) {
+                    char* pair = row + 3 * b + 1 + (b >= 8);
+                    pair[-1] = ' ';
+                    memcpy(pair, digits + 2 * (i + b), 2);
+                }
+                row[24] = ' ';
+                memcpy(row + 49, "  |", 3);
+                row += 52;
+                for (size_t b = 0; b < 16; b++) {
+                    row[b] = bytes[b] >= 0x20 && bytes[b] < 0x7f ? bytes[b]
+                                                                 : '.';
+                }
+                memcpy(row + 16, "|\n", 2);
+                row += 18;
+                continue;
+            }
+            for (size_t b = 0; b < 16; b++) {
+                *row++ = ' ';
+                if (b == 8) {
+                    *row++ = ' ';
+                }
+                if (b < count) {
+                    memcpy(row, digits + 2 * (i + b), 2);
+                } else {
+                    row[0] = ' ';
+                    row[1] = ' ';
+                }
+                row += 2;
+            }
+            *row++ = ' ';
+            *row++ = ' ';
+            *row++ = '|';
+            for (size_t b = 0; b < count; b++) {
+                *row++ = bytes[b] >= 0x20 && bytes[b] < 0x7f ? bytes[b] : '.';
+            }
+            *row++ = '|';
+            *row++ = '\n';
+        }
+    }
+    return (size_t)(row - dst);
+}
@@ -0,0 +1,898 @@
+// src/json.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "json.h"
+#include "archive.h"
+#include "chained.h"
+#include "dyldinfo.h"
+#include "fat.h"
+#include "funcstarts.h"
+#include "macho.h"
+#include "out.h"
+#include "stats.h"
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// Symbols are rendered this many at a time, one chunk per task.
+#define JSON_CHUNK_SIZE 16384
+
+// Writes a member of an object that already has at least one member.
+#define FIELD(name, value) do { \
+    out_puts(out, ",\"" name "\":"); \
+    out_dec(out, (value)); \
+} while (0)
+#define FIELD_STRING(name, value, n) do { \
+    out_puts(out, ",\"" name "\":"); \
+    json_string(out, (value), (n)); \
+} while (0)
+
+// The length of the well-formed UTF-8 sequence at s, or 0 if there is none.
+local size_t utf8_length(const unsigned char* s, size_t n) {
+    size_t length;
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        length = 2;
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        length = 3;
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        length = 4;
+    } else {
+        return 0;
+    }
+    if (length > n) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+void json_string(struct out* out, const char* s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* bytes = (const unsigned char*)s;
+    out_putc(out, '"');
+    // Runs of characters that need no escaping are copied in one go. Bytes
+    // that are not valid UTF-8 are written as the Latin-1 code point of the
+    // same value so the output is always valid JSON.
+    size_t run = 0;
+    size_t i = 0;
+    while (i < n && bytes[i]) {
+        const unsigned char c = bytes[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            i++;
+            continue;
+        }
+        if (c >= 0x80) {
+            const size_t length = utf8_length(bytes + i, n - i);
+            if (length > 0) {
+                i += length;
+                continue;
+            }
+        }
+        out_write(out, s + run, i - run);
+        if (c == '"' || c == '\\') {
+            const char escape[2] = { '\\', (char)c };
+            out_write(out, escape, 2);
+        } else {
+            const char escape[6] = {
+                '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]
+            };
+            out_write(out, escape, 6);
+        }
+        run = ++i;
+    }
+    out_write(out, s + run, i - run);
+    out_putc(out, '"');
+}
+
+local void json_string_or_null(struct out* out, const char* s) {
+    if (s) {
+        json_string(out, s, (size_t)-1);
+    } else {
+        out_puts(out, "null");
+    }
+}
+
+local void json_header(struct out* out, const S(mach_header_64*) header,
+                       bool ndjson) {
+    out_puts(out, ndjson ? "{\"record\":\"header\",\"magic\":"
+                         : "\"header\":{\"magic\":");
+    out_dec(out, header->magic);
+    FIELD("cputype", (uint32_t)header->cputype);
+    FIELD("cpusubtype", (uint32_t)header->cpusubtype);
+    out_puts(out, ",\"arch\":");
+    json_string_or_null(out, arch_name(header->cputype, header->cpusubtype));
+    FIELD("filetype", header->filetype);
+    FIELD("ncmds", header->ncmds);
+    FIELD("sizeofcmds", header->sizeofcmds);
+    FIELD("flags", header->flags);
+    out_puts(out, ndjson ? "}\n" : "}");
+}
+
+local void json_section_64(struct out* out, uint32_t command, uint32_t index,
+                           const S(section_64*) sec64, bool ndjson) {
+    if (ndjson) {
+        out_puts(out, "{\"record\":\"section\",\"load_command\":");
+        out_dec(out, command);
+        FIELD("index", index);
+    } else {
+        out_puts(out, index > 0 ? ",{\"index\":" : "{\"index\":");
+        out_dec(out, index);
+    }
+    FIELD_STRING("sectname", sec64->sectname, sizeof(sec64->sectname));
+    FIELD_STRING("segname", sec64->segname, sizeof(sec64->segname));
+    FIELD("addr", sec64->addr);
+    FIELD("size", sec64->size);
+    FIELD("offset", sec64->offset);
+    FIELD("align", sec64->align);
+    FIELD("reloff", sec64->reloff);
+    FIELD("nreloc", sec64->nreloc);
+    FIELD("flags", sec64->flags);
+    out_puts(out, ndjson ? "}\n" : "}");
+}
+
+struct json_symbols {
+    const struct macho* macho;
+    uint32_t command;
+    bool ndjson;
+    bool names;
+};
+
+static void json_symbol_range(struct out* out, void* context, size_t begin,
+                              size_t end) {
+    const struct json_symbols* symbols = context;
+    for (size_t i = begin; i < end; i++) {
+        const S(nlist_64) symbol = macho_symbol(symbols->macho, (uint32_t)i);
+        const S(nlist_64*) elem = &symbol;
+        if (symbols->ndjson) {
+            out_puts(out, "{\"record\":\"symbol\",\"load_command\":");
+            out_dec(out, symbols->command);
+            FIELD("index", i);
+        } else {
+            out_puts(out, i > 0 ? ",{\"index\":" : "{\"index\":");
+            out_dec(out, i);
+        }
+        out_puts(out, ",\"name\":");
+        size_t length;
+        const char* name = macho_symbol_name(symbols->macho, symbols->names,
+                                             elem, &length);
+        if (elem->n_un.n_strx < symbols->macho->symtab.strsize) {
+            json_string(out, name, length);
+        } else {
+            out_puts(out, "null");
+        }
+        FIELD("strx", elem->n_un.n_strx);
+        FIELD("type", elem->n_type);
+        FIELD("sect", elem->n_sect);
+        FIELD("desc", elem->n_desc);
+        FIELD("value", elem->n_value);
+        out_puts(out, symbols->ndjson ? "}\n" : "}");
+    }
+}
+
+struct json_functions {
+    const struct function_starts* starts;
+    const struct symindex* index;
+    uint32_t command;
+    bool ndjson;
+};
+
+static void json_function_range(struct out* out, void* context, size_t begin,
+                                size_t end) {
+    const struct json_functions* functions = context;
+    const struct function_starts* starts = functions->starts;
+    for (size_t i = begin; i < end; i++) {
+        if (functions->ndjson) {
+            out_puts(out, "{\"record\":\"function\",\"load_command\":");
+            out_dec(out, functions->command);
+            FIELD("index", i);
+        } else {
+            out_puts(out, i > 0 ? ",{\"index\":" : "{\"index\":");
+            out_dec(out, i);
+        }
+        FIELD("address", starts->addresses[i]);
+        FIELD("size", starts->sizes[i]);
+        out_puts(out, ",\"name\":");
+        if (starts->symbols[i] != SYMINDEX_NONE) {
+            const char* name = symindex_name(functions->index,
+                                             starts->symbols[i]);
+            json_string(out, name, strlen(name));
+        } else {
+            out_puts(out, "null");
+        }
+        out_puts(out, functions->ndjson ? "}\n" : "}");
+    }
+}
+
+// Writes the function starts of the command, which is the file's valid
+// LC_FUNCTION_STARTS, and closes its object.
+local void json_function_starts(struct out* out, const struct macho* macho,
+                                uint32_t index, unsigned threads,
+                                bool ndjson) {
+    struct function_starts starts;
+    struct symindex symbols;
+    function_starts_decode(&starts, macho);
+    symindex_build(&symbols, macho);
+    function_starts_join(&starts, &symbols);
+    out_puts(out, starts.truncated ? ",\"truncated\":true"
+                                   : ",\"truncated\":false");
+    out_puts(out, ndjson ? "}\n" : ",\"functions\":[");
+    if (starts.symbols) {
+        struct json_functions functions = { &starts, &symbols, index, ndjson };
+        out_render_chunks(out, threads, starts.count, JSON_CHUNK_SIZE,
+                          json_function_range, &functions);
+    }
+    if (!ndjson) {
+        out_puts(out, "]}");
+    }
+    symindex_free(&symbols);
+    function_starts_free(&starts);
+}
+
+// Writes a member holding a signed value.
+#define FIELD_SIGNED(name, value) do { \
+    out_puts(out, ",\"" name "\":"); \
+    if ((value) < 0) { \
+        out_putc(out, '-'); \
+        out_dec(out, 0 - (uint64_t)(value)); \
+    } else { \
+        out_dec(out, (uint64_t)(value)); \
+    } \
+} while (0)
+
+static const char* json_fixup_records[DYLD_STREAM_COUNT] = {
+    "rebase", "bind", "weak_bind", "lazy_bind"
+};
+
+struct json_fixups {
+    const struct dyld_fixups* fixups;
+    enum dyld_stream stream;
+    uint32_t command;
+    bool ndjson;
+};
+
+static void json_fixup_range(struct out* out, void* context, size_t begin,
+                             size_t end) {
+    const struct json_fixups* fixups = context;
+    for (size_t i = begin; i < end; i++) {
+        const struct dyld_fixup* fixup = &fixups->fixups->entries[i];
+        if (fixups->ndjson) {
+            out_puts(out, "{\"record\":\"");
+            out_puts(out, json_fixup_records[fixups->stream]);
+            out_puts(out, "\",\"load_command\":");
+            out_dec(out, fixups->command);
+            FIELD("index", i);
+        } else {
+            out_puts(out, i > 0 ? ",{\"index\":" : "{\"index\":");
+            out_dec(out, i);
+        }
+        FIELD("address", fixup->address);
+        FIELD("segment", fixup->segment);
+        FIELD("type", fixup->type);
+        if (fixups->stream != DyldStreamRebase) {
+            out_puts(out, ",\"symbol\":");
+            if (fixup->symbol) {
+                json_string(out, fixup->symbol, strlen(fixup->symbol));
+            } else {
+                out_puts(out, "null");
+            }
+            FIELD_SIGNED("ordinal", fixup->ordinal);
+            FIELD_SIGNED("addend", fixup->addend);
+            FIELD("flags", fixup->flags);
+        }
+        out_puts(out, fixups->ndjson ? "}\n" : "}");
+    }
+}
+
+struct json_exports {
+    const struct dyld_exports* exports;
+    uint32_t command;
+    bool ndjson;
+};
+
+static void json_export_range(struct out* out, void* context, size_t begin,
+                              size_t end) {
+    const struct json_exports* exports = context;
+    for (size_t i = begin; i < end; i++) {
+        const struct dyld_export* entry = &exports->exports->entries[i];
+        if (exports->ndjson) {
+            out_puts(out, "{\"record\":\"export\",\"load_command\":");
+            out_dec(out, exports->command);
+            FIELD("index", i);
+        } else {
+            out_puts(out, i > 0 ? ",{\"index\":" : "{\"index\":");
+            out_dec(out, i);
+        }
+        const char* name = dyld_export_name(exports->exports, entry);
+        FIELD_STRING("name", name, strlen(name));
+        FIELD("address", entry->address);
+        FIELD("flags", entry->flags);
+        FIELD("other", entry->other);
+        out_puts(out, ",\"import_name\":");
+        if (entry->import_name) {
+            json_string(out, entry->import_name, strlen(entry->import_name));
+        } else {
+            out_puts(out, "null");
+        }
+        out_puts(out, exports->ndjson ? "}\n" : "}");
+    }
+}
+
+// Writes the exports as the last member of the command's object, or as
+// records after it, and closes it.
+local void json_exports(struct out* out, const struct dyld_exports* exports,
+                        uint32_t index, unsigned threads, bool ndjson) {
+    if (!ndjson) {
+        out_puts(out, ",\"exports\":[");
+    }
+    struct json_exports context = { exports, index, ndjson };
+    out_render_chunks(out, threads, exports->count, JSON_CHUNK_SIZE,
+                      json_export_range, &context);
+    if (!ndjson) {
+        out_puts(out, "]}");
+    }
+}
+
+// Writes the exports of the command, which is a valid LC_DYLD_EXPORTS_TRIE,
+// and closes its object.
+local void json_exports_trie(struct out* out, const struct macho* macho,
+                             const struct macho_command* command,
+                             uint32_t index, unsigned threads, bool ndjson) {
+    const S(linkedit_data_command*) data =
+        (const void*)macho_command_data(macho, command);
+    struct dyld_exports exports;
+    dyld_exports_decode(&exports, macho, data->dataoff, data->datasize);
+    out_puts(out, exports.malformed ? ",\"malformed\":[\"exports\"]"
+                                    : ",\"malformed\":[]");
+    if (ndjson) {
+        out_puts(out, "}\n");
+    }
+    json_exports(out, &exports, index, threads, ndjson);
+    dyld_exports_free(&exports);
+}
+
+struct json_chained {
+    const struct chained_fixups* fixups;
+    uint32_t command;
+    bool ndjson;
+};
+
+static void json_chained_range(struct out* out, void* context, size_t begin,
+                               size_t end) {
+    const struct json_chained* chained = context;
+    for (size_t i = begin; i < end; i++) {
+        const struct chained_fixup* fixup = &chained->fixups->fixups[i];
+        if (chained->ndjson) {
+            out_puts(out, "{\"record\":\"chained_fixup\","
+                          "\"load_command\":");
+            out_dec(out, chained->command);
+            FIELD("index", i);
+        } else {
+            out_puts(out, i > 0 ? ",{\"index\":" : "{\"index\":");
+            out_dec(out, i);
+        }
+        FIELD("address", fixup->address);
+        if (fixup->flags & ChainedFlagBind) {
+            FIELD("import", fixup->import);
+            FIELD_SIGNED("addend", (int64_t)fixup->target);
+        } else {
+            out_puts(out, ",\"import\":null");
+            FIELD("target", fixup->target);
+        }
+        if (fixup->flags & ChainedFlagAuth) {
+            FIELD("key", fixup->key);
+            FIELD("diversity", fixup->diversity);
+            out_puts(out, fixup->flags & ChainedFlagAddressDiversity
+                          ? ",\"address_diversity\":true"
+                          : ",\"address_diversity\":false");
+        }
+        out_puts(out, chained->ndjson ? "}\n" : "}");
+    }
+}
+
+// Writes the header, imports, starts and fixups of the command, which is a
+// valid LC_DYLD_CHAINED_FIXUPS, and closes its object. The imports and starts
+// are small and always members; the fixups are an array member or records
+// after the command's own.
+local void json_chained_fixups(struct out* out, const struct macho* macho,
+                               const struct macho_command* command,
+                               uint32_t index, unsigned threads,
+                               bool ndjson) {
+    struct chained_fixups fixups;
+    chained_fixups_decode(&fixups, macho, command, threads);
+    const S(dyld_chained_fixups_header*) header = &fixups.header;
+    FIELD("fixups_version", header->fixups_version);
+    FIELD("imports_format", header->imports_format);
+    FIELD("symbols_format", header->symbols_format);
+    out_puts(out, fixups.malformed ? ",\"malformed\":true"
+                                   : ",\"malformed\":false");
+    out_puts(out, ",\"imports\":[");
+    for (uint32_t i = 0; i < fixups.nimports; i++) {
+        const struct chained_import* import = &fixups.imports[i];
+        out_puts(out, i > 0 ? ",{\"name\":" : "{\"name\":");
+        if (import->name) {
+            json_string(out, import->name, strlen(import->name));
+        } else {
+            out_puts(out, "null");
+        }
+        FIELD_SIGNED("ordinal", import->ordinal);
+        FIELD_SIGNED("addend", import->addend);
+        out_puts(out, import->weak ? ",\"weak\":true}" : ",\"weak\":false}");
+    }
+    out_puts(out, "],\"starts\":[");
+    for (uint32_t i = 0; i < fixups.nstarts; i++) {
+        const struct chained_starts* starts = &fixups.starts[i];
+        out_puts(out, i > 0 ? ",{\"segment\":" : "{\"segment\":");
+        out_dec(out, starts->segment);
+        FIELD("page_size", starts->page_size);
+        FIELD("pointer_format", starts->pointer_format);
+        FIELD("segment_offset", starts->segment_offset);
+        FIELD("max_valid_pointer", starts->max_valid_pointer);
+        FIELD("page_count", starts->page_count);
+        out_puts(out, starts->malformed ? ",\"malformed\":true}"
+                                        : ",\"malformed\":false}");
+    }
+    out_puts(out, ndjson ? "]}\n" : "],\"fixups\":[");
+    struct json_chained context = { &fixups, index, ndjson };
+    out_render_chunks(out, threads, fixups.count, JSON_CHUNK_SIZE,
+                      json_chained_range, &context);
+    if (!ndjson) {
+        out_puts(out, "]}");
+    }
+    chained_fixups_free(&fixups);
+}
+
+// Writes the fixups and exports of the command, which is a valid
+// LC_DYLD_INFO(_ONLY), and closes its object. Each list is an array member,
+// or a run of records after the command's own, and whether its data was
+// malformed is a member of the command.
+local void json_dyld_info(struct out* out, const struct macho* macho,
+                          const struct macho_command* command,
+                          uint32_t index, unsigned threads, bool ndjson) {
+    static const char* members[DYLD_STREAM_COUNT] = {
+        "rebases", "binds", "weak_binds", "lazy_binds"
+    };
+    const S(dyld_info_command*) info =
+        (const void*)macho_command_data(macho, command);
+    struct dyld_fixups fixups[DYLD_STREAM_COUNT];
+    for (int stream = 0; stream < DYLD_STREAM_COUNT; stream++) {
+        dyld_fixups_decode(&fixups[stream], macho, command, stream);
+    }
+    struct dyld_exports exports;
+    dyld_exports_decode(&exports, macho, info->export_off, info->export_size);
+
+    out_puts(out, ",\"malformed\":[");
+    bool first = true;
+    for (int stream = 0; stream < DYLD_STREAM_COUNT; stream++) {
+        if (fixups[stream].malformed) {
+            out_puts(out, first ? "\"" : ",\"");
+            out_puts(out, members[stream]);
+            out_putc(out, '"');
+            first = false;
+        }
+    }
+    if (exports.malformed) {
+        out_puts(out, first ? "\"exports\"" : ",\"exports\"");
+    }
+    out_putc(out, ']');
+    if (ndjson) {
+        out_puts(out, "}\n");
+    }
+
+    for (int stream = 0; stream < DYLD_STREAM_COUNT; stream++) {
+        if (!ndjson) {
+            out_puts(out, ",\"");
+            out_puts(out, members[stream]);
+            out_puts(out, "\":[");
+        }
+        struct json_fixups context = { &fixups[stream], stream, index, ndjson };
+        out_render_chunks(out, threads, fixups[stream].count, JSON_CHUNK_SIZE,
+                          json_fixup_range, &context);
+        if (!ndjson) {
+            out_putc(out, ']');
+        }
+        dyld_fixups_free(&fixups[stream]);
+    }
+
+    json_exports(out, &exports, index, threads, ndjson);
+    dyld_exports_free(&exports);
+}
+
+// Writes a string stored in a load command at the given offset from its
+// start, bounded by the command.
+local void json_lc_str(struct out* out, const S(load_command*) lc,
+                       uint32_t offset) {
+    if (offset < lc->cmdsize) {
+        json_string(out, (const char*)lc + offset, lc->cmdsize - offset);
+    } else {
+        out_puts(out, "null");
+    }
+}
+
+// Writes the members specific to the command, and closes its object. Only the
+// fields of a command that reaches outside the file are written, not the
+// tables it points at, and nothing of a malformed command.
+local void json_load_command_fields(struct out* out, const struct macho* macho,
+                                    const struct macho_command* command,
+                                    uint32_t index, unsigned threads,
+                                    bool ndjson) {
+    const S(load_command*) lc = macho_command_data(macho, command);
+    const char* close = ndjson ? "}\n" : "}";
+    if (command->verdict != MachoVerdictValid) {
+        out_puts(out, ",\"error\":");
+        json_string_or_null(out, macho_verdictstr(command->verdict));
+    }
+    if (command->verdict == MachoVerdictMalformed) {
+        out_puts(out, close);
+        return;
+    }
+    if (command->segment != MACHO_NONE) {
+        const struct macho_segment* segment =
+            &macho->segments[command->segment];
+        const S(segment_command_64*) seg64 = &segment->command;
+        FIELD_STRING("segname", seg64->segname, sizeof(seg64->segname));
+        FIELD("vmaddr", seg64->vmaddr);
+        FIELD("vmsize", seg64->vmsize);
+        FIELD("fileoff", seg64->fileoff);
+        FIELD("filesize", seg64->filesize);
+        FIELD("maxprot", (uint32_t)seg64->maxprot);
+        FIELD("initprot", (uint32_t)seg64->initprot);
+        FIELD("nsects", seg64->nsects);
+        FIELD("flags", seg64->flags);
+        out_puts(out, ndjson ? "}\n" : ",\"sections\":[");
+        struct macho_iter it = macho_segment_sections(macho, segment);
+        uint32_t i = 0;
+        for (const S(section_64*) sec64; (sec64 = macho_next_section(&it));) {
+            json_section_64(out, index, i++, sec64, ndjson);
+        }
+        if (!ndjson) {
+            out_puts(out, "]}");
+        }
+        return;
+    } else if (lc->cmd == LC_SYMTAB) {
+        S(symtab_command) copy;
+        memcpy(&copy, lc, sizeof(copy));
+        const S(symtab_command*) symt = &copy;
+        FIELD("symoff", symt->symoff);
+        FIELD("nsyms", symt->nsyms);
+        FIELD("stroff", symt->stroff);
+        FIELD("strsize", symt->strsize);
+        out_puts(out, ndjson ? "}\n" : ",\"symbols\":[");
+        const uint32_t nsyms = command->verdict == MachoVerdictValid
+                               ? symt->nsyms : 0;
+        struct json_symbols symbols = {
+            macho, index, ndjson,
+            nsyms > 0 && macho_symbol_names(macho)
+        };
+        out_render_chunks(out, threads, nsyms,
+                          JSON_CHUNK_SIZE, json_symbol_range, &symbols);
+        stats_add(StatsSymbols, nsyms);
+        if (!ndjson) {
+            out_puts(out, "]}");
+        }
+        return;
+    } else if (lc->cmd == LC_DYSYMTAB) {
+        S(dysymtab_command) copy;
+        memcpy(&copy, lc, sizeof(copy));
+        const S(dysymtab_command*) dsymt = &copy;
+        FIELD("ilocalsym", dsymt->ilocalsym);
+        FIELD("nlocalsym", dsymt->nlocalsym);
+        FIELD("iextdefsym", dsymt->iextdefsym);
+        FIELD("nextdefsym", dsymt->nextdefsym);
+        FIELD("iundefsym", dsymt->iundefsym);
+        FIELD("nundefsym", dsymt->nundefsym);
+        FIELD("tocoff", dsymt->tocoff);
+        FIELD("ntoc", dsymt->ntoc);
+        FIELD("modtaboff", dsymt->modtaboff);
+        FIELD("nmodtab", dsymt->nmodtab);
+        FIELD("extrefsymoff", dsymt->extrefsymoff);
+        FIELD("nextrefsyms", dsymt->nextrefsyms);
+        FIELD("indirectsymoff", dsymt->indirectsymoff);
+        FIELD("nindirectsyms", dsymt->nindirectsyms);
+        FIELD("extreloff", dsymt->extreloff);
+        FIELD("nextrel", dsymt->nextrel);
+        FIELD("locreloff", dsymt->locreloff);
+        FIELD("nlocrel", dsymt->nlocrel);
+    } else if (lc->cmd == LC_BUILD_VERSION) {
+        const S(build_version_command*) bver = (const void*)lc;
+        FIELD("platform", bver->platform);
+        FIELD("minos", bver->minos);
+        FIELD("sdk", bver->sdk);
+        FIELD("ntools", bver->ntools);
+    } else if (index == macho->uuid_command) {
+        static const char hex[] = "0123456789abcdef";
+        char text[37];
+        size_t j = 0;
+        for (size_t i = 0; i < sizeof(macho->uuid); i++) {
+            if (i == 4 || i == 6 || i == 8 || i == 10) {
+                text[j++] = '-';
+            }
+            text[j++] = hex[macho->uuid[i] >> 4];
+            text[j++] = hex[macho->uuid[i] & 0xf];
+        }
+        FIELD_STRING("uuid", text, j);
+    } else if ((lc->cmd == LC_LOAD_DYLIB || lc->cmd == LC_ID_DYLIB
+                || lc->cmd == LC_LOAD_WEAK_DYLIB
+                || lc->cmd == LC_REEXPORT_DYLIB
+                || lc->cmd == LC_LAZY_LOAD_DYLIB
+                || lc->cmd == LC_LOAD_UPWARD_DYLIB)) {
+        const S(dylib_command*) dylib = (const void*)lc;
+        out_puts(out, ",\"dylib\":");
+        json_lc_str(out, lc, dylib->dylib.name.offset);
+        FIELD("timestamp", dylib->dylib.timestamp);
+        FIELD("current_version", dylib->dylib.current_version);
+        FIELD("compatibility_version", dylib->dylib.compatibility_version);
+    } else if (lc->cmd == LC_LOAD_DYLINKER || lc->cmd == LC_ID_DYLINKER) {
+        const S(dylinker_command*) dylinker = (const void*)lc;
+        out_puts(out, ",\"dylinker\":");
+        json_lc_str(out, lc, dylinker->name.offset);
+    } else if (lc->cmd == LC_RPATH) {
+        out_puts(out, ",\"path\":");
+        json_lc_str(out, lc, ((const S(rpath_command*))lc)->path.offset);
+    } else if (lc->cmd == LC_SOURCE_VERSION) {
+        FIELD("version", ((const S(source_version_command*))lc)->version);
+    } else if (lc->cmd == LC_VERSION_MIN_MACOSX
+               || lc->cmd == LC_VERSION_MIN_IPHONEOS
+               || lc->cmd == LC_VERSION_MIN_TVOS
+               || lc->cmd == LC_VERSION_MIN_WATCHOS) {
+        const S(version_min_command*) version = (const void*)lc;
+        FIELD("version", version->version);
+        FIELD("sdk", version->sdk);
+    } else if (lc->cmd == LC_DYLD_INFO || lc->cmd == LC_DYLD_INFO_ONLY) {
+        const S(dyld_info_command*) info = (const void*)lc;
+        FIELD("rebase_off", info->rebase_off);
+        FIELD("rebase_size", info->rebase_size);
+        FIELD("bind_off", info->bind_off);
+        FIELD("bind_size", info->bind_size);
+        FIELD("weak_bind_off", info->weak_bind_off);
+        FIELD("weak_bind_size", info->weak_bind_size);
+        FIELD("lazy_bind_off", info->lazy_bind_off);
+        FIELD("lazy_bind_size", info->lazy_bind_size);
+        FIELD("export_off", info->export_off);
+        FIELD("export_size", info->export_size);
+        if (command->verdict == MachoVerdictValid) {
+            json_dyld_info(out, macho, command, index, threads, ndjson);
+            return;
+        }
+    } else if (lc->cmd == LC_MAIN) {
+        const S(entry_point_command*) entry = (const void*)lc;
+        FIELD("entryoff", entry->entryoff);
+        FIELD("stacksize", entry->stacksize);
+    } else if ((lc->cmd == LC_CODE_SIGNATURE
+                || lc->cmd == LC_SEGMENT_SPLIT_INFO
+                || lc->cmd == LC_FUNCTION_STARTS
+                || lc->cmd == LC_DATA_IN_CODE
+                || lc->cmd == LC_DYLIB_CODE_SIGN_DRS
+                || lc->cmd == LC_LINKER_OPTIMIZATION_HINT
+                || lc->cmd == LC_DYLD_EXPORTS_TRIE
+                || lc->cmd == LC_DYLD_CHAINED_FIXUPS)) {
+        const S(linkedit_data_command*) data = (const void*)lc;
+        FIELD("dataoff", data->dataoff);
+        FIELD("datasize", data->datasize);
+        if (index == macho->function_starts_command) {
+            json_function_starts(out, macho, index, threads, ndjson);
+            return;
+        }
+        if (command->verdict == MachoVerdictValid
+            && lc->cmd == LC_DYLD_EXPORTS_TRIE) {
+            json_exports_trie(out, macho, command, index, threads, ndjson);
+            return;
+        }
+        if (command->verdict == MachoVerdictValid
+            && lc->cmd == LC_DYLD_CHAINED_FIXUPS) {
+            json_chained_fixups(out, macho, command, index, threads, ndjson);
+            return;
+        }
+    }
+    out_puts(out, close);
+}
+
+enum dump_error json_macho(struct out* out, void* buffer, size_t length,
+                           unsigned threads, bool ndjson) {
+    struct macho macho;
+    enum dump_error error = macho_parse(&macho, buffer, length);
+    if (error != DumpErrorNone) {
+        if (!ndjson) {
+            out_puts(out, "null");
+        }
+        return error;
+    }
+
+    const uint64_t start = stats_begin();
+    if (!ndjson) {
+        out_putc(out, '{');
+    }
+    if (dump_wants_header()) {
+        json_header(out, &macho.header, ndjson);
+        if (!ndjson) {
+            out_putc(out, ',');
+        }
+    }
+    if (!ndjson) {
+        out_puts(out, "\"load_commands\":[");
+    }
+
+    // Commands that are filtered out are skipped without looking at anything
+    // they point at.
+    struct macho_iter it = macho_commands(&macho);
+    bool first = true;
+    for (const struct macho_command* command;
+         (command = macho_next_command(&it));) {
+        if (!dump_wants_command(macho_command_data(&macho, command))) {
+            continue;
+        }
+        const uint32_t i = (uint32_t)(command - macho.commands);
+        const uint64_t command_start = stats_begin();
+        if (ndjson) {
+            out_puts(out, "{\"record\":\"load_command\",\"index\":");
+        } else {
+            out_puts(out, first ? "{\"index\":" : ",{\"index\":");
+        }
+        first = false;
+        out_dec(out, i);
+        FIELD("offset", command->offset);
+        FIELD("cmd", command->cmd);
+        out_puts(out, ",\"name\":");
+        const struct macho_command_kind* kind =
+            macho_command_kind(command->cmd);
+        json_string_or_null(out, kind ? kind->name : NULL);
+        FIELD("cmdsize", command->cmdsize);
+        json_load_command_fields(out, &macho, command, i, threads, ndjson);
+        stats_command(command->cmd, command_start);
+    }
+
+    if (!ndjson) {
+        out_puts(out, "]}");
+    }
+    stats_end(StatsPhaseRender, start);
+    error = macho.error;
+    macho_free(&macho);
+    return error;
+}
+
+void json_fat_begin(struct out* out, uint32_t magic, uint32_t nfat_arch,
+                    bool ndjson) {
+    out_puts(out, ndjson ? "{\"record\":\"fat_header\",\"magic\":"
+                         : "{\"fat\":{\"magic\":");
+    out_dec(out, magic);
+    FIELD("nfat_arch", nfat_arch);
+    out_puts(out, ndjson ? "}\n" : ",\"arches\":[");
+}
+
+void json_fat_arch_begin(struct out* out, size_t index,
+                         const struct fat_slice* slice, bool ndjson) {
+    if (ndjson) {
+        out_puts(out, "{\"record\":\"fat_arch\",\"index\":");
+    } else {
+        out_puts(out, index > 0 ? ",{\"index\":" : "{\"index\":");
+    }
+    out_dec(out, index);
+    FIELD("cputype", (uint32_t)slice->cputype);
+    FIELD("cpusubtype", (uint32_t)slice->cpusubtype);
+    out_puts(out, ",\"arch\":");
+    json_string_or_null(out, arch_name(slice->cputype, slice->cpusubtype));
+    FIELD("offset", slice->offset);
+    FIELD("size", slice->size);
+    FIELD("align", slice->align);
+    out_puts(out, ndjson ? "}\n" : ",\"contents\":");
+}
+
+// Ends an object whose contents were begun by one of the _begin functions:
+// a slice, an archive member or a file.
+local void json_contents_end(struct out* out, bool dumped, const char* error,
+                             bool ndjson) {
+    if (ndjson) {
+        if (error) {
+            out_puts(out, "{\"record\":\"error\",\"message\":");
+            json_string(out, error, (size_t)-1);
+            out_puts(out, "}\n");
+        }
+        return;
+    }
+    out_puts(out, dumped ? ",\"error\":" : "null,\"error\":");
+    json_string_or_null(out, error);
+    out_putc(out, '}');
+}
+
+void json_fat_arch_end(struct out* out, bool dumped, const char* error,
+                       bool ndjson) {
+    json_contents_end(out, dumped, error, ndjson);
+}
+
+void json_fat_end(struct out* out, bool ndjson) {
+    if (!ndjson) {
+        out_puts(out, "]}}");
+    }
+}
+
+void json_archive_begin(struct out* out, size_t nmembers, bool ndjson) {
+    out_puts(out, ndjson ? "{\"record\":\"archive\",\"nmembers\":"
+                         : "{\"archive\":{\"nmembers\":");
+    out_dec(out, nmembers);
+    out_puts(out, ndjson ? "}\n" : ",\"members\":[");
+}
+
+void json_archive_member_begin(struct out* out, size_t index,
+                               const struct archive_member* member,
+                               bool ndjson) {
+    if (ndjson) {
+        out_puts(out, "{\"record\":\"archive_member\",\"index\":");
+    } else {
+        out_puts(out, index > 0 ? ",{\"index\":" : "{\"index\":");
+    }
+    out_dec(out, index);
+    FIELD_STRING("name", member->name, member->name_length);
+    FIELD("header", member->header);
+    FIELD("offset", member->offset);
+    FIELD("size", member->size);
+    FIELD("date", member->date);
+    FIELD("uid", member->uid);
+    FIELD("gid", member->gid);
+    FIELD("mode", member->mode);
+    out_puts(out, ndjson ? "}\n" : ",\"contents\":");
+}
+
+void json_archive_member_end(struct out* out, bool dumped, const char* error,
+                             bool ndjson) {
+    json_contents_end(out, dumped, error, ndjson);
+}
+
+void json_archive_end(struct out* out, bool ndjson) {
+    if (!ndjson) {
+        out_puts(out, "]}}");
+    }
+}
+
+void json_archive_symbols(struct out* out,
+                          const struct archive_symbols* symbols,
+                          const struct archive_member* members, size_t count,
+                          bool ndjson) {
+    if (!ndjson) {
+        out_puts(out, symbols->malformed
+                      ? "{\"malformed\":true,\"symbols\":["
+                      : "{\"malformed\":false,\"symbols\":[");
+    }
+    for (size_t i = 0; i < symbols->count; i++) {
+        const struct archive_symbol* symbol = &symbols->entries[i];
+        const size_t member = archive_find_member(members, count,
+                                                  symbol->member);
+        if (ndjson) {
+            out_puts(out, "{\"record\":\"archive_symbol\",\"index\":");
+            out_dec(out, i);
+            out_puts(out, ",\"name\":");
+        } else {
+            out_puts(out, i > 0 ? ",{\"name\":" : "{\"name\":");
+        }
+        json_string(out, symbol->name, symbol->name_length);
+        out_puts(out, ",\"member\":");
+        if (member == ARCHIVE_NONE) {
+            out_puts(out, "null");
+        } else {
+            out_dec(out, member);
+        }
+        FIELD("member_header", symbol->member);
+        out_puts(out, ndjson ? "}\n" : "}");
+    }
+    if (!ndjson) {
+        out_puts(out, "]}");
+    }
+}
+
+void json_file_begin(struct out* out, const char* path, bool ndjson) {
+    out_puts(out, ndjson ? "{\"record\":\"file\",\"path\":" : "{\"path\":");
+    json_string(out, path, (size_t)-1);
+    out_puts(out, ndjson ? "}\n" : ",\"contents\":");
+}
+
+void json_file_end(struct out* out, bool dumped, const char* error,
+                   bool ndjson) {
+    json_contents_end(out, dumped, error, ndjson);
+    if (!ndjson) {
+        out_putc(out, '\n');
+    }
+}
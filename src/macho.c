@@ -0,0 +1,499 @@
+// src/macho.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "macho.h"
+#include "safe.h"
+#include "stats.h"
+#include <mach-o/reloc.h>
+#include <stddef.h>
+#include <string.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+const void* macho_data(const struct macho* macho, uint64_t offset,
+                       uint64_t length) {
+    if (offset > macho->length || length > macho->length - offset) {
+        return NULL;
+    }
+    return macho->data + offset;
+}
+
+bool macho_symbol_names(const struct macho* macho) {
+    const S(symtab_command*) symt = &macho->symtab;
+    if (macho->symtab_command == MACHO_NONE || symt->strsize == 0
+        || macho->data[symt->stroff + symt->strsize - 1] != 0) {
+        return false;
+    }
+    uint32_t outside = 0;
+    for (uint32_t i = 0; i < symt->nsyms; i++) {
+        outside += macho_symbol(macho, i).n_un.n_strx >= symt->strsize;
+    }
+    return outside == 0;
+}
+
+const char* macho_symbol_name(const struct macho* macho, bool names,
+                              const S(nlist_64*) symbol, size_t* length) {
+    const char* strings = macho_strings(macho);
+    const uint32_t strx = symbol->n_un.n_strx;
+    if (names) {
+        *length = strlen(strings + strx);
+        return strings + strx;
+    }
+    if (!strings || strx >= macho->symtab.strsize) {
+        *length = 0;
+        return "";
+    }
+    const char* name = strings + strx;
+    const char* nul = memchr(name, '\0', macho->symtab.strsize - strx);
+    *length = nul ? (size_t)(nul - name) : macho->symtab.strsize - strx;
+    return name;
+}
+
+#define KIND(lc, type) \
+    [MACHO_KIND_DYLD(lc)][MACHO_KIND_INDEX(lc)] = { \
+        #lc, #type, sizeof(S(type)), 0 \
+    }
+#define KIND_STRING(lc, type, string) \
+    [MACHO_KIND_DYLD(lc)][MACHO_KIND_INDEX(lc)] = { \
+        #lc, #type, sizeof(S(type)), offsetof(S(type), string) \
+    }
+
+static const struct macho_command_kind macho_command_kinds[2][0x80] = {
+    KIND(LC_SEGMENT, segment_command),
+    KIND(LC_SYMTAB, symtab_command),
+    KIND(LC_SYMSEG, symseg_command),
+    KIND(LC_THREAD, thread_command),
+    KIND(LC_UNIXTHREAD, thread_command),
+    KIND_STRING(LC_LOADFVMLIB, fvmlib_command, fvmlib.name),
+    KIND_STRING(LC_IDFVMLIB, fvmlib_command, fvmlib.name),
+    KIND(LC_IDENT, ident_command),
+    KIND_STRING(LC_FVMFILE, fvmfile_command, name),
+    KIND(LC_PREPAGE, load_command),
+    KIND(LC_DYSYMTAB, dysymtab_command),
+    KIND_STRING(LC_LOAD_DYLIB, dylib_command, dylib.name),
+    KIND_STRING(LC_ID_DYLIB, dylib_command, dylib.name),
+    KIND_STRING(LC_LOAD_DYLINKER, dylinker_command, name),
+    KIND_STRING(LC_ID_DYLINKER, dylinker_command, name),
+    KIND_STRING(LC_PREBOUND_DYLIB, prebound_dylib_command, name),
+    KIND(LC_ROUTINES, routines_command),
+    KIND_STRING(LC_SUB_FRAMEWORK, sub_framework_command, umbrella),
+    KIND_STRING(LC_SUB_UMBRELLA, sub_umbrella_command, sub_umbrella),
+    KIND_STRING(LC_SUB_CLIENT, sub_client_command, client),
+    KIND_STRING(LC_SUB_LIBRARY, sub_library_command, sub_library),
+    KIND(LC_TWOLEVEL_HINTS, twolevel_hints_command),
+    KIND(LC_PREBIND_CKSUM, prebind_cksum_command),
+    KIND_STRING(LC_LOAD_WEAK_DYLIB, dylib_command, dylib.name),
+    KIND(LC_SEGMENT_64, segment_command_64),
+    KIND(LC_ROUTINES_64, routines_command_64),
+    KIND(LC_UUID, uuid_command),
+    KIND_STRING(LC_RPATH, rpath_command, path),
+    KIND(LC_CODE_SIGNATURE, linkedit_data_command),
+    KIND(LC_SEGMENT_SPLIT_INFO, linkedit_data_command),
+    KIND_STRING(LC_REEXPORT_DYLIB, dylib_command, dylib.name),
+    KIND_STRING(LC_LAZY_LOAD_DYLIB, dylib_command, dylib.name),
+    KIND(LC_ENCRYPTION_INFO, encryption_info_command),
+    KIND(LC_DYLD_INFO, dyld_info_command),
+    KIND(LC_DYLD_INFO_ONLY, dyld_info_command),
+    KIND_STRING(LC_LOAD_UPWARD_DYLIB, dylib_command, dylib.name),
+    KIND(LC_VERSION_MIN_MACOSX, version_min_command),
+    KIND(LC_VERSION_MIN_IPHONEOS, version_min_command),
+    KIND(LC_FUNCTION_STARTS, linkedit_data_command),
+    KIND_STRING(LC_DYLD_ENVIRONMENT, dylinker_command, name),
+    KIND(LC_MAIN, entry_point_command),
+    KIND(LC_DATA_IN_CODE, linkedit_data_command),
+    KIND(LC_SOURCE_VERSION, source_version_command),
+    KIND(LC_DYLIB_CODE_SIGN_DRS, linkedit_data_command),
+    KIND(LC_ENCRYPTION_INFO_64, encryption_info_command_64),
+    KIND(LC_LINKER_OPTION, linker_option_command),
+    KIND(LC_LINKER_OPTIMIZATION_HINT, linkedit_data_command),
+    KIND(LC_VERSION_MIN_TVOS, version_min_command),
+    KIND(LC_VERSION_MIN_WATCHOS, version_min_command),
+    KIND(LC_NOTE, note_command),
+    KIND(LC_BUILD_VERSION, build_version_command),
+    KIND(LC_DYLD_EXPORTS_TRIE, linkedit_data_command),
+    KIND(LC_DYLD_CHAINED_FIXUPS, linkedit_data_command),
+    KIND_STRING(LC_FILESET_ENTRY, fileset_entry_command, entry_id)
+};
+
+const struct macho_command_kind* macho_command_kind(uint32_t cmd) {
+    if (!MACHO_KIND_VALID(cmd)) {
+        return NULL;
+    }
+    const struct macho_command_kind* kind =
+        &macho_command_kinds[MACHO_KIND_DYLD(cmd)][MACHO_KIND_INDEX(cmd)];
+    return kind->name ? kind : NULL;
+}
+
+static const char* macho_verdictstrs[MACHO_VERDICT_COUNT] = {
+    "Valid",
+    "Malformed load command",
+    "Refers to data past the end of the file"
+};
+
+const char* macho_verdictstr(const enum macho_verdict verdict) {
+    return macho_verdictstrs[verdict];
+}
+
+// How many entries the tables have room for.
+struct macho_capacity {
+    uint32_t commands;
+    uint32_t segments;
+    uint32_t sections;
+    uint32_t section_verdicts;
+};
+
+// Grows the table to hold at least needed entries of the given size.
+local bool macho_reserve(void* table, uint32_t* capacity, uint64_t needed,
+                         size_t size) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    uint64_t grown = *capacity ? *capacity : 16;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    if (grown > UINT32_MAX) {
+        return false;
+    }
+    void* resized = xrealloc(*(void**)table, (size_t)grown * size);
+    if (!resized) {
+        return false;
+    }
+    *(void**)table = resized;
+    *capacity = (uint32_t)grown;
+    return true;
+}
+
+// The verdict on a table of count entries of the given size at offset.
+local enum macho_verdict macho_check(const struct macho* macho,
+                                     uint64_t offset, uint64_t count,
+                                     uint64_t size) {
+    return macho_data(macho, offset, count * size) ? MachoVerdictValid
+                                                   : MachoVerdictOutside;
+}
+
+// The verdict on the command's size and embedded string, as far as its kind
+// in the registry describes them. Unknown commands are taken as they are.
+local enum macho_verdict macho_check_kind(const S(load_command*) lc) {
+    const struct macho_command_kind* kind = macho_command_kind(lc->cmd);
+    if (!kind) {
+        return MachoVerdictValid;
+    }
+    if (lc->cmdsize < kind->size) {
+        return MachoVerdictMalformed;
+    }
+    if (kind->string) {
+        uint32_t offset;
+        memcpy(&offset, (const char*)lc + kind->string, sizeof(offset));
+        if (offset < kind->size || offset >= lc->cmdsize) {
+            return MachoVerdictMalformed;
+        }
+    }
+    return MachoVerdictValid;
+}
+
+// Combines two verdicts, keeping the first problem.
+local enum macho_verdict macho_and(enum macho_verdict a, enum macho_verdict b) {
+    return a != MachoVerdictValid ? a : b;
+}
+
+local enum macho_verdict macho_index_segment(struct macho* macho,
+                                             struct macho_capacity* capacity,
+                                             struct macho_command* command,
+                                             const S(load_command*) lc) {
+    S(segment_command_64) seg64;
+    if (lc->cmdsize < sizeof(seg64)) {
+        return MachoVerdictMalformed;
+    }
+    memcpy(&seg64, lc, sizeof(seg64));
+    if (seg64.nsects > (lc->cmdsize - sizeof(seg64))
+                       / sizeof(S(section_64))) {
+        return MachoVerdictMalformed;
+    }
+    if (!macho_reserve(&macho->segments, &capacity->segments,
+                       (uint64_t)macho->nsegments + 1,
+                       sizeof(*macho->segments))
+        || !macho_reserve(&macho->sections, &capacity->sections,
+                          (uint64_t)macho->nsections + seg64.nsects,
+                          sizeof(*macho->sections))
+        || !macho_reserve(&macho->section_verdicts,
+                          &capacity->section_verdicts,
+                          (uint64_t)macho->nsections + seg64.nsects,
+                          sizeof(*macho->section_verdicts))) {
+        return MachoVerdictMalformed;
+    }
+    command->segment = macho->nsegments;
+    struct macho_segment* segment = &macho->segments[macho->nsegments++];
+    segment->command = seg64;
+    segment->first_section = macho->nsections;
+    if (seg64.nsects > 0) {
+        memcpy(&macho->sections[macho->nsections],
+               (const char*)lc + sizeof(seg64),
+               seg64.nsects * sizeof(S(section_64)));
+    }
+
+    // Zero filled sections have no bytes in the file to be outside of, so
+    // their verdicts are kept but do not count against the segment.
+    enum macho_verdict verdict = macho_check(macho, seg64.fileoff,
+                                             seg64.filesize, 1);
+    for (uint32_t i = 0; i < seg64.nsects; i++) {
+        const S(section_64*) section = &macho->sections[macho->nsections];
+        const enum macho_verdict contents =
+            macho_check(macho, section->offset, section->size, 1);
+        const enum macho_verdict relocations =
+            macho_check(macho, section->reloff, section->nreloc,
+                        sizeof(S(relocation_info)));
+        macho->section_verdicts[macho->nsections++] =
+            macho_and(contents, relocations);
+        if (macho_section_has_contents(section)) {
+            verdict = macho_and(verdict, contents);
+        }
+        verdict = macho_and(verdict, relocations);
+    }
+    return verdict;
+}
+
+local enum macho_verdict macho_index_symtab(struct macho* macho,
+                                            const S(load_command*) lc) {
+    S(symtab_command) symt;
+    if (lc->cmdsize < sizeof(symt)) {
+        return MachoVerdictMalformed;
+    }
+    memcpy(&symt, lc, sizeof(symt));
+    if (symt.symoff % sizeof(uint64_t) != 0) {
+        return MachoVerdictMalformed;
+    }
+    const enum macho_verdict verdict = macho_and(
+        macho_check(macho, symt.symoff, symt.nsyms, sizeof(S(nlist_64))),
+        macho_check(macho, symt.stroff, symt.strsize, 1));
+    if (verdict != MachoVerdictValid) {
+        return verdict;
+    }
+    // Names outside the string table are not an error; they are rendered as
+    // empty, and only the renderers that need the names look for them.
+    macho->symtab_command = macho->ncommands;
+    macho->symtab = symt;
+    return MachoVerdictValid;
+}
+
+local enum macho_verdict macho_index_dysymtab(struct macho* macho,
+                                              const S(load_command*) lc) {
+    S(dysymtab_command) dsymt;
+    if (lc->cmdsize < sizeof(dsymt)) {
+        return MachoVerdictMalformed;
+    }
+    memcpy(&dsymt, lc, sizeof(dsymt));
+    enum macho_verdict verdict = MachoVerdictValid;
+    verdict = macho_and(verdict, macho_check(macho, dsymt.tocoff, dsymt.ntoc,
+                                             sizeof(S(dylib_table_of_contents))));
+    verdict = macho_and(verdict, macho_check(macho, dsymt.modtaboff,
+                                             dsymt.nmodtab,
+                                             sizeof(S(dylib_module_64))));
+    verdict = macho_and(verdict, macho_check(macho, dsymt.extrefsymoff,
+                                             dsymt.nextrefsyms,
+                                             sizeof(S(dylib_reference))));
+    verdict = macho_and(verdict, macho_check(macho, dsymt.indirectsymoff,
+                                             dsymt.nindirectsyms,
+                                             sizeof(uint32_t)));
+    verdict = macho_and(verdict, macho_check(macho, dsymt.extreloff,
+                                             dsymt.nextrel,
+                                             sizeof(S(relocation_info))));
+    verdict = macho_and(verdict, macho_check(macho, dsymt.locreloff,
+                                             dsymt.nlocrel,
+                                             sizeof(S(relocation_info))));
+    if (verdict == MachoVerdictValid) {
+        macho->dysymtab_command = macho->ncommands;
+        macho->dysymtab = dsymt;
+    }
+    return verdict;
+}
+
+// Checks and records the command at offset, whose cmd and cmdsize are known
+// to be sane. Returns false only if the tables cannot grow.
+local bool macho_index_command(struct macho* macho,
+                               struct macho_capacity* capacity,
+                               uint64_t offset) {
+    if (!macho_reserve(&macho->commands, &capacity->commands,
+                       (uint64_t)macho->ncommands + 1,
+                       sizeof(*macho->commands))) {
+        return false;
+    }
+    const S(load_command*) lc = (const void*)(macho->load_commands + offset);
+    struct macho_command* command = &macho->commands[macho->ncommands];
+    command->offset = offset;
+    command->cmd = lc->cmd;
+    command->cmdsize = lc->cmdsize;
+    command->segment = MACHO_NONE;
+
+    // 64-bit load commands are 8 byte aligned, which the decoders rely on;
+    // a command that is not is left undecoded. So is one too small for its
+    // kind, which the cases below can then take for granted.
+    enum macho_verdict verdict = lc->cmdsize % 8 == 0
+                                 ? macho_check_kind(lc)
+                                 : MachoVerdictMalformed;
+    switch (verdict == MachoVerdictValid ? lc->cmd : 0) {
+        case LC_SEGMENT_64:
+            verdict = macho_index_segment(macho, capacity, command, lc);
+            break;
+        case LC_SYMTAB:
+            verdict = macho_index_symtab(macho, lc);
+            break;
+        case LC_DYSYMTAB:
+            verdict = macho_index_dysymtab(macho, lc);
+            break;
+        case LC_UUID:
+            macho->uuid_command = macho->ncommands;
+            memcpy(macho->uuid, ((const S(uuid_command*))lc)->uuid,
+                   sizeof(macho->uuid));
+            break;
+        case LC_BUILD_VERSION: {
+            const S(build_version_command*) bver = (const void*)lc;
+            if (bver->ntools > (lc->cmdsize - sizeof(*bver))
+                               / sizeof(S(build_tool_version))) {
+                verdict = MachoVerdictMalformed;
+            }
+            break;
+        }
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY: {
+            const S(dyld_info_command*) info = (const void*)lc;
+            verdict = macho_and(verdict, macho_check(macho, info->rebase_off,
+                                                     info->rebase_size, 1));
+            verdict = macho_and(verdict, macho_check(macho, info->bind_off,
+                                                     info->bind_size, 1));
+            verdict = macho_and(verdict, macho_check(macho,
+                                                     info->weak_bind_off,
+                                                     info->weak_bind_size, 1));
+            verdict = macho_and(verdict, macho_check(macho,
+                                                     info->lazy_bind_off,
+                                                     info->lazy_bind_size, 1));
+            verdict = macho_and(verdict, macho_check(macho, info->export_off,
+                                                     info->export_size, 1));
+            break;
+        }
+        case LC_CODE_SIGNATURE:
+        case LC_SEGMENT_SPLIT_INFO:
+        case LC_FUNCTION_STARTS:
+        case LC_DATA_IN_CODE:
+        case LC_DYLIB_CODE_SIGN_DRS:
+        case LC_LINKER_OPTIMIZATION_HINT:
+        case LC_DYLD_EXPORTS_TRIE:
+        case LC_DYLD_CHAINED_FIXUPS: {
+            const S(linkedit_data_command*) data = (const void*)lc;
+            verdict = macho_check(macho, data->dataoff, data->datasize, 1);
+            if (verdict == MachoVerdictValid && lc->cmd == LC_FUNCTION_STARTS) {
+                macho->function_starts_command = macho->ncommands;
+            }
+            break;
+        }
+        case LC_ENCRYPTION_INFO_64: {
+            const S(encryption_info_command_64*) crypt = (const void*)lc;
+            verdict = macho_check(macho, crypt->cryptoff, crypt->cryptsize, 1);
+            break;
+        }
+    }
+    command->verdict = verdict;
+    if (verdict != MachoVerdictValid && macho->error == DumpErrorNone) {
+        macho->error = verdict == MachoVerdictOutside ? DumpErrorTruncated
+                                                      : DumpErrorMalformed;
+    }
+    macho->ncommands++;
+    return true;
+}
+
+local enum dump_error macho_index(struct macho* macho, const void* buffer,
+                                  size_t length) {
+    memset(macho, 0, sizeof(*macho));
+    if (length < sizeof(macho->header)) {
+        return DumpErrorTruncated;
+    }
+    memcpy(&macho->header, buffer, sizeof(macho->header));
+    if (macho->header.magic != MH_MAGIC_64) {
+        return DumpErrorNotMachO64;
+    }
+    macho->data = buffer;
+    macho->length = length;
+
+    // Commands hold 64-bit fields at offsets that are multiples of 8, so in a
+    // file that is not 8 byte aligned they are read from a copy instead.
+    const uint64_t end = sizeof(macho->header)
+                         + (uint64_t)macho->header.sizeofcmds;
+    macho->load_commands = macho->data;
+    if ((uintptr_t)buffer % sizeof(uint64_t) != 0) {
+        const size_t size = end < length ? (size_t)end : length;
+        char* copy = xmalloc(size);
+        if (copy == NULL) {
+            return DumpErrorNoMemory;
+        }
+        memcpy(copy, buffer, size);
+        macho->load_commands = copy;
+    }
+    macho->symtab_command = MACHO_NONE;
+    macho->dysymtab_command = MACHO_NONE;
+    macho->function_starts_command = MACHO_NONE;
+    macho->uuid_command = MACHO_NONE;
+
+    // The tables grow as commands are found rather than being sized from the
+    // header, whose counts are not to be trusted yet. The commands must lie
+    // within sizeofcmds as well as the file, since that is all the kernel and
+    // dyld map of them, and all that mach_fetch reads.
+    struct macho_capacity capacity = { 0, 0, 0, 0 };
+    uint64_t offset = sizeof(macho->header);
+    for (uint32_t i = 0; i < macho->header.ncmds; i++) {
+        const S(load_command*) lc = NULL;
+        enum dump_error error = DumpErrorNone;
+        if (end - offset < sizeof(*lc)) {
+            error = DumpErrorMalformed;
+        } else if (!macho_data(macho, offset, sizeof(*lc))) {
+            error = DumpErrorTruncated;
+        } else {
+            lc = (const void*)(macho->load_commands + offset);
+            if (lc->cmdsize < sizeof(*lc)
+                || !macho_data(macho, offset, lc->cmdsize)) {
+                error = DumpErrorTruncated;
+            } else if (lc->cmdsize > end - offset) {
+                error = DumpErrorMalformed;
+            } else if (!macho_index_command(macho, &capacity, offset)) {
+                error = DumpErrorNoMemory;
+            }
+        }
+        if (error != DumpErrorNone) {
+            if (macho->error == DumpErrorNone) {
+                macho->error = error;
+            }
+            break;
+        }
+        if (lc->cmdsize % 8 != 0) {
+            break;
+        }
+        offset += lc->cmdsize;
+    }
+    return DumpErrorNone;
+}
+
+enum dump_error macho_parse(struct macho* macho, const void* buffer,
+                            size_t length) {
+    const uint64_t start = stats_begin();
+    const enum dump_error error = macho_index(macho, buffer, length);
+    stats_end(StatsPhaseParse, start);
+    return error;
+}
+
+void macho_free(struct macho* macho) {
+    if (macho->load_commands != macho->data) {
+        xfree((char*)macho->load_commands);
+    }
+    macho->load_commands = macho->data;
+    xfree(macho->commands);
+    xfree(macho->segments);
+    xfree(macho->sections);
+    xfree(macho->section_verdicts);
+    macho->commands = NULL;
+    macho->segments = NULL;
+    macho->sections = NULL;
+    macho->section_verdicts = NULL;
+    macho->ncommands = 0;
+    macho->nsegments = 0;
+    macho->nsections = 0;
+}
@@ -0,0 +1,56 @@
+// src/mapfile.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mapfile.h"
+#include "safe.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int map_file(const char* filename, struct mapped_file* file) {
+    file->buffer = NULL;
+    file->length = 0;
+    file->mapped = false;
+
+    FILE* stream = xfopen(filename, "r");
+    if (!stream) {
+        return 1;
+    }
+
+    // Only regular files can be mapped; everything else (pipes, character
+    // devices, process substitution) goes through the buffered path.
+    struct stat info;
+    if (fstat(fileno(stream), &info) == 0 && S_ISREG(info.st_mode)
+        && info.st_size > 0) {
+        void* buffer = mmap(NULL, (size_t)info.st_size, PROT_READ,
+                            MAP_PRIVATE, fileno(stream), 0);
+        if (buffer != MAP_FAILED) {
+            // The dump walks the header and load commands and then streams
+            // forward through the tables they point at, so ask for aggressive
+            // readahead and let the kernel drop pages behind us.
+            posix_madvise(buffer, (size_t)info.st_size,
+                          POSIX_MADV_SEQUENTIAL);
+            file->buffer = buffer;
+            file->length = (size_t)info.st_size;
+            file->mapped = true;
+            xfclose(stream);
+            return 0;
+        }
+    }
+
+    file->buffer = xfreadall(stream, &file->length);
+    xfclose(stream);
+    return file->buffer == NULL;
+}
+
+void unmap_file(struct mapped_file* file) {
+    if (file->mapped) {
+        munmap(file->buffer, file->length);
+    } else {
+        xfree(file->buffer);
+    }
+    file->buffer = NULL;
+    file->length = 0;
+    file->mapped = false;
+}
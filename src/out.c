@@ -0,0 +1,213 @@
+// src/out.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "out.h"
+#include "pool.h"
+#include "safe.h"
+#include "termcolor.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+void out_init(struct out* out, int fd) {
+    out->stream = NULL;
+    out->fd = fd;
+    out->capacity = fd < 0 ? 4096 : OUT_FLUSH_SIZE;
+    out->data = xmalloc(out->capacity);
+    out->length = 0;
+    out->failed = false;
+}
+
+void out_init_stdio(struct out* out, FILE* stream) {
+    out->stream = stream;
+    out->fd = -1;
+    out->data = NULL;
+    out->length = 0;
+    out->capacity = 0;
+    out->failed = false;
+}
+
+void out_free(struct out* out) {
+    xfree(out->data);
+    out->data = NULL;
+    out->length = 0;
+    out->capacity = 0;
+}
+
+static void out_write_fd(struct out* out, const char* data, size_t length) {
+    const uint64_t start = stats_begin();
+    size_t written = 0;
+    while (written < length && !out->failed) {
+        const ssize_t n = write(out->fd, data + written, length - written);
+        if (n < 0 && errno != EINTR) {
+            out->failed = true;
+        } else if (n > 0) {
+            written += (size_t)n;
+        }
+    }
+    stats_end(StatsPhaseWrite, start);
+    stats_emitted(data, written);
+}
+
+int out_flush(struct out* out) {
+    if (out->stream) {
+        const uint64_t start = stats_begin();
+        if (fflush(out->stream) != 0) {
+            out->failed = true;
+        }
+        stats_end(StatsPhaseWrite, start);
+        return out->failed;
+    }
+    if (out->fd < 0) {
+        return out->failed;
+    }
+    // Once the descriptor has failed (e.g. the reader of a pipe went away)
+    // there is nothing useful to do with further output, so it is dropped.
+    out_write_fd(out, out->data, out->length);
+    out->length = 0;
+    return out->failed;
+}
+
+void out_append(struct out* out, const struct out* other) {
+    if (out->fd >= 0 && other->length >= OUT_FLUSH_SIZE / 2) {
+        out_flush(out);
+        out_write_fd(out, other->data, other->length);
+    } else {
+        out_write(out, other->data, other->length);
+    }
+}
+
+void out_reserve(struct out* out, size_t n) {
+    if (out->fd >= 0 && out->length > 0) {
+        out_flush(out);
+    }
+    if (out->capacity - out->length >= n) {
+        return;
+    }
+    size_t capacity = out->capacity * 2;
+    if (capacity < out->length + n) {
+        capacity = out->length + n;
+    }
+    out->data = xrealloc(out->data, capacity);
+    out->capacity = capacity;
+}
+
+struct out_chunks {
+    struct out* outs;
+    size_t first;
+    size_t count;
+    size_t chunk;
+    void (*render)(struct out* out, void* context, size_t begin, size_t end);
+    void* context;
+};
+
+static void out_chunk_task(void* context, size_t index) {
+    struct out_chunks* chunks = context;
+    const size_t begin = chunks->first + index * chunks->chunk;
+    const size_t end = chunks->count - begin < chunks->chunk
+                       ? chunks->count : begin + chunks->chunk;
+    chunks->render(&chunks->outs[index], chunks->context, begin, end);
+}
+
+void out_render_chunks(struct out* out, unsigned threads, size_t count,
+                       size_t chunk,
+                       void (*render)(struct out* out, void* context,
+                                      size_t begin, size_t end),
+                       void* context) {
+    if (threads <= 1 || count <= chunk) {
+        render(out, context, 0, count);
+        return;
+    }
+    const size_t window = (size_t)threads * 2;
+    struct out_chunks chunks = {
+        xmalloc(sizeof(struct out) * window), 0, count, chunk, render, context
+    };
+    for (; chunks.first < count; chunks.first += window * chunk) {
+        size_t n = (count - chunks.first + chunk - 1) / chunk;
+        if (n > window) {
+            n = window;
+        }
+        for (size_t i = 0; i < n; i++) {
+            out_init(&chunks.outs[i], -1);
+        }
+        pool_for(threads, n, out_chunk_task, &chunks);
+        for (size_t i = 0; i < n; i++) {
+            out_append(out, &chunks.outs[i]);
+            out_free(&chunks.outs[i]);
+        }
+    }
+    xfree(chunks.outs);
+}
+
+void out_printf(struct out* out, const char* fmt, ...) {
+    // If the markup cannot be translated the format string is used as is, so
+    // the values are still printed even if the markup shows through.
+    const char* translated;
+    if (tcol_fmt_cached(fmt, &translated) != TermColorErrorNone) {
+        translated = fmt;
+    }
+
+    // Lines printed straight to a stream are not counted, only bytes.
+    va_list ap;
+    va_start(ap, fmt);
+    const uint64_t start = stats_begin();
+    if (out->stream) {
+        const int n = vfprintf(out->stream, translated, ap);
+        va_end(ap);
+        stats_end(StatsPhaseFormat, start);
+        stats_add(StatsBytesEmitted, n > 0 ? (uint64_t)n : 0);
+        return;
+    }
+    if (out->capacity - out->length < 256) {
+        out_reserve(out, 256);
+    }
+    va_list retry;
+    va_copy(retry, ap);
+    const int n = vsnprintf(out->data + out->length,
+                            out->capacity - out->length, translated, ap);
+    if (n >= 0 && (size_t)n >= out->capacity - out->length) {
+        out_reserve(out, (size_t)n + 1);
+        vsnprintf(out->data + out->length, out->capacity - out->length,
+                  translated, retry);
+    }
+    if (n > 0) {
+        out->length += (size_t)n;
+    }
+    va_end(retry);
+    va_end(ap);
+    stats_end(StatsPhaseFormat, start);
+}
+
+void out_cputs(struct out* out, const char* s) {
+    const char* translated;
+    if (tcol_fmt_cached(s, &translated) != TermColorErrorNone) {
+        translated = s;
+    }
+    out_puts(out, translated);
+}
+
+void out_hex(struct out* out, uint64_t value, int digits) {
+    static const char hex[] = "0123456789abcdef";
+    char text[16];
+    int i = 16;
+    do {
+        text[--i] = hex[value & 0xf];
+        value >>= 4;
+    } while (value);
+    while (16 - i < digits && i > 0) {
+        text[--i] = '0';
+    }
+    out_write(out, text + i, 16 - i);
+}
+
+void out_dec(struct out* out, uint64_t value) {
+    char text[20];
+    int i = 20;
+    do {
+        text[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    out_write(out, text + i, 20 - i);
+}
@@ -0,0 +1,172 @@
+// src/partial.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+// For MAP_ANONYMOUS, which POSIX only added in 2024.
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "partial.h"
+#include "safe.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+int partial_open(const char* filename, struct partial_file* file) {
+    file->fd = -1;
+    file->buffer = NULL;
+    file->length = 0;
+    file->mapped = false;
+    file->bytes_read = 0;
+    file->wanted = NULL;
+    file->nwanted = 0;
+    file->capacity = 0;
+
+    const int fd = open(filename, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        const int errnum = errno;
+        close(fd);
+        errno = errnum;
+        return 1;
+    }
+
+    // Pipes and the like are read whole, as map_file would.
+    if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+        FILE* stream = fdopen(fd, "r");
+        if (stream == NULL) {
+            close(fd);
+            return 1;
+        }
+        file->buffer = xfreadall(stream, &file->length);
+        xfclose(stream);
+        file->bytes_read = file->length;
+        return file->buffer == NULL;
+    }
+
+    void* buffer = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        const int errnum = errno;
+        close(fd);
+        errno = errnum;
+        return 1;
+    }
+    // Only the few ranges that are asked for are read.
+#ifdef POSIX_FADV_RANDOM
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+    file->fd = fd;
+    file->buffer = buffer;
+    file->length = (size_t)info.st_size;
+    file->mapped = true;
+    return 0;
+}
+
+void partial_close(struct partial_file* file) {
+    if (file->mapped) {
+        munmap(file->buffer, file->length);
+    } else {
+        xfree(file->buffer);
+    }
+    if (file->fd >= 0) {
+        close(file->fd);
+    }
+    xfree(file->wanted);
+    file->fd = -1;
+    file->buffer = NULL;
+    file->length = 0;
+    file->mapped = false;
+    file->wanted = NULL;
+    file->nwanted = 0;
+    file->capacity = 0;
+}
+
+void partial_want(struct partial_file* file, uint64_t offset,
+                  uint64_t length) {
+    if (file->fd < 0 || offset >= file->length || length == 0) {
+        return;
+    }
+    if (length > file->length - offset) {
+        length = file->length - offset;
+    }
+    if (file->nwanted == file->capacity) {
+        const size_t capacity = file->capacity ? file->capacity * 2 : 16;
+        struct partial_range* wanted =
+            xrealloc(file->wanted, sizeof(*wanted) * capacity);
+        if (wanted == NULL) {
+            return;
+        }
+        file->wanted = wanted;
+        file->capacity = capacity;
+    }
+    file->wanted[file->nwanted].offset = offset;
+    file->wanted[file->nwanted].length = length;
+    file->nwanted++;
+}
+
+static int partial_range_compare(const void* a, const void* b) {
+    const struct partial_range* x = a;
+    const struct partial_range* y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Reads the whole range, which lies within the file, retrying short reads.
+static int partial_read(struct partial_file* file, uint64_t offset,
+                        uint64_t length) {
+    while (length > 0) {
+        const ssize_t n = pread(file->fd, file->buffer + offset,
+                                (size_t)length, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return 1;
+        }
+        // The file has shrunk since it was opened; the rest stays zero.
+        if (n == 0) {
+            return 0;
+        }
+        file->bytes_read += (uint64_t)n;
+        offset += (uint64_t)n;
+        length -= (uint64_t)n;
+    }
+    return 0;
+}
+
+int partial_fetch(struct partial_file* file) {
+    const size_t count = file->nwanted;
+    file->nwanted = 0;
+    if (count == 0) {
+        return 0;
+    }
+    qsort(file->wanted, count, sizeof(*file->wanted), partial_range_compare);
+    uint64_t begin = file->wanted[0].offset;
+    uint64_t end = begin + file->wanted[0].length;
+    for (size_t i = 1; i < count; i++) {
+        const struct partial_range* range = &file->wanted[i];
+        if (range->offset <= end || range->offset - end <= PARTIAL_GAP) {
+            if (range->offset + range->length > end) {
+                end = range->offset + range->length;
+            }
+            continue;
+        }
+        if (partial_read(file, begin, end - begin) != 0) {
+            return 1;
+        }
+        begin = range->offset;
+        end = range->offset + range->length;
+    }
+    return partial_read(file, begin, end - begin);
+}
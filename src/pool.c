@@ -0,0 +1,139 @@
+// src/pool.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+struct pool {
+    size_t next;
+    size_t count;
+    void (*task)(void* context, size_t index);
+    void* context;
+};
+
+static void* pool_worker(void* arg) {
+    struct pool* pool = arg;
+    while (true) {
+        const size_t index = __atomic_fetch_add(&pool->next, 1,
+                                                __ATOMIC_RELAXED);
+        if (index >= pool->count) {
+            return NULL;
+        }
+        pool->task(pool->context, index);
+    }
+}
+
+void pool_for(unsigned threads, size_t count,
+              void (*task)(void* context, size_t index), void* context) {
+    struct pool pool = { 0, count, task, context };
+    if (threads > count) {
+        threads = (unsigned)count;
+    }
+
+    // Helper threads that fail to start are simply not used; the calling
+    // thread alone still runs every task.
+    pthread_t helpers[threads > 1 ? threads - 1 : 1];
+    unsigned started = 0;
+    for (unsigned i = 1; i < threads; i++) {
+        if (pthread_create(&helpers[started], NULL, pool_worker, &pool) == 0) {
+            started++;
+        }
+    }
+    pool_worker(&pool);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(helpers[i], NULL);
+    }
+}
+
+// done[i % window] is set once task i has finished and cleared once it has
+// been emitted. Workers wait on room for the window to move and the emitter
+// waits on ready for the next task in order.
+struct pool_ordered {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t room;
+    size_t next;
+    size_t emitted;
+    size_t count;
+    size_t window;
+    bool* done;
+    void (*task)(void* context, size_t index);
+    void* context;
+};
+
+static void* pool_ordered_worker(void* arg) {
+    struct pool_ordered* pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->next < pool->count
+               && pool->next >= pool->emitted + pool->window) {
+            pthread_cond_wait(&pool->room, &pool->lock);
+        }
+        if (pool->next >= pool->count) {
+            break;
+        }
+        const size_t index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->task(pool->context, index);
+        pthread_mutex_lock(&pool->lock);
+        pool->done[index % pool->window] = true;
+        if (index == pool->emitted) {
+            pthread_cond_signal(&pool->ready);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void pool_ordered(unsigned threads, size_t count, size_t window,
+                  void (*task)(void* context, size_t index),
+                  void (*emit)(void* context, size_t index), void* context) {
+    if (window == 0) {
+        window = 1;
+    }
+    if (threads > count) {
+        threads = (unsigned)count;
+    }
+    bool done[window];
+    memset(done, 0, sizeof(done));
+    struct pool_ordered pool = {
+        PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+        PTHREAD_COND_INITIALIZER, 0, 0, count, window, done, task, context
+    };
+
+    // Without any workers the calling thread runs every task itself.
+    pthread_t workers[threads > 0 ? threads : 1];
+    unsigned started = 0;
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, pool_ordered_worker,
+                           &pool) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        for (size_t i = 0; i < count; i++) {
+            task(context, i);
+            emit(context, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    for (size_t i = 0; i < count; i++) {
+        while (!done[i % window]) {
+            pthread_cond_wait(&pool.ready, &pool.lock);
+        }
+        done[i % window] = false;
+        pthread_mutex_unlock(&pool.lock);
+        emit(context, i);
+        pthread_mutex_lock(&pool.lock);
+        pool.emitted = i + 1;
+        pthread_cond_broadcast(&pool.room);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
@@ -0,0 +1,265 @@
+// src/query.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "query.h"
+#include "json.h"
+#include "out.h"
+#include "safe.h"
+#include "symindex.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define local static inline
+
+int query_load(struct query_list* queries, const char* arg) {
+    queries->items = NULL;
+    queries->count = 0;
+    queries->storage = NULL;
+    if (strcmp(arg, "-") != 0 && arg[0] != '@') {
+        queries->items = xmalloc(sizeof(*queries->items));
+        if (!queries->items) {
+            return 1;
+        }
+        queries->items[0] = arg;
+        queries->count = 1;
+        return 0;
+    }
+
+    FILE* stream = stdin;
+    if (arg[0] == '@' && !(stream = xfopen(arg + 1, "r"))) {
+        return 1;
+    }
+    size_t length;
+    char* text = xfreadall(stream, &length);
+    const int saved_errno = errno;
+    if (stream != stdin) {
+        xfclose(stream);
+    }
+    if (!text) {
+        errno = saved_errno;
+        return 1;
+    }
+    text = xrealloc(text, length + 1);
+    if (!text) {
+        return 1;
+    }
+    text[length] = '\0';
+
+    // Lines are split in place; blank lines are ignored.
+    size_t capacity = 0;
+    for (size_t i = 0; i < length; i++) {
+        capacity += text[i] == '\n';
+    }
+    queries->items = xmalloc(sizeof(*queries->items) * (capacity + 1));
+    if (!queries->items) {
+        xfree(text);
+        return 1;
+    }
+    queries->storage = text;
+    for (char* line = text; line < text + length;) {
+        char* end = memchr(line, '\n', (size_t)(text + length - line));
+        if (!end) {
+            end = text + length;
+        }
+        *end = '\0';
+        if (end > line && end[-1] == '\r') {
+            end[-1] = '\0';
+        }
+        if (*line) {
+            queries->items[queries->count++] = line;
+        }
+        line = end + 1;
+    }
+    return 0;
+}
+
+void query_free(struct query_list* queries) {
+    xfree(queries->items);
+    xfree(queries->storage);
+    queries->items = NULL;
+    queries->storage = NULL;
+    queries->count = 0;
+}
+
+local void query_symbol_text(struct out* out, const struct symindex* index,
+                             uint32_t symbol) {
+    out_cputs(out, "{Y}0x");
+    out_hex(out, index->value[symbol], 16);
+    out_cputs(out, "{0} symbol ");
+    out_dec(out, symbol);
+    out_cputs(out, ", type {Y}0x");
+    out_hex(out, index->type[symbol], 2);
+    out_cputs(out, "{0}, section ");
+    out_dec(out, index->sect[symbol]);
+    out_cputs(out, ", description {Y}0x");
+    out_hex(out, index->desc[symbol], 4);
+    out_cputs(out, "{0}\n");
+}
+
+local void query_symbol_json(struct out* out, const struct symindex* index,
+                             uint32_t symbol) {
+    out_puts(out, "{\"index\":");
+    out_dec(out, symbol);
+    out_puts(out, ",\"name\":");
+    json_string(out, symindex_name(index, symbol), (size_t)-1);
+    out_puts(out, ",\"type\":");
+    out_dec(out, index->type[symbol]);
+    out_puts(out, ",\"sect\":");
+    out_dec(out, index->sect[symbol]);
+    out_puts(out, ",\"desc\":");
+    out_dec(out, index->desc[symbol]);
+    out_puts(out, ",\"value\":");
+    out_dec(out, index->value[symbol]);
+    out_putc(out, '}');
+}
+
+local void query_find_symbol(struct out* out, const struct symindex* index,
+                             const char* name, enum dump_format format) {
+    uint32_t cursor = 0;
+    uint32_t symbol = symindex_find(index, name, &cursor);
+    if (format == DumpFormatText) {
+        if (symbol == SYMINDEX_NONE) {
+            out_puts(out, name);
+            out_cputs(out, ": {R+}not found{0}\n");
+        }
+        for (; symbol != SYMINDEX_NONE;
+             symbol = symindex_find(index, name, &cursor)) {
+            out_puts(out, name);
+            out_puts(out, ": ");
+            query_symbol_text(out, index, symbol);
+        }
+        return;
+    }
+    out_puts(out, "\"symbols\":[");
+    for (bool first = true; symbol != SYMINDEX_NONE;
+         symbol = symindex_find(index, name, &cursor), first = false) {
+        if (!first) {
+            out_putc(out, ',');
+        }
+        query_symbol_json(out, index, symbol);
+    }
+    out_putc(out, ']');
+}
+
+local void query_addr2sym(struct out* out, const struct symindex* index,
+                          const char* query, enum dump_format format) {
+    char* end;
+    errno = 0;
+    const uint64_t address = strtoull(query, &end, 0);
+    const bool valid = *query && !*end && errno == 0;
+    const uint32_t symbol = valid ? symindex_lookup(index, address)
+                                  : SYMINDEX_NONE;
+    if (format == DumpFormatText) {
+        out_puts(out, query);
+        if (!valid) {
+            out_cputs(out, ": {R+}invalid address{0}\n");
+        } else if (symbol == SYMINDEX_NONE) {
+            out_cputs(out, ": {R+}no symbol{0}\n");
+        } else {
+            out_puts(out, ": ");
+            out_puts(out, symindex_name(index, symbol));
+            out_puts(out, "+0x");
+            out_hex(out, address - index->value[symbol], 1);
+            out_puts(out, " at ");
+            query_symbol_text(out, index, symbol);
+        }
+        return;
+    }
+    out_puts(out, "\"address\":");
+    if (valid) {
+        out_dec(out, address);
+    } else {
+        out_puts(out, "null");
+    }
+    out_puts(out, ",\"symbol\":");
+    if (symbol == SYMINDEX_NONE) {
+        out_puts(out, "null,\"offset\":null");
+    } else {
+        query_symbol_json(out, index, symbol);
+        out_puts(out, ",\"offset\":");
+        out_dec(out, address - index->value[symbol]);
+    }
+}
+
+// Parses the file, or its selected slice, far enough to find its symbol table.
+local enum dump_error query_parse(struct macho* macho, void* buffer,
+                                  size_t length) {
+    enum dump_error error = mach_select(&buffer, &length);
+    if (error == DumpErrorNone) {
+        error = macho_parse(macho, buffer, length);
+    }
+    if (error == DumpErrorNone && macho->symtab_command == MACHO_NONE
+        && macho->error != DumpErrorNone) {
+        error = macho->error;
+        macho_free(macho);
+    }
+    return error;
+}
+
+enum dump_error query_dump(struct out* out, void* buffer, size_t length,
+                           enum query_kind kind,
+                           const struct query_list* queries,
+                           enum dump_format format, const char* index_path) {
+    struct macho macho;
+    enum dump_error error = query_parse(&macho, buffer, length);
+    if (error != DumpErrorNone) {
+        if (format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+        return error;
+    }
+    struct symindex index;
+    if (!(index_path && macho.uuid_command != MACHO_NONE
+          && symindex_open(&index, index_path, macho.uuid, macho.length))) {
+        symindex_build(&index, &macho);
+    }
+
+    if (format == DumpFormatJSON) {
+        out_putc(out, '[');
+    }
+    for (size_t i = 0; i < queries->count; i++) {
+        if (format != DumpFormatText) {
+            out_puts(out, format == DumpFormatNDJSON
+                          ? "{\"record\":\"query\",\"query\":"
+                          : i > 0 ? ",{\"query\":" : "{\"query\":");
+            json_string(out, queries->items[i], (size_t)-1);
+            out_putc(out, ',');
+        }
+        if (kind == QueryFindSymbol) {
+            query_find_symbol(out, &index, queries->items[i], format);
+        } else {
+            query_addr2sym(out, &index, queries->items[i], format);
+        }
+        if (format != DumpFormatText) {
+            out_puts(out, format == DumpFormatNDJSON ? "}\n" : "}");
+        }
+    }
+    if (format == DumpFormatJSON) {
+        out_putc(out, ']');
+    }
+    symindex_free(&index);
+    macho_free(&macho);
+    return DumpErrorNone;
+}
+
+enum dump_error query_write_index(void* buffer, size_t length,
+                                  const char* index_path) {
+    struct macho macho;
+    enum dump_error error = query_parse(&macho, buffer, length);
+    if (error != DumpErrorNone) {
+        return error;
+    }
+    if (macho.uuid_command == MACHO_NONE) {
+        macho_free(&macho);
+        return DumpErrorNoUUID;
+    }
+    struct symindex index;
+    symindex_build(&index, &macho);
+    if (symindex_write(&index, macho.uuid, macho.length, index_path) != 0) {
+        error = DumpErrorIndexWrite;
+    }
+    symindex_free(&index);
+    macho_free(&macho);
+    return error;
+}
@@ -2,6 +2,7 @@
 // Copyright (C) 2021 Ethan Uppal. All rights reserved.
 
 #include "safe.h"
+#include "stats.h"
 
 static void (*fhandler)(enum failure);
 
@@ -9,7 +10,18 @@ void set_failure_handler(void (*handler)(enum failure)) {
     fhandler = handler;
 }
 
+const char* failure_str(enum failure failure) {
+    switch (failure) {
+        case VirtualMemoryExhausted: return "Virtual memory exhausted";
+        case FailedToOpenFile: return "Failed to open file";
+        case FailedToReadFile: return "Failed to read file";
+        case FailedToCloseFile: return "Failed to close file";
+        default: return "Unknown failure";
+    }
+}
+
 void* xmalloc(size_t n) {
+    stats_add(StatsAllocations, 1);
     void* ptr = malloc(n);
     if (ptr) {
         return ptr;
@@ -23,6 +35,21 @@ void* xmalloc(size_t n) {
     }
 }
 
+void* xrealloc(void* ptr, size_t n) {
+    stats_add(StatsAllocations, 1);
+    void* new_ptr = realloc(ptr, n);
+    if (new_ptr) {
+        return new_ptr;
+    }
+    if (!fhandler) {
+        fprintf(stderr, "realloc: Virtual memory exhausted\n");
+        exit(1);
+    } else {
+        fhandler(VirtualMemoryExhausted);
+        return NULL;
+    }
+}
+
 FILE* xfopen(const char* filename, const char* mode) {
     FILE* file = fopen(filename, mode);
     if (file) {
@@ -62,3 +89,36 @@ int xfclose(FILE* file) {
     }
     return status;
 }
+
+void* xfreadall(FILE* stream, size_t* length) {
+    size_t capacity = 64 * 1024;
+    char* buffer = xmalloc(capacity);
+    *length = 0;
+    while (buffer) {
+        if (*length == capacity) {
+            char* grown = xrealloc(buffer, capacity * 2);
+            if (!grown) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        *length += fread(buffer + *length, sizeof(char), capacity - *length,
+                         stream);
+        if (ferror(stream)) {
+            free(buffer);
+            if (!fhandler) {
+                fprintf(stderr, "fread: Failed to read file\n");
+                exit(1);
+            } else {
+                fhandler(FailedToReadFile);
+                return NULL;
+            }
+        }
+        if (feof(stream)) {
+            break;
+        }
+    }
+    return buffer;
+}
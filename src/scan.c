@@ -0,0 +1,359 @@
+// src/scan.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+// For d_type, which saves a stat of almost every entry the walk comes across.
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "scan.h"
+#include "json.h"
+#include "out.h"
+#include "safe.h"
+#include <ar.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+// The names otool gives the file types, indexed by filetype.
+static const char* scan_filetypes[] = {
+    [MH_OBJECT] = "object",
+    [MH_EXECUTE] = "executable",
+    [MH_FVMLIB] = "fixed VM library",
+    [MH_CORE] = "core",
+    [MH_PRELOAD] = "preloaded executable",
+    [MH_DYLIB] = "dynamic library",
+    [MH_DYLINKER] = "dynamic linker",
+    [MH_BUNDLE] = "bundle",
+    [MH_DYLIB_STUB] = "dynamic library stub",
+    [MH_DSYM] = "dSYM companion",
+    [MH_KEXT_BUNDLE] = "kernel extension",
+    [MH_FILESET] = "file set"
+};
+
+static const char* scan_kind_names[SCAN_KIND_COUNT] = {
+    [ScanKindNone] = "none",
+    [ScanKindMachO] = "macho",
+    [ScanKindFat] = "fat",
+    [ScanKindArchive] = "archive"
+};
+
+// An entry of a directory being walked, with its d_type or DT_UNKNOWN.
+struct scan_entry {
+    char* name;
+    unsigned char type;
+};
+
+local void scan_add(struct scan_list* list, const char* path, size_t length) {
+    if (list->count == list->capacity) {
+        const size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char** paths = xrealloc(list->paths, sizeof(*paths) * capacity);
+        if (paths == NULL) {
+            return;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    char* copy = xmalloc(length + 1);
+    if (copy) {
+        memcpy(copy, path, length + 1);
+        list->paths[list->count++] = copy;
+    }
+}
+
+static int scan_entry_compare(const void* a, const void* b) {
+    return strcmp(((const struct scan_entry*)a)->name,
+                  ((const struct scan_entry*)b)->name);
+}
+
+// Reads the whole directory at *path, which is length bytes long, before
+// descending into it, so that only one directory is open at a time however
+// deep the tree goes. *path grows as needed to hold the paths of its entries.
+static void scan_directory(struct scan_list* list, char** path,
+                           size_t* capacity, size_t length,
+                           void (*failed)(const char* path, int errnum)) {
+    DIR* dir = opendir(*path);
+    if (dir == NULL) {
+        failed(*path, errno);
+        return;
+    }
+    struct scan_entry* entries = NULL;
+    size_t count = 0;
+    size_t allocated = 0;
+    for (struct dirent* dirent; (dirent = readdir(dir));) {
+        const char* name = dirent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        if (count == allocated) {
+            allocated = allocated ? allocated * 2 : 16;
+            struct scan_entry* grown = xrealloc(entries,
+                                                sizeof(*entries) * allocated);
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        const size_t n = strlen(name) + 1;
+        entries[count].name = xmalloc(n);
+        if (entries[count].name == NULL) {
+            break;
+        }
+        memcpy(entries[count].name, name, n);
+#ifdef DT_UNKNOWN
+        entries[count].type = dirent->d_type;
+#else
+        entries[count].type = 0;
+#endif
+        count++;
+    }
+    closedir(dir);
+    if (count > 1) {
+        qsort(entries, count, sizeof(*entries), scan_entry_compare);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const size_t n = strlen(entries[i].name);
+        const size_t sublength = length + 1 + n;
+        if (sublength + 1 > *capacity) {
+            char* grown = xrealloc(*path, sublength + 1);
+            if (grown == NULL) {
+                xfree(entries[i].name);
+                continue;
+            }
+            *path = grown;
+            *capacity = sublength + 1;
+        }
+        (*path)[length] = '/';
+        memcpy(*path + length + 1, entries[i].name, n + 1);
+        xfree(entries[i].name);
+
+        bool directory = false;
+        bool regular = false;
+#ifdef DT_UNKNOWN
+        directory = entries[i].type == DT_DIR;
+        regular = entries[i].type == DT_REG;
+        if (entries[i].type == DT_UNKNOWN)
+#endif
+        {
+            struct stat info;
+            if (lstat(*path, &info) == 0) {
+                directory = S_ISDIR(info.st_mode);
+                regular = S_ISREG(info.st_mode);
+            }
+        }
+        if (directory) {
+            scan_directory(list, path, capacity, sublength, failed);
+        } else if (regular) {
+            scan_add(list, *path, sublength);
+        }
+    }
+    xfree(entries);
+}
+
+void scan_tree(struct scan_list* list, const char* root,
+               void (*failed)(const char* path, int errnum)) {
+    // The root itself is followed if it is a link, as it was named.
+    struct stat info;
+    size_t length = strlen(root);
+    if (stat(root, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        scan_add(list, root, length);
+        return;
+    }
+    while (length > 1 && root[length - 1] == '/') {
+        length--;
+    }
+    size_t capacity = length + 256;
+    char* path = xmalloc(capacity);
+    if (path == NULL) {
+        return;
+    }
+    memcpy(path, root, length);
+    path[length] = '\0';
+    scan_directory(list, &path, &capacity, length, failed);
+    xfree(path);
+}
+
+void scan_free(struct scan_list* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        xfree(list->paths[i]);
+    }
+    xfree(list->paths);
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+// Tells the kind of file from its first bytes, of which there are length.
+local enum scan_kind scan_kind_of(const unsigned char* bytes, size_t length,
+                                  uint32_t* nslices) {
+    if (length >= SARMAG && memcmp(bytes, ARMAG, SARMAG) == 0) {
+        return ScanKindArchive;
+    }
+    if (length < sizeof(S(fat_header))) {
+        return ScanKindNone;
+    }
+    uint32_t magic;
+    memcpy(&magic, bytes, sizeof(magic));
+    if (magic == MH_MAGIC_64 && length >= sizeof(S(mach_header_64))) {
+        return ScanKindMachO;
+    }
+    magic = read_be32(bytes);
+    *nslices = read_be32(bytes + 4);
+    if ((magic == FAT_MAGIC || magic == FAT_MAGIC_64) && *nslices > 0
+        && *nslices <= SCAN_MAX_SLICES) {
+        return ScanKindFat;
+    }
+    return ScanKindNone;
+}
+
+int scan_sniff(const char* path, struct scan_sniff* sniff) {
+    memset(sniff, 0, offsetof(struct scan_sniff, slices));
+    const int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        return errno;
+    }
+
+    // Most files under a tree are not Mach-O, and reading ahead of the few
+    // bytes needed would only fill the page cache with them.
+#ifdef POSIX_FADV_RANDOM
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+    unsigned char header[sizeof(S(mach_header_64))];
+    const ssize_t n = pread(fd, header, sizeof(header), 0);
+    if (n < 0) {
+        const int errnum = errno;
+        close(fd);
+        return errnum;
+    }
+    sniff->bytes_read = (uint64_t)n;
+    sniff->kind = scan_kind_of(header, (size_t)n, &sniff->nslices);
+
+    // Only the files that match are worth a stat.
+    struct stat info;
+    if (sniff->kind != ScanKindNone && fstat(fd, &info) == 0) {
+        sniff->size = (uint64_t)info.st_size;
+    }
+
+    if (sniff->kind == ScanKindMachO) {
+        S(mach_header_64) mh;
+        memcpy(&mh, header, sizeof(mh));
+        sniff->filetype = mh.filetype;
+        sniff->nslices = 1;
+        sniff->slices[0].cputype = mh.cputype;
+        sniff->slices[0].cpusubtype = mh.cpusubtype;
+        sniff->slices[0].offset = 0;
+        sniff->slices[0].size = sniff->size;
+        sniff->slices[0].align = 0;
+    } else if (sniff->kind == ScanKindFat) {
+        const bool is64 = read_be32(header) == FAT_MAGIC_64;
+        const size_t entry_size = is64 ? sizeof(S(fat_arch_64))
+                                       : sizeof(S(fat_arch));
+        unsigned char table[SCAN_MAX_SLICES * sizeof(S(fat_arch_64))];
+        const size_t size = sniff->nslices * entry_size;
+        const ssize_t m = pread(fd, table, size, sizeof(S(fat_header)));
+        if (m < 0 || (size_t)m < size) {
+            // Too short to be a universal binary after all.
+            sniff->kind = ScanKindNone;
+            sniff->nslices = 0;
+        } else {
+            sniff->bytes_read += (uint64_t)m;
+            for (uint32_t i = 0; i < sniff->nslices; i++) {
+                fat_slice_read(&sniff->slices[i], table + i * entry_size,
+                               is64);
+            }
+        }
+    } else {
+        sniff->nslices = 0;
+    }
+    close(fd);
+    return 0;
+}
+
+local const char* scan_filetype(uint32_t filetype) {
+    const size_t count = sizeof(scan_filetypes) / sizeof(*scan_filetypes);
+    return filetype < count ? scan_filetypes[filetype] : NULL;
+}
+
+local void scan_summary_text(struct out* out, const char* path,
+                             const struct scan_sniff* sniff) {
+    out_puts(out, path);
+    if (sniff->kind == ScanKindArchive) {
+        out_cputs(out, ": {C}static archive{0}");
+    } else {
+        const char* type = scan_filetype(sniff->filetype);
+        out_cputs(out, sniff->kind == ScanKindFat
+                  ? ": {C}universal binary{0} (" : ": {C}Mach-O{0} ");
+        if (sniff->kind == ScanKindMachO) {
+            out_puts(out, type ? type : "unknown file type");
+            out_puts(out, " (");
+        }
+        for (uint32_t i = 0; i < sniff->nslices; i++) {
+            const struct fat_slice* slice = &sniff->slices[i];
+            const char* name = arch_name(slice->cputype, slice->cpusubtype);
+            if (i > 0) {
+                out_puts(out, ", ");
+            }
+            if (name) {
+                out_puts(out, name);
+            } else {
+                out_puts(out, "0x");
+                out_hex(out, (uint32_t)slice->cputype, 8);
+            }
+        }
+        out_putc(out, ')');
+    }
+    out_puts(out, ", ");
+    out_dec(out, sniff->size);
+    out_puts(out, " byte(s)\n");
+}
+
+local void scan_summary_json(struct out* out, const char* path,
+                             const struct scan_sniff* sniff, bool ndjson) {
+    out_puts(out, ndjson ? "{\"record\":\"summary\",\"path\":"
+                         : "{\"path\":");
+    json_string(out, path, (size_t)-1);
+    out_puts(out, ",\"kind\":\"");
+    out_puts(out, scan_kind_names[sniff->kind]);
+    out_puts(out, "\",\"size\":");
+    out_dec(out, sniff->size);
+    out_puts(out, ",\"filetype\":");
+    if (sniff->kind == ScanKindMachO) {
+        out_dec(out, sniff->filetype);
+    } else {
+        out_puts(out, "null");
+    }
+    out_puts(out, ",\"arches\":[");
+    for (uint32_t i = 0; i < sniff->nslices; i++) {
+        const struct fat_slice* slice = &sniff->slices[i];
+        const char* name = arch_name(slice->cputype, slice->cpusubtype);
+        if (i > 0) {
+            out_putc(out, ',');
+        }
+        if (name) {
+            json_string(out, name, (size_t)-1);
+        } else {
+            out_puts(out, "null");
+        }
+    }
+    out_puts(out, "]}\n");
+}
+
+void scan_summary(struct out* out, const char* path,
+                  const struct scan_sniff* sniff, enum dump_format format) {
+    if (format == DumpFormatText) {
+        scan_summary_text(out, path, sniff);
+    } else {
+        scan_summary_json(out, path, sniff, format == DumpFormatNDJSON);
+    }
+}
@@ -0,0 +1,287 @@
+// src/sha256.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "sha256.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+#define SHA256_ARM 1
+#include <arm_neon.h>
+#endif
+
+#define local static inline
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+local uint32_t sha256_rotr(uint32_t x, unsigned n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+local uint32_t sha256_load_be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8
+           | p[3];
+}
+
+static void sha256_blocks_portable(uint32_t state[8], const uint8_t* data,
+                                   size_t blocks) {
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = sha256_load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            const uint32_t s0 = sha256_rotr(w[i - 15], 7)
+                                ^ sha256_rotr(w[i - 15], 18) ^ w[i - 15] >> 3;
+            const uint32_t s1 = sha256_rotr(w[i - 2], 17)
+                                ^ sha256_rotr(w[i - 2], 19) ^ w[i - 2] >> 10;
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            const uint32_t s1 = sha256_rotr(e, 6) ^ sha256_rotr(e, 11)
+                                ^ sha256_rotr(e, 25);
+            const uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i]
+                                + w[i];
+            const uint32_t s0 = sha256_rotr(a, 2) ^ sha256_rotr(a, 13)
+                                ^ sha256_rotr(a, 22);
+            const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA256_X86
+// The SHA extensions keep the state as ABEF and CDGH and do two rounds per
+// instruction. Each group of four rounds also extends the message schedule
+// by four words, in the register whose words it just consumed.
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t state[8], const uint8_t* data,
+                                size_t blocks) {
+    const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(
+        _mm_loadu_si128((const __m128i*)&state[0]), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(
+        _mm_loadu_si128((const __m128i*)&state[4]), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)(data + 16 * i)), swap);
+        }
+        // Spelled out, since compilers do not reliably unroll the 16 groups
+        // and the message registers must not spill to memory.
+#define SHANI_ROUNDS(i) do { \
+            __m128i wk = _mm_add_epi32( \
+                msg[(i) & 3], \
+                _mm_loadu_si128((const __m128i*)&sha256_k[4 * (i)])); \
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk); \
+            wk = _mm_shuffle_epi32(wk, 0x0e); \
+            state0 = _mm_sha256rnds2_epu32(state0, state1, wk); \
+            if ((i) < 12) { \
+                const __m128i w = _mm_add_epi32( \
+                    _mm_sha256msg1_epu32(msg[(i) & 3], msg[((i) + 1) & 3]), \
+                    _mm_alignr_epi8(msg[((i) + 3) & 3], msg[((i) + 2) & 3], \
+                                    4)); \
+                msg[(i) & 3] = _mm_sha256msg2_epu32(w, msg[((i) + 3) & 3]); \
+            } \
+        } while (0)
+        SHANI_ROUNDS(0);
+        SHANI_ROUNDS(1);
+        SHANI_ROUNDS(2);
+        SHANI_ROUNDS(3);
+        SHANI_ROUNDS(4);
+        SHANI_ROUNDS(5);
+        SHANI_ROUNDS(6);
+        SHANI_ROUNDS(7);
+        SHANI_ROUNDS(8);
+        SHANI_ROUNDS(9);
+        SHANI_ROUNDS(10);
+        SHANI_ROUNDS(11);
+        SHANI_ROUNDS(12);
+        SHANI_ROUNDS(13);
+        SHANI_ROUNDS(14);
+        SHANI_ROUNDS(15);
+#undef SHANI_ROUNDS
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+local int sha256_has_shani(void) {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1)
+        || !(c & bit_SSSE3)) {
+        return 0;
+    }
+    return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29));
+}
+#endif
+
+#ifdef SHA256_ARM
+// The ARMv8 instructions keep the state as ABCD and EFGH and do four rounds
+// per pair of instructions, with the schedule extended as on x86.
+static void sha256_blocks_armv8(uint32_t state[8], const uint8_t* data,
+                                size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+    for (; blocks > 0; blocks--, data += 64) {
+        const uint32x4_t abcd = state0;
+        const uint32x4_t efgh = state1;
+        uint32x4_t msg[4];
+        for (int i = 0; i < 4; i++) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+#define ARMV8_ROUNDS(i) do { \
+            const uint32x4_t wk = vaddq_u32(msg[(i) & 3], \
+                                            vld1q_u32(&sha256_k[4 * (i)])); \
+            const uint32x4_t previous = state0; \
+            state0 = vsha256hq_u32(state0, state1, wk); \
+            state1 = vsha256h2q_u32(state1, previous, wk); \
+            if ((i) < 12) { \
+                msg[(i) & 3] = vsha256su1q_u32( \
+                    vsha256su0q_u32(msg[(i) & 3], msg[((i) + 1) & 3]), \
+                    msg[((i) + 2) & 3], msg[((i) + 3) & 3]); \
+            } \
+        } while (0)
+        ARMV8_ROUNDS(0);
+        ARMV8_ROUNDS(1);
+        ARMV8_ROUNDS(2);
+        ARMV8_ROUNDS(3);
+        ARMV8_ROUNDS(4);
+        ARMV8_ROUNDS(5);
+        ARMV8_ROUNDS(6);
+        ARMV8_ROUNDS(7);
+        ARMV8_ROUNDS(8);
+        ARMV8_ROUNDS(9);
+        ARMV8_ROUNDS(10);
+        ARMV8_ROUNDS(11);
+        ARMV8_ROUNDS(12);
+        ARMV8_ROUNDS(13);
+        ARMV8_ROUNDS(14);
+        ARMV8_ROUNDS(15);
+#undef ARMV8_ROUNDS
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+#endif
+
+struct sha256_kernel {
+    const char* name;
+    void (*blocks)(uint32_t state[8], const uint8_t* data, size_t blocks);
+};
+
+static const struct sha256_kernel sha256_portable = {
+    "portable", sha256_blocks_portable
+};
+
+// Resolved on first use. Every thread that races to resolve it stores the
+// same pointer.
+static const struct sha256_kernel* sha256_selected = NULL;
+
+static const struct sha256_kernel* sha256_select(void) {
+    const struct sha256_kernel* kernel =
+        __atomic_load_n(&sha256_selected, __ATOMIC_ACQUIRE);
+    if (kernel) {
+        return kernel;
+    }
+    kernel = &sha256_portable;
+#if defined(SHA256_X86)
+    static const struct sha256_kernel shani = {
+        "x86 SHA extensions", sha256_blocks_shani
+    };
+    if (sha256_has_shani()) {
+        kernel = &shani;
+    }
+#elif defined(SHA256_ARM)
+    static const struct sha256_kernel armv8 = {
+        "ARMv8 SHA2 instructions", sha256_blocks_armv8
+    };
+    kernel = &armv8;
+#endif
+    __atomic_store_n(&sha256_selected, kernel, __ATOMIC_RELEASE);
+    return kernel;
+}
+
+const char* sha256_kernel(void) {
+    return sha256_select()->name;
+}
+
+void sha256(const void* data, size_t length,
+            uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    const struct sha256_kernel* kernel = sha256_select();
+    const uint8_t* bytes = data;
+    const size_t blocks = length / 64;
+    kernel->blocks(state, bytes, blocks);
+
+    // The tail, the 0x80 marker and the bit length fill one or two blocks.
+    uint8_t tail[128];
+    const size_t rest = length % 64;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, bytes + blocks * 64, rest);
+    tail[rest] = 0x80;
+    const size_t size = rest < 56 ? 64 : 128;
+    const uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[size - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    kernel->blocks(state, tail, size / 64);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)state[i];
+    }
+}
@@ -0,0 +1,176 @@
+// src/stats.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+#include "macho.h"
+#include <string.h>
+#include <time.h>
+
+#define local static inline
+
+// Load commands are tallied by their registry index, as in macho.h, with a
+// last slot for those the registry does not know.
+#define STATS_COMMANDS (2 * 128 + 1)
+#define STATS_UNKNOWN (STATS_COMMANDS - 1)
+
+bool stats_enabled = false;
+uint64_t stats_phases[STATS_PHASE_COUNT];
+uint64_t stats_counters[STATS_COUNTER_COUNT];
+
+// What reading the clock costs, which timings leave out.
+static uint64_t stats_clock_cost;
+static uint64_t stats_command_time[STATS_COMMANDS];
+static uint64_t stats_command_count[STATS_COMMANDS];
+
+static const char* stats_phase_names[STATS_PHASE_COUNT] = {
+    [StatsPhaseRead] = "read",
+    [StatsPhaseParse] = "parse",
+    [StatsPhaseRender] = "render",
+    [StatsPhaseMarkup] = "markup",
+    [StatsPhaseFormat] = "format",
+    [StatsPhaseWrite] = "write"
+};
+
+static const char* stats_counter_names[STATS_COUNTER_COUNT] = {
+    [StatsBytesRead] = "bytes_read",
+    [StatsBytesEmitted] = "bytes_emitted",
+    [StatsLinesEmitted] = "lines_emitted",
+    [StatsSymbols] = "symbols",
+    [StatsAllocations] = "allocations",
+    [StatsTermcolorAllocations] = "termcolor_allocations",
+    [StatsTranslations] = "translations"
+};
+
+// The counters as the table labels them.
+static const char* stats_counter_labels[STATS_COUNTER_COUNT] = {
+    [StatsBytesRead] = "Bytes Read",
+    [StatsBytesEmitted] = "Bytes Emitted",
+    [StatsLinesEmitted] = "Lines Emitted",
+    [StatsSymbols] = "Symbols",
+    [StatsAllocations] = "Allocations",
+    [StatsTermcolorAllocations] = "libtermcolor Allocations",
+    [StatsTranslations] = "Markup Translations"
+};
+
+void stats_enable(void) {
+    uint64_t cost = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        const uint64_t start = stats_clock();
+        const uint64_t elapsed = stats_clock() - start;
+        if (elapsed < cost) {
+            cost = elapsed;
+        }
+    }
+    stats_clock_cost = cost;
+    stats_enabled = true;
+}
+
+uint64_t stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+local uint64_t stats_elapsed(uint64_t start) {
+    const uint64_t elapsed = stats_clock() - start;
+    return elapsed > stats_clock_cost ? elapsed - stats_clock_cost : 0;
+}
+
+void stats_phase(enum stats_phase phase, uint64_t start) {
+    __atomic_fetch_add(&stats_phases[phase], stats_elapsed(start),
+                       __ATOMIC_RELAXED);
+}
+
+void stats_count_emitted(const char* data, size_t length) {
+    uint64_t lines = 0;
+    for (const char* end = data + length;
+         (data = memchr(data, '\n', (size_t)(end - data))); data++) {
+        lines++;
+    }
+    stats_add(StatsBytesEmitted, length);
+    stats_add(StatsLinesEmitted, lines);
+}
+
+void stats_load_command(uint32_t cmd, uint64_t start) {
+    const size_t slot = macho_command_kind(cmd)
+        ? MACHO_KIND_DYLD(cmd) * 128 + MACHO_KIND_INDEX(cmd) : STATS_UNKNOWN;
+    __atomic_fetch_add(&stats_command_time[slot], stats_elapsed(start),
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_command_count[slot], 1, __ATOMIC_RELAXED);
+}
+
+// The name of the load commands in the slot, or NULL for unknown ones.
+local const char* stats_command_name(size_t slot) {
+    if (slot == STATS_UNKNOWN) {
+        return NULL;
+    }
+    const uint32_t cmd = (slot >= 128 ? LC_REQ_DYLD : 0) | (slot % 128);
+    return macho_command_kind(cmd)->name;
+}
+
+local double stats_ms(uint64_t ns) {
+    return ns / 1e6;
+}
+
+local void stats_print_table(FILE* stream) {
+    fprintf(stream, "machdump: stats\n  %-26s %12s\n", "Phase", "Time (ms)");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        // Markup and formatting are part of rendering.
+        const bool nested = i == StatsPhaseMarkup || i == StatsPhaseFormat;
+        fprintf(stream, "  %s%-*s %12.3f\n", nested ? "  " : "",
+                nested ? 24 : 26, stats_phase_names[i],
+                stats_ms(stats_phases[i]));
+    }
+    fprintf(stream, "  %-26s %12s %12s\n", "Load Command", "Count",
+            "Time (ms)");
+    for (size_t i = 0; i < STATS_COMMANDS; i++) {
+        if (stats_command_count[i] > 0) {
+            const char* name = stats_command_name(i);
+            fprintf(stream, "  %-26s %12llu %12.3f\n", name ? name : "Unknown",
+                    (unsigned long long)stats_command_count[i],
+                    stats_ms(stats_command_time[i]));
+        }
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        fprintf(stream, "  %-26s %12llu\n", stats_counter_labels[i],
+                (unsigned long long)stats_counters[i]);
+    }
+}
+
+local void stats_print_json(FILE* stream) {
+    fputs("{\"phases_ns\":{", stream);
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        fprintf(stream, "%s\"%s\":%llu", i ? "," : "", stats_phase_names[i],
+                (unsigned long long)stats_phases[i]);
+    }
+    fputs("},\"load_commands\":[", stream);
+    bool first = true;
+    for (size_t i = 0; i < STATS_COMMANDS; i++) {
+        if (stats_command_count[i] == 0) {
+            continue;
+        }
+        const char* name = stats_command_name(i);
+        fprintf(stream, "%s{\"name\":%s%s%s,\"count\":%llu,\"ns\":%llu}",
+                first ? "" : ",", name ? "\"" : "", name ? name : "null",
+                name ? "\"" : "",
+                (unsigned long long)stats_command_count[i],
+                (unsigned long long)stats_command_time[i]);
+        first = false;
+    }
+    fputc(']', stream);
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        fprintf(stream, ",\"%s\":%llu", stats_counter_names[i],
+                (unsigned long long)stats_counters[i]);
+    }
+    fputs("}\n", stream);
+}
+
+void stats_print(FILE* stream, bool json) {
+    if (json) {
+        stats_print_json(stream);
+    } else {
+        stats_print_table(stream);
+    }
+}
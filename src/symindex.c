@@ -0,0 +1,332 @@
+// src/symindex.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "symindex.h"
+#include "safe.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#define S(...) struct __VA_ARGS__
+#define local static inline
+
+uint32_t symindex_hash(const char* name, size_t length) {
+    // 32 bit FNV-1a. Symbol names are short enough that anything fancier does
+    // not pay for itself.
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+const char* symindex_name(const struct symindex* index, uint32_t symbol) {
+    const uint32_t strx = index->strx[symbol];
+    return strx < index->strsize ? index->strtbl + strx : "";
+}
+
+struct address_entry {
+    uint64_t value;
+    uint32_t symbol;
+};
+
+static int compare_addresses(const void* a, const void* b) {
+    const struct address_entry* x = a;
+    const struct address_entry* y = b;
+    if (x->value != y->value) {
+        return x->value < y->value ? -1 : 1;
+    }
+    return x->symbol < y->symbol ? -1 : x->symbol > y->symbol;
+}
+
+void symindex_build(struct symindex* index, const struct macho* macho) {
+    memset(index, 0, sizeof(*index));
+    if (macho->symtab_command == MACHO_NONE) {
+        return;
+    }
+    const S(symtab_command*) symt = &macho->symtab;
+
+    const uint32_t count = symt->nsyms;
+    uint32_t nnames = 1;
+    while (nnames < (uint64_t)count * 2 && nnames < (1u << 31)) {
+        nnames <<= 1;
+    }
+
+    // Every column lives in one allocation, widest first so each stays
+    // aligned.
+    const size_t size = (size_t)count * (sizeof(uint64_t) + sizeof(uint32_t)
+                                         + sizeof(uint32_t) + sizeof(uint16_t)
+                                         + 2 * sizeof(uint8_t))
+                        + (size_t)nnames * sizeof(uint32_t);
+    char* storage = xmalloc(size ? size : 1);
+    struct address_entry* entries = xmalloc(sizeof(*entries)
+                                            * (count ? count : 1));
+    if (!storage || !entries) {
+        xfree(storage);
+        xfree(entries);
+        return;
+    }
+    uint64_t* value = (uint64_t*)storage;
+    uint32_t* strx = (uint32_t*)(value + count);
+    uint32_t* addresses = strx + count;
+    uint32_t* names = addresses + count;
+    uint16_t* desc = (uint16_t*)(names + nnames);
+    uint8_t* type = (uint8_t*)(desc + count);
+    uint8_t* sect = type + count;
+    memset(names, 0, (size_t)nnames * sizeof(uint32_t));
+
+    const char* strtbl = macho_strings(macho);
+    uint32_t naddresses = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const S(nlist_64) symbol = macho_symbol(macho, i);
+        strx[i] = symbol.n_un.n_strx;
+        value[i] = symbol.n_value;
+        type[i] = symbol.n_type;
+        sect[i] = symbol.n_sect;
+        desc[i] = symbol.n_desc;
+
+        // Names that run off the end of the string table are left out.
+        if (strx[i] < symt->strsize) {
+            const char* name = strtbl + strx[i];
+            const char* nul = memchr(name, '\0', symt->strsize - strx[i]);
+            if (nul && nul != name) {
+                uint32_t slot = symindex_hash(name, (size_t)(nul - name))
+                                & (nnames - 1);
+                while (names[slot]) {
+                    slot = (slot + 1) & (nnames - 1);
+                }
+                names[slot] = i + 1;
+            } else {
+                strx[i] = symt->strsize;
+            }
+        }
+        if (!(type[i] & N_STAB) && (type[i] & N_TYPE) == N_SECT) {
+            entries[naddresses].value = value[i];
+            entries[naddresses].symbol = i;
+            naddresses++;
+        }
+    }
+    qsort(entries, naddresses, sizeof(*entries), compare_addresses);
+    for (uint32_t i = 0; i < naddresses; i++) {
+        addresses[i] = entries[i].symbol;
+    }
+    xfree(entries);
+
+    index->count = count;
+    index->strx = strx;
+    index->value = value;
+    index->type = type;
+    index->sect = sect;
+    index->desc = desc;
+    index->strtbl = strtbl;
+    index->strsize = symt->strsize;
+    index->names = names;
+    index->nnames = nnames;
+    index->addresses = addresses;
+    index->naddresses = naddresses;
+    index->storage = storage;
+}
+
+void symindex_free(struct symindex* index) {
+    if (index->file.buffer) {
+        unmap_file(&index->file);
+    } else {
+        xfree(index->storage);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+static const char symindex_magic[8] = "MDSYMIX";
+
+local uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Writes n bytes and then pads the file to a multiple of 8 bytes.
+local void write_column(FILE* stream, const void* data, size_t n) {
+    static const char padding[8] = { 0 };
+    fwrite(data, 1, n, stream);
+    fwrite(padding, 1, (size_t)(align8(n) - n), stream);
+}
+
+int symindex_write(const struct symindex* index, const uint8_t uuid[16],
+                   uint64_t binary_size, const char* path) {
+    struct symindex_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, symindex_magic, sizeof(header.magic));
+    header.version = SYMINDEX_VERSION;
+    header.byte_order = 0x01020304;
+    memcpy(header.uuid, uuid, sizeof(header.uuid));
+    header.binary_size = binary_size;
+    header.count = index->count;
+    header.nnames = index->nnames;
+    header.naddresses = index->naddresses;
+    header.strsize = index->strsize;
+
+    const uint64_t count = index->count;
+    header.value_offset = align8(sizeof(header));
+    header.strx_offset = header.value_offset + align8(count * 8);
+    header.addresses_offset = header.strx_offset + align8(count * 4);
+    header.names_offset = header.addresses_offset
+                          + align8((uint64_t)index->naddresses * 4);
+    header.desc_offset = header.names_offset
+                         + align8((uint64_t)index->nnames * 4);
+    header.type_offset = header.desc_offset + align8(count * 2);
+    header.sect_offset = header.type_offset + align8(count);
+    header.strtbl_offset = header.sect_offset + align8(count);
+    // The string table is always followed by at least one NUL, so every
+    // name in it is terminated.
+    header.file_size = header.strtbl_offset
+                       + align8((uint64_t)index->strsize + 1);
+
+    // The index is written next to its final name and renamed into place, so
+    // readers never see a partial file.
+    const size_t length = strlen(path);
+    char* temporary = xmalloc(length + 5);
+    if (!temporary) {
+        return 1;
+    }
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", 5);
+    FILE* stream = fopen(temporary, "wb");
+    if (!stream) {
+        xfree(temporary);
+        return 1;
+    }
+    write_column(stream, &header, sizeof(header));
+    write_column(stream, index->value, count * 8);
+    write_column(stream, index->strx, count * 4);
+    write_column(stream, index->addresses, (size_t)index->naddresses * 4);
+    write_column(stream, index->names, (size_t)index->nnames * 4);
+    write_column(stream, index->desc, count * 2);
+    write_column(stream, index->type, count);
+    write_column(stream, index->sect, count);
+    write_column(stream, index->strtbl, index->strsize);
+    if (index->strsize % 8 == 0) {
+        write_column(stream, "", 1);
+    }
+    int failed = ferror(stream);
+    failed |= fclose(stream) != 0;
+    if (!failed) {
+        failed = rename(temporary, path) != 0;
+    }
+    if (failed) {
+        const int saved_errno = errno;
+        remove(temporary);
+        errno = saved_errno;
+    }
+    xfree(temporary);
+    return failed;
+}
+
+// Whether the column of count elements of the given size at offset lies
+// within a file of the given size.
+local bool column_fits(uint64_t offset, uint64_t count, uint64_t size,
+                       uint64_t file_size) {
+    return offset % 8 == 0 && offset <= file_size
+           && count <= (file_size - offset) / size;
+}
+
+bool symindex_open(struct symindex* index, const char* path,
+                   const uint8_t uuid[16], uint64_t binary_size) {
+    memset(index, 0, sizeof(*index));
+    if (map_file(path, &index->file) != 0) {
+        return false;
+    }
+    const char* base = index->file.buffer;
+    const size_t length = index->file.length;
+    const struct symindex_file_header* header = (const void*)base;
+    const bool valid = length >= sizeof(*header)
+        && memcmp(header->magic, symindex_magic, sizeof(header->magic)) == 0
+        && header->version == SYMINDEX_VERSION
+        && header->byte_order == 0x01020304
+        && memcmp(header->uuid, uuid, sizeof(header->uuid)) == 0
+        && header->binary_size == binary_size
+        && header->file_size == length
+        && header->nnames > header->count
+        && (header->nnames & (header->nnames - 1)) == 0
+        && header->naddresses <= header->count
+        && column_fits(header->value_offset, header->count, 8, length)
+        && column_fits(header->strx_offset, header->count, 4, length)
+        && column_fits(header->addresses_offset, header->naddresses, 4,
+                       length)
+        && column_fits(header->names_offset, header->nnames, 4, length)
+        && column_fits(header->desc_offset, header->count, 2, length)
+        && column_fits(header->type_offset, header->count, 1, length)
+        && column_fits(header->sect_offset, header->count, 1, length)
+        && column_fits(header->strtbl_offset, (uint64_t)header->strsize + 1,
+                       1, length)
+        && base[header->strtbl_offset + header->strsize] == '\0';
+    if (!valid) {
+        unmap_file(&index->file);
+        return false;
+    }
+
+    // Lookups hop around the tables, so readahead would only waste I/O.
+    if (index->file.mapped) {
+        posix_madvise(index->file.buffer, length, POSIX_MADV_RANDOM);
+    }
+    index->count = header->count;
+    index->value = (const void*)(base + header->value_offset);
+    index->strx = (const void*)(base + header->strx_offset);
+    index->addresses = (const void*)(base + header->addresses_offset);
+    index->naddresses = header->naddresses;
+    index->names = (const void*)(base + header->names_offset);
+    index->nnames = header->nnames;
+    index->desc = (const void*)(base + header->desc_offset);
+    index->type = (const void*)(base + header->type_offset);
+    index->sect = (const void*)(base + header->sect_offset);
+    index->strtbl = base + header->strtbl_offset;
+    index->strsize = header->strsize;
+    return true;
+}
+
+uint32_t symindex_find(const struct symindex* index, const char* name,
+                       uint32_t* cursor) {
+    if (index->count == 0 || *cursor == UINT32_MAX) {
+        return SYMINDEX_NONE;
+    }
+    // The probe stops after one lap of the table, which only matters for a
+    // corrupt sidecar index without any empty slots.
+    const uint32_t mask = index->nnames - 1;
+    const uint32_t home = symindex_hash(name, strlen(name)) & mask;
+    uint32_t slot = *cursor ? *cursor - 1 : home;
+    do {
+        if (!index->names[slot]) {
+            break;
+        }
+        const uint32_t symbol = index->names[slot] - 1;
+        slot = (slot + 1) & mask;
+        if (symbol < index->count
+            && strcmp(symindex_name(index, symbol), name) == 0) {
+            *cursor = slot == home ? UINT32_MAX : slot + 1;
+            return symbol;
+        }
+    } while (slot != home);
+    *cursor = UINT32_MAX;
+    return SYMINDEX_NONE;
+}
+
+uint32_t symindex_lookup(const struct symindex* index, uint64_t address) {
+    // Finds the first symbol above address; the one before it is the answer.
+    uint32_t low = 0;
+    uint32_t high = index->naddresses;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        const uint32_t symbol = index->addresses[middle];
+        if (symbol >= index->count || index->value[symbol] <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    // A sidecar index is only checked as far as its header, so a corrupt
+    // addresses table must not send the caller out of bounds.
+    return low > 0 && index->addresses[low - 1] < index->count
+           ? index->addresses[low - 1] : SYMINDEX_NONE;
+}
@@ -0,0 +1,209 @@
+// src/verify.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "verify.h"
+#include "codesign.h"
+#include "hex.h"
+#include "json.h"
+#include "out.h"
+#include "sha256.h"
+#include <string.h>
+
+#define local static inline
+
+// Writes a page's expected hash, or the one it actually has, as hex.
+local void verify_hash(struct out* out, const unsigned char* hash,
+                       size_t size) {
+    char hex[2 * SHA256_DIGEST_SIZE];
+    hex_encode(hex, hash, size);
+    out_write(out, hex, 2 * size);
+}
+
+local void verify_page_text(struct out* out, const struct codesign* codesign,
+                            const struct macho* macho, uint32_t page) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    const uint64_t offset = codesign_page_offset(codesign, page);
+    const uint64_t size = codesign_page_size(codesign, page);
+    sha256(macho->data + offset, (size_t)size, digest);
+    out_cputs(out, "  {R+}Page ");
+    out_dec(out, page);
+    out_cputs(out, "{0} at {Y}0x");
+    out_hex(out, offset, 8);
+    out_cputs(out, "{0}, ");
+    out_dec(out, size);
+    out_puts(out, " byte(s)\n    Expected: ");
+    verify_hash(out, codesign->hashes + (size_t)page * codesign->hash_size,
+                codesign->hash_size);
+    out_puts(out, "\n    Computed: ");
+    verify_hash(out, digest, codesign->hash_size);
+    out_putc(out, '\n');
+}
+
+local void verify_page_json(struct out* out, const struct codesign* codesign,
+                            const struct macho* macho, uint32_t page) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    const uint64_t offset = codesign_page_offset(codesign, page);
+    const uint64_t size = codesign_page_size(codesign, page);
+    sha256(macho->data + offset, (size_t)size, digest);
+    out_puts(out, "\"page\":");
+    out_dec(out, page);
+    out_puts(out, ",\"offset\":");
+    out_dec(out, offset);
+    out_puts(out, ",\"size\":");
+    out_dec(out, size);
+    out_puts(out, ",\"expected\":\"");
+    verify_hash(out, codesign->hashes + (size_t)page * codesign->hash_size,
+                codesign->hash_size);
+    out_puts(out, "\",\"computed\":\"");
+    verify_hash(out, digest, codesign->hash_size);
+    out_putc(out, '"');
+}
+
+local void verify_text(struct out* out, const struct codesign* codesign,
+                       const struct macho* macho) {
+    out_cputs(out, "Code signature of {/}\"");
+    out_write(out, codesign->identifier, codesign->identifier_length);
+    out_cputs(out, "\"{0}\n  CodeDirectory version {Y}0x");
+    out_hex(out, codesign->version, 5);
+    out_cputs(out, "{0}, flags {Y}0x");
+    out_hex(out, codesign->flags, 8);
+    out_cputs(out, "{0}, platform ");
+    out_dec(out, codesign->platform);
+    out_puts(out, "\n  Hash: ");
+    out_puts(out, codesign_hash_name(codesign->hash_type));
+    out_puts(out, ", ");
+    out_dec(out, codesign->hash_size);
+    out_puts(out, " byte(s), computed with ");
+    out_puts(out, sha256_kernel());
+    out_cputs(out, "\n  Code Limit: {Y}0x");
+    out_hex(out, codesign->code_limit, 8);
+    out_cputs(out, "{0}\n  Page Size: ");
+    if (codesign->page_shift) {
+        out_dec(out, (uint64_t)1 << codesign->page_shift);
+        out_puts(out, " byte(s)\n");
+    } else {
+        out_puts(out, "unpaged\n");
+    }
+    for (uint32_t i = 0; i < codesign->npages; i++) {
+        if (codesign->mismatched[i]) {
+            verify_page_text(out, codesign, macho, i);
+        }
+    }
+    if (codesign->nmismatched > 0) {
+        out_cputs(out, "  {R+}");
+        out_dec(out, codesign->nmismatched);
+        out_puts(out, " of ");
+        out_dec(out, codesign->npages);
+        out_cputs(out, " page(s) do not match{0}\n");
+    } else {
+        out_puts(out, "  All ");
+        out_dec(out, codesign->npages);
+        out_puts(out, " page(s) match\n");
+    }
+}
+
+local void verify_json(struct out* out, const struct codesign* codesign,
+                       const struct macho* macho, uint32_t index,
+                       bool ndjson) {
+    out_puts(out, ndjson ? "{\"record\":\"code_directory\",\"load_command\":"
+                         : "{\"load_command\":");
+    out_dec(out, index);
+    out_puts(out, ",\"identifier\":");
+    json_string(out, codesign->identifier, codesign->identifier_length);
+    out_puts(out, ",\"version\":");
+    out_dec(out, codesign->version);
+    out_puts(out, ",\"flags\":");
+    out_dec(out, codesign->flags);
+    out_puts(out, ",\"platform\":");
+    out_dec(out, codesign->platform);
+    out_puts(out, ",\"hash_type\":");
+    out_dec(out, codesign->hash_type);
+    out_puts(out, ",\"hash_size\":");
+    out_dec(out, codesign->hash_size);
+    out_puts(out, ",\"code_limit\":");
+    out_dec(out, codesign->code_limit);
+    out_puts(out, ",\"page_size\":");
+    out_dec(out, codesign->page_shift ? (uint64_t)1 << codesign->page_shift
+                                      : 0);
+    out_puts(out, ",\"pages\":");
+    out_dec(out, codesign->npages);
+    out_puts(out, ",\"nmismatched\":");
+    out_dec(out, codesign->nmismatched);
+    out_puts(out, ndjson ? "}\n" : ",\"mismatched\":[");
+    bool first = true;
+    for (uint32_t i = 0; i < codesign->npages; i++) {
+        if (!codesign->mismatched[i]) {
+            continue;
+        }
+        if (ndjson) {
+            out_puts(out, "{\"record\":\"page_mismatch\",\"load_command\":");
+            out_dec(out, index);
+            out_putc(out, ',');
+        } else {
+            out_puts(out, first ? "{" : ",{");
+        }
+        verify_page_json(out, codesign, macho, i);
+        out_puts(out, ndjson ? "}\n" : "}");
+        first = false;
+    }
+    if (!ndjson) {
+        out_puts(out, "]}");
+    }
+}
+
+// Finds the file's code signature, which only needs to be well formed
+// itself: other problems in the file do not stop it from being verified.
+local enum dump_error verify_find(const struct macho* macho,
+                                  uint32_t* index) {
+    for (uint32_t i = 0; i < macho->ncommands; i++) {
+        if (macho->commands[i].cmd == LC_CODE_SIGNATURE) {
+            *index = i;
+            return macho->commands[i].verdict == MachoVerdictValid
+                   ? DumpErrorNone : DumpErrorMalformed;
+        }
+    }
+    return macho->error != DumpErrorNone ? macho->error
+                                         : DumpErrorNoSignature;
+}
+
+enum dump_error verify_dump(struct out* out, void* buffer, size_t length,
+                            enum dump_format format, unsigned threads) {
+    struct macho macho;
+    enum dump_error error = mach_select(&buffer, &length);
+    if (error == DumpErrorNone) {
+        error = macho_parse(&macho, buffer, length);
+    }
+    if (error != DumpErrorNone) {
+        if (format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+        return error;
+    }
+    uint32_t index;
+    struct codesign codesign;
+    error = verify_find(&macho, &index);
+    if (error == DumpErrorNone) {
+        error = codesign_verify(&codesign, &macho, &macho.commands[index],
+                                threads);
+    }
+    if (error != DumpErrorNone) {
+        if (format == DumpFormatJSON) {
+            out_puts(out, "null");
+        }
+        macho_free(&macho);
+        return error;
+    }
+
+    if (format == DumpFormatText) {
+        verify_text(out, &codesign, &macho);
+    } else {
+        verify_json(out, &codesign, &macho, index,
+                    format == DumpFormatNDJSON);
+    }
+    if (codesign.nmismatched > 0) {
+        error = DumpErrorHashMismatch;
+    }
+    codesign_free(&codesign);
+    macho_free(&macho);
+    return error;
+}
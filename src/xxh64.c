@@ -0,0 +1,90 @@
+// src/xxh64.c
+// Copyright (C) 2021 Ethan Uppal. All rights reserved.
+
+#include "xxh64.h"
+#include <string.h>
+
+#define local static inline
+
+#define XXH64_PRIME1 0x9e3779b185ebca87ULL
+#define XXH64_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define XXH64_PRIME3 0x165667b19e3779f9ULL
+#define XXH64_PRIME4 0x85ebca77c2b2ae63ULL
+#define XXH64_PRIME5 0x27d4eb2f165667c5ULL
+
+local uint64_t xxh64_rotl(uint64_t x, unsigned n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+// The input is read as little-endian words, whatever the host.
+local uint64_t xxh64_read64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+local uint32_t xxh64_read32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+           | (uint32_t)p[3] << 24;
+}
+
+local uint64_t xxh64_round(uint64_t lane, uint64_t input) {
+    lane += input * XXH64_PRIME2;
+    return xxh64_rotl(lane, 31) * XXH64_PRIME1;
+}
+
+local uint64_t xxh64_merge(uint64_t hash, uint64_t lane) {
+    hash ^= xxh64_round(0, lane);
+    return hash * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+uint64_t xxh64(const void* data, size_t length, uint64_t seed) {
+    const uint8_t* p = data;
+    const uint8_t* const end = p + length;
+    uint64_t hash;
+    if (length >= 32) {
+        uint64_t v1 = seed + XXH64_PRIME1 + XXH64_PRIME2;
+        uint64_t v2 = seed + XXH64_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH64_PRIME1;
+        for (; end - p >= 32; p += 32) {
+            v1 = xxh64_round(v1, xxh64_read64(p));
+            v2 = xxh64_round(v2, xxh64_read64(p + 8));
+            v3 = xxh64_round(v3, xxh64_read64(p + 16));
+            v4 = xxh64_round(v4, xxh64_read64(p + 24));
+        }
+        hash = xxh64_rotl(v1, 1) + xxh64_rotl(v2, 7) + xxh64_rotl(v3, 12)
+               + xxh64_rotl(v4, 18);
+        hash = xxh64_merge(hash, v1);
+        hash = xxh64_merge(hash, v2);
+        hash = xxh64_merge(hash, v3);
+        hash = xxh64_merge(hash, v4);
+    } else {
+        hash = seed + XXH64_PRIME5;
+    }
+    hash += (uint64_t)length;
+
+    for (; end - p >= 8; p += 8) {
+        hash ^= xxh64_round(0, xxh64_read64(p));
+        hash = xxh64_rotl(hash, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    }
+    if (end - p >= 4) {
+        hash ^= (uint64_t)xxh64_read32(p) * XXH64_PRIME1;
+        hash = xxh64_rotl(hash, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * XXH64_PRIME5;
+        hash = xxh64_rotl(hash, 11) * XXH64_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH64_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}